@@ -0,0 +1,1069 @@
+//  Copyright (c) 2017 OsiriX Foundation
+//  Copyright (c) 2017 Spaltenstein Natural Image
+//  Copyright (c) 2017 volz.io
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#import <Cocoa/Cocoa.h>
+#import <XCTest/XCTest.h>
+#import <NIBuildingBlocks/NIVolumeData.h>
+#import <NIBuildingBlocks/NIGenerator.h>
+#import <NIBuildingBlocks/NIGeneratorRequest.h>
+#import <NIBuildingBlocks/NIBezierPath.h>
+
+@interface NIVolumeDataTests : XCTestCase
+
+@end
+
+@implementation NIVolumeDataTests
+
+// a CT like volume, integer values with smooth structures surrounded by uniform air
+- (NIVolumeData *)volumeDataWithPixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep {
+    NSMutableData *floatData = [NSMutableData dataWithLength:pixelsWide * pixelsHigh * pixelsDeep * sizeof(float)];
+    float *floats = (float *)[floatData mutableBytes];
+    NSUInteger x, y, z;
+
+    srandom(1);
+    for (z = 0; z < pixelsDeep; z++) {
+        for (y = 0; y < pixelsHigh; y++) {
+            for (x = 0; x < pixelsWide; x++) {
+                CGFloat dx = (CGFloat)x / (CGFloat)pixelsWide - 0.5;
+                CGFloat dy = (CGFloat)y / (CGFloat)pixelsHigh - 0.5;
+                CGFloat dz = (CGFloat)z / (CGFloat)pixelsDeep - 0.5;
+                if (dx*dx + dy*dy + dz*dz < 0.16) {
+                    floats[x + pixelsWide*(y + pixelsHigh*z)] = round(40.0 + 400.0 * sin(10.0 * dx) * cos(8.0 * dy) + (CGFloat)(random() % 20));
+                } else {
+                    floats[x + pixelsWide*(y + pixelsHigh*z)] = -1000;
+                }
+            }
+        }
+    }
+
+    return [[[NIVolumeData alloc] initWithData:floatData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                         modelToVoxelTransform:NIAffineTransformMakeScale(2, 2, 1) outOfBoundsValue:-1000] autorelease];
+}
+
+// a volume with the identity modelToVoxelTransform whose voxels are given by the intensities block
+- (NIVolumeData *)volumeDataWithPixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                               intensities:(float (^)(NSUInteger x, NSUInteger y, NSUInteger z))intensities {
+    NSMutableData *floatData = [NSMutableData dataWithLength:pixelsWide * pixelsHigh * pixelsDeep * sizeof(float)];
+    float *floats = (float *)[floatData mutableBytes];
+    NSUInteger x, y, z;
+
+    for (z = 0; z < pixelsDeep; z++) {
+        for (y = 0; y < pixelsHigh; y++) {
+            for (x = 0; x < pixelsWide; x++) {
+                floats[x + pixelsWide*(y + pixelsHigh*z)] = intensities(x, y, z);
+            }
+        }
+    }
+
+    return [[[NIVolumeData alloc] initWithData:floatData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                         modelToVoxelTransform:NIAffineTransformIdentity outOfBoundsValue:-1000] autorelease];
+}
+
+// a 16x16x16 volume whose intensity is the z of the voxel
+- (NIVolumeData *)zRampVolumeData {
+    return [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return z;
+    }];
+}
+
+// an 8x8 slice of 1 mm pixels parallel to the xy plane
+- (NIObliqueSliceGeneratorRequest *)axialRequestWithCenter:(NIVector)center {
+    return [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:center pixelsWide:8 pixelsHigh:8 xBasis:NIVectorMake(1, 0, 0) yBasis:NIVectorMake(0, 1, 0)] autorelease];
+}
+
+// a stretched slice of the line from (2, 8, 8) to (14, 8, 8), its rows go along y from midHeightY and its slab is along z, it is projected by NIProjectionOperation
+- (NIStretchedGeneratorRequest *)stretchedRequestWithPixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh midHeightY:(CGFloat)midHeightY {
+    NIMutableBezierPath *bezierPath = [NIMutableBezierPath bezierPath];
+    [bezierPath moveToVector:NIVectorMake(2, 8, 8)];
+    [bezierPath lineToVector:NIVectorMake(14, 8, 8)];
+
+    NIStretchedGeneratorRequest *request = [[[NIStretchedGeneratorRequest alloc] init] autorelease];
+    request.bezierPath = bezierPath;
+    request.projectionNormal = NIVectorMake(0, 1, 0);
+    request.midHeightPoint = NIVectorMake(8, midHeightY, 8);
+    request.pixelsWide = pixelsWide;
+    request.pixelsHigh = pixelsHigh;
+    return request;
+}
+
+- (void)testBrickedRoundTrip {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:37 pixelsHigh:21 pixelsDeep:19]; // no axis is a multiple of the brick size
+    NIVolumeData *brickedVolumeData = [volumeData volumeDataWithBrickSize:8];
+    NIVolumeData *flatVolumeData = [brickedVolumeData volumeDataWithBrickSize:0];
+    NIVector vectors[] = {NIVectorMake(0, 0, 0), NIVectorMake(3.7, 5.2, 7.9), NIVectorMake(18, 10, 18), NIVectorMake(17.9, 9.9, 17.5), NIVectorMake(-0.3, 4, 20)};
+    float run[37];
+    float brickedRun[37];
+    NSUInteger i;
+
+    XCTAssertEqual(brickedVolumeData.brickSize, (NSUInteger)8);
+    XCTAssertEqual(flatVolumeData.brickSize, (NSUInteger)0);
+    XCTAssertEqualObjects(flatVolumeData.floatData, volumeData.floatData);
+
+    for (i = 0; i < sizeof(vectors) / sizeof(NIVector); i++) {
+        XCTAssertEqualWithAccuracy([brickedVolumeData linearInterpolatedFloatAtModelVector:vectors[i]], [volumeData linearInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+        XCTAssertEqualWithAccuracy([brickedVolumeData cubicInterpolatedFloatAtModelVector:vectors[i]], [volumeData cubicInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+        XCTAssertEqualWithAccuracy([brickedVolumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[i]], [volumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+    }
+
+    // the run crosses brick boundaries and is clipped at the end of the row
+    XCTAssertEqual([brickedVolumeData getFloatRun:brickedRun atPixelCoordinateX:6 y:20 z:18 length:37], (NSUInteger)31);
+    [volumeData getFloatRun:run atPixelCoordinateX:6 y:20 z:18 length:37];
+    XCTAssertEqual(memcmp(run, brickedRun, 31 * sizeof(float)), 0);
+
+    NIVolumeData *unarchivedVolumeData = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:brickedVolumeData]];
+    XCTAssertEqual(unarchivedVolumeData.brickSize, (NSUInteger)8);
+    XCTAssertEqualObjects(unarchivedVolumeData, brickedVolumeData);
+
+    XCTAssertEqualObjects(brickedVolumeData.floatData, volumeData.floatData);
+}
+
+- (void)testBatchSamplersMatchScalarSamplers {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:11 pixelsHigh:9 pixelsDeep:7 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (float)((NSInteger)(x*x + 7*y) - (NSInteger)(3*z*x));
+    }];
+    NSMutableData *sampleData = [NSMutableData dataWithLength:11 * 9 * 7 * sizeof(int16_t)];
+    int16_t *samples = (int16_t *)[sampleData mutableBytes];
+    NSUInteger x, y, z;
+    for (z = 0; z < 7; z++) {
+        for (y = 0; y < 9; y++) {
+            for (x = 0; x < 11; x++) {
+                samples[x + 11*(y + 9*z)] = (int16_t)(2*((NSInteger)(x*x + 7*y) - (NSInteger)(3*z*x)) + 20); // the same values once rescaled
+            }
+        }
+    }
+    NIVolumeData *sampleVolumeData = [[[NIVolumeData alloc] initWithSampleData:sampleData sampleType:NIVolumeDataSampleTypeInt16 rescaleSlope:0.5 rescaleIntercept:-10
+                                                                    pixelsWide:11 pixelsHigh:9 pixelsDeep:7 modelToVoxelTransform:NIAffineTransformIdentity outOfBoundsValue:-1000] autorelease];
+    NSArray *volumes = @[volumeData, [volumeData volumeDataWithBrickSize:4], [volumeData volumeDataWithBorderWidth:2], sampleVolumeData];
+
+    // the samplers work on groups of 4, the groups are inside, on the edge voxels, at negative coordinates and far outside, and the last vector is left over
+    NIVector vectors[] = {NIVectorMake(1.3, 2.2, 3.7), NIVectorMake(5.5, 4.5, 2.5), NIVectorMake(9.9, 7.9, 5.9), NIVectorMake(0, 0, 0),
+                          NIVectorMake(10, 8, 6), NIVectorMake(0, 8, 0), NIVectorMake(10, 0, 6), NIVectorMake(5, 4, 3),
+                          NIVectorMake(-0.5, 3, 3), NIVectorMake(-2.2, -1, -0.1), NIVectorMake(3, -0.49, 2), NIVectorMake(4, 4, -3),
+                          NIVectorMake(1e12, 3, 3), NIVectorMake(3, -1e12, 3), NIVectorMake(2, 2, 1e11), NIVectorMake(11.4, 9.4, 7.4),
+                          NIVectorMake(6.6, 1.1, 0.2)};
+    const NSUInteger vectorCount = sizeof(vectors) / sizeof(NIVector);
+    float linearValues[vectorCount];
+    float nearestValues[vectorCount];
+    float cubicValues[vectorCount];
+    NSUInteger i;
+
+    for (NIVolumeData *sampledVolumeData in volumes) {
+        [sampledVolumeData linearInterpolateVolumeVectors:vectors outputValues:linearValues numVectors:vectorCount];
+        [sampledVolumeData nearestNeighborInterpolateVolumeVectors:vectors outputValues:nearestValues numVectors:vectorCount];
+        [sampledVolumeData cubicInterpolateVolumeVectors:vectors outputValues:cubicValues numVectors:vectorCount];
+
+        for (i = 0; i < vectorCount; i++) { // the modelToVoxelTransform is the identity, so the model vectors are the volume vectors
+            XCTAssertEqualWithAccuracy(linearValues[i], [volumeData linearInterpolatedFloatAtModelVector:vectors[i]], 0.001, @"vector %d", (int)i);
+            XCTAssertEqualWithAccuracy(nearestValues[i], [volumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[i]], 0.001, @"vector %d", (int)i);
+            XCTAssertEqualWithAccuracy(cubicValues[i], [volumeData cubicInterpolatedFloatAtModelVector:vectors[i]], 0.001, @"vector %d", (int)i);
+        }
+    }
+}
+
+- (void)testCoordinateSamplersMatchScalarSamplers {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:11 pixelsHigh:9 pixelsDeep:7 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (float)((NSInteger)(x*x + 7*y) - (NSInteger)(3*z*x));
+    }];
+    NSArray *volumes = @[volumeData, [volumeData volumeDataWithBrickSize:4], [volumeData volumeDataWithBorderWidth:2]];
+
+    // the samplers work on groups of 8, the groups are inside, on the edges and negative, and far outside where the coordinates don't fit in an int, the last one is left over
+    const float xCoordinates[] = {1.3, 5.5, 9.9, 0.0, 2.0, 7.25, 3.5, 8.1,   10, 0, 10, -0.5, -2.2, 3, 4, 11.4,   1e10, 3, 2, 5, -3e9, 6, 7, 1,   6.6};
+    const float yCoordinates[] = {2.2, 4.5, 7.9, 0.0, 3.0, 1.75, 6.5, 5.2,   8, 8, 0, 3, -1, -0.49, 4, 9.4,       3, -1e10, 2, 5, 4, 4, 4, 4,      1.1};
+    const float zCoordinates[] = {3.7, 2.5, 5.9, 0.0, 1.0, 4.5, 3.25, 1.9,   6, 0, 6, 3, -0.1, 2, -3, 7.4,        3, 3, 1e10, 2, 2, 2, 2, 2,       0.2};
+    const NSUInteger coordinateCount = sizeof(xCoordinates) / sizeof(float);
+    float linearValues[coordinateCount];
+    float nearestValues[coordinateCount];
+    float cubicValues[coordinateCount];
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NSUInteger i;
+
+    for (NIVolumeData *sampledVolumeData in volumes) {
+        [sampledVolumeData acquireInlineBuffer:&inlineBuffer];
+        NIVolumeDataLinearInterpolateVolumeCoordinates(&inlineBuffer, xCoordinates, yCoordinates, zCoordinates, linearValues, coordinateCount);
+        NIVolumeDataNearestNeighborInterpolateVolumeCoordinates(&inlineBuffer, xCoordinates, yCoordinates, zCoordinates, nearestValues, coordinateCount);
+        NIVolumeDataCubicInterpolateVolumeCoordinates(&inlineBuffer, xCoordinates, yCoordinates, zCoordinates, cubicValues, coordinateCount);
+
+        for (i = 0; i < coordinateCount; i++) {
+            NIVector vector = NIVectorMake(xCoordinates[i], yCoordinates[i], zCoordinates[i]);
+            XCTAssertEqualWithAccuracy(linearValues[i], [volumeData linearInterpolatedFloatAtModelVector:vector], 0.05, @"coordinate %d", (int)i);
+            XCTAssertEqualWithAccuracy(nearestValues[i], [volumeData nearestNeighborInterpolatedFloatAtModelVector:vector], 0.05, @"coordinate %d", (int)i);
+            XCTAssertEqualWithAccuracy(cubicValues[i], [volumeData cubicInterpolatedFloatAtModelVector:vector], 0.05, @"coordinate %d", (int)i);
+        }
+    }
+}
+
+- (void)testPaddedSamplingMatchesUnpadded {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:9 pixelsHigh:7 pixelsDeep:5 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (float)(x * 13 + y * 7 + z * z * 5);
+    }];
+    NIVolumeData *paddedVolumeData = [volumeData volumeDataWithBorderWidth:2];
+    NSMutableData *vectorData = [NSMutableData data];
+    CGFloat x, y, z;
+
+    XCTAssertEqual(paddedVolumeData.borderWidth, (NSUInteger)2);
+
+    // a grid that starts and ends past the border, so every edge, corner and out of bounds case is sampled
+    for (z = -3; z < 8; z += 0.7) {
+        for (y = -3; y < 10; y += 0.9) {
+            for (x = -3; x < 12; x += 0.55) {
+                NIVector vector = NIVectorMake(x, y, z);
+                [vectorData appendBytes:&vector length:sizeof(NIVector)];
+
+                XCTAssertEqualWithAccuracy([paddedVolumeData linearInterpolatedFloatAtModelVector:vector], [volumeData linearInterpolatedFloatAtModelVector:vector], 0.001);
+                XCTAssertEqualWithAccuracy([paddedVolumeData cubicInterpolatedFloatAtModelVector:vector], [volumeData cubicInterpolatedFloatAtModelVector:vector], 0.001);
+                XCTAssertEqualWithAccuracy([paddedVolumeData nearestNeighborInterpolatedFloatAtModelVector:vector], [volumeData nearestNeighborInterpolatedFloatAtModelVector:vector], 0.001);
+            }
+        }
+    }
+
+    const NSUInteger vectorCount = [vectorData length] / sizeof(NIVector);
+    float *values = malloc(vectorCount * sizeof(float));
+    float *paddedValues = malloc(vectorCount * sizeof(float));
+    NSUInteger i;
+    [volumeData cubicInterpolateVolumeVectors:(const NIVector *)[vectorData bytes] outputValues:values numVectors:vectorCount];
+    [paddedVolumeData cubicInterpolateVolumeVectors:(const NIVector *)[vectorData bytes] outputValues:paddedValues numVectors:vectorCount]; // the border lets more groups take the vector path
+    for (i = 0; i < vectorCount; i++) {
+        XCTAssertEqualWithAccuracy(paddedValues[i], values[i], 0.001);
+    }
+    free(values);
+    free(paddedValues);
+
+    XCTAssertEqualObjects(paddedVolumeData.floatData, volumeData.floatData);
+}
+
+- (void)testSampleTypes {
+    const NIVolumeDataSampleType sampleTypes[] = {NIVolumeDataSampleTypeInt16, NIVolumeDataSampleTypeUInt16, NIVolumeDataSampleTypeUInt8};
+    const size_t sampleSizes[] = {sizeof(int16_t), sizeof(uint16_t), sizeof(uint8_t)};
+    const float rescaleSlopes[] = {1, 0.25, 4};
+    const float rescaleIntercepts[] = {-1024, 100, -50};
+    const NSUInteger pixelsWide = 13;
+    const NSUInteger pixelsHigh = 11;
+    const NSUInteger pixelsDeep = 6;
+    NIVector vectors[] = {NIVectorMake(0, 0, 0), NIVectorMake(4.3, 2.7, 1.5), NIVectorMake(12, 10, 5), NIVectorMake(11.5, 9.5, 4.5), NIVectorMake(6.2, 5.1, 2.9),
+                          NIVectorMake(-0.6, 3, 3), NIVectorMake(3, 12, 2), NIVectorMake(7.7, 1.2, 3.3), NIVectorMake(2.5, 8.5, 0.5)};
+    const NSUInteger vectorCount = sizeof(vectors) / sizeof(NIVector);
+    float values[vectorCount];
+    float expectedValues[vectorCount];
+    float run[13];
+    float expectedRun[13];
+    NSUInteger i, j, x, y, z;
+
+    for (i = 0; i < sizeof(sampleTypes) / sizeof(NIVolumeDataSampleType); i++) {
+        NSMutableData *sampleData = [NSMutableData dataWithLength:pixelsWide * pixelsHigh * pixelsDeep * sampleSizes[i]];
+        NSMutableData *floatData = [NSMutableData dataWithLength:pixelsWide * pixelsHigh * pixelsDeep * sizeof(float)];
+        float *floats = (float *)[floatData mutableBytes];
+
+        for (z = 0; z < pixelsDeep; z++) {
+            for (y = 0; y < pixelsHigh; y++) {
+                for (x = 0; x < pixelsWide; x++) {
+                    NSUInteger index = x + pixelsWide*(y + pixelsHigh*z);
+                    NSInteger sample = (NSInteger)((x * 37 + y * 11 + z * 5) % 256); // fits all three types
+                    switch (sampleTypes[i]) {
+                        case NIVolumeDataSampleTypeInt16:
+                            sample = sample * 8 - 1000;
+                            ((int16_t *)[sampleData mutableBytes])[index] = (int16_t)sample;
+                            break;
+                        case NIVolumeDataSampleTypeUInt16:
+                            sample = sample * 200;
+                            ((uint16_t *)[sampleData mutableBytes])[index] = (uint16_t)sample;
+                            break;
+                        default:
+                            ((uint8_t *)[sampleData mutableBytes])[index] = (uint8_t)sample;
+                            break;
+                    }
+                    floats[index] = (float)sample * rescaleSlopes[i] + rescaleIntercepts[i];
+                }
+            }
+        }
+
+        NIVolumeData *sampleVolumeData = [[[NIVolumeData alloc] initWithSampleData:sampleData sampleType:sampleTypes[i] rescaleSlope:rescaleSlopes[i] rescaleIntercept:rescaleIntercepts[i]
+                                                                        pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                                                             modelToVoxelTransform:NIAffineTransformIdentity outOfBoundsValue:-2000] autorelease];
+        NIVolumeData *floatVolumeData = [[[NIVolumeData alloc] initWithData:floatData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                                                       modelToVoxelTransform:NIAffineTransformIdentity outOfBoundsValue:-2000] autorelease];
+
+        XCTAssertEqual(sampleVolumeData.sampleType, sampleTypes[i]);
+        XCTAssertEqual([sampleVolumeData floatAtPixelCoordinateX:12 y:3 z:5], [floatVolumeData floatAtPixelCoordinateX:12 y:3 z:5]);
+        XCTAssertEqual([sampleVolumeData getFloatRun:run atPixelCoordinateX:2 y:7 z:4 length:13], (NSUInteger)11);
+        [floatVolumeData getFloatRun:expectedRun atPixelCoordinateX:2 y:7 z:4 length:13];
+        XCTAssertEqual(memcmp(run, expectedRun, 11 * sizeof(float)), 0);
+
+        for (j = 0; j < vectorCount; j++) {
+            XCTAssertEqualWithAccuracy([sampleVolumeData linearInterpolatedFloatAtModelVector:vectors[j]], [floatVolumeData linearInterpolatedFloatAtModelVector:vectors[j]], 0.01);
+            XCTAssertEqualWithAccuracy([sampleVolumeData cubicInterpolatedFloatAtModelVector:vectors[j]], [floatVolumeData cubicInterpolatedFloatAtModelVector:vectors[j]], 0.01);
+            XCTAssertEqualWithAccuracy([sampleVolumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[j]], [floatVolumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[j]], 0.01);
+        }
+        [sampleVolumeData linearInterpolateVolumeVectors:vectors outputValues:values numVectors:vectorCount];
+        [floatVolumeData linearInterpolateVolumeVectors:vectors outputValues:expectedValues numVectors:vectorCount];
+        for (j = 0; j < vectorCount; j++) {
+            XCTAssertEqualWithAccuracy(values[j], expectedValues[j], 0.01);
+        }
+
+        // sampling reads the stored samples, the flat floats are only built when floatData is asked for
+        XCTAssertNil([sampleVolumeData valueForKey:@"_floatData"]);
+        XCTAssertEqualObjects(sampleVolumeData.floatData, floatData);
+    }
+}
+
+- (void)testCompressedBricksRoundTrip {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:16];
+    float run[70];
+    float compressedRun[70];
+
+    XCTAssertEqual(compressedVolumeData.compressedBrickSize, (NSUInteger)16);
+    XCTAssertEqualObjects([compressedVolumeData volumeDataWithIndexRangesX:NSMakeRange(3, 60) y:NSMakeRange(10, 33) z:NSMakeRange(5, 30)].floatData,
+                          [volumeData volumeDataWithIndexRangesX:NSMakeRange(3, 60) y:NSMakeRange(10, 33) z:NSMakeRange(5, 30)].floatData);
+
+    XCTAssertEqual([compressedVolumeData getFloatRun:compressedRun atPixelCoordinateX:5 y:20 z:39 length:70], (NSUInteger)65);
+    [volumeData getFloatRun:run atPixelCoordinateX:5 y:20 z:39 length:70];
+    XCTAssertEqual(memcmp(run, compressedRun, 65 * sizeof(float)), 0);
+
+    XCTAssertEqualObjects(compressedVolumeData.floatData, volumeData.floatData);
+}
+
+- (void)testCompressedBricksSampling {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:8];
+    NIVector vectors[] = {NIVectorMake(0.3, 0.1, 0.2), NIVectorMake(35.7, 12.2, 19.9), NIVectorMake(139.0, 99.5, 39.5), NIVectorMake(-1.0, 50.0, 10.0)};
+    NSUInteger i;
+
+    compressedVolumeData.brickCacheLimit = 0; // every sample decompresses its bricks again
+    for (i = 0; i < sizeof(vectors) / sizeof(NIVector); i++) {
+        XCTAssertEqualWithAccuracy([compressedVolumeData linearInterpolatedFloatAtModelVector:vectors[i]], [volumeData linearInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+        XCTAssertEqualWithAccuracy([compressedVolumeData cubicInterpolatedFloatAtModelVector:vectors[i]], [volumeData cubicInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+        XCTAssertEqualWithAccuracy([compressedVolumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[i]], [volumeData nearestNeighborInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+    }
+}
+
+- (void)testCompressedBricksBatchSampling {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:8];
+    NIVector vectors[] = {NIVectorMake(20.3, 30.1, 10.2), NIVectorMake(35.7, 12.2, 19.9), NIVectorMake(40.0, 20.5, 15.5), NIVectorMake(22.0, 25.0, 12.0)};
+    const NSUInteger count = sizeof(vectors) / sizeof(NIVector);
+    float values[count];
+    float compressedValues[count];
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NSUInteger i;
+
+    [volumeData linearInterpolateVolumeVectors:vectors outputValues:values numVectors:count];
+    [compressedVolumeData linearInterpolateVolumeVectors:vectors outputValues:compressedValues numVectors:count];
+    for (i = 0; i < count; i++) {
+        XCTAssertEqualWithAccuracy(compressedValues[i], values[i], 0.001);
+    }
+    [volumeData cubicInterpolateVolumeVectors:vectors outputValues:values numVectors:count];
+    [compressedVolumeData cubicInterpolateVolumeVectors:vectors outputValues:compressedValues numVectors:count];
+    for (i = 0; i < count; i++) {
+        XCTAssertEqualWithAccuracy(compressedValues[i], values[i], 0.001);
+    }
+
+    XCTAssertThrowsSpecificNamed([compressedVolumeData acquireInlineBuffer:&inlineBuffer], NSException, NSInvalidArgumentException);
+    XCTAssertEqualObjects(compressedVolumeData, volumeData);
+    XCTAssertEqualObjects(volumeData, compressedVolumeData);
+}
+
+- (void)testCompressedBricksGenerating {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:8];
+    NIObliqueSliceGeneratorRequest *obliqueRequest = [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:NIVectorMake(35, 25, 20) pixelsWide:32 pixelsHigh:32
+                                                                                                      xBasis:NIVectorMake(0.8, 0.6, 0) yBasis:NIVectorMake(0, 0.6, 0.8)] autorelease];
+    NIStretchedGeneratorRequest *stretchedRequest = [self stretchedRequestWithPixelsWide:24 pixelsHigh:16 midHeightY:8];
+    NSUInteger i;
+
+    // the generator samples the bricks around the slab, B-spline slabs sample the coefficients of the whole volume
+    for (NSNumber *interpolationMode in @[@(NIInterpolationModeLinear), @(NIInterpolationModeCubicBSpline)]) {
+        for (NIGeneratorRequest *request in @[obliqueRequest, stretchedRequest]) {
+            request.interpolationMode = [interpolationMode integerValue];
+            request.slabWidth = 3;
+            request.projectionMode = NIProjectionModeMIP;
+
+            NIVolumeData *generatedVolume = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+            NIVolumeData *compressedGeneratedVolume = [NIGenerator synchronousRequestVolume:request volumeData:compressedVolumeData];
+            const float *floats = [generatedVolume.floatData bytes];
+            const float *compressedFloats = [compressedGeneratedVolume.floatData bytes];
+            XCTAssertEqual(compressedGeneratedVolume.floatData.length, generatedVolume.floatData.length);
+            for (i = 0; i < generatedVolume.floatData.length / sizeof(float); i++) {
+                XCTAssertEqualWithAccuracy(compressedFloats[i], floats[i], 0.001);
+            }
+        }
+    }
+}
+
+- (void)testCompressedBricksArchiving {
+    NIVolumeData *compressedVolumeData = [[self volumeDataWithPixelsWide:33 pixelsHigh:17 pixelsDeep:9] volumeDataWithCompressedBrickSize:16];
+    NIVolumeData *unarchivedVolumeData = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:compressedVolumeData]];
+
+    XCTAssertEqual(unarchivedVolumeData.compressedBrickSize, (NSUInteger)16);
+    XCTAssertEqualObjects(unarchivedVolumeData, compressedVolumeData);
+}
+
+- (void)testCompressedBricksRatio {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:128 pixelsHigh:128 pixelsDeep:64];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:16];
+    NSUInteger compressedLength = [[NSKeyedArchiver archivedDataWithRootObject:compressedVolumeData] length];
+
+    XCTAssertGreaterThan((double)volumeData.floatData.length / (double)compressedLength, 2.0, @"CT like data should compress at least 2 times");
+}
+
+- (void)testPerformanceBrickCompression {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:256 pixelsHigh:256 pixelsDeep:128];
+    [volumeData floatData];
+
+    [self measureBlock:^{
+        [volumeData volumeDataWithCompressedBrickSize:16];
+    }];
+}
+
+- (void)testPerformanceBrickDecompression {
+    NIVolumeData *compressedVolumeData = [[self volumeDataWithPixelsWide:256 pixelsHigh:256 pixelsDeep:128] volumeDataWithCompressedBrickSize:16];
+
+    [self measureBlock:^{
+        NIVolumeData *coldVolumeData = [[compressedVolumeData copy] autorelease]; // starts with an empty brick cache
+        [coldVolumeData volumeDataWithIndexRangesX:NSMakeRange(0, 256) y:NSMakeRange(0, 256) z:NSMakeRange(0, 128)];
+    }];
+}
+
+- (void)testMappedFileRoundTrip {
+    NIVolumeData *volumeData = [[self volumeDataWithPixelsWide:33 pixelsHigh:17 pixelsDeep:9] volumeDataWithModelToVoxelTransform:NIAffineTransformMakeTranslation(1.5, -2.25, 30)];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSError *error = nil;
+
+    XCTAssertTrue([volumeData writeToFile:path error:&error], @"%@", error);
+    NIVolumeData *mappedVolumeData = [[[NIVolumeData alloc] initWithContentsOfMappedFile:path error:&error] autorelease];
+    XCTAssertNotNil(mappedVolumeData, @"%@", error);
+    XCTAssertEqualObjects(mappedVolumeData.mappedFilePath, path);
+    XCTAssertEqual(mappedVolumeData.outOfBoundsValue, volumeData.outOfBoundsValue);
+    XCTAssertTrue(NIAffineTransformEqualToTransform(mappedVolumeData.modelToVoxelTransform, volumeData.modelToVoxelTransform));
+    XCTAssertEqualObjects(mappedVolumeData, volumeData);
+
+    // archives refer to the file
+    NIVolumeData *unarchivedVolumeData = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:mappedVolumeData]];
+    XCTAssertEqualObjects(unarchivedVolumeData.mappedFilePath, path);
+    XCTAssertEqualObjects(unarchivedVolumeData, volumeData);
+
+    NSData *fileData = [NSData dataWithContentsOfFile:path];
+    NSString *corruptPath = [path stringByAppendingPathExtension:@"corrupt"];
+
+    // the last slice is missing
+    [[fileData subdataWithRange:NSMakeRange(0, [fileData length] - sizeof(float))] writeToFile:corruptPath atomically:NO];
+    error = nil;
+    XCTAssertNil([[[NIVolumeData alloc] initWithContentsOfMappedFile:corruptPath error:&error] autorelease]);
+    XCTAssertEqual(error.code, (NSInteger)NSFileReadCorruptFileError);
+
+    // the header is cut short
+    [[fileData subdataWithRange:NSMakeRange(0, sizeof(NIVolumeDataFileHeader) - 1)] writeToFile:corruptPath atomically:NO];
+    error = nil;
+    XCTAssertNil([[[NIVolumeData alloc] initWithContentsOfMappedFile:corruptPath error:&error] autorelease]);
+    XCTAssertEqual(error.code, (NSInteger)NSFileReadCorruptFileError);
+
+    // the magic is wrong
+    NSMutableData *corruptData = [[fileData mutableCopy] autorelease];
+    ((char *)[corruptData mutableBytes])[0] = 'X';
+    [corruptData writeToFile:corruptPath atomically:NO];
+    error = nil;
+    XCTAssertNil([[[NIVolumeData alloc] initWithContentsOfMappedFile:corruptPath error:&error] autorelease]);
+    XCTAssertEqual(error.code, (NSInteger)NSFileReadCorruptFileError);
+
+    // the voxels are not aligned
+    corruptData = [[fileData mutableCopy] autorelease];
+    uint64_t voxelOffset = CFSwapInt64HostToLittle(sizeof(NIVolumeDataFileHeader));
+    memcpy((char *)[corruptData mutableBytes] + offsetof(NIVolumeDataFileHeader, voxelOffset), &voxelOffset, sizeof(voxelOffset));
+    [corruptData writeToFile:corruptPath atomically:NO];
+    error = nil;
+    XCTAssertNil([[[NIVolumeData alloc] initWithContentsOfMappedFile:corruptPath error:&error] autorelease]);
+    XCTAssertEqual(error.code, (NSInteger)NSFileReadCorruptFileError);
+
+    // an archive of a file that has been replaced by a volume of another size can't be decoded
+    NSData *archive = [NSKeyedArchiver archivedDataWithRootObject:mappedVolumeData];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL]; // truncating the file would pull the pages from under the mapped volumes
+    XCTAssertTrue([[self volumeDataWithPixelsWide:16 pixelsHigh:17 pixelsDeep:9] writeToFile:path error:&error], @"%@", error);
+    XCTAssertThrowsSpecificNamed([NSKeyedUnarchiver unarchiveObjectWithData:archive], NSException, NSInvalidUnarchiveOperationException);
+
+    [[NSFileManager defaultManager] removeItemAtPath:corruptPath error:NULL];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+- (void)testStridedViews {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *brickedVolumeData = [volumeData volumeDataWithBrickSize:8]; // bricked volumes copy instead of returning views
+    NIVector vectors[] = {NIVectorMake(0.3, 0.1, 0.2), NIVectorMake(35.7, 12.2, 19.9), NIVectorMake(120.0, 80.5, 30.5)};
+    NSUInteger i;
+
+    NIVolumeData *subvolumeData = [volumeData volumeDataWithIndexRangesX:NSMakeRange(3, 60) y:NSMakeRange(10, 33) z:NSMakeRange(5, 30)];
+    XCTAssertEqualObjects(subvolumeData.floatData, [brickedVolumeData volumeDataWithIndexRangesX:NSMakeRange(3, 60) y:NSMakeRange(10, 33) z:NSMakeRange(5, 30)].floatData);
+    XCTAssertEqualObjects([subvolumeData volumeDataForSliceAtIndex:7].floatData, [brickedVolumeData volumeDataWithIndexRangesX:NSMakeRange(3, 60) y:NSMakeRange(10, 33) z:NSMakeRange(12, 1)].floatData);
+
+    NIVolumeData *reversedVolumeData = [volumeData volumeDataWithReversedAxesX:NO y:YES z:YES];
+    NIVolumeData *fullyReversedVolumeData = [volumeData volumeDataWithReversedAxesX:YES y:YES z:YES];
+    XCTAssertEqual([reversedVolumeData floatAtPixelCoordinateX:4 y:0 z:0], [volumeData floatAtPixelCoordinateX:4 y:49 z:39]);
+    XCTAssertEqual([fullyReversedVolumeData floatAtPixelCoordinateX:4 y:0 z:0], [volumeData floatAtPixelCoordinateX:65 y:49 z:39]);
+    for (i = 0; i < sizeof(vectors) / sizeof(NIVector); i++) {
+        CGFloat value = [volumeData linearInterpolatedFloatAtModelVector:vectors[i]];
+        XCTAssertEqualWithAccuracy([reversedVolumeData linearInterpolatedFloatAtModelVector:vectors[i]], value, 0.001);
+        XCTAssertEqualWithAccuracy([fullyReversedVolumeData linearInterpolatedFloatAtModelVector:vectors[i]], value, 0.001);
+        XCTAssertEqualWithAccuracy([reversedVolumeData cubicInterpolatedFloatAtModelVector:vectors[i]], [volumeData cubicInterpolatedFloatAtModelVector:vectors[i]], 0.001);
+    }
+
+    NIVolumeData *unarchivedVolumeData = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:subvolumeData]];
+    XCTAssertEqualObjects(unarchivedVolumeData, subvolumeData);
+}
+
+- (void)testCubicBSplineInterpolation {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:12 pixelsHigh:10 pixelsDeep:8 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (float)round(100.0 * sin(0.7 * x) * cos(0.5 * y) + 20.0 * z);
+    }];
+    NIVolumeData *coefficients = volumeData.cubicBSplineCoefficients;
+    NIVolumeDataInlineBuffer coefficientsInlineBuffer;
+    NSUInteger x, y, z;
+
+    [coefficients acquireInlineBuffer:&coefficientsInlineBuffer];
+
+    // the prefiltered B-spline goes through the voxels, the edge voxels are left out because the spline reads outOfBoundsValue past the edges
+    for (z = 1; z < 7; z++) {
+        for (y = 1; y < 9; y++) {
+            for (x = 1; x < 11; x++) {
+                XCTAssertEqualWithAccuracy(NIVolumeDataCubicBSplineInterpolatedFloatAtVolumeCoordinate(&coefficientsInlineBuffer, x, y, z), [volumeData floatAtPixelCoordinateX:x y:y z:z], 0.01);
+            }
+        }
+    }
+
+    // between the voxels the 8 linear taps match the 64 taps of the B-spline evaluated directly from the coefficients
+    const float xCoordinates[] = {1.5, 2.25, 4.9, 7.1, 8.75, 3.33, 5.5, 6.01, 1.2};
+    const float yCoordinates[] = {1.5, 3.75, 2.1, 6.6, 5.25, 4.5, 1.01, 6.99, 3.3};
+    const float zCoordinates[] = {1.5, 2.5, 4.4, 1.9, 3.75, 2.2, 4.99, 1.01, 3.6};
+    const NSUInteger coordinateCount = sizeof(xCoordinates) / sizeof(float);
+    float batchValues[coordinateCount];
+    NSUInteger i;
+    NSInteger j, k, l;
+
+    NIVolumeDataCubicBSplineInterpolateVolumeCoordinates(&coefficientsInlineBuffer, xCoordinates, yCoordinates, zCoordinates, batchValues, coordinateCount);
+    for (i = 0; i < coordinateCount; i++) {
+        const CGFloat coordinates[3] = {xCoordinates[i], yCoordinates[i], zCoordinates[i]};
+        CGFloat weights[3][4];
+        NSInteger floors[3];
+        CGFloat expectedValue = 0;
+
+        for (j = 0; j < 3; j++) {
+            floors[j] = (NSInteger)floor(coordinates[j]);
+            CGFloat t = coordinates[j] - floors[j];
+            weights[j][0] = (1 - t)*(1 - t)*(1 - t) / 6;
+            weights[j][1] = (4 - 6*t*t + 3*t*t*t) / 6;
+            weights[j][2] = (1 + 3*t + 3*t*t - 3*t*t*t) / 6;
+            weights[j][3] = t*t*t / 6;
+        }
+        for (l = 0; l < 4; l++) {
+            for (k = 0; k < 4; k++) {
+                for (j = 0; j < 4; j++) {
+                    expectedValue += weights[0][j] * weights[1][k] * weights[2][l] * [coefficients floatAtPixelCoordinateX:floors[0] + j - 1 y:floors[1] + k - 1 z:floors[2] + l - 1];
+                }
+            }
+        }
+
+        XCTAssertEqualWithAccuracy(NIVolumeDataCubicBSplineInterpolatedFloatAtVolumeCoordinate(&coefficientsInlineBuffer, coordinates[0], coordinates[1], coordinates[2]), expectedValue, 0.01);
+        XCTAssertEqualWithAccuracy(batchValues[i], expectedValue, 0.05);
+    }
+}
+
+- (void)testSeparableResampling {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIAffineTransform isotropicTransform = NIAffineTransformConcat(NIAffineTransformMakeScale(2, 2, 2), NIAffineTransformMakeTranslation(-0.3, 0.25, 0));
+    NIInterpolationMode interpolationModes[] = {NIInterpolationModeLinear, NIInterpolationModeNearestNeighbor, NIInterpolationModeCubic};
+    NSUInteger i;
+    NSUInteger j;
+
+    for (i = 0; i < sizeof(interpolationModes) / sizeof(NIInterpolationMode); i++) {
+        NIVolumeData *resampledVolumeData = [volumeData volumeDataResampledWithModelToVoxelTransform:isotropicTransform pixelsWide:40 pixelsHigh:30 pixelsDeep:90 interpolationMode:interpolationModes[i]];
+        NIVector voxels[] = {NIVectorMake(0, 0, 0), NIVectorMake(17, 11, 42), NIVectorMake(39, 29, 88)}; // even z, so that nearest neighbor never rounds a half
+        for (j = 0; j < sizeof(voxels) / sizeof(NIVector); j++) {
+            NIVector modelVector = [resampledVolumeData convertVolumeVectorToModelVector:voxels[j]];
+            CGFloat expectedValue;
+            switch (interpolationModes[i]) {
+                case NIInterpolationModeNearestNeighbor:
+                    expectedValue = [volumeData nearestNeighborInterpolatedFloatAtModelVector:modelVector];
+                    break;
+                case NIInterpolationModeCubic:
+                    expectedValue = [volumeData cubicInterpolatedFloatAtModelVector:modelVector];
+                    break;
+                default:
+                    expectedValue = [volumeData linearInterpolatedFloatAtModelVector:modelVector];
+                    break;
+            }
+            XCTAssertEqualWithAccuracy([resampledVolumeData floatAtPixelCoordinateX:voxels[j].x y:voxels[j].y z:voxels[j].z], expectedValue, 0.01);
+        }
+    }
+}
+
+- (void)testSeparableResamplingPerformance {
+    NIVolumeData *volumeData = [[self volumeDataWithPixelsWide:256 pixelsHigh:256 pixelsDeep:200] volumeDataWithModelToVoxelTransform:NIAffineTransformMakeScale(1.4, 1.4, 2)];
+
+    [self measureBlock:^{
+        [volumeData volumeDataResampledWithModelToVoxelTransform:NIAffineTransformMakeScale(1.4, 1.4, 1.4) interpolationMode:NIInterpolationModeLinear];
+    }];
+}
+
+- (void)testMipLevelForAnisotropicSpacing {
+    // 0.5 x 0.5 x 2.5 mm voxels, like thick slice CT
+    NIVolumeData *volumeData = [[self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16] volumeDataWithModelToVoxelTransform:NIAffineTransformMakeScale(2, 2, 0.4)];
+
+    XCTAssertEqual([volumeData mipLevelForSampleSpacing:0.5], (NSUInteger)0);
+    XCTAssertEqual([volumeData mipLevelForSampleSpacing:1], (NSUInteger)0); // level 1 would have 5 mm slices
+    XCTAssertEqual([volumeData mipLevelForSampleSpacing:4.9], (NSUInteger)0);
+    XCTAssertEqual([volumeData mipLevelForSampleSpacing:5], (NSUInteger)1);
+    XCTAssertEqual([volumeData mipLevelForSampleSpacing:10], (NSUInteger)2);
+}
+
+- (void)testMipLevelOfOddDimensions {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:5 pixelsHigh:3 pixelsDeep:3 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (float)(x + 10*y + 100*z);
+    }];
+    NIVolumeData *levelVolumeData = [volumeData volumeDataForMipLevel:1];
+    float run[3];
+
+    XCTAssertEqual(volumeData.mipLevelCount, (NSUInteger)4);
+    XCTAssertEqual(levelVolumeData.pixelsWide, (NSUInteger)3);
+    XCTAssertEqual(levelVolumeData.pixelsHigh, (NSUInteger)2);
+    XCTAssertEqual(levelVolumeData.pixelsDeep, (NSUInteger)2);
+
+    [levelVolumeData getFloatRun:run atPixelCoordinateX:0 y:0 z:0 length:3];
+    XCTAssertEqualWithAccuracy(run[0], 55.5, 0.001);
+    XCTAssertEqualWithAccuracy(run[2], 59, 0.001); // the last voxel only covers x == 4
+    [levelVolumeData getFloatRun:run atPixelCoordinateX:0 y:1 z:1 length:3];
+    XCTAssertEqualWithAccuracy(run[2], 224, 0.001); // and y == 2 and z == 2
+
+    // volumes that aren't flat floats are downsampled slice by slice and give the same levels
+    XCTAssertEqualObjects([[volumeData volumeDataWithCompressedBrickSize:4] volumeDataForMipLevel:1].floatData, levelVolumeData.floatData);
+    XCTAssertEqualObjects([[volumeData volumeDataWithBorderWidth:2] volumeDataForMipLevel:1].floatData, levelVolumeData.floatData);
+}
+
+- (void)testIntensityStatistics {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    const float *floats = (const float *)[volumeData.floatData bytes];
+    const NSUInteger floatCount = 70 * 50 * 40;
+    float expectedMin;
+    float expectedMax;
+    float expectedMean;
+    NSUInteger histogramTotal = 0;
+    NSUInteger i;
+
+    vDSP_minv(floats, 1, &expectedMin, floatCount);
+    vDSP_maxv(floats, 1, &expectedMax, floatCount);
+    vDSP_meanv(floats, 1, &expectedMean, floatCount);
+
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:16];
+    for (NIVolumeData *testedVolumeData in @[volumeData, compressedVolumeData, [volumeData volumeDataWithBrickSize:8]]) {
+        XCTAssertEqual(testedVolumeData.intensityMin, expectedMin);
+        XCTAssertEqual(testedVolumeData.intensityMax, expectedMax);
+        XCTAssertEqualWithAccuracy(testedVolumeData.intensityMean, expectedMean, 0.01);
+    }
+
+    NSData *histogram = [compressedVolumeData intensityHistogramWithBinCount:64];
+    XCTAssertEqual([histogram length], 64 * sizeof(NSUInteger));
+    for (i = 0; i < 64; i++) {
+        histogramTotal += ((const NSUInteger *)[histogram bytes])[i];
+    }
+    XCTAssertEqual(histogramTotal, floatCount);
+    XCTAssertTrue(((const NSUInteger *)[histogram bytes])[0] > 0); // the air
+    XCTAssertTrue([compressedVolumeData intensityHistogramWithBinCount:64] == histogram);
+    XCTAssertEqualObjects([volumeData intensityHistogramWithBinCount:64], histogram);
+}
+
+- (void)testMinMaxGrid {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:70 pixelsHigh:50 pixelsDeep:40];
+    NIVolumeData *compressedVolumeData = [volumeData volumeDataWithCompressedBrickSize:16];
+    NIVolumeDataMinMaxGrid minMaxGrid;
+    NIVolumeDataMinMaxGrid compressedMinMaxGrid;
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NSUInteger i;
+    NSUInteger j;
+
+    [volumeData acquireMinMaxGrid:&minMaxGrid];
+    [compressedVolumeData acquireMinMaxGrid:&compressedMinMaxGrid];
+    XCTAssertEqual(minMaxGrid.cellsWide, (NSUInteger)9);
+    XCTAssertEqual(minMaxGrid.cellsHigh, (NSUInteger)7);
+    XCTAssertEqual(minMaxGrid.cellsDeep, (NSUInteger)5);
+    XCTAssertEqual(memcmp(minMaxGrid.cellMins, compressedMinMaxGrid.cellMins, 9 * 7 * 5 * sizeof(float)), 0);
+    XCTAssertEqual(memcmp(minMaxGrid.cellMaxs, compressedMinMaxGrid.cellMaxs, 9 * 7 * 5 * sizeof(float)), 0);
+
+    // every linear and nearest neighbor sample inside a box must be inside the bounds of the box
+    [volumeData acquireInlineBuffer:&inlineBuffer];
+    srandom(2);
+    for (i = 0; i < 200; i++) {
+        NIVector minVector = NIVectorMake((CGFloat)(random() % 800) / 10.0 - 5.0, (CGFloat)(random() % 600) / 10.0 - 5.0, (CGFloat)(random() % 500) / 10.0 - 5.0);
+        NIVector maxVector = NIVectorAdd(minVector, NIVectorMake((CGFloat)(random() % 100) / 10.0, (CGFloat)(random() % 100) / 10.0, (CGFloat)(random() % 100) / 10.0));
+        float boundsMin;
+        float boundsMax;
+        NIVolumeDataMinMaxGridGetBounds(&minMaxGrid, minVector, maxVector, &boundsMin, &boundsMax);
+        XCTAssertTrue(boundsMin <= boundsMax);
+        for (j = 0; j < 50; j++) {
+            NIVector vector = NIVectorMake(minVector.x + (maxVector.x - minVector.x) * (CGFloat)(random() % 1001) / 1000.0,
+                                           minVector.y + (maxVector.y - minVector.y) * (CGFloat)(random() % 1001) / 1000.0,
+                                           minVector.z + (maxVector.z - minVector.z) * (CGFloat)(random() % 1001) / 1000.0);
+            float linearValue = NIVolumeDataLinearInterpolatedFloatAtVolumeVector(&inlineBuffer, vector);
+            float nearestValue = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(&inlineBuffer, vector);
+            XCTAssertTrue(linearValue >= boundsMin - 0.001 && linearValue <= boundsMax + 0.001);
+            XCTAssertTrue(nearestValue >= boundsMin && nearestValue <= boundsMax);
+        }
+    }
+
+    // the grid of air outside the sphere is uniform
+    float airMin;
+    float airMax;
+    NIVolumeDataMinMaxGridGetBounds(&minMaxGrid, NIVectorMake(0, 0, 0), NIVectorMake(4, 4, 4), &airMin, &airMax);
+    XCTAssertEqual(airMin, -1000);
+    XCTAssertEqual(airMax, -1000);
+}
+
+- (void)testVolumeRendering {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return 100;
+    }];
+    NIObliqueSliceGeneratorRequest *request = [self axialRequestWithCenter:NIVectorMake(8, 8, 8)];
+    const float opaqueTable[] = {0, 1};
+    const float transparentTable[] = {0, 0};
+    NSUInteger i;
+
+    request.projectionMode = NIProjectionModeVR;
+    request.slabWidth = 4;
+    request.slabSampleDistance = 1;
+    request.opacityTableMin = 0;
+    request.opacityTableMax = 100;
+
+    // the first sample stops every ray
+    request.opacityTable = [NSData dataWithBytes:opaqueTable length:sizeof(opaqueTable)];
+    NIVolumeData *rendering = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTAssertEqual(rendering.pixelsDeep, (NSUInteger)1);
+    for (i = 0; i < 8 * 8; i++) {
+        XCTAssertEqualWithAccuracy(((const float *)[rendering.floatData bytes])[i], 100, 0.001);
+    }
+
+    // every ray goes through to the background
+    request.opacityTable = [NSData dataWithBytes:transparentTable length:sizeof(transparentTable)];
+    rendering = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    for (i = 0; i < 8 * 8; i++) {
+        XCTAssertEqualWithAccuracy(((const float *)[rendering.floatData bytes])[i], -1000, 0.001);
+    }
+}
+
+- (void)testVolumeRenderingEarlyTermination {
+    // the samples of the slab are 90, 80, 70, 60, 50, 60, 70, 80, 90 from z = 4 to 12, so both ends of the slab composite the same way
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return 50 + 10 * fabs((float)z - 8);
+    }];
+    const float rampTable[] = {0, 1}; // the opacity of a sample is its intensity / 100
+    // the rays let through 0.1, 0.02, 0.006 and then 0.0024 of their light, which is under NIProjectionOpaqueTransmittance, so the last 5 samples and the background are skipped
+    const float expectedColor = 0.9 * 90 + 0.1 * 0.8 * 80 + 0.02 * 0.7 * 70 + 0.006 * 0.6 * 60;
+    NSUInteger i;
+
+    NIObliqueSliceGeneratorRequest *obliqueRequest = [self axialRequestWithCenter:NIVectorMake(8, 8, 8)];
+    obliqueRequest.projectionMode = NIProjectionModeVR;
+
+    NIStretchedGeneratorRequest *stretchedRequest = [self stretchedRequestWithPixelsWide:8 pixelsHigh:8 midHeightY:8];
+    stretchedRequest.projectionMode = NIProjectionModeVR;
+
+    // the oblique slice projects while it fills the slab, the stretched slice fills the slab and then projects it with NIProjectionOperation
+    for (NIGeneratorRequest *request in @[obliqueRequest, stretchedRequest]) {
+        request.interpolationMode = NIInterpolationModeLinear;
+        request.slabWidth = 8;
+        request.slabSampleDistance = 1;
+        request.opacityTable = [NSData dataWithBytes:rampTable length:sizeof(rampTable)];
+        request.opacityTableMin = 0;
+        request.opacityTableMax = 100;
+
+        NIVolumeData *rendering = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+        XCTAssertEqual(rendering.pixelsDeep, (NSUInteger)1);
+        for (i = 0; i < 8 * 8; i++) {
+            XCTAssertEqualWithAccuracy(((const float *)[rendering.floatData bytes])[i], expectedColor, 0.01);
+        }
+    }
+}
+
+- (void)testVolumeRenderingDefaultOpacities {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return 50 + 10 * fabs((float)z - 8);
+    }];
+    const float rampTable[] = {0, 1};
+    NSUInteger i;
+
+    NIObliqueSliceGeneratorRequest *obliqueRequest = [self axialRequestWithCenter:NIVectorMake(8, 8, 8)];
+    NIStretchedGeneratorRequest *stretchedRequest = [self stretchedRequestWithPixelsWide:8 pixelsHigh:8 midHeightY:8];
+
+    // an empty table is the ramp from the minimum to the maximum intensity of the volume, rather than a transparent slab
+    for (NIGeneratorRequest *request in @[obliqueRequest, stretchedRequest]) {
+        request.projectionMode = NIProjectionModeVR;
+        request.interpolationMode = NIInterpolationModeLinear;
+        request.slabWidth = 8;
+        request.slabSampleDistance = 1;
+        request.opacityTable = [NSData dataWithBytes:rampTable length:sizeof(rampTable)];
+        request.opacityTableMin = volumeData.intensityMin;
+        request.opacityTableMax = volumeData.intensityMax;
+        NIVolumeData *rampRendering = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+
+        request.opacityTable = [NSData data];
+        NIVolumeData *defaultRendering = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+        for (i = 0; i < 8 * 8; i++) {
+            XCTAssertEqualWithAccuracy(((const float *)[defaultRendering.floatData bytes])[i], ((const float *)[rampRendering.floatData bytes])[i], 0.001);
+            XCTAssertGreaterThan(((const float *)[defaultRendering.floatData bytes])[i], 0);
+        }
+    }
+}
+
+- (void)testStreamingProjections {
+    NIVolumeData *volumeData = [self zRampVolumeData];
+    NIObliqueSliceGeneratorRequest *request = [self axialRequestWithCenter:NIVectorMake(8, 8, 8)];
+    NSUInteger i;
+
+    request.interpolationMode = NIInterpolationModeLinear;
+    request.slabWidth = 4; // the slices at z = 6, 7, 8, 9 and 10
+    request.slabSampleDistance = 1;
+
+    request.projectionMode = NIProjectionModeSum;
+    NIVolumeData *projection = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTAssertEqualWithAccuracy(((const float *)[projection.floatData bytes])[0], 40, 0.001);
+
+    request.projectionMode = NIProjectionModeStandardDeviation;
+    projection = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTAssertEqualWithAccuracy(((const float *)[projection.floatData bytes])[0], sqrt(2), 0.001);
+
+    request.projectionMode = NIProjectionModeMIPWithDepth;
+    projection = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTAssertEqual(projection.pixelsDeep, (NSUInteger)2);
+    for (i = 0; i < 8 * 8; i++) {
+        XCTAssertEqualWithAccuracy(((const float *)[projection.floatData bytes])[i], 10, 0.001);
+        XCTAssertEqual(((const float *)[projection.floatData bytes])[8 * 8 + i], 4);
+    }
+}
+
+- (void)testStreamedProjectionsMatchProjectionOperation {
+    // a bright block in a background that fades away from z = 8, nothing changes along x so that the slices only have to match along y and z
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        if (y >= 6 && y <= 9 && z >= 7 && z <= 9) {
+            return 1000;
+        }
+        return 100 - 10 * fabs((float)z - 8) + y;
+    }];
+    // the stretched slice fills its slab and projects it with NIProjectionOperation, the oblique slice samples the same points but projects them while it
+    // fills, skipping the spans that the min/max grid shows can't change the projection. Its rows start half a pixel lower since it is centered on its edge
+    NIStretchedGeneratorRequest *stretchedRequest = [self stretchedRequestWithPixelsWide:24 pixelsHigh:24 midHeightY:8];
+    NIObliqueSliceGeneratorRequest *obliqueRequest = [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:NIVectorMake(8, 8.25, 8) pixelsWide:24 pixelsHigh:24
+                                                                                                      xBasis:NIVectorMake(0.5, 0, 0) yBasis:NIVectorMake(0, 0.5, 0)] autorelease];
+    const float thresholds[][2] = {{-INFINITY, INFINITY}, {150, 500}, {0, 70}}; // the windows clamp whole spans of the background to one of their ends
+    NSUInteger i, j;
+
+    for (i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+        for (NSNumber *projectionMode in @[@(NIProjectionModeMIP), @(NIProjectionModeMinIP), @(NIProjectionModeMean)]) {
+            stretchedRequest.projectionMode = [projectionMode integerValue];
+            obliqueRequest.projectionMode = [projectionMode integerValue];
+            for (NIGeneratorRequest *request in @[stretchedRequest, obliqueRequest]) {
+                request.interpolationMode = NIInterpolationModeLinear;
+                request.slabWidth = 6;
+                request.slabSampleDistance = 1;
+                request.projectionThresholdMin = thresholds[i][0];
+                request.projectionThresholdMax = thresholds[i][1];
+            }
+
+            const float *projectedFloats = [[NIGenerator synchronousRequestVolume:stretchedRequest volumeData:volumeData].floatData bytes];
+            const float *streamedFloats = [[NIGenerator synchronousRequestVolume:obliqueRequest volumeData:volumeData].floatData bytes];
+            for (j = 0; j < 24 * 24; j++) {
+                XCTAssertEqualWithAccuracy(streamedFloats[j], projectedFloats[j], 0.01);
+            }
+        }
+    }
+}
+
+- (void)testProjectionBands {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return (x * 7 + y * 13 + z * 29) % 50;
+    }];
+    const CGFloat sampleSpacing = 0.5; // the 12 mm line over 24 pixels
+    NSUInteger x, y;
+
+    // the rows of a slice are split in bands, a slice that is a single row is a single band. The heights are under, at and over the number of bands of small machines
+    for (NSNumber *pixelsHigh in @[@1, @3, @29]) {
+        for (NSNumber *projectionMode in @[@(NIProjectionModeMIP), @(NIProjectionModeMinIP), @(NIProjectionModeMean), @(NIProjectionModeStandardDeviation)]) {
+            NIStretchedGeneratorRequest *request = [self stretchedRequestWithPixelsWide:24 pixelsHigh:[pixelsHigh unsignedIntegerValue] midHeightY:8];
+            request.projectionMode = [projectionMode integerValue];
+            request.interpolationMode = NIInterpolationModeLinear;
+            request.slabWidth = 4;
+            request.slabSampleDistance = 1;
+            NIVolumeData *projection = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+            XCTAssertEqual(projection.pixelsHigh, [pixelsHigh unsignedIntegerValue]);
+
+            for (y = 0; y < [pixelsHigh unsignedIntegerValue]; y++) {
+                NIStretchedGeneratorRequest *rowRequest = [[request copy] autorelease];
+                rowRequest.pixelsHigh = 1;
+                rowRequest.midHeightPoint = NIVectorMake(8, 8 + sampleSpacing * ((CGFloat)y - (CGFloat)([pixelsHigh unsignedIntegerValue] - 1) / 2.0), 8);
+                NIVolumeData *rowProjection = [NIGenerator synchronousRequestVolume:rowRequest volumeData:volumeData];
+                for (x = 0; x < 24; x++) {
+                    XCTAssertEqualWithAccuracy(((const float *)[projection.floatData bytes])[y * 24 + x], ((const float *)[rowProjection.floatData bytes])[x], 0.01);
+                }
+            }
+        }
+    }
+
+    // a request cancelled while its bands are being reduced gives no volume, never a partial one
+    NIStretchedGeneratorRequest *request = [self stretchedRequestWithPixelsWide:24 pixelsHigh:29 midHeightY:8];
+    request.projectionMode = NIProjectionModeMean;
+    request.slabWidth = 12;
+    request.slabSampleDistance = 0.25;
+    NIVolumeData *projection = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTestExpectation *cancelledExpectation = [self expectationWithDescription:@"the cancelled request finishes"];
+    NIGeneratorAsynchronousRequestID requestID = [NIGenerator asynchronousRequestVolume:request volumeData:volumeData completionBlock:^(NIVolumeData *generatedVolume) {
+        if (generatedVolume) {
+            XCTAssertEqualObjects(generatedVolume.floatData, projection.floatData);
+        }
+        [cancelledExpectation fulfill];
+    }];
+    [NIGenerator cancelAsynchronousRequest:requestID];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+- (void)testResultCache {
+    NIVolumeData *volumeData = [self zRampVolumeData];
+    NIVolumeData *otherVolumeData = [[[NIVolumeData alloc] initWithVolumeData:volumeData] autorelease]; // the same voxels in another NIVolumeData
+    NIObliqueSliceGeneratorRequest *request = [self axialRequestWithCenter:NIVectorMake(8, 8, 8)];
+    NSUInteger byteBudget = [NIGenerator resultCacheByteBudget];
+
+    XCTAssertNotEqual(volumeData.uniqueIdentifier, otherVolumeData.uniqueIdentifier);
+    XCTAssertEqual([request hash], [[[request copy] autorelease] hash]);
+
+    [NIGenerator setResultCacheByteBudget:8 * 8 * sizeof(float)];
+    NSUInteger hitCount = [NIGenerator resultCacheHitCount];
+    NSUInteger missCount = [NIGenerator resultCacheMissCount];
+
+    NIVolumeData *slice = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+    XCTAssertEqual(slice, [NIGenerator synchronousRequestVolume:[[request copy] autorelease] volumeData:volumeData]);
+    XCTAssertNotEqual(slice, [NIGenerator synchronousRequestVolume:request volumeData:otherVolumeData]); // also pushes the first slice out of the budget
+    XCTAssertNotEqual(slice, [NIGenerator synchronousRequestVolume:request volumeData:volumeData]);
+    XCTAssertEqual([NIGenerator resultCacheHitCount] - hitCount, (NSUInteger)1);
+    XCTAssertEqual([NIGenerator resultCacheMissCount] - missCount, (NSUInteger)3);
+
+    [NIGenerator removeAllCachedResults];
+    [NIGenerator setResultCacheByteBudget:byteBudget];
+}
+
+- (void)testRequestStream {
+    NIVolumeData *volumeData = [self zRampVolumeData];
+    NSUInteger i;
+
+    XCTestExpectation *newestVolumeExpectation = [self expectationWithDescription:@"the volume of the newest request is delivered"];
+    NIGeneratorRequestStream *stream = [NIGenerator requestStreamWithVolumeData:volumeData qualityOfService:NSQualityOfServiceUserInitiated
+                                                               completionBlock:^(NIVolumeData *generatedVolume, NIGeneratorRequest *request) {
+        XCTAssertNotNil(generatedVolume);
+        // only the newest request at the time the volume is done is delivered, so the volumes are delivered in order
+        if (((const float *)[generatedVolume.floatData bytes])[0] == 15) {
+            [newestVolumeExpectation fulfill];
+        }
+    }];
+
+    for (i = 0; i < 16; i++) {
+        [stream requestVolume:[self axialRequestWithCenter:NIVectorMake(8, 8, i)]];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+- (void)testProgressiveRequest {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16];
+    NIObliqueSliceGeneratorRequest *request = [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:NIVectorMake(4, 4, 8) pixelsWide:12 pixelsHigh:12
+                                                                                                xBasis:NIVectorMake(0.7, 0, 0) yBasis:NIVectorMake(0, 0.7, 0)] autorelease];
+    request.interpolationMode = NIInterpolationModeCubic;
+    NSMutableArray<NSNumber *> *passInterpolationModes = [NSMutableArray array];
+    __block NIVolumeData *finalVolume = nil;
+    XCTestExpectation *finalPassExpectation = [self expectationWithDescription:@"the final pass is delivered"];
+
+    [NIGenerator asynchronousProgressiveRequestVolume:request volumeData:volumeData qualityOfService:NSQualityOfServiceUserInitiated
+                                            passBlock:^(NIVolumeData *generatedVolume, NIGeneratorRequest *passRequest, BOOL finalPass) {
+        XCTAssertNotNil(generatedVolume);
+        XCTAssertEqual(generatedVolume.pixelsWide, (NSUInteger)12);
+        [passInterpolationModes addObject:@(passRequest.interpolationMode)];
+        if (finalPass) {
+            finalVolume = [generatedVolume retain];
+            [finalPassExpectation fulfill];
+        }
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    // passes can be dropped when they finish out of order, but never delivered out of order
+    NSArray<NSNumber *> *allInterpolationModes = @[@(NIInterpolationModeNearestNeighbor), @(NIInterpolationModeLinear), @(NIInterpolationModeCubic)];
+    NSUInteger lastIndex = 0;
+    for (NSNumber *interpolationMode in passInterpolationModes) {
+        NSUInteger index = [allInterpolationModes indexOfObject:interpolationMode];
+        XCTAssertNotEqual(index, NSNotFound);
+        XCTAssertGreaterThanOrEqual(index, lastIndex);
+        lastIndex = index + 1;
+    }
+    XCTAssertEqualObjects([passInterpolationModes lastObject], @(NIInterpolationModeCubic));
+    XCTAssertEqualObjects(finalVolume.floatData, [NIGenerator synchronousRequestVolume:request volumeData:volumeData].floatData);
+    [finalVolume release];
+}
+
+- (void)testReformatSlices {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:16 pixelsHigh:16 pixelsDeep:16];
+    NIObliqueSliceGeneratorRequest *request = [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:NIVectorMake(4, 4, 6) pixelsWide:11 pixelsHigh:9
+                                                                                                xBasis:NIVectorMake(0.7, 0, 0) yBasis:NIVectorMake(0, 0.7, 0)] autorelease];
+    request.interpolationMode = NIInterpolationModeLinear;
+    request.slabWidth = 1;
+    request.slabSampleDistance = 0.5;
+
+    for (NSNumber *projectionMode in @[@(NIProjectionModeNone), @(NIProjectionModeMIP)]) {
+        request.projectionMode = [projectionMode integerValue];
+        __block NSUInteger sliceCount = 0;
+        [NIGenerator reformatSlicesOfRequest:request volumeData:volumeData sliceCount:5 sliceSpacing:0.8 sliceBlock:^(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop) {
+            XCTAssertEqual(sliceIndex, sliceCount);
+            NIObliqueSliceGeneratorRequest *sliceRequest = [[request copy] autorelease];
+            sliceRequest.origin = NIVectorAdd(request.origin, NIVectorMake(0, 0, 0.8 * sliceIndex));
+            NIVolumeData *expectedSlice = [NIGenerator synchronousRequestVolume:sliceRequest volumeData:volumeData];
+            XCTAssertEqual(slice.pixelsDeep, expectedSlice.pixelsDeep);
+            XCTAssertEqualObjects(slice.floatData, expectedSlice.floatData);
+            sliceCount++;
+        }];
+        XCTAssertEqual(sliceCount, (NSUInteger)5);
+    }
+
+    __block NSUInteger deliveredSliceCount = 0;
+    [NIGenerator reformatSlicesOfRequest:request volumeData:volumeData sliceCount:100 sliceSpacing:0.1 sliceBlock:^(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop) {
+        deliveredSliceCount++;
+        *stop = sliceIndex == 2;
+    }];
+    XCTAssertEqual(deliveredSliceCount, (NSUInteger)3);
+}
+
+- (void)testFillTiles {
+    NIVolumeData *volumeData = [self volumeDataWithPixelsWide:32 pixelsHigh:32 pixelsDeep:16 intensities:^float(NSUInteger x, NSUInteger y, NSUInteger z) {
+        return ((x + 32*(y + 32*z)) * 7919) % 1000; // every voxel differs from its neighbours, so a misplaced tile shows
+    }];
+    NIObliqueSliceGeneratorRequest *request = [[[NIObliqueSliceGeneratorRequest alloc] initWithCenter:NIVectorMake(16, 16, 8) pixelsWide:29 pixelsHigh:23
+                                                                                                xBasis:NIVectorMake(1, 0, 0) yBasis:NIVectorMake(0, 1, 0)] autorelease];
+    request.interpolationMode = NIInterpolationModeLinear;
+    request.slabWidth = 4;
+    request.slabSampleDistance = 1;
+
+    for (NSNumber *projectionMode in @[@(NIProjectionModeNone), @(NIProjectionModeMIPWithDepth)]) {
+        request.projectionMode = [projectionMode integerValue];
+        NIVolumeData *slab = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+        [NIGenerator setOverrideFillTileWidth:5 tileHeight:3];
+        NIVolumeData *tiledSlab = [NIGenerator synchronousRequestVolume:request volumeData:volumeData];
+        [NIGenerator setOverrideFillTileWidth:0 tileHeight:0];
+        XCTAssertEqualObjects(slab.floatData, tiledSlab.floatData);
+    }
+}
+
+@end
@@ -694,15 +694,20 @@ NS_ASSUME_NONNULL_BEGIN
         [NSException raise:@"NIVolumeData Out Of Bounds" format:@"z is out of bounds"];
     }
 
-    NIVolumeDataInlineBuffer inlineBuffer;
-
-    [self acquireInlineBuffer:&inlineBuffer];
-    const float *floatPtr = NIVolumeDataFloatBytes(&inlineBuffer);
-
-    if (z == 0 && _pixelsDeep == 1) {
+    if (z == 0 && _pixelsDeep == 1 && self.compressedBrickSize == 0) {
         sliceData = [self floatData];
+    } else if (self.brickSize || self.borderWidth || self.sampleType != NIVolumeDataSampleTypeFloat32 || self.compressedBrickSize) {
+        sliceData = [[self volumeDataForSliceAtIndex:z] floatData];
     } else {
-        sliceData = [NSData dataWithBytes:floatPtr + (self.pixelsWide*self.pixelsHigh*z) length:self.pixelsWide * self.pixelsHigh * sizeof(float)];
+        NIVolumeDataInlineBuffer inlineBuffer;
+
+        [self acquireInlineBuffer:&inlineBuffer];
+        if (inlineBuffer.rowStride == (NSInteger)self.pixelsWide) { // the rows of the slice are contiguous
+            const float *floatPtr = NIVolumeDataFloatBytes(&inlineBuffer);
+            sliceData = [NSData dataWithBytes:floatPtr + (inlineBuffer.sliceStride*(NSInteger)z) length:self.pixelsWide * self.pixelsHigh * sizeof(float)];
+        } else {
+            sliceData = [[self volumeDataForSliceAtIndex:z] floatData];
+        }
     }
     sliceImageRep = [[NIFloatImageRep alloc] initWithData:sliceData pixelsWide:self.pixelsWide pixelsHigh:self.pixelsHigh];
     sliceImageRep.sliceThickness = self.pixelSpacingZ;
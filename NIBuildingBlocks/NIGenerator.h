@@ -27,8 +27,11 @@
 NS_ASSUME_NONNULL_BEGIN
 
 @class NIGeneratorRequest;
+@class NIObliqueSliceGeneratorRequest;
 @class NIVolumeData;
 
+@class NIGeneratorRequestStream;
+
 @protocol NIGeneratorDelegate;
 
 /**
@@ -40,6 +43,10 @@ typedef int64_t NIGeneratorAsynchronousRequestID;
  The NIGenerator class is used in conjunction with a NIVolumeData and a NIGeneratorRequest subclasses to build a new NIVolumeData
  that represents the slice described by the NIGeneratorRequest. The synchronous and asynchronous class methods are the
  preferred way to use this class. Curved NIVolumeData objects can not be used as source NIVolumeDate objects.
+
+ Requests that set samplesMipLevels and whose samples are farther apart than the source volume's voxels (see -[NIGeneratorRequest sampleSpacing]) are generated
+ from the coarsest level of the source volume's mip pyramid that still resolves the samples. The level is built before the request is generated if it isn't built
+ yet, so the generated volume only depends on the request and the source volume.
  */
 @interface NIGenerator : NSObject {
     NSOperationQueue *_generatorQueue;
@@ -71,6 +78,21 @@ typedef int64_t NIGeneratorAsynchronousRequestID;
 */
 + (NIVolumeData *)synchronousRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData;
 
+/**
+ Generates a series of parallel slices, for example to export a reformatted series, without holding the whole series in memory. The first slice is the one described
+ by the request, and each following slice is sliceSpacing farther along the request's slab normal. The slices share the setup of the request, the tiles of several
+ slices are filled in parallel at once, and each slice is handed to the sliceBlock, in order, as soon as its group of slices is done. Like synchronous requests,
+ this method returns once the last slice has been delivered, and the Quality of Service depends on whether it is called from the main thread.
+ @param request The NIObliqueSliceGeneratorRequest object that defines the first slice of the series, including its slab and projection.
+ @param volumeData The source volume from which to generate the slices.
+ @param sliceCount The number of slices to generate.
+ @param sliceSpacing The distance, in model space, between consecutive slices.
+ @param sliceBlock The block that is given each generated slice and its index in the series, it is called on the thread that called this method. Set stop to YES
+ to skip the remaining slices.
+ */
++ (void)reformatSlicesOfRequest:(NIObliqueSliceGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData sliceCount:(NSUInteger)sliceCount sliceSpacing:(CGFloat)sliceSpacing
+                     sliceBlock:(void (^)(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop))sliceBlock;
+
 /**
  Begins asynchronously generating a NIVolumeData object based on the slice described by the given NIGeneratorRequest. The
  newly generated NIVolumeData is returned via the given completionBlock. The execution context for your completion block is not guaranteed.
@@ -92,6 +114,23 @@ typedef int64_t NIGeneratorAsynchronousRequestID;
  @see asynchronousRequestVolume:volumeData:qualityOfService:completionBlock:
  */
 + (NIGeneratorAsynchronousRequestID)asynchronousRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService completionBlock:(void (^)(NIVolumeData* __nullable generatedVolume))completionBlock;
+/**
+ Begins asynchronously generating a NIVolumeData object in passes of increasing quality, so that something can be shown long before the requested volume is done.
+ The first pass uses nearest neighbor interpolation, sampling the next coarser level of the source volume's mip pyramid if the request samplesMipLevels. Requests for cubic
+ interpolation are then generated with linear interpolation, and the last pass generates the request as given. Each pass only starts once the previous one is
+ done, so cancelling the request also cancels the passes that have not been delivered yet. Requests with nearest neighbor interpolation, and requests whose volume
+ is in the result cache, only have the final pass.
+ @param request The NIGeneratorRequest object that defines to slice to be generatred.
+ @param volumeData The source volume from which to generate the slice.
+ @param qualityOfService The quality of sevice used to generate the passes.
+ @param passBlock The block that is given the volume of each pass and the request it was generated for. A pass is not delivered if it is cancelled or if a later
+ pass was delivered first. The block is always called for the final pass, with a nil volume if the request was cancelled. The block is never called concurrently
+ for the same request, the context in which it is called in not defined.
+ @return Returns a NIGeneratorAsynchronousRequestID as an ID token that can be used to refer to this request.
+ @see asynchronousRequestVolume:volumeData:qualityOfService:completionBlock:
+ */
++ (NIGeneratorAsynchronousRequestID)asynchronousProgressiveRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                                                               passBlock:(void (^)(NIVolumeData* __nullable generatedVolume, NIGeneratorRequest *passRequest, BOOL finalPass))passBlock;
 /**
  Cancels the request refered to by the give NIGeneratorAsynchronousRequestID token ID. The completion block will still be called, but if the
  NIVolumeData has not yet been generated, the generated volume will be nil.
@@ -113,6 +152,53 @@ typedef int64_t NIGeneratorAsynchronousRequestID;
 
 + (void)setPriority:(CGFloat)priority forAsynchronousRequest:(NIGeneratorAsynchronousRequestID)requestID __deprecated; // Use quality of service instead
 
+/**
+ The number of bytes of generated volumes that NIGenerator keeps to answer later requests that are equal to the one that generated them, made from the same
+ source NIVolumeData (see -[NIVolumeData uniqueIdentifier]). When the budget is exceeded the least recently used volumes are dropped first. The default is 0,
+ which turns the cache off. Cached volumes are shared by every request that hits them, so they must not be modified.
+ @see resultCacheHitCount
+ */
++ (NSUInteger)resultCacheByteBudget;
+/**
+ Sets the number of bytes of generated volumes NIGenerator may keep, setting a smaller budget drops volumes right away.
+ @param byteBudget The new budget in bytes, 0 turns the cache off and empties it.
+ @see resultCacheByteBudget
+ */
++ (void)setResultCacheByteBudget:(NSUInteger)byteBudget;
+/**
+ The number of requests that were answered from the result cache since the process started.
+ @see resultCacheMissCount
+ */
++ (NSUInteger)resultCacheHitCount;
+/**
+ The number of requests that were made while the result cache was on and that had to be generated.
+ @see resultCacheHitCount
+ */
++ (NSUInteger)resultCacheMissCount;
+/**
+ Empties the result cache, the budget and the hit and miss counts are kept.
+ */
++ (void)removeAllCachedResults;
+
+/**
+ Forces the size of the tiles the generated slices are split into to be filled in parallel, to benchmark tile shapes. By default the tiles are chosen for each
+ request from the number of cores, the size of the slice and of the slab, the footprint of the interpolation and the size of the L2 cache.
+ @param tileWidth The width of the tiles in pixels, or 0 to choose it for each request.
+ @param tileHeight The height of the tiles in pixels, or 0 to choose it for each request.
+ */
++ (void)setOverrideFillTileWidth:(NSUInteger)tileWidth tileHeight:(NSUInteger)tileHeight;
+
+/**
+ Returns a new NIGeneratorRequestStream that generates slices of the given volume. Use a stream when requests follow each other faster than they can be
+ generated, for example while the user drags through slices.
+ @param volumeData The source volume from which to generate the slices.
+ @param qualityOfService The quality of service used to generate the slices.
+ @param completionBlock The block that is given the newest generated volume, or nil if it could not be generated, and the request that it was generated for. The context in which this block is called in not defined.
+ @see NIGeneratorRequestStream
+ */
++ (NIGeneratorRequestStream *)requestStreamWithVolumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                                          completionBlock:(void (^)(NIVolumeData * __nullable generatedVolume, NIGeneratorRequest *request))completionBlock;
+
 
 // Don't use the functions below. They are either broken or behaves strangely.
 // Use synchronousRequestVolume:... and asynchronousRequestVolume:... instead
@@ -127,6 +213,60 @@ typedef int64_t NIGeneratorAsynchronousRequestID;
 
 @end
 
+/**
+ A NIGeneratorRequestStream generates volumes from a series of requests of which only the newest matters. Requesting a volume from a stream cancels the requests
+ of the stream that are still queued or being generated, so at most one request of the stream does useful work at any time and the completion block is only
+ called with the volume of the newest request. Streams are thread safe. A stream stays alive until its last request has finished, call -cancel to stop it early.
+ @see [NIGenerator requestStreamWithVolumeData:qualityOfService:completionBlock:]
+ */
+@interface NIGeneratorRequestStream : NSObject {
+    NIVolumeData *_volumeData;
+    NSQualityOfService _qualityOfService;
+    void (^_completionBlock)(NIVolumeData * __nullable, NIGeneratorRequest *);
+    int64_t _latestRequestNumber;
+    NIGeneratorAsynchronousRequestID _latestRequestID;
+    BOOL _progressive;
+}
+
+/**
+ Initializes a NIGeneratorRequestStream.
+ @param volumeData The source volume from which to generate the slices.
+ @param qualityOfService The quality of service used to generate the slices.
+ @param completionBlock The block that is given the newest generated volume, or nil if it could not be generated, and the request that it was generated for. The context in which this block is called in not defined.
+ */
+- (instancetype)initWithVolumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                   completionBlock:(void (^)(NIVolumeData * __nullable generatedVolume, NIGeneratorRequest *request))completionBlock;
+
+/**
+ The NIVolumeData object that serves as the source of the stream.
+ */
+@property (readonly) NIVolumeData *volumeData;
+
+/**
+ The quality of service used to generate the volumes of the stream.
+ */
+@property (readonly) NSQualityOfService qualityOfService;
+
+/**
+ If YES, the requests of the stream are generated in passes of increasing quality and the completion block is called with the volume of each pass of the newest
+ request, along with the request of the pass. The default is NO.
+ @see [NIGenerator asynchronousProgressiveRequestVolume:volumeData:qualityOfService:passBlock:]
+ */
+@property (readwrite) BOOL progressive;
+
+/**
+ Begins generating the volume for the given request and cancels the earlier requests of the stream, whose volumes will not be delivered.
+ @param request The NIGeneratorRequest object that defines to slice to be generatred. The request is copied.
+ */
+- (void)requestVolume:(NIGeneratorRequest *)request;
+
+/**
+ Cancels every request of the stream, no volume is delivered for requests made before this call.
+ */
+- (void)cancel;
+
+@end
+
 // Don't get data back with a delegate. This code will change in the future.
 // Use synchronousRequestVolume:... and asynchronousRequestVolume:... instead
 
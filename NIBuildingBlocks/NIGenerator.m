@@ -37,11 +37,117 @@
 #import "NIVolumeData.h"
 #import "NIGeneratorRequest.h"
 #import "NIGeneratorOperation.h"
+#import "NIGeneratorOperationPrivate.h"
+#import "NIHorizontalFillOperation.h"
 
 NSString * const _NIGeneratorRunLoopMode = @"_NIGeneratorRunLoopMode";
 
 static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
 
+// the result cache is guarded by synchronizing on the dictionary returned by +[NIGenerator _resultCache]
+static NSUInteger resultCacheByteBudget = 0;
+static NSUInteger resultCacheByteCount = 0;
+static NSUInteger resultCacheHitCount = 0;
+static NSUInteger resultCacheMissCount = 0;
+
+static NSUInteger NIGeneratorResultCacheByteCount(NIVolumeData *volume)
+{
+    return volume.pixelsWide * volume.pixelsHigh * volume.pixelsDeep * sizeof(float);
+}
+
+// The key of a volume in the result cache. Requests are mutable so the key keeps its own copy, and the source volume is only referred to by its identifier
+// so that the cache doesn't keep source volumes alive.
+@interface _NIGeneratorResultCacheKey : NSObject <NSCopying> {
+    NIGeneratorRequest *_request;
+    uint64_t _volumeIdentifier;
+}
+- (id)initWithRequest:(NIGeneratorRequest *)request volumeIdentifier:(uint64_t)volumeIdentifier;
+@end
+
+@implementation _NIGeneratorResultCacheKey
+
+- (id)initWithRequest:(NIGeneratorRequest *)request volumeIdentifier:(uint64_t)volumeIdentifier
+{
+    if ( (self = [super init]) ) {
+        _request = [request copy];
+        _volumeIdentifier = volumeIdentifier;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [_request release];
+    _request = nil;
+    [super dealloc];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return [self retain];
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if ([object isKindOfClass:[_NIGeneratorResultCacheKey class]]) {
+        _NIGeneratorResultCacheKey *key = (_NIGeneratorResultCacheKey *)object;
+        // the requests' isEqual: accepts subclasses, but requests of different classes generate different volumes
+        return _volumeIdentifier == key->_volumeIdentifier && [_request class] == [key->_request class] && [_request isEqual:key->_request];
+    }
+    return NO;
+}
+
+- (NSUInteger)hash
+{
+    return [_request hash] ^ (NSUInteger)(_volumeIdentifier * 0x9e3779b97f4a7c15ull);
+}
+
+@end
+
+// Stands for the passes of a progressive request, it finishes after the final pass, takes the final pass's volume, and cancelling it cancels every pass.
+@interface _NIGeneratorProgressiveOperation : NIGeneratorOperation {
+    NSArray<NIGeneratorOperation *> *_passOperations;
+}
+- (id)initWithPassOperations:(NSArray<NIGeneratorOperation *> *)passOperations;
+@end
+
+@implementation _NIGeneratorProgressiveOperation
+
+- (id)initWithPassOperations:(NSArray<NIGeneratorOperation *> *)passOperations
+{
+    NIGeneratorOperation *finalPassOperation = [passOperations lastObject];
+    if ( (self = [super initWithRequest:finalPassOperation.request volumeData:finalPassOperation.volumeData]) ) {
+        _passOperations = [passOperations copy];
+        [self addDependency:finalPassOperation];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [_passOperations release];
+    _passOperations = nil;
+    [super dealloc];
+}
+
+- (void)main
+{
+    NIGeneratorOperation *finalPassOperation = [_passOperations lastObject];
+    if ([self isCancelled] == NO && [finalPassOperation isCancelled] == NO) {
+        self.generatedVolume = finalPassOperation.generatedVolume;
+    }
+}
+
+- (void)cancel
+{
+    for (NIGeneratorOperation *passOperation in _passOperations) {
+        [passOperation cancel];
+    }
+    [super cancel];
+}
+
+@end
+
 @interface NIGenerator ()
 
 + (NSMutableDictionary<NSNumber *, NSOperation *> *)_requestIDs;
@@ -49,6 +155,14 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
 + (void)_setOperation:(NSOperation *)operation forRequestID:(NIGeneratorAsynchronousRequestID)requestID;
 + (NSOperation *)_operationForRequestID:(NIGeneratorAsynchronousRequestID)requestID;
 + (void)_removeOperationForRequestID:(NIGeneratorAsynchronousRequestID)requestID;
++ (NIVolumeData *)_volumeData:(NIVolumeData *)volumeData forRequest:(NIGeneratorRequest *)request;
++ (NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *)_resultCache;
++ (NSMutableOrderedSet<_NIGeneratorResultCacheKey *> *)_resultCacheRecency;
++ (void)_trimResultCacheToByteBudget;
++ (NIVolumeData *)_cachedVolumeForRequest:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData;
++ (void)_cacheVolumeOfFinishedOperation:(NIGeneratorOperation *)operation;
++ (NIGeneratorOperation *)_newOperationForRequest:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData;
++ (NSArray<NIGeneratorRequest *> *)_coarsePassRequestsForRequest:(NIGeneratorRequest *)request;
 - (void)_didFinishOperation;
 - (void)_cullGeneratedFrameTimes;
 - (void)_logFrameRate:(NSTimer *)timer;
@@ -138,6 +252,160 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
     }
 }
 
+// the level is always waited for, so that the generated volume only depends on the request and the volume
++ (NIVolumeData *)_volumeData:(NIVolumeData *)volumeData forRequest:(NIGeneratorRequest *)request
+{
+    if (request.samplesMipLevels == NO) {
+        return volumeData;
+    }
+    return [volumeData volumeDataForMipLevel:[volumeData mipLevelForSampleSpacing:[request sampleSpacing]]];
+}
+
++ (NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *)_resultCache
+{
+    static dispatch_once_t pred;
+    static NSMutableDictionary *resultCache = nil;
+    dispatch_once(&pred, ^{
+        resultCache = [[NSMutableDictionary alloc] init];
+    });
+    return resultCache;
+}
+
++ (NSMutableOrderedSet<_NIGeneratorResultCacheKey *> *)_resultCacheRecency // least recently used first
+{
+    static dispatch_once_t pred;
+    static NSMutableOrderedSet *resultCacheRecency = nil;
+    dispatch_once(&pred, ^{
+        resultCacheRecency = [[NSMutableOrderedSet alloc] init];
+    });
+    return resultCacheRecency;
+}
+
++ (NSUInteger)resultCacheByteBudget
+{
+    @synchronized([self _resultCache]) {
+        return resultCacheByteBudget;
+    }
+}
+
++ (void)setResultCacheByteBudget:(NSUInteger)byteBudget
+{
+    @synchronized([self _resultCache]) {
+        resultCacheByteBudget = byteBudget;
+        [self _trimResultCacheToByteBudget];
+    }
+}
+
++ (NSUInteger)resultCacheHitCount
+{
+    @synchronized([self _resultCache]) {
+        return resultCacheHitCount;
+    }
+}
+
++ (NSUInteger)resultCacheMissCount
+{
+    @synchronized([self _resultCache]) {
+        return resultCacheMissCount;
+    }
+}
+
++ (void)removeAllCachedResults
+{
+    NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *resultCache = [self _resultCache];
+    @synchronized(resultCache) {
+        [resultCache removeAllObjects];
+        [[self _resultCacheRecency] removeAllObjects];
+        resultCacheByteCount = 0;
+    }
+}
+
++ (void)_trimResultCacheToByteBudget // must be called while synchronized on the result cache
+{
+    NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *resultCache = [self _resultCache];
+    NSMutableOrderedSet<_NIGeneratorResultCacheKey *> *resultCacheRecency = [self _resultCacheRecency];
+
+    while (resultCacheByteCount > resultCacheByteBudget && [resultCacheRecency count]) {
+        _NIGeneratorResultCacheKey *key = [resultCacheRecency firstObject];
+        resultCacheByteCount -= NIGeneratorResultCacheByteCount([resultCache objectForKey:key]);
+        [resultCache removeObjectForKey:key];
+        [resultCacheRecency removeObjectAtIndex:0];
+    }
+}
+
++ (NIVolumeData *)_cachedVolumeForRequest:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData
+{
+    NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *resultCache = [self _resultCache];
+    @synchronized(resultCache) {
+        if (resultCacheByteBudget == 0) {
+            return nil;
+        }
+
+        _NIGeneratorResultCacheKey *key = [[[_NIGeneratorResultCacheKey alloc] initWithRequest:request volumeIdentifier:volumeData.uniqueIdentifier] autorelease];
+        NIVolumeData *cachedVolume = [resultCache objectForKey:key];
+        if (cachedVolume) {
+            NSMutableOrderedSet<_NIGeneratorResultCacheKey *> *resultCacheRecency = [self _resultCacheRecency];
+            NSUInteger index = [resultCacheRecency indexOfObject:key];
+            key = [[[resultCacheRecency objectAtIndex:index] retain] autorelease];
+            [resultCacheRecency removeObjectAtIndex:index];
+            [resultCacheRecency addObject:key];
+            resultCacheHitCount++;
+        } else {
+            resultCacheMissCount++;
+        }
+        return [[cachedVolume retain] autorelease];
+    }
+}
+
++ (void)_cacheVolumeOfFinishedOperation:(NIGeneratorOperation *)operation
+{
+    NIVolumeData *generatedVolume = operation.generatedVolume;
+    if (generatedVolume == nil || [operation isCancelled]) {
+        return;
+    }
+
+    NSMutableDictionary<_NIGeneratorResultCacheKey *, NIVolumeData *> *resultCache = [self _resultCache];
+    @synchronized(resultCache) {
+        NSUInteger byteCount = NIGeneratorResultCacheByteCount(generatedVolume);
+        if (byteCount > resultCacheByteBudget) {
+            return;
+        }
+
+        _NIGeneratorResultCacheKey *key = [[_NIGeneratorResultCacheKey alloc] initWithRequest:operation.request volumeIdentifier:operation.volumeData.uniqueIdentifier];
+        NIVolumeData *cachedVolume = [resultCache objectForKey:key];
+        if (cachedVolume == nil) { // volumes that were answered from the cache were already moved to the back of the recency order
+            [resultCache setObject:generatedVolume forKey:key];
+            [[self _resultCacheRecency] addObject:key];
+            resultCacheByteCount += byteCount;
+            [self _trimResultCacheToByteBudget];
+        }
+        [key release];
+    }
+}
+
++ (NIGeneratorOperation *)_newOperationForRequest:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData
+{
+    NIVolumeData *cachedVolume = [self _cachedVolumeForRequest:request volumeData:volumeData];
+    if (cachedVolume) {
+        // a plain NIGeneratorOperation does nothing when it runs, so completion blocks, waits and delegates see the cached volume like a generated one
+        NIGeneratorOperation *operation = [[NIGeneratorOperation alloc] initWithRequest:request volumeData:volumeData];
+        operation.generatedVolume = cachedVolume;
+        return operation;
+    }
+
+    return [[[request operationClass] alloc] initWithRequest:request volumeData:volumeData];
+}
+
++ (void)setOverrideFillTileWidth:(NSUInteger)tileWidth tileHeight:(NSUInteger)tileHeight
+{
+    [NIHorizontalFillOperation setOverrideTileWidth:tileWidth tileHeight:tileHeight];
+}
+
++ (NIGeneratorRequestStream *)requestStreamWithVolumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                                          completionBlock:(void (^)(NIVolumeData * __nullable generatedVolume, NIGeneratorRequest *request))completionBlock
+{
+    return [[[NIGeneratorRequestStream alloc] initWithVolumeData:volumeData qualityOfService:qualityOfService completionBlock:completionBlock] autorelease];
+}
 
 + (NIVolumeData *)synchronousRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData
 {
@@ -147,7 +415,7 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
     NSOperationQueue *operationQueue;
     NIVolumeData *generatedVolume;
     
-    operation = [[[request operationClass] alloc] initWithRequest:request volumeData:volumeData];
+    operation = [self _newOperationForRequest:request volumeData:[self _volumeData:volumeData forRequest:request]];
     if ([NSThread isMainThread]) {
         [operation setQualityOfService:NSQualityOfServiceUserInteractive];
         operationQueue = [self _synchronousMainThreadRequestQueue];
@@ -156,12 +424,26 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
         operationQueue = [self _userInitiatedRequestQueue];
     }
     [operationQueue addOperations:@[operation] waitUntilFinished:YES];
+    [self _cacheVolumeOfFinishedOperation:operation];
     generatedVolume = [[operation.generatedVolume retain] autorelease];
     [operation release];
     
     return generatedVolume;
 }
 
++ (void)reformatSlicesOfRequest:(NIObliqueSliceGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData sliceCount:(NSUInteger)sliceCount sliceSpacing:(CGFloat)sliceSpacing
+                     sliceBlock:(void (^)(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop))sliceBlock
+{
+    NSAssert(request != nil, @"the generator request can't be nil");
+    NSAssert(volumeData != nil, @"the volumeData can't be nil");
+    NSAssert(sliceBlock != nil, @"the sliceBlock can't be nil");
+
+    // the slices are all generated from the level of the mip pyramid of the first one, they sample it the same way
+    [NIObliqueSliceOperation reformatSlicesOfRequest:request volumeData:[self _volumeData:volumeData forRequest:request]
+                                          sliceCount:sliceCount sliceSpacing:sliceSpacing
+                                    qualityOfService:[NSThread isMainThread] ? NSQualityOfServiceUserInteractive : NSQualityOfServiceUserInitiated sliceBlock:sliceBlock];
+}
+
 + (NIGeneratorAsynchronousRequestID)asynchronousRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData completionBlock:(void (^)(NIVolumeData * __nullable))completionBlock
 {
     return [self asynchronousRequestVolume:request volumeData:volumeData qualityOfService:NSQualityOfServiceUserInitiated completionBlock:completionBlock];
@@ -171,13 +453,14 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
 {
     NSAssert(request != nil, @"the generator request can't be nil");
     NSAssert(volumeData != nil, @"the volumeData request can't be nil");
-    NIGeneratorOperation * operation = [[[[request operationClass] alloc] initWithRequest:request volumeData:volumeData] autorelease];
+    NIGeneratorOperation * operation = [[self _newOperationForRequest:request volumeData:[self _volumeData:volumeData forRequest:request]] autorelease];
     [operation setQualityOfService:qualityOfService];
     NIGeneratorAsynchronousRequestID requestID = [self _generateRequestID];
     [self _setOperation:operation forRequestID:requestID];
     void (^completionBlockCopy)(NIVolumeData *) = [[completionBlock copy] autorelease];
     [operation setCompletionBlock:^{
         [self _removeOperationForRequestID:requestID];
+        [self _cacheVolumeOfFinishedOperation:operation];
         completionBlockCopy(operation.generatedVolume);
     }];
     if (qualityOfService == NSQualityOfServiceUserInteractive) {
@@ -189,6 +472,95 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
     return requestID;
 }
 
++ (NSArray<NIGeneratorRequest *> *)_coarsePassRequestsForRequest:(NIGeneratorRequest *)request
+{
+    NSMutableArray<NIGeneratorRequest *> *passRequests = [NSMutableArray array];
+    NIGeneratorRequest *passRequest;
+
+    if (request.interpolationMode == NIInterpolationModeNearestNeighbor || request.interpolationMode == NIInterpolationModeNone) {
+        return passRequests;
+    }
+
+    passRequest = [[request copy] autorelease];
+    passRequest.interpolationMode = NIInterpolationModeNearestNeighbor;
+    [passRequests addObject:passRequest];
+
+    if (request.interpolationMode != NIInterpolationModeLinear) {
+        passRequest = [[request copy] autorelease];
+        passRequest.interpolationMode = NIInterpolationModeLinear;
+        [passRequests addObject:passRequest];
+    }
+
+    return passRequests;
+}
+
++ (NIGeneratorAsynchronousRequestID)asynchronousProgressiveRequestVolume:(NIGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                                                               passBlock:(void (^)(NIVolumeData* __nullable generatedVolume, NIGeneratorRequest *passRequest, BOOL finalPass))passBlock
+{
+    NSAssert(request != nil, @"the generator request can't be nil");
+    NSAssert(volumeData != nil, @"the volumeData request can't be nil");
+    NSAssert(passBlock != nil, @"the passBlock can't be nil");
+    NSMutableArray<NIGeneratorOperation *> *passOperations = [NSMutableArray array];
+    NIGeneratorOperation *finalPassOperation = [[self _newOperationForRequest:request volumeData:[self _volumeData:volumeData forRequest:request]] autorelease];
+
+    if (finalPassOperation.generatedVolume == nil) { // there is nothing to refine when the final volume is in the result cache
+        for (NIGeneratorRequest *passRequest in [self _coarsePassRequestsForRequest:request]) {
+            NIVolumeData *passVolumeData;
+            if ([passOperations count] == 0 && request.samplesMipLevels) { // the first pass samples one mip level coarser than the request resolves
+                passVolumeData = [volumeData volumeDataForMipLevel:[volumeData mipLevelForSampleSpacing:[passRequest sampleSpacing]] + 1];
+            } else {
+                passVolumeData = [self _volumeData:volumeData forRequest:passRequest];
+            }
+            NIGeneratorOperation *passOperation = [[self _newOperationForRequest:passRequest volumeData:passVolumeData] autorelease];
+            if ([passOperations count]) {
+                [passOperation addDependency:[passOperations lastObject]];
+            }
+            [passOperations addObject:passOperation];
+        }
+        if ([passOperations count]) {
+            [finalPassOperation addDependency:[passOperations lastObject]];
+        }
+    }
+    [passOperations addObject:finalPassOperation];
+
+    _NIGeneratorProgressiveOperation *operation = [[[_NIGeneratorProgressiveOperation alloc] initWithPassOperations:passOperations] autorelease];
+    NIGeneratorAsynchronousRequestID requestID = [self _generateRequestID];
+    [self _setOperation:operation forRequestID:requestID];
+    void (^passBlockCopy)(NIVolumeData *, NIGeneratorRequest *, BOOL) = [[passBlock copy] autorelease];
+    NSUInteger passCount = [passOperations count];
+    __block NSUInteger deliveredPassCount = 0; // guarded by synchronizing on the operation
+
+    [passOperations enumerateObjectsUsingBlock:^(NIGeneratorOperation *passOperation, NSUInteger passIndex, BOOL *stop) {
+        [passOperation setQualityOfService:qualityOfService];
+        [passOperation setCompletionBlock:^{
+            [self _cacheVolumeOfFinishedOperation:passOperation];
+            if (passIndex == passCount - 1 || passOperation.generatedVolume == nil || [passOperation isCancelled]) {
+                return; // the final pass is delivered by the progressive operation
+            }
+            // completion blocks don't run in the order the passes finish, so a pass that is late is dropped
+            @synchronized (operation) {
+                if (passIndex >= deliveredPassCount) {
+                    deliveredPassCount = passIndex + 1;
+                    passBlockCopy(passOperation.generatedVolume, passOperation.request, NO);
+                }
+            }
+        }];
+    }];
+    [operation setQualityOfService:qualityOfService];
+    [operation setCompletionBlock:^{
+        [self _removeOperationForRequestID:requestID];
+        @synchronized (operation) {
+            deliveredPassCount = passCount;
+            passBlockCopy(operation.generatedVolume, operation.request, YES);
+        }
+    }];
+
+    NSOperationQueue *operationQueue = qualityOfService == NSQualityOfServiceUserInteractive ? [self _userInteractiveRequestQueue] : [self _userInitiatedRequestQueue];
+    [operationQueue addOperations:[passOperations arrayByAddingObject:operation] waitUntilFinished:NO];
+
+    return requestID;
+}
+
 + (void)cancelAsynchronousRequest:(NIGeneratorAsynchronousRequestID)requestID
 {
     NSOperation *operation = [self _operationForRequestID:requestID];
@@ -269,7 +641,8 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
         }
     }
     
-    operation = [[[request operationClass] alloc] initWithRequest:[[request copy] autorelease] volumeData:_volumeData];
+    request = [[request copy] autorelease];
+    operation = [[self class] _newOperationForRequest:request volumeData:[[self class] _volumeData:_volumeData forRequest:request]];
     operation.qualityOfService = NSQualityOfServiceUserInitiated;
     [self retain]; // so that the generator can't disappear while the operation is running
     [operation addObserver:self forKeyPath:@"isFinished" options:0 context:&self->_generatorQueue];
@@ -330,6 +703,7 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
         [operation removeObserver:self forKeyPath:@"isFinished"];
         [self autorelease]; // to match the retain in -[NIGenerator requestVolume:]
         
+        [[self class] _cacheVolumeOfFinishedOperation:operation];
         volumeData = operation.generatedVolume;
         if (volumeData && [operation isCancelled] == NO && sentGeneratedVolume == NO) {
 			[_generatedFrameTimes addObject:[NSDate date]];
@@ -375,11 +749,97 @@ static volatile int64_t requestIDCount __attribute__ ((__aligned__(8))) = 0;
 
 @end
 
+@implementation NIGeneratorRequestStream
 
+@synthesize volumeData = _volumeData;
+@synthesize qualityOfService = _qualityOfService;
+@synthesize progressive = _progressive;
 
+- (instancetype)initWithVolumeData:(NIVolumeData *)volumeData qualityOfService:(NSQualityOfService)qualityOfService
+                   completionBlock:(void (^)(NIVolumeData * __nullable generatedVolume, NIGeneratorRequest *request))completionBlock
+{
+    NSAssert(volumeData != nil, @"the volumeData can't be nil");
+    NSAssert(completionBlock != nil, @"the completionBlock can't be nil");
 
+    if ( (self = [super init]) ) {
+        _volumeData = [volumeData retain];
+        _qualityOfService = qualityOfService;
+        _completionBlock = [completionBlock copy];
+    }
+    return self;
+}
 
+- (void)dealloc
+{
+    [_volumeData release];
+    _volumeData = nil;
+    [_completionBlock release];
+    _completionBlock = nil;
+    [super dealloc];
+}
+
+- (void)requestVolume:(NIGeneratorRequest *)request
+{
+    NSAssert(request != nil, @"the generator request can't be nil");
+    NIGeneratorAsynchronousRequestID supersededRequestID;
+    int64_t requestNumber;
+
+    request = [[request copy] autorelease];
+
+    @synchronized (self) {
+        supersededRequestID = _latestRequestID;
+        _latestRequestID = 0;
+        requestNumber = ++_latestRequestNumber;
+    }
+    if (supersededRequestID) {
+        [NIGenerator cancelAsynchronousRequest:supersededRequestID];
+    }
+
+    // the block retains the stream, so the stream lives until its last request finishes
+    void (^passBlock)(NIVolumeData *, NIGeneratorRequest *, BOOL) = ^(NIVolumeData *generatedVolume, NIGeneratorRequest *passRequest, BOOL finalPass) {
+        @synchronized (self) {
+            if (requestNumber != _latestRequestNumber) {
+                return;
+            }
+            if (finalPass) {
+                _latestRequestID = 0;
+            }
+        }
+        _completionBlock(generatedVolume, passRequest);
+    };
+    NIGeneratorAsynchronousRequestID requestID;
+    if (self.progressive) {
+        requestID = [NIGenerator asynchronousProgressiveRequestVolume:request volumeData:_volumeData qualityOfService:_qualityOfService passBlock:passBlock];
+    } else {
+        requestID = [NIGenerator asynchronousRequestVolume:request volumeData:_volumeData qualityOfService:_qualityOfService completionBlock:^(NIVolumeData *generatedVolume) {
+            passBlock(generatedVolume, request, YES);
+        }];
+    }
 
+    BOOL superseded;
+    @synchronized (self) {
+        superseded = requestNumber != _latestRequestNumber; // an even newer request was made while this one was being queued
+        if (superseded == NO) {
+            _latestRequestID = requestID; // if the request already finished, cancelling it later does nothing
+        }
+    }
+    if (superseded) {
+        [NIGenerator cancelAsynchronousRequest:requestID];
+    }
+}
 
+- (void)cancel
+{
+    NIGeneratorAsynchronousRequestID supersededRequestID;
 
+    @synchronized (self) {
+        supersededRequestID = _latestRequestID;
+        _latestRequestID = 0;
+        _latestRequestNumber++;
+    }
+    if (supersededRequestID) {
+        [NIGenerator cancelAsynchronousRequest:supersededRequestID];
+    }
+}
 
+@end
@@ -21,6 +21,9 @@
 
 #import "NIGeneratorOperation.h"
 #import "NIGeneratorOperationPrivate.h"
+#import "NIGeneratorRequest.h"
+#import "NIProjectionOperation.h"
+#import "NIVolumeData.h"
 
 @implementation NIGeneratorOperation
 
@@ -53,5 +56,72 @@
     return NO;
 }
 
+// the opacities of the table are those of a 1 mm thick layer, a layer that is sampleDistance thick lets through (1 - opacity)^sampleDistance
+- (NSData *)_opacitiesForSampleDistance:(CGFloat)sampleDistance opacityTableMin:(float *)opacityTableMin opacityTableMax:(float *)opacityTableMax
+{
+    const float *opacityTable;
+    NSUInteger opacityCount;
+    float *opacities;
+    float opacity;
+    NSUInteger i;
+
+    if ([_request.opacityTable length] >= sizeof(float)) {
+        opacityTable = [_request.opacityTable bytes];
+        opacityCount = [_request.opacityTable length] / sizeof(float);
+        *opacityTableMin = _request.opacityTableMin;
+        *opacityTableMax = _request.opacityTableMax;
+    } else {
+        opacityTable = NIProjectionDefaultOpacities;
+        opacityCount = sizeof(NIProjectionDefaultOpacities) / sizeof(float);
+        *opacityTableMin = _volumeData.intensityMin;
+        *opacityTableMax = _volumeData.intensityMax;
+    }
+
+    opacities = malloc(opacityCount * sizeof(float));
+    for (i = 0; i < opacityCount; i++) {
+        opacity = MIN(MAX(opacityTable[i], 0), 1);
+        opacities[i] = opacity == 1 ? 1 : 1.0f - powf(1.0f - opacity, (float)sampleDistance);
+    }
+
+    return [NSData dataWithBytesNoCopy:opacities length:opacityCount * sizeof(float) freeWhenDone:YES];
+}
+
+// the points of a curved slab are vectors + normals*y + slabNormals*z, with y and z out to (pixelsHigh - 1)/2 and (pixelsDeep - 1)/2 on both sides of the vectors. For
+// compressed volumes the fill operations sample the bricks around those points rather than the full decompressed copy, B-spline slabs sample the coefficients of the
+// whole volume, which are built once, so they keep the whole volume
+- (NIVolumeData *)_samplingVolumeDataWithVectors:(NIVectorArray)vectors normals:(NIVectorArray)normals slabNormals:(NIVectorArray)slabNormals vectorCount:(NSUInteger)vectorCount
+                                      pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+{
+    NIAffineTransform modelToVoxelTransform = _volumeData.modelToVoxelTransform;
+    CGFloat fillDistance = ((CGFloat)pixelsHigh - 1.0)/2.0;
+    CGFloat slabDistance = ((CGFloat)pixelsDeep - 1.0)/2.0;
+    NIVector volumeMin = NIVectorMake(CGFLOAT_MAX, CGFLOAT_MAX, CGFLOAT_MAX);
+    NIVector volumeMax = NIVectorMake(-CGFLOAT_MAX, -CGFLOAT_MAX, -CGFLOAT_MAX);
+    NIVector corner;
+    NSUInteger i;
+    NSInteger j;
+
+    if (_volumeData.compressedBrickSize == 0 || _request.interpolationMode == NIInterpolationModeCubicBSpline) {
+        return _volumeData;
+    }
+    if (vectorCount == 0) { // compressed volumes can't hand out an inline buffer, so even an empty fill gets a sampling volume
+        return [_volumeData volumeDataForSamplingFromVolumeVector:NIVectorZero toVolumeVector:NIVectorZero];
+    }
+
+    for (i = 0; i < vectorCount; i++) {
+        for (j = 0; j < 4; j++) {
+            corner = NIVectorAdd(vectors[i], NIVectorScalarMultiply(normals[i], (j & 1) ? fillDistance : -fillDistance));
+            if (slabNormals) {
+                corner = NIVectorAdd(corner, NIVectorScalarMultiply(slabNormals[i], (j & 2) ? slabDistance : -slabDistance));
+            }
+            corner = NIVectorApplyTransform(corner, modelToVoxelTransform);
+            volumeMin = NIVectorMake(MIN(volumeMin.x, corner.x), MIN(volumeMin.y, corner.y), MIN(volumeMin.z, corner.z));
+            volumeMax = NIVectorMake(MAX(volumeMax.x, corner.x), MAX(volumeMax.y, corner.y), MAX(volumeMax.z, corner.z));
+        }
+    }
+
+    return [_volumeData volumeDataForSamplingFromVolumeVector:volumeMin toVolumeVector:volumeMax];
+}
+
 
 @end
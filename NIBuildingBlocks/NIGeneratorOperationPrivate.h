@@ -29,10 +29,15 @@
 
 @interface NIGeneratorOperation ()
 @property (readwrite, retain) NIVolumeData *generatedVolume;
-@end
 
-@interface NIObliqueSliceOperation ()
-+ (NSOperationQueue *)_fillQueueForQualityOfService:(NSQualityOfService)qualityOfService;
+// the opacities of NIProjectionModeVR for slices that are sampleDistance apart, made from the opacity table of the request or from the default ramp over the
+// intensities of the volume, the range the opacities are spread over is returned in opacityTableMin and opacityTableMax
+- (NSData *)_opacitiesForSampleDistance:(CGFloat)sampleDistance opacityTableMin:(float *)opacityTableMin opacityTableMax:(float *)opacityTableMax;
+
+// the volume that the fill operations of a curved slab sample, the slab is filled from the vectors out to (pixelsHigh - 1)/2 normals and (pixelsDeep - 1)/2 slabNormals
+// on both sides. For compressed volumes it only holds the decompressed bricks around the slab, slabNormals can be NULL for slabs that are one slice deep
+- (NIVolumeData *)_samplingVolumeDataWithVectors:(NIVectorArray)vectors normals:(NIVectorArray)normals slabNormals:(NIVectorArray)slabNormals vectorCount:(NSUInteger)vectorCount
+                                      pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep;
 @end
 
 #endif /* _NIGENERATOROPERATIONPRIVATE_H_ */
@@ -49,7 +49,24 @@ typedef NS_ENUM(NSInteger, NIProjectionMode)
  Mean intensity projection
 */
     NIProjectionModeMean,
-    NIProjectionModeVR, // don't use this, it is not implemented
+/**
+ Volume rendering, the slices of the slab are composited front to back with the opacities of the opacityTable of the request.
+*/
+    NIProjectionModeVR,
+/**
+ Sum of the intensities through the slab, a digitally reconstructed radiograph when the intensities are attenuations.
+*/
+    NIProjectionModeSum,
+/**
+ Standard deviation of the intensities through the slab.
+*/
+    NIProjectionModeStandardDeviation,
+/**
+ Maximum intensity projection in the first slice of the generated volume. The second slice holds, for each pixel, the index of the slice of the slab
+ where the maximum was found, 0 being the front of the slab, so that the point under the mouse can be found without casting another ray. When several slices
+ reach the maximum, the frontmost one is kept.
+*/
+    NIProjectionModeMIPWithDepth,
 
 };
 
@@ -67,6 +84,15 @@ typedef NS_ENUM(NSInteger, NIProjectionMode)
 
     NIInterpolationMode _interpolationMode;
 
+    float _projectionThresholdMin;
+    float _projectionThresholdMax;
+
+    NSData *_opacityTable;
+    float _opacityTableMin;
+    float _opacityTableMax;
+
+    BOOL _samplesMipLevels;
+
     void *_context;
 }
 
@@ -82,6 +108,22 @@ typedef NS_ENUM(NSInteger, NIProjectionMode)
 
 @property (nonatomic, readwrite, assign) NIInterpolationMode interpolationMode;
 
+// the window of intensities that a MIP or MinIP of the slab is clamped to, -INFINITY and INFINITY by default. The parts of the slab that are entirely outside
+// the window can't change the clamped projection, so they are not sampled. Values outside the window are still sampled when the projection mode is not MIP or MinIP
+@property (nonatomic, readwrite, assign) float projectionThresholdMin;
+@property (nonatomic, readwrite, assign) float projectionThresholdMax;
+
+// the opacity transfer function of NIProjectionModeVR, an array of floats that are the opacities of a 1 mm thick layer of the intensities spread evenly from
+// opacityTableMin to opacityTableMax, intensities outside the range take the opacity at the nearest end. If this is nil, which is the default, the opacity goes
+// from 0 at the volume's intensityMin to 1 at its intensityMax. The composited intensities are colored with the CLUT like the intensities of any other image
+@property (nonatomic, readwrite, copy) NSData *opacityTable;
+@property (nonatomic, readwrite, assign) float opacityTableMin;
+@property (nonatomic, readwrite, assign) float opacityTableMax;
+
+// if YES, NIGenerator samples the coarsest level of the volume's mip pyramid that still resolves the sampleSpacing of the request, and blocks while that level is
+// built the first time it is needed. NO by default, so that the full resolution volume is sampled
+@property (nonatomic, readwrite, assign) BOOL samplesMipLevels;
+
 @property (nonatomic, readwrite, assign) void *context;
 
 - (BOOL)isEqual:(id)object;
@@ -96,6 +138,10 @@ typedef NS_ENUM(NSInteger, NIProjectionMode)
 
 - (Class)operationClass; // must be a subclass of NIGeneratorOperation 
 
+// the smallest distance in mm between neighboring samples of the request, when samplesMipLevels is YES NIGenerator uses it to sample the coarsest mip level of the
+// volume that still resolves the samples. 0 means that the full resolution volume is always used
+- (CGFloat)sampleSpacing;
+
 @end
 
 
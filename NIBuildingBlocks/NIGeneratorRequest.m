@@ -26,6 +26,45 @@
 #import "NIObliqueSliceOperation.h"
 #import "NIVTKObliqueSliceOperation.h"
 
+// The hashes mix every property that isEqual: compares, so that requests that differ only by a small move of the plane or a different projection still land in
+// different buckets of the dictionaries that cache generated volumes.
+static NSUInteger NIGeneratorRequestHashMix(NSUInteger hash, NSUInteger value)
+{
+    return hash ^ (value + (NSUInteger)0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+}
+
+static NSUInteger NIGeneratorRequestHashMixDouble(NSUInteger hash, double value)
+{
+    uint64_t bits;
+    if (value == 0) { // 0 and -0 are equal so they must hash the same
+        value = 0;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return NIGeneratorRequestHashMix(hash, (NSUInteger)(bits ^ (bits >> 32)));
+}
+
+static NSUInteger NIGeneratorRequestHashMixVector(NSUInteger hash, NIVector vector)
+{
+    hash = NIGeneratorRequestHashMixDouble(hash, vector.x);
+    hash = NIGeneratorRequestHashMixDouble(hash, vector.y);
+    return NIGeneratorRequestHashMixDouble(hash, vector.z);
+}
+
+static NSUInteger NIGeneratorRequestHashMixBezierPath(NSUInteger hash, NIBezierPath *bezierPath)
+{
+    NSInteger elementCount = [bezierPath elementCount];
+    NIVector endpoint;
+
+    hash = NIGeneratorRequestHashMix(hash, (NSUInteger)elementCount);
+    if (elementCount > 0) {
+        [bezierPath elementAtIndex:0 control1:NULL control2:NULL endpoint:&endpoint];
+        hash = NIGeneratorRequestHashMixVector(hash, endpoint);
+        [bezierPath elementAtIndex:elementCount - 1 control1:NULL control2:NULL endpoint:&endpoint];
+        hash = NIGeneratorRequestHashMixVector(hash, endpoint);
+    }
+    return hash;
+}
+
 @implementation NIGeneratorRequest
 
 @synthesize pixelsWide = _pixelsWide;
@@ -33,15 +72,31 @@
 @synthesize slabWidth = _slabWidth;
 @synthesize slabSampleDistance = _slabSampleDistance;
 @synthesize interpolationMode = _interpolationMode;
+@synthesize projectionThresholdMin = _projectionThresholdMin;
+@synthesize projectionThresholdMax = _projectionThresholdMax;
+@synthesize opacityTable = _opacityTable;
+@synthesize opacityTableMin = _opacityTableMin;
+@synthesize opacityTableMax = _opacityTableMax;
+@synthesize samplesMipLevels = _samplesMipLevels;
 @synthesize context = _context;
 
 - (id)init
 {
     if ( (self = [super init]) ) {
+        _projectionThresholdMin = -INFINITY;
+        _projectionThresholdMax = INFINITY;
     }
     return self;
 }
 
+- (void)dealloc
+{
+    [_opacityTable release];
+    _opacityTable = nil;
+
+    [super dealloc];
+}
+
 - (id)copyWithZone:(NSZone *)zone
 {
     NIGeneratorRequest *copy;
@@ -52,6 +107,12 @@
     copy.slabWidth = _slabWidth;
     copy.slabSampleDistance = _slabSampleDistance;
     copy.interpolationMode = _interpolationMode;
+    copy.projectionThresholdMin = _projectionThresholdMin;
+    copy.projectionThresholdMax = _projectionThresholdMax;
+    copy.opacityTable = _opacityTable;
+    copy.opacityTableMin = _opacityTableMin;
+    copy.opacityTableMax = _opacityTableMax;
+    copy.samplesMipLevels = _samplesMipLevels;
     copy.context = _context;
 
     return copy;
@@ -67,6 +128,12 @@
             _slabWidth == generatorRequest.slabWidth &&
             _slabSampleDistance == generatorRequest.slabSampleDistance &&
             _interpolationMode == generatorRequest.interpolationMode &&
+            _projectionThresholdMin == generatorRequest.projectionThresholdMin &&
+            _projectionThresholdMax == generatorRequest.projectionThresholdMax &&
+            (_opacityTable == generatorRequest.opacityTable || [_opacityTable isEqualToData:generatorRequest.opacityTable]) &&
+            _opacityTableMin == generatorRequest.opacityTableMin &&
+            _opacityTableMax == generatorRequest.opacityTableMax &&
+            _samplesMipLevels == generatorRequest.samplesMipLevels &&
             _context == generatorRequest.context) {
             return YES;
         }
@@ -76,7 +143,18 @@
 
 - (NSUInteger)hash
 {
-    return _pixelsWide ^ _pixelsHigh ^ *((NSUInteger *)&_slabWidth) ^ *((NSUInteger *)&_slabSampleDistance) ^ *((NSUInteger *)&_interpolationMode) ^ ((NSUInteger)_context);
+    NSUInteger hash = NIGeneratorRequestHashMix(0, _pixelsWide);
+    hash = NIGeneratorRequestHashMix(hash, _pixelsHigh);
+    hash = NIGeneratorRequestHashMixDouble(hash, _slabWidth);
+    hash = NIGeneratorRequestHashMixDouble(hash, _slabSampleDistance);
+    hash = NIGeneratorRequestHashMix(hash, (NSUInteger)_interpolationMode);
+    hash = NIGeneratorRequestHashMixDouble(hash, _projectionThresholdMin);
+    hash = NIGeneratorRequestHashMixDouble(hash, _projectionThresholdMax);
+    hash = NIGeneratorRequestHashMix(hash, [_opacityTable hash]);
+    hash = NIGeneratorRequestHashMixDouble(hash, _opacityTableMin);
+    hash = NIGeneratorRequestHashMixDouble(hash, _opacityTableMax);
+    hash = NIGeneratorRequestHashMix(hash, (NSUInteger)_samplesMipLevels);
+    return NIGeneratorRequestHashMix(hash, (NSUInteger)_context);
 }
 
 - (Class)operationClass
@@ -84,6 +162,11 @@
     return nil;
 }
 
+- (CGFloat)sampleSpacing
+{
+    return 0;
+}
+
 - (instancetype)interpolateBetween:(NIGeneratorRequest *)rightRequest withWeight:(CGFloat)weight
 {
     if (weight < 0.5) {
@@ -182,9 +265,11 @@
     return NO;
 }
 
-- (NSUInteger)hash // a not that great hash function....
+- (NSUInteger)hash
 {
-    return [super hash] ^ [_bezierPath hash] ^ (NSUInteger)NIVectorLength(_initialNormal) ^ (NSUInteger)_projectionMode /* ^ (NSUInteger)_vertical */;
+    NSUInteger hash = NIGeneratorRequestHashMixBezierPath([super hash], _bezierPath);
+    hash = NIGeneratorRequestHashMixVector(hash, _initialNormal);
+    return NIGeneratorRequestHashMix(hash, (NSUInteger)_projectionMode);
 }
 
 
@@ -248,9 +333,12 @@
     return NO;
 }
 
-- (NSUInteger)hash // a not that great hash function....
+- (NSUInteger)hash
 {
-    return [super hash] ^ [_bezierPath hash] ^ (NSUInteger)NIVectorLength(_projectionNormal) ^ (NSUInteger)NIVectorLength(_midHeightPoint) ^ (NSUInteger)_projectionMode;
+    NSUInteger hash = NIGeneratorRequestHashMixBezierPath([super hash], _bezierPath);
+    hash = NIGeneratorRequestHashMixVector(hash, _projectionNormal);
+    hash = NIGeneratorRequestHashMixVector(hash, _midHeightPoint);
+    return NIGeneratorRequestHashMix(hash, (NSUInteger)_projectionMode);
 }
 
 
@@ -361,6 +449,17 @@
     return NO;
 }
 
+- (NSUInteger)hash
+{
+    NSUInteger hash = NIGeneratorRequestHashMixVector([super hash], _origin);
+    hash = NIGeneratorRequestHashMixVector(hash, _directionX);
+    hash = NIGeneratorRequestHashMixVector(hash, _directionY);
+    hash = NIGeneratorRequestHashMixVector(hash, _directionZ);
+    hash = NIGeneratorRequestHashMixDouble(hash, _pixelSpacingX);
+    hash = NIGeneratorRequestHashMixDouble(hash, _pixelSpacingY);
+    return NIGeneratorRequestHashMix(hash, (NSUInteger)_projectionMode);
+}
+
 - (instancetype)interpolateBetween:(NIGeneratorRequest *)rightRequest withWeight:(CGFloat)weight
 {
     if ([rightRequest isKindOfClass:[NIObliqueSliceGeneratorRequest class]] == NO) {
@@ -445,6 +544,17 @@
     return [NIObliqueSliceOperation class];
 }
 
+- (CGFloat)sampleSpacing
+{
+    CGFloat sampleSpacing = MIN(_pixelSpacingX, _pixelSpacingY);
+
+    // a slabSampleDistance of 0 is picked by the operation from the volume it samples, so it follows the mip level
+    if (self.slabWidth != 0 && self.slabSampleDistance != 0) {
+        sampleSpacing = MIN(sampleSpacing, self.slabSampleDistance);
+    }
+    return sampleSpacing;
+}
+
 - (void)setPixelSpacingZ:(CGFloat)pixelSpacingZ
 {
     [self setSlabSampleDistance:pixelSpacingZ];
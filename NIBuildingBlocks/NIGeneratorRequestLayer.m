@@ -50,6 +50,7 @@
 
 - (void)_updateCubicTimer;
 - (void)_updateCubic;
+- (NIInterpolationMode)_cubicInterpolationMode; // the interpolation mode used to refine the image once the layer has settled
 
 
 @end
@@ -269,21 +270,30 @@
 
     NIGeneratorRequest *cubicRequest = [[self.presentedGeneratorRequest copy] autorelease];
     if (cubicRequest) {
-        cubicRequest.interpolationMode = NIInterpolationModeCubic;
+        cubicRequest.interpolationMode = [self _cubicInterpolationMode];
         [_cubicGenerator requestVolume:cubicRequest];
     }
 }
 
+- (NIInterpolationMode)_cubicInterpolationMode
+{
+    NIInterpolationMode interpolationMode = self.preferredInterpolationMode;
+    if (interpolationMode == NIInterpolationModeNone) {
+        interpolationMode = self.generatorRequest.interpolationMode;
+    }
+    return interpolationMode == NIInterpolationModeCubicBSpline ? NIInterpolationModeCubicBSpline : NIInterpolationModeCubic;
+}
+
 - (void)drawInCGLContext:(CGLContextObj)cgl_ctx pixelFormat:(CGLPixelFormatObj)pixelFormat forLayerTime:(CFTimeInterval)timeInterval displayTime:(const CVTimeStamp *)timeStamp
 {
     NIGeneratorRequestLayer *presentationLayer = [self presentationLayer];
     NIGeneratorRequestLayer *modelLayer = [self modelLayer];
 
     NIInterpolationMode liveInterpolationMode = modelLayer.generatorRequest.interpolationMode == NIInterpolationModeNearestNeighbor ? NIInterpolationModeNearestNeighbor : NIInterpolationModeLinear;
-    BOOL buildCubic = modelLayer.generatorRequest.interpolationMode == NIInterpolationModeCubic;
+    BOOL buildCubic = modelLayer.generatorRequest.interpolationMode == NIInterpolationModeCubic || modelLayer.generatorRequest.interpolationMode == NIInterpolationModeCubicBSpline;
     if (self.preferredInterpolationMode != NIInterpolationModeNone) {
         liveInterpolationMode = self.preferredInterpolationMode == NIInterpolationModeNearestNeighbor ? NIInterpolationModeNearestNeighbor : NIInterpolationModeLinear;
-        buildCubic = self.preferredInterpolationMode == NIInterpolationModeCubic;
+        buildCubic = self.preferredInterpolationMode == NIInterpolationModeCubic || self.preferredInterpolationMode == NIInterpolationModeCubicBSpline;
     }
 
     if (self.preferredInterpolationMode == NIInterpolationModeNearestNeighbor) {
@@ -321,7 +331,7 @@
     NIFloatImageRep *floatImageRepToDraw = nil;
 
     NIGeneratorRequest *cubicRequestToDraw = [[requestToDraw copy] autorelease];
-    cubicRequestToDraw.interpolationMode = NIInterpolationModeCubic;
+    cubicRequestToDraw.interpolationMode = [modelLayer _cubicInterpolationMode];
 
     if (buildCubic && [cubicRequestToDraw isEqual:modelLayer.presentedGeneratorRequest]) {
         floatImageRepToDraw = modelLayer.presentedFloatImageRep;
@@ -25,38 +25,113 @@
 #import <Cocoa/Cocoa.h>
 #import "NIGeometry.h"
 #import "NIVolumeData.h"
+#import "NIGeneratorRequest.h"
 
 @class NIVolumeData;
 
 // This operation will fill out floatBytes from the given data. FloatBytes is assumed to be tightly packed float image of width "width" and height "height"
 // float bytes will be filled in with values at vectors and each successive scan line will be filled with with values at vector+normal*scanlineNumber
+// When the sampled points are an affine grid, the operation can instead be given the start point and the steps along and between scan lines in voxel space,
+// in which case the points are generated as the scan lines are filled and no per point arrays are allocated or transformed.
+// When the operation is given a slab, every slice of the slab is sampled scan line by scan line and reduced into floatBytes with the projection mode, so the slab
+// is never stored. For MIP and MinIP, spans of the scan lines that the min/max grid of the volume shows can't change the projection are not sampled.
+// For VR the slices are composited front to back, and spans whose rays are already opaque, or that the min/max grid shows are transparent, are not sampled.
 @interface NIHorizontalFillOperation : NSOperation {
     NIVolumeData *_volumeData;
 
     float *_floatBytes;
+    float *_depthFloatBytes;
     NSUInteger _width;
     NSUInteger _height;
+    NSUInteger _rowStride;
 
     NIVectorArray _vectors;
     NIVectorArray _normals;
+    NIVectorArray _slabNormals;
+
+    NIVector _volumeStart;
+    NIVector _volumeXStep;
+    NIVector _volumeYStep;
+    NIVector _volumeSlabStep;
+
+    NSUInteger _slabDepth;
 
     NIInterpolationMode _interpolationMode;
+
+    NIProjectionMode _projectionMode;
+    float _projectionThresholdMin;
+    float _projectionThresholdMax;
+    NIVolumeData *_boundingVolumeData;
+
+    NSData *_opacities;
+    float _opacityTableMin;
+    float _opacityTableMax;
 }
 
 // vectors and normals need to be arrays of length width
 - (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height vectors:(NIVectorArray)vectors normals:(NIVectorArray)normals;
+// the value at (x, y) in floatBytes is sampled at volumeStart + x*volumeXStep + y*volumeYStep in the voxel space of volumeData
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height
+             volumeStart:(NIVector)volumeStart volumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep;
+
+// the vectors are in the middle of the slab, the slab's values are sampled at vector+normal*scanlineNumber+slabNormal*(z - (slabDepth-1)/2) for z from 0 to slabDepth-1
+// and reduced into floatBytes with the projection mode, which can be any mode but NIProjectionModeNone. slabNormals is an array of length width
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height vectors:(NIVectorArray)vectors normals:(NIVectorArray)normals
+             slabNormals:(NIVectorArray)slabNormals slabDepth:(NSUInteger)slabDepth projectionMode:(NIProjectionMode)projectionMode;
+// the slab's values are sampled at volumeStart + x*volumeXStep + y*volumeYStep + (z - (slabDepth-1)/2)*volumeSlabStep in the voxel space of volumeData
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height
+             volumeStart:(NIVector)volumeStart volumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep volumeSlabStep:(NIVector)volumeSlabStep slabDepth:(NSUInteger)slabDepth
+          projectionMode:(NIProjectionMode)projectionMode;
 
 @property (readonly, retain) NIVolumeData *volumeData;
 
 @property (readonly, assign) float *floatBytes;
 @property (readonly, assign) NSUInteger width;
 @property (readonly, assign) NSUInteger height;
+@property (readwrite, assign) NSUInteger rowStride; // the number of floats from a row of floatBytes and depthFloatBytes to the next, width by default. Set it to fill a tile of a wider image
 
 @property (readonly, assign) NIVectorArray vectors;
 @property (readonly, assign) NIVectorArray normals;
+@property (readonly, assign) NIVectorArray slabNormals; // NULL if the operation fills a single slice
+
+@property (readonly, assign) NIVector volumeStart; // only valid for operations initialized with a start point and steps, vectors and normals are NULL for those operations
+@property (readonly, assign) NIVector volumeXStep;
+@property (readonly, assign) NIVector volumeYStep;
+@property (readonly, assign) NIVector volumeSlabStep;
+
+@property (readonly, assign) NSUInteger slabDepth; // 1 if the operation fills a single slice
 
 @property (readonly, assign) NIInterpolationMode interpolationMode; // YES by default
 
+@property (readonly, assign) NIProjectionMode projectionMode; // NIProjectionModeNone if the operation fills a single slice
+// spans are only skipped for MIP and MinIP projections with nearest neighbor or linear interpolation, the bounds of the min/max grid don't hold for cubic interpolation
+@property (readwrite, assign) float projectionThresholdMin; // the window a MIP or MinIP is clamped to, -INFINITY and INFINITY by default
+@property (readwrite, assign) float projectionThresholdMax;
+@property (readwrite, retain) NIVolumeData *boundingVolumeData; // the volume whose min/max grid bounds the samples, its voxels can only be translated from those of volumeData. nil to use volumeData
+
+// the opacities of one slice for NIProjectionModeVR, see NIProjectionCompositeSlice(). The slice at z = 0 is the front of the slab
+@property (readwrite, retain) NSData *opacities;
+@property (readwrite, assign) float opacityTableMin;
+@property (readwrite, assign) float opacityTableMax;
+
+// for NIProjectionModeMIPWithDepth, the index in the slab of the slice of each maximum is written in this tightly packed width by height image
+@property (readwrite, assign) float *depthFloatBytes;
+
+// Runs the fill operations in parallel and returns once they are all done, the operations are never added to a queue and can't be observed. Each worker of the
+// global queue of the quality of service starts on its own run of consecutive operations, so that neighbouring bands share the cache, and steals operations
+// from the end of the other workers' runs once its own run is done. Operations that are cancelled before they are reached are skipped.
++ (void)runFillOperations:(NSArray<NIHorizontalFillOperation *> *)fillOperations qualityOfService:(NSQualityOfService)qualityOfService;
+
+// Chooses the size of the tiles a pixelsWide by pixelsHigh image is split into when every tile samples slabDepth slices. The tiles are as wide as the image unless
+// the voxels that one row of samples touches across the slab, given the footprint of the interpolation, would not stay in the L2 cache of a core until the next
+// row is sampled, in which case the image is split in columns that are a multiple of the span length wide. The rows are then split so that there are a few tiles
+// per core for the scheduler to balance, without making the tiles taller than they are wide or so small that their setup costs more than their samples.
++ (void)getTileWidth:(NSUInteger *)tileWidth tileHeight:(NSUInteger *)tileHeight forPixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh
+           slabDepth:(NSUInteger)slabDepth interpolationMode:(NIInterpolationMode)interpolationMode;
+// Forces the size of the tiles returned by getTileWidth:tileHeight:forPixelsWide:pixelsHigh:slabDepth:interpolationMode:, to benchmark tile shapes. The size is
+// clamped to the image, and a width or height of 0 lets that dimension be chosen at runtime again
++ (void)setOverrideTileWidth:(NSUInteger)tileWidth tileHeight:(NSUInteger)tileHeight;
+
 @end
 
 #endif /* _NIHORIZONTALFILLOPERATION_H_ */
@@ -22,13 +22,243 @@
 #import "NIHorizontalFillOperation.h"
 #import "NIVolumeData.h"
 #import "NIGeometry.h"
+#import "NIProjectionOperation.h"
+#include <Accelerate/Accelerate.h>
+#include <libkern/OSAtomic.h>
+#include <sys/sysctl.h>
+
+typedef void (*NIHorizontalFillSampler)(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                        float *outputValues, NSUInteger numCoordinates);
+
+static const NSUInteger NIHorizontalFillSpanLength = 16; // the number of values of a scan line that are skipped or sampled together
+static const NSUInteger NIHorizontalFillMinimumTilePixels = 2048; // below this the setup of a tile costs about as much as filling it
+static const NSUInteger NIHorizontalFillTilesPerCore = 4; // enough tiles for the workers to even out tiles that skip spans and tiles that don't
+
+static volatile NSUInteger NIHorizontalFillOverrideTileWidth = 0;
+static volatile NSUInteger NIHorizontalFillOverrideTileHeight = 0;
+
+// the bytes of L2 cache one core can count on, for the cores that share an L2 cluster the cache is split between them
+static NSUInteger NIHorizontalFillCoreCacheBytes()
+{
+    static dispatch_once_t pred;
+    static NSUInteger coreCacheBytes = 256 * 1024;
+    dispatch_once(&pred, ^{
+        uint64_t cacheBytes = 0;
+        uint32_t coresPerCache = 0;
+        size_t length = sizeof(cacheBytes);
+        if (sysctlbyname("hw.perflevel0.l2cachesize", &cacheBytes, &length, NULL, 0) != 0 || cacheBytes == 0) {
+            length = sizeof(cacheBytes);
+            if (sysctlbyname("hw.l2cachesize", &cacheBytes, &length, NULL, 0) != 0) {
+                cacheBytes = 0;
+            }
+        }
+        length = sizeof(coresPerCache);
+        if (sysctlbyname("hw.perflevel0.cpusperl2", &coresPerCache, &length, NULL, 0) != 0 || coresPerCache == 0) {
+            coresPerCache = 1;
+        }
+        if (cacheBytes > 0) {
+            coreCacheBytes = (NSUInteger)(cacheBytes / coresPerCache);
+        }
+    });
+    return coreCacheBytes;
+}
+
+// the number of voxels along each axis that the samples of the interpolation mode read around a sample point
+static NSUInteger NIHorizontalFillInterpolationFootprint(NIInterpolationMode interpolationMode)
+{
+    switch (interpolationMode) {
+        case NIInterpolationModeNearestNeighbor:
+            return 1;
+        case NIInterpolationModeLinear:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+// the operations a worker of +[NIHorizontalFillOperation runFillOperations:qualityOfService:] has left to run, the next one in the low 32 bits and the end of the
+// run in the high 32 bits so that the worker and the thieves can both take an operation with a single compare and swap. Padded to a cache line.
+typedef struct {
+    volatile int64_t run __attribute__ ((aligned (64)));
+} NIHorizontalFillWorkerRun;
+
+static int64_t NIHorizontalFillMakeRun(uint32_t next, uint32_t end)
+{
+    return (int64_t)(((uint64_t)end << 32) | next);
+}
+
+// takes the next operation of the worker's own run, or else steals the last operation of another worker's run. Returns NO once every run is empty
+static BOOL NIHorizontalFillTakeOperation(NIHorizontalFillWorkerRun *workerRuns, NSUInteger workerCount, NSUInteger worker, NSUInteger *operationIndex)
+{
+    NSUInteger i;
+    int64_t run;
+    uint32_t next;
+    uint32_t end;
+
+    for (i = 0; i < workerCount; i++) {
+        NIHorizontalFillWorkerRun *workerRun = workerRuns + ((worker + i) % workerCount);
+        while (1) {
+            run = workerRun->run;
+            next = (uint32_t)run;
+            end = (uint32_t)((uint64_t)run >> 32);
+            if (next >= end) {
+                break;
+            }
+            if (i == 0) {
+                if (OSAtomicCompareAndSwap64Barrier(run, NIHorizontalFillMakeRun(next + 1, end), &workerRun->run)) {
+                    *operationIndex = next;
+                    return YES;
+                }
+            } else {
+                if (OSAtomicCompareAndSwap64Barrier(run, NIHorizontalFillMakeRun(next, end - 1), &workerRun->run)) {
+                    *operationIndex = end - 1;
+                    return YES;
+                }
+            }
+        }
+    }
+    return NO;
+}
+
+// Returns YES and fills the span if none of the values that can be sampled in the box can change the MIP or MinIP of the slab once it is clamped to the threshold window.
+// projectedValues are the projection of the slices of the slab that were already sampled, or NULL. The fill value never wins over the values that are sampled.
+static BOOL NIHorizontalFillSkipSpan(const NIVolumeDataMinMaxGrid *minMaxGrid, NIVector minVolumeVector, NIVector maxVolumeVector, NIProjectionMode projectionMode,
+                                     const float *projectedValues, float thresholdMin, float thresholdMax, float *values, NSUInteger length)
+{
+    float boundsMin;
+    float boundsMax;
+    float projectedValue;
+    float fillValue;
+
+    NIVolumeDataMinMaxGridGetBounds(minMaxGrid, minVolumeVector, maxVolumeVector, &boundsMin, &boundsMax);
+
+    if (projectionMode == NIProjectionModeMIP) {
+        if (boundsMin >= thresholdMax) { // every value is clamped to the top of the window, which the projection can't exceed
+            fillValue = thresholdMax;
+        } else if (boundsMax <= thresholdMin) {
+            fillValue = thresholdMin;
+        } else if (projectedValues) {
+            vDSP_minv(projectedValues, 1, &projectedValue, length);
+            if (boundsMax > projectedValue) {
+                return NO;
+            }
+            fillValue = boundsMax;
+        } else {
+            return NO;
+        }
+    } else {
+        if (boundsMax <= thresholdMin) {
+            fillValue = thresholdMin;
+        } else if (boundsMin >= thresholdMax) {
+            fillValue = thresholdMax;
+        } else if (projectedValues) {
+            vDSP_maxv(projectedValues, 1, &projectedValue, length);
+            if (boundsMin < projectedValue) {
+                return NO;
+            }
+            fillValue = boundsMin;
+        } else {
+            return NO;
+        }
+    }
+
+    vDSP_vfill(&fillValue, values, 1, length);
+    return YES;
+}
+
+// Returns YES and fills the span if the composited rays of the span are already opaque, in which case their transmittances are set to 0 so that the fill value
+// adds nothing to them, or if the min/max grid shows that every value that can be sampled in the box is transparent. minMaxGrid is NULL if its bounds don't hold.
+static BOOL NIHorizontalFillSkipCompositedSpan(const NIVolumeDataMinMaxGrid *minMaxGrid, NIVector minVolumeVector, NIVector maxVolumeVector, const float *opacities, NSUInteger opacityCount,
+                                               float opacityTableMin, float opacityTableMax, float *transmittances, float *values, NSUInteger length)
+{
+    float maxTransmittance;
+    float boundsMin;
+    float boundsMax;
+    float scale;
+    float firstIndex;
+    float lastIndex;
+    float maxOpacity;
+
+    vDSP_maxv(transmittances, 1, &maxTransmittance, length);
+    if (maxTransmittance < NIProjectionOpaqueTransmittance) {
+        vDSP_vclr(transmittances, 1, length);
+        vDSP_vclr(values, 1, length);
+        return YES;
+    }
+
+    if (minMaxGrid == NULL) {
+        return NO;
+    }
+
+    if (opacityCount == 0) {
+        opacities = NIProjectionDefaultOpacities;
+        opacityCount = sizeof(NIProjectionDefaultOpacities) / sizeof(float);
+    }
+
+    // the same mapping as NIProjectionCompositeSlice(), widened to whole entries of the table since the opacities are interpolated between them
+    NIVolumeDataMinMaxGridGetBounds(minMaxGrid, minVolumeVector, maxVolumeVector, &boundsMin, &boundsMax);
+    scale = opacityTableMax > opacityTableMin ? (float)(opacityCount - 1) / (opacityTableMax - opacityTableMin) : 0;
+    firstIndex = MIN(MAX(floorf((boundsMin - opacityTableMin) * scale), 0), (float)(opacityCount - 1));
+    lastIndex = MIN(MAX(ceilf((boundsMax - opacityTableMin) * scale), 0), (float)(opacityCount - 1));
+    vDSP_maxv(opacities + (NSUInteger)firstIndex, 1, &maxOpacity, (NSUInteger)lastIndex - (NSUInteger)firstIndex + 1);
+    if (maxOpacity > 0) {
+        return NO;
+    }
+
+    vDSP_vfill(&boundsMin, values, 1, length);
+    return YES;
+}
+
+// the slices of a slab are sampled starting from the middle one, which is the most likely to hold the structure the slab is centered on, so that
+// more spans of the other slices can be skipped. VR composites the slices front to back, and MIPWithDepth keeps the depth of the first slice that reaches the
+// maximum, the frontmost one like NIProjectionOperation does, so both are sampled in order.
+// Returns the offset from the middle of the slab, in slices, of the sliceIndex'th slice that is sampled
+static CGFloat NIHorizontalFillSliceOffset(NSUInteger sliceIndex, NSUInteger slabDepth, NIProjectionMode projectionMode)
+{
+    NSUInteger z = projectionMode == NIProjectionModeVR || projectionMode == NIProjectionModeMIPWithDepth ? sliceIndex : ((slabDepth - 1) / 2 + sliceIndex) % slabDepth;
+    return (CGFloat)z - (CGFloat)(slabDepth - 1) / 2.0;
+}
+
+// the first slice of a slab is sampled straight into the projection, the values of the other slices are then reduced into it
+static void NIHorizontalFillReduceSlice(NIProjectionMode projectionMode, const float *sliceValues, float *values, NSUInteger length)
+{
+    switch (projectionMode) {
+        case NIProjectionModeMIP:
+            vDSP_vmax(values, 1, sliceValues, 1, values, 1, length);
+            break;
+        case NIProjectionModeMinIP:
+            vDSP_vmin(values, 1, sliceValues, 1, values, 1, length);
+            break;
+        case NIProjectionModeMean:
+        case NIProjectionModeSum:
+            vDSP_vadd(values, 1, sliceValues, 1, values, 1, length);
+            break;
+        default:
+            break;
+    }
+}
 
 @interface NIHorizontalFillOperation ()
 
 - (void)_nearestNeighborFill;
 - (void)_linearInterpolatingFill;
 - (void)_cubicInterpolatingFill;
+- (void)_cubicBSplineInterpolatingFill;
 - (void)_unknownInterpolatingFill;
+- (void)_scanlineFill;
+- (void)_fillUsingSampler:(NIHorizontalFillSampler)sampler;
+- (void)_acquireSamplingInlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer;
+- (BOOL)_acquireMinMaxGrid:(NIVolumeDataMinMaxGrid *)minMaxGrid offset:(NIVector *)offset;
+- (BOOL)_skipsSpansWithMinMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid;
+- (BOOL)_skipSpanWithMinMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid minVolumeVector:(NIVector)minVolumeVector maxVolumeVector:(NIVector)maxVolumeVector
+                         values:(float *)values projectedValues:(float *)projectedValues length:(NSUInteger)length;
+- (void)_sampleCoordinates:(float * const *)coordinates usingSampler:(NIHorizontalFillSampler)sampler inlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+                minMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid gridOffset:(NIVector)gridOffset values:(float *)values projectedValues:(float *)projectedValues;
+- (void)_sampleScanlineAtVolumeVector:(NIVector)startVolumeVector inlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+                           minMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid gridOffset:(NIVector)gridOffset values:(float *)values projectedValues:(float *)projectedValues;
+- (void)_startProjectionOfRow:(NSUInteger)y state:(float *)state;
+- (BOOL)_reduceSlice:(NSUInteger)slice values:(float *)sliceValues intoRow:(NSUInteger)y state:(float *)state;
+- (void)_finishProjectionOfRow:(NSUInteger)y state:(float *)state;
 
 @end
 
@@ -41,20 +271,81 @@
 @synthesize floatBytes = _floatBytes;
 @synthesize vectors = _vectors;
 @synthesize normals = _normals;
+@synthesize slabNormals = _slabNormals;
+@synthesize volumeStart = _volumeStart;
+@synthesize volumeXStep = _volumeXStep;
+@synthesize volumeYStep = _volumeYStep;
+@synthesize volumeSlabStep = _volumeSlabStep;
+@synthesize slabDepth = _slabDepth;
 @synthesize interpolationMode = _interpolationMode;
+@synthesize projectionMode = _projectionMode;
+@synthesize projectionThresholdMin = _projectionThresholdMin;
+@synthesize projectionThresholdMax = _projectionThresholdMax;
+@synthesize boundingVolumeData = _boundingVolumeData;
+@synthesize opacities = _opacities;
+@synthesize opacityTableMin = _opacityTableMin;
+@synthesize opacityTableMax = _opacityTableMax;
+@synthesize depthFloatBytes = _depthFloatBytes;
+@synthesize rowStride = _rowStride;
+
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height vectors:(NIVectorArray)vectors normals:(NIVectorArray)normals
+{
+    return [self initWithVolumeData:volumeData interpolationMode:interpolationMode floatBytes:floatBytes width:width height:height vectors:vectors normals:normals
+                        slabNormals:NULL slabDepth:1 projectionMode:NIProjectionModeNone];
+}
+
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height
+             volumeStart:(NIVector)volumeStart volumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep
+{
+    return [self initWithVolumeData:volumeData interpolationMode:interpolationMode floatBytes:floatBytes width:width height:height
+                        volumeStart:volumeStart volumeXStep:volumeXStep volumeYStep:volumeYStep volumeSlabStep:NIVectorZero slabDepth:1 projectionMode:NIProjectionModeNone];
+}
 
 - (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height vectors:(NIVectorArray)vectors normals:(NIVectorArray)normals
+             slabNormals:(NIVectorArray)slabNormals slabDepth:(NSUInteger)slabDepth projectionMode:(NIProjectionMode)projectionMode
 {
     if ( (self = [super init])) {
         _volumeData = [volumeData retain];
         _floatBytes = floatBytes;
         _width = width;
         _height = height;
+        _rowStride = width;
         _vectors = malloc(width * sizeof(NIVector));
         memcpy(_vectors, vectors, width * sizeof(NIVector));
         _normals = malloc(width * sizeof(NIVector));
         memcpy(_normals, normals, width * sizeof(NIVector));
+        if (slabNormals) {
+            _slabNormals = malloc(width * sizeof(NIVector));
+            memcpy(_slabNormals, slabNormals, width * sizeof(NIVector));
+        }
+        _slabDepth = MAX(slabDepth, 1);
         _interpolationMode = interpolationMode;
+        _projectionMode = projectionMode;
+        _projectionThresholdMin = -INFINITY;
+        _projectionThresholdMax = INFINITY;
+    }
+    return self;
+}
+
+- (id)initWithVolumeData:(NIVolumeData *)volumeData interpolationMode:(NIInterpolationMode)interpolationMode floatBytes:(float *)floatBytes width:(NSUInteger)width height:(NSUInteger)height
+             volumeStart:(NIVector)volumeStart volumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep volumeSlabStep:(NIVector)volumeSlabStep slabDepth:(NSUInteger)slabDepth
+          projectionMode:(NIProjectionMode)projectionMode
+{
+    if ( (self = [super init])) {
+        _volumeData = [volumeData retain];
+        _floatBytes = floatBytes;
+        _width = width;
+        _height = height;
+        _rowStride = width;
+        _volumeStart = volumeStart;
+        _volumeXStep = volumeXStep;
+        _volumeYStep = volumeYStep;
+        _volumeSlabStep = volumeSlabStep;
+        _slabDepth = MAX(slabDepth, 1);
+        _interpolationMode = interpolationMode;
+        _projectionMode = projectionMode;
+        _projectionThresholdMin = -INFINITY;
+        _projectionThresholdMax = INFINITY;
     }
     return self;
 }
@@ -63,13 +354,113 @@
 {
     [_volumeData release];
     _volumeData = nil;
+    [_boundingVolumeData release];
+    _boundingVolumeData = nil;
+    [_opacities release];
+    _opacities = nil;
     free(_vectors);
     _vectors = NULL;
     free(_normals);
     _normals = NULL;
+    free(_slabNormals);
+    _slabNormals = NULL;
     [super dealloc];
 }
 
++ (void)runFillOperations:(NSArray<NIHorizontalFillOperation *> *)fillOperations qualityOfService:(NSQualityOfService)qualityOfService
+{
+    const NSUInteger operationCount = [fillOperations count];
+    NSUInteger workerCount;
+    NSUInteger worker;
+    NIHorizontalFillOperation **operations;
+    NIHorizontalFillWorkerRun *workerRuns;
+    qos_class_t qualityOfServiceClass;
+
+    if (operationCount == 0) {
+        return;
+    }
+
+    NSAssert(operationCount <= UINT32_MAX, @"too many fill operations");
+    workerCount = MIN(operationCount, [[NSProcessInfo processInfo] activeProcessorCount]);
+    operations = malloc(operationCount * sizeof(NIHorizontalFillOperation *));
+    if (posix_memalign((void **)&workerRuns, 64, workerCount * sizeof(NIHorizontalFillWorkerRun)) != 0) {
+        workerRuns = NULL; // posix_memalign leaves the pointer undefined when it fails
+    }
+    if (workerRuns == NULL || operations == NULL) {
+        free(workerRuns);
+        free(operations);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the worker runs", __PRETTY_FUNCTION__];
+    }
+
+    [fillOperations getObjects:operations range:NSMakeRange(0, operationCount)];
+    for (worker = 0; worker < workerCount; worker++) {
+        workerRuns[worker].run = NIHorizontalFillMakeRun((uint32_t)((worker * operationCount) / workerCount), (uint32_t)(((worker + 1) * operationCount) / workerCount));
+    }
+    OSMemoryBarrier();
+
+    qualityOfServiceClass = qualityOfService == NSQualityOfServiceDefault ? QOS_CLASS_DEFAULT : (qos_class_t)qualityOfService;
+    dispatch_apply(workerCount, dispatch_get_global_queue(qualityOfServiceClass, 0), ^(size_t workerIndex) {
+        NSUInteger operationIndex;
+        while (NIHorizontalFillTakeOperation(workerRuns, workerCount, workerIndex, &operationIndex)) {
+            if ([operations[operationIndex] isCancelled] == NO) {
+                [operations[operationIndex] main];
+            }
+        }
+    });
+
+    free(workerRuns);
+    free(operations);
+}
+
++ (void)getTileWidth:(NSUInteger *)tileWidth tileHeight:(NSUInteger *)tileHeight forPixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh
+           slabDepth:(NSUInteger)slabDepth interpolationMode:(NIInterpolationMode)interpolationMode
+{
+    const NSUInteger footprint = NIHorizontalFillInterpolationFootprint(interpolationMode);
+    const NSUInteger cacheBytes = NIHorizontalFillCoreCacheBytes() / 2; // leave room for the output and for the other data of the process
+    const NSUInteger targetTileCount = [[NSProcessInfo processInfo] activeProcessorCount] * NIHorizontalFillTilesPerCore;
+    NSUInteger columnBytes;
+    NSUInteger columnCount;
+    NSUInteger width;
+    NSUInteger height;
+
+    pixelsWide = MAX(pixelsWide, 1);
+    pixelsHigh = MAX(pixelsHigh, 1);
+    slabDepth = MAX(slabDepth, 1);
+
+    // the voxels a column of a row touches across the slab, neighbouring samples share most of their footprint, plus the coordinates and values the fill keeps per column
+    columnBytes = (footprint * (slabDepth + footprint - 1)) * sizeof(float) + 15 * sizeof(float);
+    if (pixelsWide * columnBytes <= cacheBytes) {
+        width = pixelsWide;
+    } else {
+        width = MAX((cacheBytes / columnBytes) / NIHorizontalFillSpanLength, 1) * NIHorizontalFillSpanLength;
+        columnCount = (pixelsWide + width - 1) / width;
+        width = (((pixelsWide + columnCount - 1) / columnCount) + NIHorizontalFillSpanLength - 1) / NIHorizontalFillSpanLength * NIHorizontalFillSpanLength; // even out the columns
+        width = MIN(width, pixelsWide);
+    }
+    columnCount = (pixelsWide + width - 1) / width;
+
+    height = (pixelsHigh * columnCount + targetTileCount - 1) / targetTileCount;
+    height = MIN(height, width); // square-ish tiles keep the rows of a tile close to each other in the volume
+    height = MAX(height, (NIHorizontalFillMinimumTilePixels + width - 1) / width);
+    height = MIN(MAX(height, 1), pixelsHigh);
+
+    if (NIHorizontalFillOverrideTileWidth) {
+        width = MIN(NIHorizontalFillOverrideTileWidth, pixelsWide);
+    }
+    if (NIHorizontalFillOverrideTileHeight) {
+        height = MIN(NIHorizontalFillOverrideTileHeight, pixelsHigh);
+    }
+
+    *tileWidth = width;
+    *tileHeight = height;
+}
+
++ (void)setOverrideTileWidth:(NSUInteger)tileWidth tileHeight:(NSUInteger)tileHeight
+{
+    NIHorizontalFillOverrideTileWidth = tileWidth;
+    NIHorizontalFillOverrideTileHeight = tileHeight;
+}
+
 - (void)main
 {
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
@@ -85,12 +476,16 @@
 //        threadPriority = [NSThread threadPriority];
 //        [NSThread setThreadPriority:threadPriority * .5];
 
-        if (_interpolationMode == NIInterpolationModeLinear) {
+        if (_vectors == NULL) {
+            [self _scanlineFill];
+        } else if (_interpolationMode == NIInterpolationModeLinear) {
             [self _linearInterpolatingFill];
         } else if (_interpolationMode == NIInterpolationModeNearestNeighbor) {
             [self _nearestNeighborFill];
         } else if (_interpolationMode == NIInterpolationModeCubic) {
             [self _cubicInterpolatingFill];
+        } else if (_interpolationMode == NIInterpolationModeCubicBSpline) {
+            [self _cubicBSplineInterpolatingFill];
         } else {
             [self _unknownInterpolatingFill];
         }
@@ -106,117 +501,375 @@
 
 - (void)_linearInterpolatingFill
 {
-    NSUInteger x;
-    NSUInteger y;
-    NIAffineTransform vectorTransform;
-    NIVectorArray volumeVectors;
-    NIVectorArray volumeNormals;
-    NIVolumeDataInlineBuffer inlineBuffer;
+    [self _fillUsingSampler:NIVolumeDataLinearInterpolateVolumeCoordinates];
+}
 
-    volumeVectors = malloc(_width * sizeof(NIVector));
-    memcpy(volumeVectors, _vectors, _width * sizeof(NIVector));
-    NIVectorApplyTransformToVectors(_volumeData.modelToVoxelTransform, volumeVectors, _width);
+- (void)_nearestNeighborFill
+{
+    [self _fillUsingSampler:NIVolumeDataNearestNeighborInterpolateVolumeCoordinates];
+}
 
-    volumeNormals = malloc(_width * sizeof(NIVector));
-    memcpy(volumeNormals, _normals, _width * sizeof(NIVector));
-    vectorTransform = _volumeData.modelToVoxelTransform;
-    vectorTransform.m41 = vectorTransform.m42 = vectorTransform.m43 = 0.0;
-    NIVectorApplyTransformToVectors(vectorTransform, volumeNormals, _width);
+- (void)_cubicInterpolatingFill
+{
+    [self _fillUsingSampler:NIVolumeDataCubicInterpolateVolumeCoordinates];
+}
 
-    [_volumeData acquireInlineBuffer:&inlineBuffer];
-    for (y = 0; y < _height; y++) {
-        if ([self isCancelled]) {
-            break;
-        }
+- (void)_cubicBSplineInterpolatingFill
+{
+    [self _fillUsingSampler:NIVolumeDataCubicBSplineInterpolateVolumeCoordinates];
+}
 
-        for (x = 0; x < _width; x++) {
-            _floatBytes[y*_width + x] = NIVolumeDataLinearInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVectors[x]);
-        }
+// B-spline interpolation samples the coefficients of the volume rather than the volume itself
+- (void)_acquireSamplingInlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+{
+    if (_interpolationMode == NIInterpolationModeCubicBSpline) {
+        [_volumeData.cubicBSplineCoefficients acquireInlineBuffer:inlineBuffer];
+    } else {
+        [_volumeData acquireInlineBuffer:inlineBuffer];
+    }
+}
 
-        NIVectorAddVectors(volumeVectors, volumeNormals, _width);
+// returns NO if the min/max grid can't be used to skip spans of this operation, otherwise the offset is added to voxel coordinates of volumeData to get voxel coordinates of the grid
+- (BOOL)_acquireMinMaxGrid:(NIVolumeDataMinMaxGrid *)minMaxGrid offset:(NIVector *)offset
+{
+    NIVolumeData *boundingVolumeData;
+
+    if (_projectionMode != NIProjectionModeMIP && _projectionMode != NIProjectionModeMinIP && _projectionMode != NIProjectionModeMIPWithDepth && _projectionMode != NIProjectionModeVR) {
+        return NO;
+    }
+    if (_interpolationMode != NIInterpolationModeLinear && _interpolationMode != NIInterpolationModeNearestNeighbor) {
+        return NO;
+    }
+    if (_projectionMode != NIProjectionModeVR && _slabDepth == 1 && _projectionThresholdMin == -INFINITY && _projectionThresholdMax == INFINITY) {
+        return NO;
     }
 
-    free(volumeVectors);
-    free(volumeNormals);
+    boundingVolumeData = _boundingVolumeData ? _boundingVolumeData : _volumeData;
+    [boundingVolumeData acquireMinMaxGrid:minMaxGrid];
+    *offset = NIVectorApplyTransform(NIVectorZero, NIAffineTransformConcat(NIAffineTransformInvert(_volumeData.modelToVoxelTransform), boundingVolumeData.modelToVoxelTransform));
+    return YES;
 }
 
-- (void)_nearestNeighborFill
+// The start vectors and normals are brought into voxel space in double precision, and then split into single precision x, y and z arrays
+// for the samplers. Each row is computed as start + y*normal rather than by adding the normals row after row, so float rounding doesn't accumulate down the tile.
+- (void)_fillUsingSampler:(NIHorizontalFillSampler)sampler
 {
-    NSUInteger x;
     NSUInteger y;
+    NSUInteger slice;
+    float floatY;
+    float floatZ;
     NIAffineTransform vectorTransform;
     NIVectorArray volumeVectors;
-    NIVectorArray volumeNormals;
+    float *coordinates;
+    float *startCoordinates[3];
+    float *normalCoordinates[3];
+    float *slabCoordinates[3];
+    float *rowCoordinates[3];
+    float *sliceValues;
+    NSUInteger i;
     NIVolumeDataInlineBuffer inlineBuffer;
+    NIVolumeDataMinMaxGrid minMaxGrid;
+    NIVector gridOffset = NIVectorZero;
+    BOOL canSkipSpans;
 
     volumeVectors = malloc(_width * sizeof(NIVector));
+    coordinates = malloc(_width * 12 * sizeof(float));
+    sliceValues = malloc(_width * 3 * sizeof(float)); // the values of a slice, then two rows of state for the projections that need more than the projected row
+    for (i = 0; i < 3; i++) {
+        startCoordinates[i] = coordinates + (_width * i);
+        normalCoordinates[i] = coordinates + (_width * (i + 3));
+        slabCoordinates[i] = coordinates + (_width * (i + 6));
+        rowCoordinates[i] = coordinates + (_width * (i + 9));
+    }
+
     memcpy(volumeVectors, _vectors, _width * sizeof(NIVector));
     NIVectorApplyTransformToVectors(_volumeData.modelToVoxelTransform, volumeVectors, _width);
+    for (i = 0; i < 3; i++) {
+        vDSP_vdpsp(((CGFloat *)volumeVectors) + i, 3, startCoordinates[i], 1, _width);
+    }
 
-    volumeNormals = malloc(_width * sizeof(NIVector));
-    memcpy(volumeNormals, _normals, _width * sizeof(NIVector));
     vectorTransform = _volumeData.modelToVoxelTransform;
     vectorTransform.m41 = vectorTransform.m42 = vectorTransform.m43 = 0.0;
-    NIVectorApplyTransformToVectors(vectorTransform, volumeNormals, _width);
+    memcpy(volumeVectors, _normals, _width * sizeof(NIVector));
+    NIVectorApplyTransformToVectors(vectorTransform, volumeVectors, _width);
+    for (i = 0; i < 3; i++) {
+        vDSP_vdpsp(((CGFloat *)volumeVectors) + i, 3, normalCoordinates[i], 1, _width);
+    }
+    if (_slabNormals) {
+        memcpy(volumeVectors, _slabNormals, _width * sizeof(NIVector));
+        NIVectorApplyTransformToVectors(vectorTransform, volumeVectors, _width);
+        for (i = 0; i < 3; i++) {
+            vDSP_vdpsp(((CGFloat *)volumeVectors) + i, 3, slabCoordinates[i], 1, _width);
+        }
+    } else {
+        memset(slabCoordinates[0], 0, _width * 3 * sizeof(float));
+    }
+    free(volumeVectors);
 
-    [_volumeData acquireInlineBuffer:&inlineBuffer];
+    [self _acquireSamplingInlineBuffer:&inlineBuffer];
+    canSkipSpans = [self _acquireMinMaxGrid:&minMaxGrid offset:&gridOffset];
     for (y = 0; y < _height; y++) {
         if ([self isCancelled]) {
             break;
         }
 
-        for (x = 0; x < _width; x++) {
-            _floatBytes[y*_width + x] = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVectors[x]);
+        floatY = y;
+        [self _startProjectionOfRow:y state:sliceValues + _width];
+        for (slice = 0; slice < _slabDepth; slice++) {
+            floatZ = NIHorizontalFillSliceOffset(slice, _slabDepth, _projectionMode);
+            for (i = 0; i < 3; i++) {
+                vDSP_vsma(normalCoordinates[i], 1, &floatY, startCoordinates[i], 1, rowCoordinates[i], 1, _width);
+                if (floatZ != 0) {
+                    vDSP_vsma(slabCoordinates[i], 1, &floatZ, rowCoordinates[i], 1, rowCoordinates[i], 1, _width);
+                }
+            }
+
+            if (slice == 0 && _projectionMode != NIProjectionModeVR) {
+                [self _sampleCoordinates:rowCoordinates usingSampler:sampler inlineBuffer:&inlineBuffer minMaxGrid:canSkipSpans ? &minMaxGrid : NULL gridOffset:gridOffset
+                                  values:_floatBytes + (y*_rowStride) projectedValues:NULL];
+                [self _reduceSlice:slice values:_floatBytes + (y*_rowStride) intoRow:y state:sliceValues + _width];
+            } else {
+                [self _sampleCoordinates:rowCoordinates usingSampler:sampler inlineBuffer:&inlineBuffer minMaxGrid:canSkipSpans ? &minMaxGrid : NULL gridOffset:gridOffset
+                                  values:sliceValues projectedValues:_projectionMode == NIProjectionModeVR ? sliceValues + _width : _floatBytes + (y*_rowStride)];
+                if ([self _reduceSlice:slice values:sliceValues intoRow:y state:sliceValues + _width] == NO) {
+                    break;
+                }
+            }
         }
-
-        NIVectorAddVectors(volumeVectors, volumeNormals, _width);
+        [self _finishProjectionOfRow:y state:sliceValues + _width];
     }
 
-    free(volumeVectors);
-    free(volumeNormals);
+    free(sliceValues);
+    free(coordinates);
 }
 
-- (void)_cubicInterpolatingFill
+// consecutive spans that can't be skipped are sampled together
+- (void)_sampleCoordinates:(float * const *)coordinates usingSampler:(NIHorizontalFillSampler)sampler inlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+                minMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid gridOffset:(NIVector)gridOffset values:(float *)values projectedValues:(float *)projectedValues
 {
     NSUInteger x;
-    NSUInteger y;
-    NIAffineTransform vectorTransform;
-    NIVectorArray volumeVectors;
-    NIVectorArray volumeNormals;
-    NIVolumeDataInlineBuffer inlineBuffer;
+    NSUInteger i;
+    NSUInteger runStart;
+    NSUInteger spanLength;
+    float spanMins[3] = {0, 0, 0};
+    float spanMaxs[3] = {0, 0, 0};
+
+    if ([self _skipsSpansWithMinMaxGrid:minMaxGrid] == NO) {
+        sampler(inlineBuffer, coordinates[0], coordinates[1], coordinates[2], values, _width);
+        return;
+    }
 
-    volumeVectors = malloc(_width * sizeof(NIVector));
-    memcpy(volumeVectors, _vectors, _width * sizeof(NIVector));
-    NIVectorApplyTransformToVectors(_volumeData.modelToVoxelTransform, volumeVectors, _width);
+    runStart = 0;
+    for (x = 0; x < _width; x += NIHorizontalFillSpanLength) {
+        spanLength = MIN(NIHorizontalFillSpanLength, _width - x);
+        if (minMaxGrid) {
+            for (i = 0; i < 3; i++) {
+                vDSP_minv(coordinates[i] + x, 1, spanMins + i, spanLength);
+                vDSP_maxv(coordinates[i] + x, 1, spanMaxs + i, spanLength);
+            }
+        }
+        if ([self _skipSpanWithMinMaxGrid:minMaxGrid minVolumeVector:NIVectorAdd(NIVectorMake(spanMins[0], spanMins[1], spanMins[2]), gridOffset)
+                          maxVolumeVector:NIVectorAdd(NIVectorMake(spanMaxs[0], spanMaxs[1], spanMaxs[2]), gridOffset)
+                                   values:values + x projectedValues:projectedValues ? projectedValues + x : NULL length:spanLength]) {
+            if (runStart < x) {
+                sampler(inlineBuffer, coordinates[0] + runStart, coordinates[1] + runStart, coordinates[2] + runStart, values + runStart, x - runStart);
+            }
+            runStart = x + spanLength;
+        }
+    }
+    if (runStart < _width) {
+        sampler(inlineBuffer, coordinates[0] + runStart, coordinates[1] + runStart, coordinates[2] + runStart, values + runStart, _width - runStart);
+    }
+}
 
-    volumeNormals = malloc(_width * sizeof(NIVector));
-    memcpy(volumeNormals, _normals, _width * sizeof(NIVector));
-    vectorTransform = _volumeData.modelToVoxelTransform;
-    vectorTransform.m41 = vectorTransform.m42 = vectorTransform.m43 = 0.0;
-    NIVectorApplyTransformToVectors(vectorTransform, volumeNormals, _width);
+- (void)_scanlineFill
+{
+    NSUInteger y;
+    NSUInteger slice;
+    NIVector rowStart;
+    float *sliceValues;
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NIVolumeDataMinMaxGrid minMaxGrid;
+    NIVector gridOffset = NIVectorZero;
+    BOOL canSkipSpans;
+
+    if (_interpolationMode != NIInterpolationModeLinear && _interpolationMode != NIInterpolationModeNearestNeighbor && _interpolationMode != NIInterpolationModeCubic &&
+        _interpolationMode != NIInterpolationModeCubicBSpline) {
+        [self _unknownInterpolatingFill];
+        return;
+    }
 
-    [_volumeData acquireInlineBuffer:&inlineBuffer];
+    sliceValues = malloc(_width * 3 * sizeof(float));
+    [self _acquireSamplingInlineBuffer:&inlineBuffer];
+    canSkipSpans = [self _acquireMinMaxGrid:&minMaxGrid offset:&gridOffset];
     for (y = 0; y < _height; y++) {
         if ([self isCancelled]) {
             break;
         }
 
-        for (x = 0; x < _width; x++) {
-            _floatBytes[y*_width + x] = NIVolumeDataCubicInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVectors[x]);
+        [self _startProjectionOfRow:y state:sliceValues + _width];
+        for (slice = 0; slice < _slabDepth; slice++) {
+            rowStart = NIVectorAdd(NIVectorAdd(_volumeStart, NIVectorScalarMultiply(_volumeYStep, (CGFloat)y)),
+                                   NIVectorScalarMultiply(_volumeSlabStep, NIHorizontalFillSliceOffset(slice, _slabDepth, _projectionMode)));
+            if (slice == 0 && _projectionMode != NIProjectionModeVR) {
+                [self _sampleScanlineAtVolumeVector:rowStart inlineBuffer:&inlineBuffer minMaxGrid:canSkipSpans ? &minMaxGrid : NULL gridOffset:gridOffset
+                                             values:_floatBytes + (y*_rowStride) projectedValues:NULL];
+                [self _reduceSlice:slice values:_floatBytes + (y*_rowStride) intoRow:y state:sliceValues + _width];
+            } else {
+                [self _sampleScanlineAtVolumeVector:rowStart inlineBuffer:&inlineBuffer minMaxGrid:canSkipSpans ? &minMaxGrid : NULL gridOffset:gridOffset
+                                             values:sliceValues projectedValues:_projectionMode == NIProjectionModeVR ? sliceValues + _width : _floatBytes + (y*_rowStride)];
+                if ([self _reduceSlice:slice values:sliceValues intoRow:y state:sliceValues + _width] == NO) {
+                    break;
+                }
+            }
         }
+        [self _finishProjectionOfRow:y state:sliceValues + _width];
+    }
+
+    free(sliceValues);
+}
 
-        NIVectorAddVectors(volumeVectors, volumeNormals, _width);
+// the scan line is straight, so the box of a span is the box of its first and last points
+- (void)_sampleScanlineAtVolumeVector:(NIVector)startVolumeVector inlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+                           minMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid gridOffset:(NIVector)gridOffset values:(float *)values projectedValues:(float *)projectedValues
+{
+    NSUInteger x;
+    NSUInteger runStart;
+    NSUInteger spanLength;
+    NIVector spanFirst;
+    NIVector spanLast;
+
+    if ([self _skipsSpansWithMinMaxGrid:minMaxGrid] == NO) {
+        NIVolumeDataInterpolateVolumeScanline(inlineBuffer, _interpolationMode, startVolumeVector, _volumeXStep, values, _width);
+        return;
     }
 
-    free(volumeVectors);
-    free(volumeNormals);
+    runStart = 0;
+    for (x = 0; x < _width; x += NIHorizontalFillSpanLength) {
+        spanLength = MIN(NIHorizontalFillSpanLength, _width - x);
+        spanFirst = NIVectorAdd(NIVectorAdd(startVolumeVector, NIVectorScalarMultiply(_volumeXStep, (CGFloat)x)), gridOffset);
+        spanLast = NIVectorAdd(spanFirst, NIVectorScalarMultiply(_volumeXStep, (CGFloat)(spanLength - 1)));
+        if ([self _skipSpanWithMinMaxGrid:minMaxGrid minVolumeVector:NIVectorMake(MIN(spanFirst.x, spanLast.x), MIN(spanFirst.y, spanLast.y), MIN(spanFirst.z, spanLast.z))
+                          maxVolumeVector:NIVectorMake(MAX(spanFirst.x, spanLast.x), MAX(spanFirst.y, spanLast.y), MAX(spanFirst.z, spanLast.z))
+                                   values:values + x projectedValues:projectedValues ? projectedValues + x : NULL length:spanLength]) {
+            if (runStart < x) {
+                NIVolumeDataInterpolateVolumeScanline(inlineBuffer, _interpolationMode, NIVectorAdd(startVolumeVector, NIVectorScalarMultiply(_volumeXStep, (CGFloat)runStart)), _volumeXStep,
+                                                      values + runStart, x - runStart);
+            }
+            runStart = x + spanLength;
+        }
+    }
+    if (runStart < _width) {
+        NIVolumeDataInterpolateVolumeScanline(inlineBuffer, _interpolationMode, NIVectorAdd(startVolumeVector, NIVectorScalarMultiply(_volumeXStep, (CGFloat)runStart)), _volumeXStep,
+                                              values + runStart, _width - runStart);
+    }
+}
+
+// VR can skip the spans of rays that are already opaque even without a min/max grid
+- (BOOL)_skipsSpansWithMinMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid
+{
+    return minMaxGrid != NULL || _projectionMode == NIProjectionModeVR;
 }
 
+// for VR, projectedValues are the transmittances of the rays
+- (BOOL)_skipSpanWithMinMaxGrid:(const NIVolumeDataMinMaxGrid *)minMaxGrid minVolumeVector:(NIVector)minVolumeVector maxVolumeVector:(NIVector)maxVolumeVector
+                         values:(float *)values projectedValues:(float *)projectedValues length:(NSUInteger)length
+{
+    if (_projectionMode == NIProjectionModeVR) {
+        return NIHorizontalFillSkipCompositedSpan(minMaxGrid, minVolumeVector, maxVolumeVector, [_opacities bytes], [_opacities length] / sizeof(float),
+                                                  _opacityTableMin, _opacityTableMax, projectedValues, values, length);
+    } else {
+        // a skipped span of a MIP with depth never beats the maximum, so it doesn't move the depth either
+        return NIHorizontalFillSkipSpan(minMaxGrid, minVolumeVector, maxVolumeVector, _projectionMode == NIProjectionModeMIPWithDepth ? NIProjectionModeMIP : _projectionMode,
+                                        projectedValues, _projectionThresholdMin, _projectionThresholdMax, values, length);
+    }
+}
+
+// VR starts with no color and rays that are fully transparent, its state is the transmittances of the rays followed by scratch space
+- (void)_startProjectionOfRow:(NSUInteger)y state:(float *)state
+{
+    float transmittance = 1;
+
+    if (_projectionMode == NIProjectionModeVR) {
+        vDSP_vclr(_floatBytes + (y*_rowStride), 1, _width);
+        vDSP_vfill(&transmittance, state, 1, _width);
+    }
+}
+
+// the first slice of the projections other than VR is sampled straight into the row, in which case sliceValues is the row. Returns NO once every ray of a VR row
+// is opaque, and the slices that are left don't need to be sampled. The standard deviation's state is the shifts of the samples followed by the sums of the squares
+- (BOOL)_reduceSlice:(NSUInteger)slice values:(float *)sliceValues intoRow:(NSUInteger)y state:(float *)state
+{
+    float *values = _floatBytes + (y*_rowStride);
+    float maxTransmittance;
+    float depth;
+
+    switch (_projectionMode) {
+        case NIProjectionModeVR:
+            NIProjectionCompositeSlice(sliceValues, [_opacities bytes], [_opacities length] / sizeof(float), _opacityTableMin, _opacityTableMax, values, state, state + _width, _width);
+            vDSP_maxv(state, 1, &maxTransmittance, _width);
+            if (maxTransmittance < NIProjectionOpaqueTransmittance) {
+                vDSP_vclr(state, 1, _width);
+                return NO;
+            }
+            break;
+        case NIProjectionModeStandardDeviation:
+            if (slice == 0) {
+                memcpy(state, values, _width * sizeof(float));
+                vDSP_vclr(values, 1, _width);
+                vDSP_vclr(state + _width, 1, _width);
+            } else {
+                vDSP_vsub(state, 1, sliceValues, 1, sliceValues, 1, _width);
+                vDSP_vadd(values, 1, sliceValues, 1, values, 1, _width);
+                vDSP_vma(sliceValues, 1, sliceValues, 1, state + _width, 1, state + _width, 1, _width);
+            }
+            break;
+        case NIProjectionModeMIPWithDepth:
+            depth = NIHorizontalFillSliceOffset(slice, _slabDepth, _projectionMode) + (CGFloat)(_slabDepth - 1) / 2.0;
+            if (slice == 0) {
+                vDSP_vfill(&depth, _depthFloatBytes + (y*_rowStride), 1, _width);
+            } else {
+                NIProjectionReduceSliceWithDepth(sliceValues, depth, values, _depthFloatBytes + (y*_rowStride), _width);
+            }
+            break;
+        default:
+            if (slice != 0) {
+                NIHorizontalFillReduceSlice(_projectionMode, sliceValues, values, _width);
+            }
+            break;
+    }
+    return YES;
+}
+
+// the mean is accumulated as a sum, MIP and MinIP are clamped to the threshold window, and what VR sees through the slab is the outOfBoundsValue
+- (void)_finishProjectionOfRow:(NSUInteger)y state:(float *)state
+{
+    float *values = _floatBytes + (y*_rowStride);
+    float slabDepth;
+    float outOfBoundsValue;
+
+    if (_projectionMode == NIProjectionModeVR) {
+        outOfBoundsValue = _volumeData.outOfBoundsValue;
+        vDSP_vsma(state, 1, &outOfBoundsValue, values, 1, values, 1, _width);
+    } else if (_projectionMode == NIProjectionModeMean) {
+        slabDepth = _slabDepth;
+        vDSP_vsdiv(values, 1, &slabDepth, values, 1, _width);
+    } else if (_projectionMode == NIProjectionModeStandardDeviation) {
+        NIProjectionFinishStandardDeviation(values, state + _width, _slabDepth, _width);
+    } else if ((_projectionMode == NIProjectionModeMIP || _projectionMode == NIProjectionModeMinIP || _projectionMode == NIProjectionModeMIPWithDepth) &&
+               (_projectionThresholdMin != -INFINITY || _projectionThresholdMax != INFINITY)) {
+        vDSP_vclip(values, 1, &_projectionThresholdMin, &_projectionThresholdMax, values, 1, _width);
+    }
+}
 
 - (void)_unknownInterpolatingFill
 {
+    NSUInteger y;
+
     NSLog(@"unknown interpolation mode");
-    memset(_floatBytes, 0, _height * _width);
+    for (y = 0; y < _height; y++) {
+        memset(_floatBytes + (y*_rowStride), 0, _width * sizeof(float));
+    }
 }
 
 
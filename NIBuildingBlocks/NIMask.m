@@ -288,17 +288,22 @@ NSArray *NIMaskIndexesInRun(NIMaskRun maskRun)
     float intensity;
     NSMutableArray *maskRuns;
     NIMaskRun maskRun;
-    NIVolumeDataInlineBuffer inlineBuffer;
+    float *row;
     
     maskRuns = [NSMutableArray array];
     maskRun = NIMaskRunZero;
     maskRun.intensity = 0.0;
     
-    [volumeData acquireInlineBuffer:&inlineBuffer];
-    for (k = 0; k < inlineBuffer.pixelsDeep; k++) {
-        for (j = 0; j < inlineBuffer.pixelsHigh; j++) {
-            for (i = 0; i < inlineBuffer.pixelsWide; i++) {
-                intensity = NIVolumeDataGetFloatAtPixelCoordinate(&inlineBuffer, i, j, k);
+    // the volume is read a row at a time, which works for every kind of volume, compressed ones included
+    row = malloc(volumeData.pixelsWide * sizeof(float));
+    if (row == NULL) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the row", __PRETTY_FUNCTION__];
+    }
+    for (k = 0; k < volumeData.pixelsDeep; k++) {
+        for (j = 0; j < volumeData.pixelsHigh; j++) {
+            [volumeData getFloatRun:row atPixelCoordinateX:0 y:j z:k length:volumeData.pixelsWide];
+            for (i = 0; i < volumeData.pixelsWide; i++) {
+                intensity = row[i];
                 intensity = roundf(intensity*255.0f)/255.0f;
                 
                 if (intensity != maskRun.intensity) { // maybe start a run, maybe close a run
@@ -329,6 +334,8 @@ NSArray *NIMaskIndexesInRun(NIMaskRun maskRun)
         }
     }
     
+    free(row);
+    
     if (modelToVoxelTransformPtr) {
         *modelToVoxelTransformPtr = volumeData.modelToVoxelTransform;
     }
@@ -27,10 +27,8 @@
 #import "NIGeneratorRequest.h"
 
 @interface NIObliqueSliceOperation : NIGeneratorOperation {
-    volatile int32_t _oustandingFillOperationCount __attribute__ ((aligned (4)));
-
     float *_floatBytes;
-    NSMutableSet *_fillOperations;
+    NSMutableArray *_fillOperations;
     NSOperation *_projectionOperation;
 
     BOOL _operationExecuting;
@@ -42,6 +40,12 @@
 
 @property (readonly) NIObliqueSliceGeneratorRequest *request;
 
+// generates sliceCount slabs like the one of the request, each sliceSpacing farther along the slab normal than the previous one. The slices share the steps and
+// tile sizes of the request, the tiles of a window of slices are filled by a single run of the fill scheduler, and each slice is handed to sliceBlock in order
+// on the calling thread before the next window is filled
++ (void)reformatSlicesOfRequest:(NIObliqueSliceGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData sliceCount:(NSUInteger)sliceCount sliceSpacing:(CGFloat)sliceSpacing
+               qualityOfService:(NSQualityOfService)qualityOfService sliceBlock:(void (^)(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop))sliceBlock;
+
 @end
 
 #endif /* _NIOBLIQUESLICEOPERATION_H_ */
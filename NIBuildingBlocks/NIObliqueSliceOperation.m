@@ -25,17 +25,39 @@
 #import "NIProjectionOperation.h"
 #import "NIGeneratorRequest.h"
 #import "NIVolumeData.h"
-#include <libkern/OSAtomic.h>
 
 
-static const NSUInteger FILL_HEIGHT = 40;
+// slices of a batch reformat are generated this many bytes at a time at most, so that long series don't need to be held in memory
+static const NSUInteger NIObliqueSliceReformatWindowByteBudget = 128 * 1024 * 1024;
+
+// the steps and tile sizes that the fill operations of a slab are built from, they don't depend on where the slab is, so the slices of a batch reformat share them
+typedef struct {
+    NIVector leftDirection;
+    NIVector downDirection;
+    NIVector inSlabNormal;
+    NIVector volumeXStep;
+    NIVector volumeYStep;
+    NSUInteger tileWidth;
+    NSUInteger tileHeight;
+    NSData *opacities; // autoreleased
+    float opacityTableMin;
+    float opacityTableMax;
+} NIObliqueSliceFillGeometry;
 
 @interface NIObliqueSliceOperation ()
 
-+ (NSOperationQueue *) _fillQueueForQualityOfService:(NSQualityOfService)qualityOfService;
+- (void)_finishFilling;
 - (CGFloat)_slabSampleDistance;
 - (NSUInteger)_pixelsDeep;
+- (BOOL)_projectsWhileFilling;
 - (NIAffineTransform)_generatedModelToVoxelTransform;
+- (NIObliqueSliceFillGeometry)_fillGeometry;
+- (NIVolumeData *)_samplingVolumeDataWithFillGeometry:(NIObliqueSliceFillGeometry)fillGeometry stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd;
+- (void)_addFillOperationsWithFillGeometry:(NIObliqueSliceFillGeometry)fillGeometry origin:(NIVector)origin floatBytes:(float *)floatBytes
+                        samplingVolumeData:(NIVolumeData *)samplingVolumeData toArray:(NSMutableArray *)fillOperations;
+- (void)_getVolumeMin:(NIVectorPointer)volumeMin max:(NIVectorPointer)volumeMax withVolumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep inSlabNormal:(NIVector)inSlabNormal
+           stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd;
+- (void)_prefetchSlicesWithVolumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep inSlabNormal:(NIVector)inSlabNormal stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd;
 
 @end
 
@@ -47,8 +69,7 @@ static const NSUInteger FILL_HEIGHT = 40;
 - (id)initWithRequest:(NIObliqueSliceGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData
 {
     if ( (self = [super initWithRequest:request volumeData:volumeData]) ) {
-        _fillOperations = [[NSMutableSet alloc] init];
-
+        _fillOperations = [[NSMutableArray alloc] init];
     }
     return self;
 }
@@ -62,9 +83,10 @@ static const NSUInteger FILL_HEIGHT = 40;
     [super dealloc];
 }
 
+// start runs the fill operations on the calling thread and only returns once they are done, so the operation is not concurrent
 - (BOOL)isConcurrent
 {
-    return YES;
+    return NO;
 }
 
 - (BOOL)isExecuting {
@@ -87,8 +109,8 @@ static const NSUInteger FILL_HEIGHT = 40;
         for (operation in _fillOperations) {
             [operation cancel];
         }
+        [_projectionOperation cancel];
     }
-    [_projectionOperation cancel];
 
     [super cancel];
 }
@@ -111,24 +133,13 @@ static const NSUInteger FILL_HEIGHT = 40;
 
 - (void)main
 {
-    NSInteger i;
-    NSInteger y;
-    NSInteger z;
     NSInteger pixelsWide;
     NSInteger pixelsHigh;
     NSInteger pixelsDeep;
-    NIVector origin;
-    NIVector leftDirection;
-    NIVector downDirection;
-    NIVector inSlabNormal;
-    NIVector heightOffset;
-    NIVector slabOffset;
-    NIVectorArray vectors;
-    NIVectorArray downVectors;
-    NIVectorArray fillVectors;
+    NIObliqueSliceFillGeometry fillGeometry;
+    NIVolumeData *samplingVolumeData;
     NIHorizontalFillOperation *horizontalFillOperation;
-    NSMutableSet *fillOperations;
-    NSOperationQueue *fillQueue;
+    NSMutableArray *fillOperations;
 
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 
@@ -139,28 +150,11 @@ static const NSUInteger FILL_HEIGHT = 40;
             pixelsWide = self.request.pixelsWide;
             pixelsHigh = self.request.pixelsHigh;
             pixelsDeep = [self _pixelsDeep];
-            origin = self.request.origin;
-            leftDirection = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionX), self.request.pixelSpacingX);
-            downDirection = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionY), self.request.pixelSpacingY);
-            if (NIVectorEqualToVector(self.request.directionZ, NIVectorZero)) {
-                inSlabNormal = NIVectorScalarMultiply(NIVectorNormalize(NIVectorCrossProduct(leftDirection, downDirection)), [self _slabSampleDistance]);
-            } else {
-                inSlabNormal = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionZ), [self _slabSampleDistance]);
-            }
-
-            _floatBytes = malloc(sizeof(float) * pixelsWide * pixelsHigh * pixelsDeep);
-            vectors = malloc(sizeof(NIVector) * pixelsWide);
-            fillVectors = malloc(sizeof(NIVector) * pixelsWide);
-            downVectors = malloc(sizeof(NIVector) * pixelsWide);
+            fillGeometry = [self _fillGeometry];
 
-            if (_floatBytes == NULL || vectors == NULL || fillVectors == NULL || downVectors == NULL) {
-                free(_floatBytes);
-                free(vectors);
-                free(fillVectors);
-                free(downVectors);
-
-                _floatBytes = NULL;
+            _floatBytes = malloc(sizeof(float) * pixelsWide * pixelsHigh * ([self _projectsWhileFilling] ? NIProjectionModeProjectedPixelsDeep(self.request.projectionMode) : pixelsDeep));
 
+            if (_floatBytes == NULL) {
                 [self willChangeValueForKey:@"didFail"];
                 [self willChangeValueForKey:@"isFinished"];
                 [self willChangeValueForKey:@"isExecuting"];
@@ -174,35 +168,12 @@ static const NSUInteger FILL_HEIGHT = 40;
                 return;
             }
 
-            for (i = 0; i < pixelsWide; i++) {
-                vectors[i] = NIVectorAdd(origin, NIVectorScalarMultiply(leftDirection, (CGFloat)i));
-                downVectors[i] = downDirection;
-            }
-
-
-            fillOperations = [NSMutableSet set];
-
-            for (z = 0; z < pixelsDeep; z++) {
-                slabOffset = NIVectorScalarMultiply(inSlabNormal, (CGFloat)z - (CGFloat)(pixelsDeep - 1)/2.0);
-                for (y = 0; y < pixelsHigh; y += FILL_HEIGHT) {
-                    heightOffset = NIVectorScalarMultiply(downDirection, (CGFloat)y);
-                    for (i = 0; i < pixelsWide; i++) {
-                        fillVectors[i] = NIVectorAdd(NIVectorAdd(vectors[i], heightOffset), slabOffset);
-                    }
-
-                    horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:_volumeData interpolationMode:self.request.interpolationMode floatBytes:_floatBytes + (y*pixelsWide) + (z*pixelsWide*pixelsHigh) width:pixelsWide height:MIN(FILL_HEIGHT, pixelsHigh - y)
-                                                                                             vectors:fillVectors normals:downVectors];
-                    [horizontalFillOperation setQueuePriority:[self queuePriority]];
-                    [horizontalFillOperation setQualityOfService:[self qualityOfService]];
-                    [fillOperations addObject:horizontalFillOperation];
-                    [horizontalFillOperation addObserver:self forKeyPath:@"isFinished" options:0 context:&self->_fillOperations];
-                    [self retain]; // so we don't get release while the operation is going
-                    [horizontalFillOperation release];
-                }
-            }
+            samplingVolumeData = [self _samplingVolumeDataWithFillGeometry:fillGeometry stackStart:NIVectorZero stackEnd:NIVectorZero];
+            fillOperations = [NSMutableArray array]; // consecutive fill operations are neighbouring tiles, so they are kept in order for the scheduler
+            [self _addFillOperationsWithFillGeometry:fillGeometry origin:self.request.origin floatBytes:_floatBytes samplingVolumeData:samplingVolumeData toArray:fillOperations];
 
             @synchronized (_fillOperations) {
-                [_fillOperations setSet:fillOperations];
+                [_fillOperations setArray:fillOperations];
             }
 
             if ([self isCancelled]) {
@@ -211,16 +182,9 @@ static const NSUInteger FILL_HEIGHT = 40;
                 }
             }
 
-            _oustandingFillOperationCount = (int32_t)[fillOperations count];
-
-            fillQueue = [[self class] _fillQueueForQualityOfService:self.qualityOfService];
-            for (horizontalFillOperation in fillOperations) {
-                [fillQueue addOperation:horizontalFillOperation];
-            }
-
-            free(vectors);
-            free(fillVectors);
-            free(downVectors);
+            // the fill operations are only descriptors of the bands, the scheduler runs them and returns once they are all done
+            [NIHorizontalFillOperation runFillOperations:fillOperations qualityOfService:self.qualityOfService];
+            [self _finishFilling];
         } else {
             [self willChangeValueForKey:@"isFinished"];
             [self willChangeValueForKey:@"isExecuting"];
@@ -244,84 +208,294 @@ static const NSUInteger FILL_HEIGHT = 40;
     }
 }
 
-- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+- (NIObliqueSliceFillGeometry)_fillGeometry
 {
-    NSOperation *operation;
-    NIVolumeData *generatedVolume;
+    NIObliqueSliceFillGeometry fillGeometry;
     NIAffineTransform modelToVoxelTransform;
-    NIProjectionOperation *projectionOperation;
-    int32_t oustandingFillOperationCount;
-
-    if (context == &self->_fillOperations) {
-        assert([object isKindOfClass:[NSOperation class]]);
-        operation = (NSOperation *)object;
-
-        if ([keyPath isEqualToString:@"isFinished"]) {
-            if ([operation isFinished]) {
-                [operation removeObserver:self forKeyPath:@"isFinished"];
-                [self autorelease]; // to balance the retain when we observe operations
-                oustandingFillOperationCount = OSAtomicDecrement32Barrier(&_oustandingFillOperationCount);
-                if (oustandingFillOperationCount == 0) { // done with the fill operations, now do the projection
-                    modelToVoxelTransform = [self _generatedModelToVoxelTransform];
-                    NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*[self _pixelsDeep] freeWhenDone:YES];
-                    generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh pixelsDeep:[self _pixelsDeep]
-                                                   modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
-                    _floatBytes = NULL;
-                    projectionOperation = [[NIProjectionOperation alloc] init];
-                    [projectionOperation setQueuePriority:[self queuePriority]];
-                    [projectionOperation setQualityOfService:[self qualityOfService]];
-
-                    projectionOperation.volumeData = generatedVolume;
-                    projectionOperation.projectionMode = self.request.projectionMode;
-                    if ([self isCancelled]) {
-                        [projectionOperation cancel];
-                    }
-
-                    [generatedVolume release];
-                    [projectionOperation addObserver:self forKeyPath:@"isFinished" options:0 context:&self->_fillOperations];
-                    [self retain]; // so we don't get released while the operation is going
-                    _projectionOperation = projectionOperation;
-                    [[[self class] _fillQueueForQualityOfService:self.qualityOfService] addOperation:projectionOperation];
-                } else if (oustandingFillOperationCount == -1) {
-                    assert([operation isKindOfClass:[NIProjectionOperation class]]);
-                    projectionOperation = (NIProjectionOperation *)operation;
-                    self.generatedVolume = projectionOperation.generatedVolume;
-
-                    [self willChangeValueForKey:@"isFinished"];
-                    [self willChangeValueForKey:@"isExecuting"];
-                    _operationExecuting = NO;
-                    _operationFinished = YES;
-                    [self didChangeValueForKey:@"isExecuting"];
-                    [self didChangeValueForKey:@"isFinished"];
-                }
 
-            }
+    memset(&fillGeometry, 0, sizeof(NIObliqueSliceFillGeometry));
+    fillGeometry.leftDirection = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionX), self.request.pixelSpacingX);
+    fillGeometry.downDirection = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionY), self.request.pixelSpacingY);
+    if (NIVectorEqualToVector(self.request.directionZ, NIVectorZero)) {
+        fillGeometry.inSlabNormal = NIVectorScalarMultiply(NIVectorNormalize(NIVectorCrossProduct(fillGeometry.leftDirection, fillGeometry.downDirection)), [self _slabSampleDistance]);
+    } else {
+        fillGeometry.inSlabNormal = NIVectorScalarMultiply(NIVectorNormalize(self.request.directionZ), [self _slabSampleDistance]);
+    }
+
+    // the slice is an affine map of the volume, so each fill operation only needs its start point and the steps in voxel space
+    modelToVoxelTransform = _volumeData.modelToVoxelTransform;
+    fillGeometry.volumeXStep = NIVectorApplyTransformToDirectionalVector(fillGeometry.leftDirection, modelToVoxelTransform);
+    fillGeometry.volumeYStep = NIVectorApplyTransformToDirectionalVector(fillGeometry.downDirection, modelToVoxelTransform);
+
+    if ([self _projectsWhileFilling]) { // each fill operation samples and projects every slice of its tile, so the slab is never stored
+        if (self.request.projectionMode == NIProjectionModeVR) {
+            fillGeometry.opacities = [self _opacitiesForSampleDistance:[self _slabSampleDistance] opacityTableMin:&fillGeometry.opacityTableMin opacityTableMax:&fillGeometry.opacityTableMax];
         }
+        [NIHorizontalFillOperation getTileWidth:&fillGeometry.tileWidth tileHeight:&fillGeometry.tileHeight forPixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh
+                                      slabDepth:[self _pixelsDeep] interpolationMode:self.request.interpolationMode];
     } else {
-        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        [NIHorizontalFillOperation getTileWidth:&fillGeometry.tileWidth tileHeight:&fillGeometry.tileHeight forPixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh
+                                      slabDepth:1 interpolationMode:self.request.interpolationMode];
+    }
+
+    return fillGeometry;
+}
+
+// the volume the fill operations sample, it covers the slab moved by stackStart through the slab moved by stackEnd, so that a window of parallel slices shares it
+- (NIVolumeData *)_samplingVolumeDataWithFillGeometry:(NIObliqueSliceFillGeometry)fillGeometry stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd
+{
+    NIVector volumeMin;
+    NIVector volumeMax;
+
+    if (_volumeData.mappedFilePath) {
+        [self _prefetchSlicesWithVolumeXStep:fillGeometry.volumeXStep volumeYStep:fillGeometry.volumeYStep inSlabNormal:fillGeometry.inSlabNormal stackStart:stackStart stackEnd:stackEnd];
+    } else if (_volumeData.compressedBrickSize && self.request.interpolationMode != NIInterpolationModeCubicBSpline) { // only decompress the bricks the slab goes through
+        // the B-spline coefficients of a cropped volume would be rebuilt for every slab and mirrored at the crop, so those slabs sample the whole volume
+        [self _getVolumeMin:&volumeMin max:&volumeMax withVolumeXStep:fillGeometry.volumeXStep volumeYStep:fillGeometry.volumeYStep inSlabNormal:fillGeometry.inSlabNormal stackStart:stackStart stackEnd:stackEnd];
+        return [_volumeData volumeDataForSamplingFromVolumeVector:volumeMin toVolumeVector:volumeMax];
     }
+    return _volumeData;
 }
 
-+ (NSOperationQueue *) _fillQueueForQualityOfService:(NSQualityOfService)qualityOfService
+// adds the fill operations of the slab whose center slice starts at origin, in model space, and that is stored at floatBytes
+- (void)_addFillOperationsWithFillGeometry:(NIObliqueSliceFillGeometry)fillGeometry origin:(NIVector)origin floatBytes:(float *)floatBytes
+                        samplingVolumeData:(NIVolumeData *)samplingVolumeData toArray:(NSMutableArray *)fillOperations
 {
-    if (qualityOfService == NSQualityOfServiceUserInteractive) {
-        static dispatch_once_t predInteractive;
-        static NSOperationQueue *interactiveFillQueue = nil;
-        dispatch_once(&predInteractive, ^{
-            interactiveFillQueue = [[NSOperationQueue alloc] init];
-            [interactiveFillQueue setQualityOfService:NSQualityOfServiceUserInteractive];
-            [interactiveFillQueue setName:@"NIObliqueSliceOperation Interactive fill queue"];
-        });
-        return interactiveFillQueue;
+    NSInteger x;
+    NSInteger y;
+    NSInteger z;
+    NSInteger pixelsWide = self.request.pixelsWide;
+    NSInteger pixelsHigh = self.request.pixelsHigh;
+    NSInteger pixelsDeep = [self _pixelsDeep];
+    NSUInteger tileWidth = fillGeometry.tileWidth;
+    NSUInteger tileHeight = fillGeometry.tileHeight;
+    NIVector heightOffset;
+    NIVector slabOffset;
+    NIVector volumeSlabStep;
+    NIVector volumeStart;
+    NIAffineTransform modelToVoxelTransform = samplingVolumeData.modelToVoxelTransform;
+    NIHorizontalFillOperation *horizontalFillOperation;
+
+    if ([self _projectsWhileFilling]) {
+        volumeSlabStep = NIVectorApplyTransformToDirectionalVector(fillGeometry.inSlabNormal, modelToVoxelTransform);
+        for (y = 0; y < pixelsHigh; y += tileHeight) {
+            for (x = 0; x < pixelsWide; x += tileWidth) {
+                heightOffset = NIVectorAdd(NIVectorScalarMultiply(fillGeometry.downDirection, (CGFloat)y), NIVectorScalarMultiply(fillGeometry.leftDirection, (CGFloat)x));
+                volumeStart = NIVectorApplyTransform(NIVectorAdd(origin, heightOffset), modelToVoxelTransform);
+
+                horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:samplingVolumeData interpolationMode:self.request.interpolationMode floatBytes:floatBytes + (y*pixelsWide) + x
+                                                                                          width:MIN(tileWidth, pixelsWide - x) height:MIN(tileHeight, pixelsHigh - y)
+                                                                                     volumeStart:volumeStart volumeXStep:fillGeometry.volumeXStep volumeYStep:fillGeometry.volumeYStep volumeSlabStep:volumeSlabStep slabDepth:pixelsDeep
+                                                                                  projectionMode:self.request.projectionMode];
+                horizontalFillOperation.rowStride = pixelsWide;
+                horizontalFillOperation.projectionThresholdMin = self.request.projectionThresholdMin;
+                horizontalFillOperation.projectionThresholdMax = self.request.projectionThresholdMax;
+                horizontalFillOperation.boundingVolumeData = _volumeData; // compressed volumes keep their min/max grid, the sampling subvolumes don't
+                horizontalFillOperation.opacities = fillGeometry.opacities;
+                horizontalFillOperation.opacityTableMin = fillGeometry.opacityTableMin;
+                horizontalFillOperation.opacityTableMax = fillGeometry.opacityTableMax;
+                if (self.request.projectionMode == NIProjectionModeMIPWithDepth) {
+                    horizontalFillOperation.depthFloatBytes = floatBytes + (pixelsWide*pixelsHigh) + (y*pixelsWide) + x;
+                }
+                [fillOperations addObject:horizontalFillOperation];
+                [horizontalFillOperation release];
+            }
+        }
     } else {
-        static dispatch_once_t predUserInitiated;
-        static NSOperationQueue *userInitiatedFillQueue = nil;
-        dispatch_once(&predUserInitiated, ^{
-            userInitiatedFillQueue = [[NSOperationQueue alloc] init];
-            [userInitiatedFillQueue setQualityOfService:NSQualityOfServiceUserInitiated];
-            [userInitiatedFillQueue setName:@"NIObliqueSliceOperation User Initiated fill queue"];
-        });
-        return userInitiatedFillQueue;
+        for (z = 0; z < pixelsDeep; z++) {
+            slabOffset = NIVectorScalarMultiply(fillGeometry.inSlabNormal, (CGFloat)z - (CGFloat)(pixelsDeep - 1)/2.0);
+            for (y = 0; y < pixelsHigh; y += tileHeight) {
+                for (x = 0; x < pixelsWide; x += tileWidth) {
+                    heightOffset = NIVectorAdd(NIVectorScalarMultiply(fillGeometry.downDirection, (CGFloat)y), NIVectorScalarMultiply(fillGeometry.leftDirection, (CGFloat)x));
+                    volumeStart = NIVectorApplyTransform(NIVectorAdd(NIVectorAdd(origin, heightOffset), slabOffset), modelToVoxelTransform);
+
+                    horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:samplingVolumeData interpolationMode:self.request.interpolationMode floatBytes:floatBytes + (y*pixelsWide) + x + (z*pixelsWide*pixelsHigh)
+                                                                                              width:MIN(tileWidth, pixelsWide - x) height:MIN(tileHeight, pixelsHigh - y)
+                                                                                         volumeStart:volumeStart volumeXStep:fillGeometry.volumeXStep volumeYStep:fillGeometry.volumeYStep];
+                    horizontalFillOperation.rowStride = pixelsWide;
+                    [fillOperations addObject:horizontalFillOperation];
+                    [horizontalFillOperation release];
+                }
+            }
+        }
+    }
+}
+
++ (void)reformatSlicesOfRequest:(NIObliqueSliceGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData sliceCount:(NSUInteger)sliceCount sliceSpacing:(CGFloat)sliceSpacing
+               qualityOfService:(NSQualityOfService)qualityOfService sliceBlock:(void (^)(NIVolumeData *slice, NSUInteger sliceIndex, BOOL *stop))sliceBlock
+{
+    NIObliqueSliceOperation *slabOperation;
+    NIObliqueSliceFillGeometry fillGeometry;
+    NSUInteger slicePixelsDeep;
+    NSUInteger sliceByteCount;
+    NSUInteger windowSliceCount;
+    NSUInteger windowStart;
+    NSUInteger windowEnd;
+    NSUInteger i;
+    NIVector sliceStep;
+    NIVector sliceOffset;
+    NIAffineTransform generatedModelToVoxelTransform;
+    NIVolumeData *samplingVolumeData;
+    NIVolumeData *slice;
+    NSMutableArray *fillOperations;
+    NSMutableArray<NSData *> *sliceDatas;
+    float *floatBytes;
+    BOOL stop = NO;
+
+    if (sliceCount == 0 || request.pixelsWide == 0 || request.pixelsHigh == 0) {
+        return;
+    }
+
+    // the operation is never run, it describes the first slab, the others are the same slab moved along the normal
+    slabOperation = [[[self alloc] initWithRequest:request volumeData:volumeData] autorelease];
+    fillGeometry = [slabOperation _fillGeometry];
+    sliceStep = NIVectorScalarMultiply(NIVectorNormalize(fillGeometry.inSlabNormal), sliceSpacing);
+    if ([slabOperation _projectsWhileFilling]) {
+        slicePixelsDeep = NIProjectionModeProjectedPixelsDeep(request.projectionMode);
+        generatedModelToVoxelTransform = NIAffineTransformConcat([slabOperation _generatedModelToVoxelTransform], NIAffineTransformMakeScale(1.0, 1.0, 1.0/(CGFloat)[slabOperation _pixelsDeep]));
+    } else { // slabs that are not projected are returned as they are sampled
+        slicePixelsDeep = [slabOperation _pixelsDeep];
+        generatedModelToVoxelTransform = [slabOperation _generatedModelToVoxelTransform];
+    }
+    sliceByteCount = sizeof(float) * request.pixelsWide * request.pixelsHigh * slicePixelsDeep;
+    windowSliceCount = MIN(MIN([[NSProcessInfo processInfo] activeProcessorCount], NIObliqueSliceReformatWindowByteBudget / sliceByteCount), sliceCount);
+    windowSliceCount = MAX(windowSliceCount, 1);
+
+    for (windowStart = 0; windowStart < sliceCount && stop == NO; windowStart = windowEnd) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        windowEnd = MIN(windowStart + windowSliceCount, sliceCount);
+
+        samplingVolumeData = [slabOperation _samplingVolumeDataWithFillGeometry:fillGeometry stackStart:NIVectorScalarMultiply(sliceStep, (CGFloat)windowStart)
+                                                                     stackEnd:NIVectorScalarMultiply(sliceStep, (CGFloat)(windowEnd - 1))];
+        fillOperations = [NSMutableArray array];
+        sliceDatas = [NSMutableArray array];
+        for (i = windowStart; i < windowEnd; i++) {
+            floatBytes = malloc(sliceByteCount);
+            if (floatBytes == NULL) {
+                [pool release];
+                [NSException raise:NSMallocException format:@"*** %s: couldn't allocate slice %lu", __PRETTY_FUNCTION__, (unsigned long)i];
+            }
+            // the data owns the buffer right away so that it is freed if the slices after it are not delivered
+            [sliceDatas addObject:[NSData dataWithBytesNoCopy:floatBytes length:sliceByteCount freeWhenDone:YES]];
+            [slabOperation _addFillOperationsWithFillGeometry:fillGeometry origin:NIVectorAdd(request.origin, NIVectorScalarMultiply(sliceStep, (CGFloat)i)) floatBytes:floatBytes
+                                           samplingVolumeData:samplingVolumeData toArray:fillOperations];
+        }
+
+        [NIHorizontalFillOperation runFillOperations:fillOperations qualityOfService:qualityOfService];
+
+        for (i = windowStart; i < windowEnd && stop == NO; i++) {
+            sliceOffset = NIVectorScalarMultiply(sliceStep, (CGFloat)i);
+            slice = [[NIVolumeData alloc] initWithData:[sliceDatas objectAtIndex:i - windowStart] pixelsWide:request.pixelsWide pixelsHigh:request.pixelsHigh pixelsDeep:slicePixelsDeep
+                                 modelToVoxelTransform:NIAffineTransformConcat(NIAffineTransformMakeTranslation(-sliceOffset.x, -sliceOffset.y, -sliceOffset.z), generatedModelToVoxelTransform)
+                                      outOfBoundsValue:volumeData.outOfBoundsValue];
+            sliceBlock(slice, i, &stop);
+            [slice release];
+        }
+
+        [pool release];
+    }
+}
+
+// builds the generated volume once the fill operations are done, running the projection of the slab if it wasn't projected while it was filled
+- (void)_finishFilling
+{
+    NIVolumeData *generatedVolume;
+    NIAffineTransform modelToVoxelTransform;
+    NIProjectionOperation *projectionOperation;
+
+    if ([self _projectsWhileFilling]) { // the fill operations already projected the slab
+        modelToVoxelTransform = NIAffineTransformConcat([self _generatedModelToVoxelTransform], NIAffineTransformMakeScale(1.0, 1.0, 1.0/(CGFloat)[self _pixelsDeep]));
+        NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*NIProjectionModeProjectedPixelsDeep(self.request.projectionMode)
+                                           freeWhenDone:YES];
+        _floatBytes = NULL;
+        if ([self isCancelled] == NO) {
+            generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh
+                                                      pixelsDeep:NIProjectionModeProjectedPixelsDeep(self.request.projectionMode)
+                                           modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
+            self.generatedVolume = generatedVolume;
+            [generatedVolume release];
+        }
+    } else { // done with the fill operations, now do the projection
+        modelToVoxelTransform = [self _generatedModelToVoxelTransform];
+        NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*[self _pixelsDeep] freeWhenDone:YES];
+        generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh pixelsDeep:[self _pixelsDeep]
+                                       modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
+        _floatBytes = NULL;
+        projectionOperation = [[NIProjectionOperation alloc] init];
+        [projectionOperation setQualityOfService:[self qualityOfService]];
+
+        projectionOperation.volumeData = generatedVolume;
+        projectionOperation.projectionMode = self.request.projectionMode;
+        projectionOperation.projectionThresholdMin = self.request.projectionThresholdMin;
+        projectionOperation.projectionThresholdMax = self.request.projectionThresholdMax;
+        [generatedVolume release];
+
+        @synchronized (_fillOperations) {
+            _projectionOperation = projectionOperation;
+        }
+        if ([self isCancelled]) {
+            [projectionOperation cancel];
+        }
+        [projectionOperation start]; // the projection operation reduces its rows in parallel itself
+        self.generatedVolume = projectionOperation.generatedVolume;
+    }
+
+    [self willChangeValueForKey:@"isFinished"];
+    [self willChangeValueForKey:@"isExecuting"];
+    _operationExecuting = NO;
+    _operationFinished = YES;
+    [self didChangeValueForKey:@"isExecuting"];
+    [self didChangeValueForKey:@"isFinished"];
+}
+
+// the box in voxel space that holds all the sample points of the slab moved by stackStart and of the slab moved by stackEnd
+- (void)_getVolumeMin:(NIVectorPointer)volumeMin max:(NIVectorPointer)volumeMax withVolumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep inSlabNormal:(NIVector)inSlabNormal
+           stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd
+{
+    NIAffineTransform modelToVoxelTransform = _volumeData.modelToVoxelTransform;
+    NSInteger pixelsDeep = [self _pixelsDeep];
+    NIVector volumeSlabStep = NIVectorApplyTransformToDirectionalVector(inSlabNormal, modelToVoxelTransform);
+    NIVector volumeStackStart = NIVectorApplyTransformToDirectionalVector(stackStart, modelToVoxelTransform);
+    NIVector volumeStackEnd = NIVectorApplyTransformToDirectionalVector(stackEnd, modelToVoxelTransform);
+    NIVector volumeOrigin = NIVectorApplyTransform(NIVectorAdd(self.request.origin, NIVectorScalarMultiply(inSlabNormal, (CGFloat)(pixelsDeep - 1)/-2.0)), modelToVoxelTransform);
+    NIVector corner;
+    NSInteger i;
+
+    *volumeMin = NIVectorMake(CGFLOAT_MAX, CGFLOAT_MAX, CGFLOAT_MAX);
+    *volumeMax = NIVectorMake(-CGFLOAT_MAX, -CGFLOAT_MAX, -CGFLOAT_MAX);
+
+    for (i = 0; i < 16; i++) {
+        corner = volumeOrigin;
+        if (i & 1) {
+            corner = NIVectorAdd(corner, NIVectorScalarMultiply(volumeXStep, (CGFloat)(self.request.pixelsWide - 1)));
+        }
+        if (i & 2) {
+            corner = NIVectorAdd(corner, NIVectorScalarMultiply(volumeYStep, (CGFloat)(self.request.pixelsHigh - 1)));
+        }
+        if (i & 4) {
+            corner = NIVectorAdd(corner, NIVectorScalarMultiply(volumeSlabStep, (CGFloat)(pixelsDeep - 1)));
+        }
+        corner = NIVectorAdd(corner, (i & 8) ? volumeStackEnd : volumeStackStart);
+        *volumeMin = NIVectorMake(MIN(volumeMin->x, corner.x), MIN(volumeMin->y, corner.y), MIN(volumeMin->z, corner.z));
+        *volumeMax = NIVectorMake(MAX(volumeMax->x, corner.x), MAX(volumeMax->y, corner.y), MAX(volumeMax->z, corner.z));
+    }
+}
+
+// asks for the z slices of a mapped volume that the slab crosses to be paged in, so that the fill operations don't each wait on their own page faults
+- (void)_prefetchSlicesWithVolumeXStep:(NIVector)volumeXStep volumeYStep:(NIVector)volumeYStep inSlabNormal:(NIVector)inSlabNormal stackStart:(NIVector)stackStart stackEnd:(NIVector)stackEnd
+{
+    NIVector volumeMin;
+    NIVector volumeMax;
+    CGFloat minZ;
+    CGFloat maxZ;
+
+    [self _getVolumeMin:&volumeMin max:&volumeMax withVolumeXStep:volumeXStep volumeYStep:volumeYStep inSlabNormal:inSlabNormal stackStart:stackStart stackEnd:stackEnd];
+
+    // the interpolation kernels reach up to 2 slices past the sample points
+    minZ = MAX(floor(volumeMin.z) - 2.0, 0.0);
+    maxZ = MIN(ceil(volumeMax.z) + 2.0, (CGFloat)_volumeData.pixelsDeep - 1.0);
+    if (maxZ >= minZ) {
+        [_volumeData prefetchSlicesInRange:NSMakeRange((NSUInteger)minZ, (NSUInteger)(maxZ - minZ) + 1)];
     }
 }
 
@@ -343,6 +517,12 @@ static const NSUInteger FILL_HEIGHT = 40;
 #endif
 }
 
+// every projection is reduced by the fill operations as the slab is sampled, only slabs that aren't projected are stored
+- (BOOL)_projectsWhileFilling
+{
+    return self.request.projectionMode != NIProjectionModeNone;
+}
+
 - (NIAffineTransform)_generatedModelToVoxelTransform
 {
     NIAffineTransform modelToVoxelTransform;
@@ -27,13 +27,50 @@
 
 @class NIVolumeData;
 
+CF_EXTERN_C_BEGIN
+
+// the number of slices of the generated volume of a projection, NIProjectionModeMIPWithDepth adds the slice of the depths of the maximums
+CF_INLINE NSUInteger NIProjectionModeProjectedPixelsDeep(NIProjectionMode projectionMode)
+{
+    return projectionMode == NIProjectionModeMIPWithDepth ? 2 : 1;
+}
+
+// a ray whose transmittance falls below this is treated as opaque, and nothing behind it is sampled
+static const float NIProjectionOpaqueTransmittance = 1.0f / 256.0f;
+
+// the opacities that are used when there is no opacity table, a ramp from transparent at the bottom of the table range to opaque at its top
+static const float NIProjectionDefaultOpacities[] = {0, 1};
+
+// composites the values of a slice behind the slices that were already composited into colors, front to back. The opacity of each value is looked up in the
+// opacities, which are spread evenly from opacityTableMin to opacityTableMax and interpolated linearly, values outside the range take the opacity at the nearest end.
+// Empty opacities are treated as NIProjectionDefaultOpacities. The colors accumulate transmittance * opacity * value and the transmittances are attenuated by the
+// opacities. scratch needs room for count floats
+void NIProjectionCompositeSlice(const float *values, const float *opacities, NSUInteger opacityCount, float opacityTableMin, float opacityTableMax,
+                                float *colors, float *transmittances, float *scratch, NSUInteger count);
+
+// keeps the larger of values and maximums in maximums, and sets depths to depth where values are larger, so ties keep the depth they already had
+void NIProjectionReduceSliceWithDepth(const float *values, float depth, float *maximums, float *depths, NSUInteger count);
+
+// turns the sums of the deviations of sampleCount samples from a shift, and the sums of their squares, into the standard deviations of the samples
+void NIProjectionFinishStandardDeviation(float *sums, const float *sumSquares, NSUInteger sampleCount, NSUInteger count);
+
+CF_EXTERN_C_END
+
 // give this operation a volumeData at the start, when the operation is finished, if everything went well, generated volume will be the projection through the Z (depth) direction
+// the slab is reduced in a single pass over its slices, whatever the projection mode, in bands of rows that are reduced in parallel. If the operation is
+// cancelled, the bands stop at the next slice and generatedVolume stays nil
 
 @interface NIProjectionOperation : NSOperation {
     NIVolumeData *_volumeData;
     NIVolumeData *_generatedVolume;
 
     NIProjectionMode _projectionMode;
+    float _projectionThresholdMin;
+    float _projectionThresholdMax;
+
+    NSData *_opacities;
+    float _opacityTableMin;
+    float _opacityTableMax;
 }
 
 @property (nonatomic, readwrite, retain) NIVolumeData *volumeData;
@@ -41,6 +78,16 @@
 
 @property (nonatomic, readwrite, assign) NIProjectionMode projectionMode;
 
+// MIP and MinIP projections, with or without depth, are clamped to this window, -INFINITY and INFINITY by default
+@property (nonatomic, readwrite, assign) float projectionThresholdMin;
+@property (nonatomic, readwrite, assign) float projectionThresholdMax;
+
+// the opacities of one slice of the volume for NIProjectionModeVR, spread evenly from opacityTableMin to opacityTableMax, NIProjectionDefaultOpacities if they are
+// empty. The first slice is the front of the slab, and whatever transmittance is left behind the last slice is filled with the outOfBoundsValue of the volume
+@property (nonatomic, readwrite, retain) NSData *opacities;
+@property (nonatomic, readwrite, assign) float opacityTableMin;
+@property (nonatomic, readwrite, assign) float opacityTableMax;
+
 @end
 
 #endif /* _NIPROJECTIONOPERATION_H_ */
@@ -23,16 +23,73 @@
 #include <Accelerate/Accelerate.h>
 #import "NIVolumeData.h"
 
+void NIProjectionCompositeSlice(const float *values, const float *opacities, NSUInteger opacityCount, float opacityTableMin, float opacityTableMax,
+                                float *colors, float *transmittances, float *scratch, NSUInteger count)
+{
+    float scale;
+    float offset;
+
+    if (opacityCount == 0) {
+        opacities = NIProjectionDefaultOpacities;
+        opacityCount = sizeof(NIProjectionDefaultOpacities) / sizeof(float);
+    }
+
+    scale = opacityTableMax > opacityTableMin ? (float)(opacityCount - 1) / (opacityTableMax - opacityTableMin) : 0;
+    offset = -opacityTableMin * scale;
+    vDSP_vtabi(values, 1, &scale, &offset, opacities, opacityCount, scratch, 1, count);
+
+    vDSP_vmul(scratch, 1, transmittances, 1, scratch, 1, count); // the part of each ray that stops at this slice
+    vDSP_vma(scratch, 1, values, 1, colors, 1, colors, 1, count);
+    vDSP_vsub(scratch, 1, transmittances, 1, transmittances, 1, count);
+}
+
+void NIProjectionReduceSliceWithDepth(const float *values, float depth, float *maximums, float *depths, NSUInteger count)
+{
+    NSUInteger i;
+
+    for (i = 0; i < count; i++) {
+        if (values[i] > maximums[i]) {
+            maximums[i] = values[i];
+            depths[i] = depth;
+        }
+    }
+}
+
+// the samples are shifted so that the sum of the squares stays close to the variance, which keeps the precision of floats for intensities that are far from 0
+void NIProjectionFinishStandardDeviation(float *sums, const float *sumSquares, NSUInteger sampleCount, NSUInteger count)
+{
+    NSUInteger i;
+    float mean;
+    float variance;
+
+    for (i = 0; i < count; i++) {
+        mean = sums[i] / (float)sampleCount;
+        variance = sumSquares[i] / (float)sampleCount - mean * mean;
+        sums[i] = variance > 0 ? sqrtf(variance) : 0;
+    }
+}
+
+@interface NIProjectionOperation ()
+- (BOOL)_projectPixelsInRange:(NSRange)range volumeFloats:(const float *)volumeFloats floatBytes:(float *)floatBytes;
+@end
+
 @implementation NIProjectionOperation
 
 @synthesize volumeData = _volumeData;
 @synthesize generatedVolume = _generatedVolume;
 @synthesize projectionMode = _projectionMode;
+@synthesize projectionThresholdMin = _projectionThresholdMin;
+@synthesize projectionThresholdMax = _projectionThresholdMax;
+@synthesize opacities = _opacities;
+@synthesize opacityTableMin = _opacityTableMin;
+@synthesize opacityTableMax = _opacityTableMax;
 
 - (id)init
 {
     if ( (self = [super init]) ) {
         _projectionMode = NIProjectionModeNone;
+        _projectionThresholdMin = -INFINITY;
+        _projectionThresholdMax = INFINITY;
     }
     return self;
 }
@@ -43,17 +100,22 @@
     _volumeData = nil;
     [_generatedVolume release];
     _generatedVolume = nil;
+    [_opacities release];
+    _opacities = nil;
     [super dealloc];
 }
 
 - (void)main
 {
     float *floatBytes;
-    NSInteger i;
-    float floati;
-    NSInteger pixelsPerPlane;
+    NSUInteger pixelsWide;
+    NSUInteger pixelsHigh;
+    NSUInteger projectedPixelsDeep;
+    NSUInteger bandCount;
     NIAffineTransform modelToVoxelTransform;
-    NIVolumeDataInlineBuffer inlineBuffer;
+    qos_class_t qualityOfServiceClass;
+    const float *volumeFloats;
+    __block volatile BOOL failed = NO;
 
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 
@@ -67,44 +129,42 @@
             return;
         }
 
-        pixelsPerPlane = _volumeData.pixelsWide * _volumeData.pixelsHigh;
-        floatBytes = malloc(sizeof(float) * pixelsPerPlane);
-
-        [_volumeData acquireInlineBuffer:&inlineBuffer];
-        memcpy(floatBytes, NIVolumeDataFloatBytes(&inlineBuffer), sizeof(float) * pixelsPerPlane);
-        switch (_projectionMode) {
-            case NIProjectionModeMIP:
-                for (i = 1; i < _volumeData.pixelsDeep; i++) {
-                    if ([self isCancelled]) {
-                        break;
-                    }
-                    vDSP_vmax(floatBytes, 1, (float *)NIVolumeDataFloatBytes(&inlineBuffer) + (i * pixelsPerPlane), 1, floatBytes, 1, pixelsPerPlane);
-                }
-                break;
-            case NIProjectionModeMinIP:
-                for (i = 1; i < _volumeData.pixelsDeep; i++) {
-                    if ([self isCancelled]) {
-                        break;
-                    }
-                    vDSP_vmin(floatBytes, 1, (float *)NIVolumeDataFloatBytes(&inlineBuffer) + (i * pixelsPerPlane), 1, floatBytes, 1, pixelsPerPlane);
-                }
-                break;
-            case NIProjectionModeMean:
-                for (i = 1; i < _volumeData.pixelsDeep; i++) {
-                    if ([self isCancelled]) {
-                        break;
-                    }
-                    floati = i;
-                    vDSP_vavlin((float *)NIVolumeDataFloatBytes(&inlineBuffer) + (i * pixelsPerPlane), 1, &floati, floatBytes, 1, pixelsPerPlane);
+        pixelsWide = _volumeData.pixelsWide;
+        pixelsHigh = _volumeData.pixelsHigh;
+        projectedPixelsDeep = NIProjectionModeProjectedPixelsDeep(_projectionMode);
+        floatBytes = malloc(sizeof(float) * pixelsWide * pixelsHigh * projectedPixelsDeep);
+        if (floatBytes == NULL) {
+            return;
+        }
+        // floatData is flat for every kind of volume, the inline buffer of a bricked or padded volume is not. A compressed volume keeps its floatData once it is
+        // built, so it is read through an uncompressed copy that goes away with the operation instead
+        if (_volumeData.compressedBrickSize) {
+            volumeFloats = (const float *)[[_volumeData volumeDataWithIndexRangesX:NSMakeRange(0, pixelsWide) y:NSMakeRange(0, pixelsHigh) z:NSMakeRange(0, _volumeData.pixelsDeep)].floatData bytes];
+        } else {
+            volumeFloats = (const float *)[_volumeData.floatData bytes];
+        }
+
+        // the rows are split in bands that are reduced in parallel, on the global queue of the quality of service the operation was given
+        qualityOfServiceClass = [self qualityOfService] == NSQualityOfServiceDefault ? QOS_CLASS_DEFAULT : (qos_class_t)[self qualityOfService];
+        bandCount = MAX(MIN(pixelsHigh, [[NSProcessInfo processInfo] activeProcessorCount] * 4), 1);
+        dispatch_apply(bandCount, dispatch_get_global_queue(qualityOfServiceClass, 0), ^(size_t band) {
+            NSUInteger firstRow = (band * pixelsHigh) / bandCount;
+            NSUInteger lastRow = ((band + 1) * pixelsHigh) / bandCount;
+            if ([self isCancelled] == NO && failed == NO) {
+                if ([self _projectPixelsInRange:NSMakeRange(firstRow * pixelsWide, (lastRow - firstRow) * pixelsWide) volumeFloats:volumeFloats floatBytes:floatBytes] == NO) {
+                    failed = YES;
                 }
-                break;
-            default:
-                break;
+            }
+        });
+
+        if ([self isCancelled] || failed) {
+            free(floatBytes);
+            return;
         }
 
         modelToVoxelTransform = NIAffineTransformConcat(_volumeData.modelToVoxelTransform, NIAffineTransformMakeScale(1.0, 1.0, 1.0/(CGFloat)_volumeData.pixelsDeep));
-        NSData *floatData = [NSData dataWithBytesNoCopy:floatBytes length:sizeof(float)*_volumeData.pixelsWide*_volumeData.pixelsHigh freeWhenDone:YES];
-        _generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:_volumeData.pixelsWide pixelsHigh:_volumeData.pixelsHigh pixelsDeep:1
+        NSData *floatData = [NSData dataWithBytesNoCopy:floatBytes length:sizeof(float)*pixelsWide*pixelsHigh*projectedPixelsDeep freeWhenDone:YES];
+        _generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:projectedPixelsDeep
                                         modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
     }
     @catch (...) {
@@ -114,6 +174,131 @@
     }
 }
 
+// projects the pixels of range in every slice of volumeFloats into the same range of floatBytes, cancellation is checked slice by slice. Returns NO if the
+// scratch space of the projection couldn't be allocated
+- (BOOL)_projectPixelsInRange:(NSRange)range volumeFloats:(const float *)volumeFloats floatBytes:(float *)floatBytes
+{
+    NSUInteger i;
+    float floati;
+    const NSUInteger pixelsPerPlane = _volumeData.pixelsWide * _volumeData.pixelsHigh;
+    const NSUInteger count = range.length;
+    float *values;
+    float *transmittances;
+    float maxTransmittance;
+    float outOfBoundsValue;
+    float *shifts;
+    float *sumSquares;
+    float *deviations;
+
+    if (count == 0) {
+        return YES;
+    }
+
+    volumeFloats += range.location;
+    values = floatBytes + range.location;
+    if (_projectionMode != NIProjectionModeVR) {
+        memcpy(values, volumeFloats, sizeof(float) * count);
+    }
+    switch (_projectionMode) {
+        case NIProjectionModeMIP:
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                vDSP_vmax(values, 1, volumeFloats + (i * pixelsPerPlane), 1, values, 1, count);
+            }
+            break;
+        case NIProjectionModeMinIP:
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                vDSP_vmin(values, 1, volumeFloats + (i * pixelsPerPlane), 1, values, 1, count);
+            }
+            break;
+        case NIProjectionModeMean:
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                floati = i;
+                vDSP_vavlin(volumeFloats + (i * pixelsPerPlane), 1, &floati, values, 1, count);
+            }
+            break;
+        case NIProjectionModeSum:
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                vDSP_vadd(values, 1, volumeFloats + (i * pixelsPerPlane), 1, values, 1, count);
+            }
+            break;
+        case NIProjectionModeStandardDeviation: // the deviations from the first slice and their squares are summed
+            shifts = malloc(sizeof(float) * count * 3);
+            if (shifts == NULL) {
+                return NO;
+            }
+            sumSquares = shifts + count;
+            deviations = shifts + (2 * count);
+            memcpy(shifts, values, sizeof(float) * count);
+            vDSP_vclr(values, 1, count);
+            vDSP_vclr(sumSquares, 1, count);
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                vDSP_vsub(shifts, 1, volumeFloats + (i * pixelsPerPlane), 1, deviations, 1, count);
+                vDSP_vadd(values, 1, deviations, 1, values, 1, count);
+                vDSP_vma(deviations, 1, deviations, 1, sumSquares, 1, sumSquares, 1, count);
+            }
+            NIProjectionFinishStandardDeviation(values, sumSquares, _volumeData.pixelsDeep, count);
+            free(shifts);
+            break;
+        case NIProjectionModeMIPWithDepth:
+            vDSP_vclr(values + pixelsPerPlane, 1, count);
+            for (i = 1; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                NIProjectionReduceSliceWithDepth(volumeFloats + (i * pixelsPerPlane), (float)i, values, values + pixelsPerPlane, count);
+            }
+            break;
+        case NIProjectionModeVR: // the slices are composited front to back until every ray is opaque
+            transmittances = malloc(sizeof(float) * count * 2);
+            if (transmittances == NULL) {
+                return NO;
+            }
+            maxTransmittance = 1;
+            vDSP_vclr(values, 1, count);
+            vDSP_vfill(&maxTransmittance, transmittances, 1, count);
+            for (i = 0; i < _volumeData.pixelsDeep; i++) {
+                if ([self isCancelled]) {
+                    break;
+                }
+                NIProjectionCompositeSlice(volumeFloats + (i * pixelsPerPlane), [_opacities bytes], [_opacities length] / sizeof(float), _opacityTableMin, _opacityTableMax,
+                                           values, transmittances, transmittances + count, count);
+                vDSP_maxv(transmittances, 1, &maxTransmittance, count);
+                if (maxTransmittance < NIProjectionOpaqueTransmittance) { // the rays are as good as opaque, like in the fill operations none of the background shows
+                    vDSP_vclr(transmittances, 1, count);
+                    break;
+                }
+            }
+            outOfBoundsValue = _volumeData.outOfBoundsValue;
+            vDSP_vsma(transmittances, 1, &outOfBoundsValue, values, 1, values, 1, count);
+            free(transmittances);
+            break;
+        default:
+            break;
+    }
+
+    if ((_projectionMode == NIProjectionModeMIP || _projectionMode == NIProjectionModeMinIP || _projectionMode == NIProjectionModeMIPWithDepth) &&
+        (_projectionThresholdMin != -INFINITY || _projectionThresholdMax != INFINITY)) {
+        vDSP_vclip(values, 1, &_projectionThresholdMin, &_projectionThresholdMax, values, 1, count);
+    }
+
+    return YES;
+}
+
 @end
 
 
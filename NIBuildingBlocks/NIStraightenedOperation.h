@@ -27,10 +27,8 @@
 #import "NIGeneratorRequest.h"
 
 @interface NIStraightenedOperation : NIGeneratorOperation {
-    volatile int32_t _outstandingFillOperationCount __attribute__ ((aligned (4)));
-    
     float *_floatBytes;
-    NSMutableSet *_fillOperations;
+    NSMutableArray *_fillOperations;
 	NSOperation *_projectionOperation;
     BOOL _operationExecuting;
     BOOL _operationFinished;
@@ -29,15 +29,13 @@
 #import "NIVolumeData.h"
 #import "NIHorizontalFillOperation.h"
 #import "NIProjectionOperation.h"
-#include <libkern/OSAtomic.h>
-
-static const NSUInteger FILL_HEIGHT = 40;
 
 @interface NIStraightenedOperation ()
 
-+ (NSOperationQueue *) _fillQueueForQualityOfService:(NSQualityOfService)qualityOfService;
+- (void)_finishFilling;
 - (CGFloat)_slabSampleDistance;
 - (NSUInteger)_pixelsDeep;
+- (BOOL)_projectsWhileFilling;
 
 @end
 
@@ -49,7 +47,7 @@ static const NSUInteger FILL_HEIGHT = 40;
 - (id)initWithRequest:(NIStraightenedGeneratorRequest *)request volumeData:(NIVolumeData *)volumeData
 {
     if ( (self = [super initWithRequest:request volumeData:volumeData]) ) {
-        _fillOperations = [[NSMutableSet alloc] init];
+        _fillOperations = [[NSMutableArray alloc] init];
     }
     return self;
 }
@@ -65,7 +63,7 @@ static const NSUInteger FILL_HEIGHT = 40;
 
 - (BOOL)isConcurrent
 {
-    return YES;
+    return NO;
 }
 
 - (BOOL)isExecuting {
@@ -88,8 +86,8 @@ static const NSUInteger FILL_HEIGHT = 40;
         for (operation in _fillOperations) {
             [operation cancel];
         }
+        [_projectionOperation cancel];
     }
-	[_projectionOperation cancel];
     
     [super cancel];
 }
@@ -117,8 +115,11 @@ static const NSUInteger FILL_HEIGHT = 40;
     CGFloat slabDistance;
     NSInteger numVectors;
     NSInteger i;
+    NSInteger x;
     NSInteger y;
     NSInteger z;
+    NSUInteger tileWidth;
+    NSUInteger tileHeight;
     NSInteger pixelsWide;
     NSInteger pixelsHigh;
     NSInteger pixelsDeep;
@@ -130,8 +131,11 @@ static const NSUInteger FILL_HEIGHT = 40;
     NIVectorArray inSlabNormals;
     NIMutableBezierCoreRef flattenedBezierCore;
     NIHorizontalFillOperation *horizontalFillOperation;
-    NSMutableSet *fillOperations;
-	NSOperationQueue *fillQueue;
+    NSMutableArray *fillOperations;
+    NIVolumeData *samplingVolumeData;
+    NSData *opacities = nil;
+    float opacityTableMin = 0;
+    float opacityTableMax = 0;
     
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
     
@@ -148,7 +152,7 @@ static const NSUInteger FILL_HEIGHT = 40;
             numVectors = pixelsWide;
             _sampleSpacing = bezierLength / (CGFloat)pixelsWide;
             
-            _floatBytes = malloc(sizeof(float) * pixelsWide * pixelsHigh * pixelsDeep);
+            _floatBytes = malloc(sizeof(float) * pixelsWide * pixelsHigh * ([self _projectsWhileFilling] ? NIProjectionModeProjectedPixelsDeep(self.request.projectionMode) : pixelsDeep));
             vectors = malloc(sizeof(NIVector) * pixelsWide);
             fillVectors = malloc(sizeof(NIVector) * pixelsWide);
             fillNormals = malloc(sizeof(NIVector) * pixelsWide);
@@ -206,31 +210,64 @@ static const NSUInteger FILL_HEIGHT = 40;
             memcpy(inSlabNormals, normals, sizeof(NIVector) * pixelsWide);
             NIVectorCrossProductWithVectors(inSlabNormals, tangents, pixelsWide);
             NIVectorScalarMultiplyVectors([self _slabSampleDistance], inSlabNormals, pixelsWide);
+            samplingVolumeData = [self _samplingVolumeDataWithVectors:vectors normals:fillNormals slabNormals:inSlabNormals vectorCount:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep];
             
-            fillOperations = [NSMutableSet set];
+            fillOperations = [NSMutableArray array]; // consecutive fill operations are neighbouring tiles, so they are kept in order for the scheduler
             
-            for (z = 0; z < pixelsDeep; z++) {
-                for (y = 0; y < pixelsHigh; y += FILL_HEIGHT) {
+            if ([self _projectsWhileFilling]) { // each fill operation samples and projects every slice of its tile, so the slab is never stored
+                if (self.request.projectionMode == NIProjectionModeVR) {
+                    opacities = [self _opacitiesForSampleDistance:[self _slabSampleDistance] opacityTableMin:&opacityTableMin opacityTableMax:&opacityTableMax];
+                }
+                [NIHorizontalFillOperation getTileWidth:&tileWidth tileHeight:&tileHeight forPixelsWide:pixelsWide pixelsHigh:pixelsHigh slabDepth:pixelsDeep interpolationMode:self.request.interpolationMode];
+                for (y = 0; y < pixelsHigh; y += tileHeight) {
                     fillDistance = (CGFloat)y - (CGFloat)(pixelsHigh - 1)/2.0; // the distance to go out from the centerline
-                    slabDistance = (CGFloat)z - (CGFloat)(pixelsDeep - 1)/2.0; // the distance to go out from the centerline
                     for (i = 0; i < pixelsWide; i++) {
-                        fillVectors[i] = NIVectorAdd(NIVectorAdd(vectors[i], NIVectorScalarMultiply(fillNormals[i], fillDistance)), NIVectorScalarMultiply(inSlabNormals[i], slabDistance));
+                        fillVectors[i] = NIVectorAdd(vectors[i], NIVectorScalarMultiply(fillNormals[i], fillDistance));
                     }
                     
-                    horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:_volumeData interpolationMode:self.request.interpolationMode floatBytes:_floatBytes + (y*pixelsWide) + (z*pixelsWide*pixelsHigh) width:pixelsWide height:MIN(FILL_HEIGHT, pixelsHigh - y)
-                                                                                             vectors:fillVectors normals:fillNormals];
-                    [horizontalFillOperation setQueuePriority:[self queuePriority]];
-                    [horizontalFillOperation setQualityOfService:[self qualityOfService]];
-
-					[fillOperations addObject:horizontalFillOperation];
-                    [horizontalFillOperation addObserver:self forKeyPath:@"isFinished" options:0 context:&self->_fillOperations];
-                    [self retain]; // so we don't get release while the operation is going
-                    [horizontalFillOperation release];
+                    for (x = 0; x < pixelsWide; x += tileWidth) { // the fill operations copy the vectors of their columns
+                        horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:samplingVolumeData interpolationMode:self.request.interpolationMode floatBytes:_floatBytes + (y*pixelsWide) + x
+                                                                                                  width:MIN(tileWidth, pixelsWide - x) height:MIN(tileHeight, pixelsHigh - y)
+                                                                                                vectors:fillVectors + x normals:fillNormals + x slabNormals:inSlabNormals + x slabDepth:pixelsDeep
+                                                                                         projectionMode:self.request.projectionMode];
+                        horizontalFillOperation.rowStride = pixelsWide;
+                        horizontalFillOperation.projectionThresholdMin = self.request.projectionThresholdMin;
+                        horizontalFillOperation.projectionThresholdMax = self.request.projectionThresholdMax;
+                        horizontalFillOperation.boundingVolumeData = _volumeData; // compressed volumes keep their min/max grid, the sampling subvolumes don't
+                        horizontalFillOperation.opacities = opacities;
+                        horizontalFillOperation.opacityTableMin = opacityTableMin;
+                        horizontalFillOperation.opacityTableMax = opacityTableMax;
+                        if (self.request.projectionMode == NIProjectionModeMIPWithDepth) {
+                            horizontalFillOperation.depthFloatBytes = _floatBytes + (pixelsWide*pixelsHigh) + (y*pixelsWide) + x;
+                        }
+                        [fillOperations addObject:horizontalFillOperation];
+                        [horizontalFillOperation release];
+                    }
+                }
+            } else {
+                [NIHorizontalFillOperation getTileWidth:&tileWidth tileHeight:&tileHeight forPixelsWide:pixelsWide pixelsHigh:pixelsHigh slabDepth:1 interpolationMode:self.request.interpolationMode];
+                for (z = 0; z < pixelsDeep; z++) {
+                    for (y = 0; y < pixelsHigh; y += tileHeight) {
+                        fillDistance = (CGFloat)y - (CGFloat)(pixelsHigh - 1)/2.0; // the distance to go out from the centerline
+                        slabDistance = (CGFloat)z - (CGFloat)(pixelsDeep - 1)/2.0; // the distance to go out from the centerline
+                        for (i = 0; i < pixelsWide; i++) {
+                            fillVectors[i] = NIVectorAdd(NIVectorAdd(vectors[i], NIVectorScalarMultiply(fillNormals[i], fillDistance)), NIVectorScalarMultiply(inSlabNormals[i], slabDistance));
+                        }
+                        
+                        for (x = 0; x < pixelsWide; x += tileWidth) {
+                            horizontalFillOperation = [[NIHorizontalFillOperation alloc] initWithVolumeData:samplingVolumeData interpolationMode:self.request.interpolationMode floatBytes:_floatBytes + (y*pixelsWide) + x + (z*pixelsWide*pixelsHigh)
+                                                                                                      width:MIN(tileWidth, pixelsWide - x) height:MIN(tileHeight, pixelsHigh - y)
+                                                                                                    vectors:fillVectors + x normals:fillNormals + x];
+                            horizontalFillOperation.rowStride = pixelsWide;
+                            [fillOperations addObject:horizontalFillOperation];
+                            [horizontalFillOperation release];
+                        }
+                    }
                 }
             }
             
             @synchronized (_fillOperations) {
-                [_fillOperations setSet:fillOperations];
+                [_fillOperations setArray:fillOperations];
             }            
             
             if ([self isCancelled]) {
@@ -239,20 +276,17 @@ static const NSUInteger FILL_HEIGHT = 40;
                 }                
             }
             
-            _outstandingFillOperationCount = (int32_t)[fillOperations count];
-            			
-			fillQueue = [[self class] _fillQueueForQualityOfService:self.qualityOfService];
-			for (horizontalFillOperation in fillOperations) {
-				[fillQueue addOperation:horizontalFillOperation];
-			}
-			
-			free(vectors);
+            free(vectors);
             free(fillVectors);
             free(fillNormals);
             free(tangents);
             free(normals);
             free(inSlabNormals);
             NIBezierCoreRelease(flattenedBezierCore);
+
+            // the fill operations are only descriptors of the bands, the scheduler runs them and returns once they are all done
+            [NIHorizontalFillOperation runFillOperations:fillOperations qualityOfService:self.qualityOfService];
+            [self _finishFilling];
         } else {
             [self willChangeValueForKey:@"isFinished"];
             [self willChangeValueForKey:@"isExecuting"];
@@ -276,86 +310,56 @@ static const NSUInteger FILL_HEIGHT = 40;
     }
 }
 
-- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+// builds the generated volume once the fill operations are done, running the projection of the slab if it wasn't projected while it was filled
+- (void)_finishFilling
 {
-    NSOperation *operation;
     NIVolumeData *generatedVolume;
     NIAffineTransform modelToVoxelTransform;
     NIProjectionOperation *projectionOperation;
-    int32_t oustandingFillOperationCount;
-    
-    if (context == &self->_fillOperations) {
-        assert([object isKindOfClass:[NSOperation class]]);
-        operation = (NSOperation *)object;
-        
-        if ([keyPath isEqualToString:@"isFinished"]) {
-            if ([operation isFinished]) {
-                [operation removeObserver:self forKeyPath:@"isFinished"];
-                [self autorelease]; // to balance the retain when we observe operations
-                oustandingFillOperationCount = OSAtomicDecrement32Barrier(&_outstandingFillOperationCount);
-                if (oustandingFillOperationCount == 0) { // done with the fill operations, now do the projection
-                    modelToVoxelTransform = NIAffineTransformMakeScale(1.0/_sampleSpacing, 1.0/_sampleSpacing, 1.0/[self _slabSampleDistance]);
-                    NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*[self _pixelsDeep] freeWhenDone:YES];
-                    generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh pixelsDeep:[self _pixelsDeep]
-                                                   modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
-                    _floatBytes = NULL;
-                    projectionOperation = [[NIProjectionOperation alloc] init];
-					[projectionOperation setQueuePriority:[self queuePriority]];
-                    [projectionOperation setQualityOfService:[self qualityOfService]];
-
-                    projectionOperation.volumeData = generatedVolume;
-                    projectionOperation.projectionMode = self.request.projectionMode;
-					if ([self isCancelled]) {
-						[projectionOperation cancel];
-					}
-                    					
-                    [generatedVolume release];
-                    [projectionOperation addObserver:self forKeyPath:@"isFinished" options:0 context:&self->_fillOperations];
-                    [self retain]; // so we don't get released while the operation is going
-                    _projectionOperation = projectionOperation;
-                    [[[self class] _fillQueueForQualityOfService:self.qualityOfService] addOperation:projectionOperation];
-                } else if (oustandingFillOperationCount == -1) {
-                    assert([operation isKindOfClass:[NIProjectionOperation class]]);
-                    projectionOperation = (NIProjectionOperation *)operation;
-                    self.generatedVolume = projectionOperation.generatedVolume;
-
-                    [self willChangeValueForKey:@"isFinished"];
-                    [self willChangeValueForKey:@"isExecuting"];
-                    _operationExecuting = NO;
-                    _operationFinished = YES;
-					
-                    [self didChangeValueForKey:@"isExecuting"];
-                    [self didChangeValueForKey:@"isFinished"];
-                }
 
-            }
+    if ([self _projectsWhileFilling]) { // the fill operations already projected the slab
+        modelToVoxelTransform = NIAffineTransformMakeScale(1.0/_sampleSpacing, 1.0/_sampleSpacing, 1.0/([self _slabSampleDistance] * (CGFloat)[self _pixelsDeep]));
+        NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*NIProjectionModeProjectedPixelsDeep(self.request.projectionMode)
+                                           freeWhenDone:YES];
+        _floatBytes = NULL;
+        if ([self isCancelled] == NO) {
+            generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh
+                                                      pixelsDeep:NIProjectionModeProjectedPixelsDeep(self.request.projectionMode)
+                                           modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
+            self.generatedVolume = generatedVolume;
+            [generatedVolume release];
         }
-    } else {
-        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+    } else { // done with the fill operations, now do the projection
+        modelToVoxelTransform = NIAffineTransformMakeScale(1.0/_sampleSpacing, 1.0/_sampleSpacing, 1.0/[self _slabSampleDistance]);
+        NSData *floatData = [NSData dataWithBytesNoCopy:_floatBytes length:sizeof(float)*self.request.pixelsWide*self.request.pixelsHigh*[self _pixelsDeep] freeWhenDone:YES];
+        generatedVolume = [[NIVolumeData alloc] initWithData:floatData pixelsWide:self.request.pixelsWide pixelsHigh:self.request.pixelsHigh pixelsDeep:[self _pixelsDeep]
+                                       modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_volumeData.outOfBoundsValue];
+        _floatBytes = NULL;
+        projectionOperation = [[NIProjectionOperation alloc] init];
+        [projectionOperation setQualityOfService:[self qualityOfService]];
+
+        projectionOperation.volumeData = generatedVolume;
+        projectionOperation.projectionMode = self.request.projectionMode;
+        projectionOperation.projectionThresholdMin = self.request.projectionThresholdMin;
+        projectionOperation.projectionThresholdMax = self.request.projectionThresholdMax;
+        [generatedVolume release];
+
+        @synchronized (_fillOperations) {
+            _projectionOperation = projectionOperation;
+        }
+        if ([self isCancelled]) {
+            [projectionOperation cancel];
+        }
+        [projectionOperation start]; // the projection operation reduces its rows in parallel itself
+        self.generatedVolume = projectionOperation.generatedVolume;
     }
-}
 
-+ (NSOperationQueue *) _fillQueueForQualityOfService:(NSQualityOfService)qualityOfService
-{
-    if (qualityOfService == NSQualityOfServiceUserInteractive) {
-        static dispatch_once_t predInteractive;
-        static NSOperationQueue *interactiveFillQueue = nil;
-        dispatch_once(&predInteractive, ^{
-            interactiveFillQueue = [[NSOperationQueue alloc] init];
-            [interactiveFillQueue setQualityOfService:NSQualityOfServiceUserInteractive];
-            [interactiveFillQueue setName:@"NIStraightenedOperation Interactive fill queue"];
-        });
-        return interactiveFillQueue;
-    } else {
-        static dispatch_once_t predUserInitiated;
-        static NSOperationQueue *userInitiatedFillQueue = nil;
-        dispatch_once(&predUserInitiated, ^{
-            userInitiatedFillQueue = [[NSOperationQueue alloc] init];
-            [userInitiatedFillQueue setQualityOfService:NSQualityOfServiceUserInitiated];
-            [userInitiatedFillQueue setName:@"NIStraightenedOperation User Initiated fill queue"];
-        });
-        return userInitiatedFillQueue;
-    }
+    [self willChangeValueForKey:@"isFinished"];
+    [self willChangeValueForKey:@"isExecuting"];
+    _operationExecuting = NO;
+    _operationFinished = YES;
+    [self didChangeValueForKey:@"isExecuting"];
+    [self didChangeValueForKey:@"isFinished"];
 }
 
 - (CGFloat)_slabSampleDistance
@@ -367,6 +371,12 @@ static const NSUInteger FILL_HEIGHT = 40;
     }
 }
 
+// every projection is reduced by the fill operations as the slab is sampled, only slabs that aren't projected are stored
+- (BOOL)_projectsWhileFilling
+{
+    return self.request.projectionMode != NIProjectionModeNone;
+}
+
 - (NSUInteger)_pixelsDeep
 {
     return MAX(self.request.slabWidth / [self _slabSampleDistance], 0) + 1;
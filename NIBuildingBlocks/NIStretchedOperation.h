@@ -28,10 +28,8 @@
 
 @interface NIStretchedOperation : NIGeneratorOperation
 {
-    volatile int32_t _outstandingFillOperationCount __attribute__ ((aligned (4)));
-    
     float *_floatBytes;
-    NSMutableSet *_fillOperations;
+    NSMutableArray *_fillOperations;
 	NSOperation *_projectionOperation;
     BOOL _operationExecuting;
     BOOL _operationFinished;
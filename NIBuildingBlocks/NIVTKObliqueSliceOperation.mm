@@ -37,8 +37,35 @@
 #import <VTK/vtkFloatArray.h>
 #pragma clang diagnostic pop
 
+@interface NIVTKObliqueSliceOperation ()
++ (NSOperationQueue *)_resliceQueueForQualityOfService:(NSQualityOfService)qualityOfService;
+@end
+
 @implementation NIVTKObliqueSliceOperation
 
++ (NSOperationQueue *)_resliceQueueForQualityOfService:(NSQualityOfService)qualityOfService
+{
+    if (qualityOfService == NSQualityOfServiceUserInteractive) {
+        static dispatch_once_t predInteractive;
+        static NSOperationQueue *interactiveResliceQueue = nil;
+        dispatch_once(&predInteractive, ^{
+            interactiveResliceQueue = [[NSOperationQueue alloc] init];
+            [interactiveResliceQueue setQualityOfService:NSQualityOfServiceUserInteractive];
+            [interactiveResliceQueue setName:@"NIVTKObliqueSliceOperation Interactive reslice queue"];
+        });
+        return interactiveResliceQueue;
+    } else {
+        static dispatch_once_t predUserInitiated;
+        static NSOperationQueue *userInitiatedResliceQueue = nil;
+        dispatch_once(&predUserInitiated, ^{
+            userInitiatedResliceQueue = [[NSOperationQueue alloc] init];
+            [userInitiatedResliceQueue setQualityOfService:NSQualityOfServiceUserInitiated];
+            [userInitiatedResliceQueue setName:@"NIVTKObliqueSliceOperation User Initiated reslice queue"];
+        });
+        return userInitiatedResliceQueue;
+    }
+}
+
 - (void)main {
     NSOperation *op = [NSBlockOperation blockOperationWithBlock:^{
         [self start];
@@ -46,7 +73,7 @@
     
     [_fillOperations addObject:op];
     
-    [[[self class] _fillQueueForQualityOfService:self.qualityOfService] addOperation:op];
+    [[[self class] _resliceQueueForQualityOfService:self.qualityOfService] addOperation:op];
 }
 
 - (void)start {
@@ -96,6 +123,7 @@
         case NIInterpolationModeLinear:
             reslice->SetInterpolationModeToLinear(); break;
         case NIInterpolationModeCubic:
+        case NIInterpolationModeCubicBSpline:
             reslice->SetInterpolationModeToCubic(); break;
         default:
             break;
@@ -42,11 +42,35 @@ typedef NS_ENUM(NSInteger, NIInterpolationMode) {
     NIInterpolationModeNearestNeighbor,
     /** Interpolate using cubic interpolation */
     NIInterpolationModeCubic,
+    /** Interpolate using a cubic B-spline of the volume's prefiltered coefficients, smoother than NIInterpolationModeCubic when magnifying
+     @see [NIVolumeData cubicBSplineCoefficients] */
+    NIInterpolationModeCubicBSpline,
 
     /** Use the default interpolation mode */
     NIInterpolationModeNone = 0xFFFFFF,
 };
 
+/** The type of the samples an NIVolumeData stores
+*/
+typedef NS_ENUM(NSInteger, NIVolumeDataSampleType) {
+/**
+ 32 bit floats, the value of a voxel is the stored float.
+*/
+    NIVolumeDataSampleTypeFloat32 = 0,
+/**
+ Signed 16 bit integers, the value of a voxel is sample * rescaleSlope + rescaleIntercept.
+*/
+    NIVolumeDataSampleTypeInt16,
+/**
+ Unsigned 16 bit integers, the value of a voxel is sample * rescaleSlope + rescaleIntercept.
+*/
+    NIVolumeDataSampleTypeUInt16,
+/**
+ Unsigned 8 bit integers, the value of a voxel is sample * rescaleSlope + rescaleIntercept.
+*/
+    NIVolumeDataSampleTypeUInt8,
+};
+
 /**
  NIVolumeDataInlineBuffer is used to make sure that values that will be often used while sampling an NIVolumeData are on the stack. The goal is to optimize CPU cache performance.
  An NIVolumeDataInlineBuffer should be used as a stack variable and then initialized using -[NIVolumeData acquireInlineBuffer:]. The NIVolumeDataInlineBuffer can then be used with
@@ -55,7 +79,12 @@ typedef NS_ENUM(NSInteger, NIInterpolationMode) {
  @see [NIVolumeData acquireInlineBuffer:]
 */
 typedef struct { // build one of these on the stack and then use -[NIVolumeData acquireInlineBuffer:] to initialize it.
-    const float *floatBytes;
+    const float *floatBytes; // NULL if the samples are not floats, use sampleBytes and NIVolumeDataUncheckedSampleAtIndex() instead
+
+    NIVolumeDataSampleType sampleType;
+    const void *sampleBytes; // the samples in their stored type, equal to floatBytes if the samples are floats
+    float rescaleSlope;
+    float rescaleIntercept;
 
     float outOfBoundsValue;
 
@@ -64,8 +93,59 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
     NSUInteger pixelsDeep;
 
     NIAffineTransform modelToVoxelTransform;
+
+    NSUInteger brickShift; // log2 of the brick size, 0 if the floats are not bricked
+    NSInteger rowStride; // the distance in floats between rows, or between rows of bricks if the floats are bricked, negative if the rows of a view are reversed
+    NSInteger sliceStride; // the distance in floats between slices, or between slices of bricks if the floats are bricked, negative if the slices of a view are reversed
+
+    NSUInteger borderWidth; // the number of voxels of outOfBoundsValue padding around the volume, floatBytes points to the first voxel inside the padding
 } NIVolumeDataInlineBuffer;
 
+/**
+ NIVolumeDataMinMaxGrid describes the coarse grid of the smallest and largest voxel of every cell of a volume, the cells being cubes of voxels.
+ The grid is used to bound the values that can be sampled in a box without sampling the box. Build one of these on the stack and then
+ use -[NIVolumeData acquireMinMaxGrid:] to initialize it.
+ @see [NIVolumeData acquireMinMaxGrid:]
+ @see NIVolumeDataMinMaxGridGetBounds
+ */
+typedef struct {
+    const float *cellMins; // the smallest voxel of each cell, x varying the fastest
+    const float *cellMaxs; // the largest voxel of each cell, x varying the fastest
+
+    NSUInteger cellShift; // log2 of the edge length of the cells
+    NSUInteger cellsWide;
+    NSUInteger cellsHigh;
+    NSUInteger cellsDeep;
+
+    NSUInteger pixelsWide;
+    NSUInteger pixelsHigh;
+    NSUInteger pixelsDeep;
+
+    float outOfBoundsValue;
+} NIVolumeDataMinMaxGrid;
+
+/**
+ The header at the start of a volume file written by -[NIVolumeData writeToFile:error:]. The header is followed by padding up to voxelOffset, and then by
+ pixelsWide*pixelsHigh*pixelsDeep 32 bit floats stored flat with x varying the fastest. All the fields and the floats are little endian.
+ */
+typedef struct {
+    char magic[8]; // "NIVOLUME", not null terminated
+    uint32_t version; // NIVolumeDataFileVersion
+    uint32_t reserved;
+    uint64_t voxelOffset; // the byte offset of the first voxel from the start of the file, a multiple of NIVolumeDataFileAlignment
+    uint64_t pixelsWide;
+    uint64_t pixelsHigh;
+    uint64_t pixelsDeep;
+    double modelToVoxelTransform[16]; // m11, m12, m13, m14, m21, ..., m44
+    float outOfBoundsValue;
+    uint32_t reserved2;
+} NIVolumeDataFileHeader;
+
+enum {
+    NIVolumeDataFileVersion = 1,
+    NIVolumeDataFileAlignment = 16384, // the largest page size, so that the voxels are page aligned when the file is mapped
+};
+
 /**
  The NIVolumeData class represents a volume of float intensity data in the three natural dimensions. In addition to the floats,
  NIVolumeData includes an NIAffineTransform referred to as the modelToVoxelTransform which is used to position the volume of
@@ -74,12 +154,60 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
  NIVolumeData can also represent curved volumes (for example, volumes generated by NIStraightenedGeneratorRequest or NIStretchedGeneratorRequest).
  If the NIVolumeData represents a curved volume, the curved property will be true, and convertVolumeVectorToModelVector and convertVolumeVectorToModelVector
  will use the coresponding blocks to convert the points. Curved volumes can not be used as source volumes by the NIGenerator.
+
+ By default the floats are stored flat, with x varying the fastest. A volume can instead be built with a bricked layout (see brickSize), in which case
+ the floats are stored as a grid of small cubic bricks so that neighboring voxels in y and z are close in memory. This keeps sampling cache-local for
+ slices at any orientation. The inline buffer functions address both layouts transparently.
+
+ Volumes can also store their voxels as 16 or 8 bit integers with a rescale slope and intercept (see sampleType). The inline buffer functions and
+ the samplers read the integers and convert them to floats as they sample, so such volumes take a half or a quarter of the memory and bandwidth of float volumes.
+
+ A flat volume can also be built with a border of padding voxels around it that are set to the outOfBoundsValue (see borderWidth). Interpolation near the edges of a
+ padded volume reads the padding instead of checking bounds, so the interpolation functions only need to check bounds for points that are outside of the padding.
+
+ Volumes that don't fit in memory as floats can be stored as losslessly compressed bricks (see compressedBrickSize). Compressed volumes decompress the bricks they
+ are asked for into a bounded cache, and the NIGenerator only decompresses the bricks that the requested slab goes through.
+
+ Subvolumes, slices and volumes with reversed y or z axes of flat float volumes are views (see volumeDataWithIndexRangesX:y:z:), they retain the floats of the volume
+ they were taken from and address them with an offset and row and slice strides, so they are made without copying any voxels.
  
  @see NIGenerator
  @see NIMask
  */
 @interface NIVolumeData : NSObject <NSCopying, NSSecureCoding> {
     NSData *_floatData;
+    NSData *_brickedFloatData;
+    NSUInteger _brickSize;
+    NSData *_paddedFloatData;
+    NSUInteger _borderWidth;
+    NSData *_viewedFloatData; // the flat floats of the volume a view was taken from
+    NSInteger _viewOffset; // the index in _viewedFloatData of the view's voxel (0, 0, 0)
+    NSInteger _viewRowStride;
+    NSInteger _viewSliceStride;
+    NSData *_compressedBrickData;
+    NSData *_compressedBrickOffsets; // one uint64_t offset into _compressedBrickData per brick, and the length of _compressedBrickData
+    NSUInteger _compressedBrickSize;
+    NSUInteger _brickCacheLimit;
+    NSUInteger _brickCacheSize;
+    NSMutableDictionary<NSNumber *, NSData *> *_brickCache;
+    NSMutableOrderedSet<NSNumber *> *_brickCacheOrder; // the least recently used brick is first
+    NIVolumeData *_cubicBSplineCoefficients;
+    NSString *_mappedFilePath;
+    BOOL _floatDataIsMapped; // _floatData holds the flat floats mapped from _mappedFilePath
+    NSData *_sampleData;
+    NIVolumeDataSampleType _sampleType;
+    float _rescaleSlope;
+    float _rescaleIntercept;
+    NSMutableArray<NIVolumeData *> *_mipLevels; // _mipLevels[i] is mip level i+1
+    BOOL _hasIntensityStatistics;
+    float _intensityMin;
+    float _intensityMax;
+    float _intensityMean;
+    NSMutableDictionary<NSNumber *, NSData *> *_intensityHistograms; // keyed by bin count
+    NSData *_minMaxGridData; // the cell minimums of the min/max grid followed by the cell maximums
+    BOOL _buildingMipLevels;
+    BOOL _mipLevelsFailed; // building the mip levels in the background raised, so they aren't built in the background again
+    volatile int64_t _uniqueIdentifier; // 0 until it is first asked for
     float _outOfBoundsValue;
 
     NSUInteger _pixelsWide;
@@ -126,6 +254,21 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
 - (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
        modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER; // modelToVoxelTransform is the transform from Model (patient) space to pixel data
 
+/**
+ Returns an NIVolumeData object initialized with the given parameters, that stores its floats in a bricked layout.
+
+ @param data NSData object that contains the packed float intensities that the returned NIVolumeData represents, with x varying the fastest.
+ @param pixelsWide The width of the volume in pixels. This value must be greater than 0.
+ @param pixelsHigh The height of the volume in pixels. This value must be greater than 0.
+ @param pixelsDeep The depth of the volume in pixels. This value must be greater than 0.
+ @param modelToVoxelTransform The NIAffineTransform that represents the mapping of coordinates from model space (DICOM space) to voxel coordinates.
+ @param outOfBoundsValue The value that will be filled in by the NIGenerator when sampling pixels that are outside of the volume.
+ @param brickSize The edge length in voxels of the bricks, this value must be a power of 2 (8 or 16 work well). Passing 0 or 1 stores the floats flat.
+ @see brickSize
+ */
+- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+       modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue brickSize:(NSUInteger)brickSize;
+
 /**
  Returns a curved NIVolumeData object initialized with the given parameters
 
@@ -142,6 +285,24 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
       volumeToModelConverter:(NIVector (^)(NIVector volumeVector))volumeToModelConverter modelToVolumeConverter:(NIVector (^)(NIVector modelVector))modelToVolumeConverter
             outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
 
+/**
+ Returns an NIVolumeData object that stores its voxels as integer samples, for example the native int16 samples of a CT series.
+
+ @param sampleData NSData object that contains the packed samples, with x varying the fastest.
+ @param sampleType The type of the samples.
+ @param rescaleSlope The value of a voxel is sample * rescaleSlope + rescaleIntercept.
+ @param rescaleIntercept The value of a voxel is sample * rescaleSlope + rescaleIntercept.
+ @param pixelsWide The width of the volume in pixels. This value must be greater than 0.
+ @param pixelsHigh The height of the volume in pixels. This value must be greater than 0.
+ @param pixelsDeep The depth of the volume in pixels. This value must be greater than 0.
+ @param modelToVoxelTransform The NIAffineTransform that represents the mapping of coordinates from model space (DICOM space) to voxel coordinates.
+ @param outOfBoundsValue The value that will be filled in by the NIGenerator when sampling pixels that are outside of the volume.
+ @see sampleType
+ */
+- (instancetype)initWithSampleData:(NSData *)sampleData sampleType:(NIVolumeDataSampleType)sampleType rescaleSlope:(float)rescaleSlope rescaleIntercept:(float)rescaleIntercept
+                        pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
+
 /**
  Returns an NIVolumeData object initialized by the values from another given NIVolumeData. The floatData is copied by reference.
  
@@ -149,6 +310,41 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
 */
 - (instancetype)initWithVolumeData:(NIVolumeData *)volumeData;
 
+/**
+ Returns an NIVolumeData object whose floats are memory mapped from a volume file (see NIVolumeDataFileHeader). Opening the file does not read the voxels, they are
+ paged in from the file as they are sampled, and processes that map the same file share the same pages. Volumes that are mapped from a file are archived as a
+ reference to the file, so the file must not be modified or moved while the volume or its archives are in use. Decoding such an archive raises an
+ NSInvalidUnarchiveOperationException if the file can't be mapped or its header doesn't match the archived volume size.
+
+ @param path The path of the volume file.
+ @param error If the file can not be opened or is not a valid volume file, on return contains an NSError object that describes the problem.
+ @return The mapped NIVolumeData, or nil if the file could not be mapped.
+ @see writeToFile:error:
+ @see prefetchSlicesInRange:
+ */
+- (nullable instancetype)initWithContentsOfMappedFile:(NSString *)path error:(NSError **)error;
+
+/**
+ Writes the receiver to a volume file that can be opened with initWithContentsOfMappedFile:error:. This method does not work on curved NIVolumeData objects.
+
+ @param path The path of the file to write, an existing file is replaced.
+ @param error If the file could not be written, on return contains an NSError object that describes the problem.
+ @return YES if the file was written.
+ */
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error;
+
+/**
+ The path of the file the floats are mapped from, or nil if the receiver was not initialized with initWithContentsOfMappedFile:error:
+ */
+@property (nullable, readonly, copy) NSString *mappedFilePath;
+
+/**
+ Advises the system that the voxels in the given range of z slices will be read soon, so that they are paged in from the volume file ahead of the sampling.
+ This method returns immediately, and does nothing for volumes whose flat floats are not mapped from a volume file.
+ @param range The range of z indexes to prefetch, it is clipped to the volume.
+ */
+- (void)prefetchSlicesInRange:(NSRange)range;
+
 /**
  The width of the volume in pixels
 */
@@ -273,10 +469,188 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
  */
 - (NIVector)convertVolumeVectorFromModelVector:(NIVector)vector;
 /**
- The float intensities represented by the NIVolumeData object.
+ The float intensities represented by the NIVolumeData object, packed with x varying the fastest.
+ @see brickSize
  */
 @property (readonly, retain) NSData *floatData;
 
+/**
+ The edge length in voxels of the cubic bricks the floats are stored in, or 0 if the floats are stored flat with x varying the fastest.
+ Bricked volumes still return flat floats from floatData, but that flat copy is only built (and then kept) the first time it is asked for,
+ so code that cares about memory or speed should sample bricked volumes through an inline buffer or getFloatRun:atPixelCoordinateX:y:z:length:.
+ @see initWithData:pixelsWide:pixelsHigh:pixelsDeep:modelToVoxelTransform:outOfBoundsValue:brickSize:
+ */
+@property (readonly) NSUInteger brickSize;
+
+/**
+ Returns an NIVolumeData object with the same values as the receiver, but that stores its floats with the given brick size.
+ This method does not work on curved NIVolumeData objects.
+ @param brickSize The edge length in voxels of the bricks, this value must be a power of 2. Passing 0 or 1 returns a volume that stores the floats flat.
+ @return An NIVolumeData object with the given brickSize.
+ @see brickSize
+ */
+- (instancetype)volumeDataWithBrickSize:(NSUInteger)brickSize;
+
+/**
+ The type of the samples the volume stores. Volumes that don't store floats only build floatData the first time it is asked for, the generators and the
+ inline buffer functions sample the stored integers directly.
+ @see initWithSampleData:sampleType:rescaleSlope:rescaleIntercept:pixelsWide:pixelsHigh:pixelsDeep:modelToVoxelTransform:outOfBoundsValue:
+ */
+@property (readonly) NIVolumeDataSampleType sampleType;
+/**
+ The slope that converts the stored samples to voxel values, 1 for volumes that store floats.
+ */
+@property (readonly) float rescaleSlope;
+/**
+ The intercept that converts the stored samples to voxel values, 0 for volumes that store floats.
+ */
+@property (readonly) float rescaleIntercept;
+
+/**
+ The number of voxels of padding, set to the outOfBoundsValue, that surround the floats on every side, or 0 if the volume is not padded. When the border is at least as wide as
+ the support of an interpolation kernel (1 voxel for linear interpolation, 2 voxels for cubic interpolation), the inline buffer functions don't check bounds for any point whose
+ kernel fits in the padding, which makes sampling slices that cross the edges of the volume as fast as sampling inside the volume.
+ Padded volumes store their floats flat, and like bricked volumes only build the unpadded floatData the first time it is asked for.
+ @see volumeDataWithBorderWidth:
+ */
+@property (readonly) NSUInteger borderWidth;
+
+/**
+ Returns an NIVolumeData object with the same values as the receiver, but that stores its floats flat with the given border of padding. A border width of 2 covers all
+ of the interpolation modes. This method does not work on curved NIVolumeData objects.
+ @param borderWidth The number of voxels of padding on each side of the volume. Passing 0 returns a volume that is not padded.
+ @return An NIVolumeData object with the given borderWidth.
+ @see borderWidth
+ */
+- (instancetype)volumeDataWithBorderWidth:(NSUInteger)borderWidth;
+
+/**
+ The edge length in voxels of the bricks the floats are compressed in, or 0 if the volume is not compressed. Each brick is compressed losslessly on its own, by
+ XORing every float with the previous one and only storing the bytes of the result that are not zero, which typically halves CT and MR data and shrinks uniform regions such as the air around the patient much more.
+ Bricks are decompressed when they are read, and the most recently used decompressed bricks are kept in a cache of at most brickCacheLimit bytes.
+
+ getFloatRun:atPixelCoordinateX:y:z:length:, volumeDataWithIndexRangesX:y:z:, the single value and batch interpolation methods and the NIGenerator oblique,
+ straightened and stretched requests only decompress the bricks they need. A compressed volume has no inline buffer, acquireInlineBuffer: raises an
+ NSInvalidArgumentException, so the inline functions sample it through volumeDataForSamplingFromVolumeVector:toVolumeVector:. The floatData of a compressed volume
+ is not backed by the brick cache, it is a full decompressed copy of the volume that is built the first time it is asked for and then kept. Requests with
+ NIInterpolationModeCubicBSpline sample the cubicBSplineCoefficients, which are uncompressed.
+ @see volumeDataWithCompressedBrickSize:
+ */
+@property (readonly) NSUInteger compressedBrickSize;
+
+/**
+ The number of bytes of decompressed bricks that a compressed volume keeps, the least recently used bricks are dropped first. The default is 64MB.
+ @see compressedBrickSize
+ */
+@property (assign) NSUInteger brickCacheLimit;
+
+/**
+ Returns an NIVolumeData object with the same values as the receiver, but that stores its floats as compressed bricks. The bricks are compressed in parallel.
+ This method does not work on curved NIVolumeData objects.
+ @param brickSize The edge length in voxels of the bricks, this value must be a power of 2 (16 or 32 work well). Passing 0 returns a volume that is not compressed.
+ @return An NIVolumeData object with the given compressedBrickSize.
+ @see compressedBrickSize
+ */
+- (instancetype)volumeDataWithCompressedBrickSize:(NSUInteger)brickSize;
+
+/**
+ Returns an uncompressed NIVolumeData object, placed in the same model space as the receiver, that holds every voxel of the receiver that the interpolation
+ functions read when sampling volume vectors inside the given box. For volumes that are not compressed this is the receiver itself, for compressed volumes
+ only the bricks that the box goes through are decompressed.
+ @param minVolumeVector The corner of the box with the smallest coordinates, in the receiver's voxel space.
+ @param maxVolumeVector The corner of the box with the largest coordinates, in the receiver's voxel space.
+ @return An NIVolumeData object that samples the same values as the receiver inside the box.
+ */
+- (NIVolumeData *)volumeDataForSamplingFromVolumeVector:(NIVector)minVolumeVector toVolumeVector:(NIVector)maxVolumeVector;
+
+/**
+ An NIVolumeData with the same size, brick size and modelToVoxelTransform as the receiver, whose floats are the coefficients of the cubic B-spline that goes through
+ the receiver's voxels. Sampling the coefficients with NIVolumeDataCubicBSplineInterpolatedFloatAtVolumeCoordinate() interpolates the receiver with a cubic B-spline.
+ The coefficients are computed with a separable recursive filter, in parallel, the first time this property is read and are then kept for the lifetime of the receiver.
+ This property is nil for curved NIVolumeData objects.
+ @see NIInterpolationModeCubicBSpline
+ */
+@property (nullable, readonly, retain) NIVolumeData *cubicBSplineCoefficients;
+
+/**
+ The smallest voxel value of the volume. The minimum, maximum and mean are computed together, in a single parallel pass over the voxels, the first time any of them is read,
+ and are then kept for the lifetime of the receiver, so reading them again is free. The voxels must not be modified after the statistics are computed.
+ @see intensityHistogramWithBinCount:
+ */
+@property (readonly) float intensityMin;
+/**
+ The largest voxel value of the volume.
+ @see intensityMin
+ */
+@property (readonly) float intensityMax;
+/**
+ The mean voxel value of the volume.
+ @see intensityMin
+ */
+@property (readonly) float intensityMean;
+
+/**
+ Returns the histogram of the voxel values of the volume. The bins evenly divide the range from intensityMin to intensityMax, with intensityMax counted in the last bin.
+ The histogram is computed in parallel the first time it is asked for with a given bin count, and is then kept for the lifetime of the receiver.
+ @param binCount The number of bins of the histogram, this value must be greater than 0.
+ @return An NSData that contains binCount NSUInteger voxel counts.
+ @see intensityMin
+ */
+- (NSData *)intensityHistogramWithBinCount:(NSUInteger)binCount;
+
+/**
+ Initializes the NIVolumeDataMinMaxGrid with the smallest and largest voxel of every 8x8x8 cell of the receiver. The grid is computed in parallel the first time
+ it is acquired, and is then kept for the lifetime of the receiver, which must outlive the use of the grid. The voxels must not be modified after the grid is computed.
+ Use NIVolumeDataMinMaxGridGetBounds() to find the values that can be sampled in a box, for example to skip the parts of a projection that can't change the result.
+ @param minMaxGrid A pointer to the NIVolumeDataMinMaxGrid to initialize.
+ @see NIVolumeDataMinMaxGridGetBounds
+ */
+- (void)acquireMinMaxGrid:(NIVolumeDataMinMaxGrid *)minMaxGrid;
+
+/**
+ A number that no other NIVolumeData object created by the process shares, it is assigned the first time it is read and then never changes. Because the voxels of a
+ NIVolumeData must not change once it is in use, the identifier can stand in for the content of the receiver, for example to key results computed from it.
+ @see [NIGenerator setResultCacheByteBudget:]
+ */
+@property (readonly) uint64_t uniqueIdentifier;
+
+/**
+ The number of levels in the receiver's mip pyramid, including the receiver itself as level 0. Each level is half the size of the previous one, rounded up, along every
+ axis that is more than one voxel long, and the last level is a single voxel. Curved NIVolumeData objects only have level 0.
+ @see volumeDataForMipLevel:
+ */
+@property (readonly) NSUInteger mipLevelCount;
+
+/**
+ Returns the given level of the receiver's mip pyramid. Each voxel of a level is the mean of the 2x2x2 voxels of the previous level that it covers, and its
+ modelToVoxelTransform places it at the center of those voxels. Along an axis with an odd number of voxels the last voxel of the level only covers the last voxel of
+ the previous level. Levels are built in parallel, one slice of the previous level at a time so that volumes that aren't stored as flat floats don't build their
+ floatData, the first time they are asked for and are then kept for the lifetime of the receiver. Levels keep the receiver's brickSize, borderWidth and compressedBrickSize.
+ @param level The level to return, levels past the end of the pyramid return the last level.
+ @return The NIVolumeData at the given level, the receiver for level 0.
+ @see mipLevelForSampleSpacing:
+ */
+- (NIVolumeData *)volumeDataForMipLevel:(NSUInteger)level;
+
+/**
+ Returns the finest level of the mip pyramid at or below the given level that has already been built, without blocking. If the given level has not been built yet,
+ it is built in the background so that a later call can return it. If that build fails the levels are not built in the background again, and volumeDataForMipLevel:
+ raises the failure.
+ @param level The desired level.
+ @return The NIVolumeData at the given level if it has been built, otherwise the closest finer level that has been built.
+ @see volumeDataForMipLevel:
+ */
+- (NIVolumeData *)availableVolumeDataForMipLevel:(NSUInteger)level;
+
+/**
+ Returns the coarsest level of the mip pyramid whose voxels are still no farther apart than the given sample spacing along any axis, so that sampling the level at
+ that spacing touches the fewest voxels without skipping any detail that the samples could resolve. Since every level halves all of the axes, the level is chosen from
+ the largest pixel spacing of the axes that are more than one voxel long.
+ @param sampleSpacing The distance, in model space, between neighboring samples.
+ @return The index of the level, 0 if the sample spacing is finer than twice the receiver's largest pixel spacing.
+ */
+- (NSUInteger)mipLevelForSampleSpacing:(CGFloat)sampleSpacing;
+
 /**
  Will copy a row of float values in the x direction starting of the given voxel coordinate into the given buffer.
  @param buffer the buffer into which to copy the floats.
@@ -295,19 +669,31 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
 */
 - (vImage_Buffer)floatBufferForSliceAtIndex:(NSUInteger)z;
 /**
- Returns an NIVolumeData object with depth of 1 that corresponds voxels at the given z depth.
+ Returns an NIVolumeData object with depth of 1 that corresponds voxels at the given z depth. For flat float volumes the slice is a view of the receiver's floats.
  @param z The depth index of the 2D slice represented in the returned NIVolumeData.
  @return An NIVolumeData with depth of 1 the represents the 2D slice of the given depth index.
 */
 - (NIVolumeData *)volumeDataForSliceAtIndex:(NSUInteger)z;
 /**
- Returns an NIVolumeData object with the subvolume described by a set of ranges within the receiver.
+ Returns an NIVolumeData object with the subvolume described by a set of ranges within the receiver. If the receiver is a flat float volume that is not curved,
+ the subvolume is a view that retains the receiver's floats instead of copying them, and its floatData is only compacted the first time it is asked for.
+ Other layouts copy the voxels.
  @param x An NSRange that corresponds to the x indexes of the voxels to be used for the returned NIVolumeData.
  @param y An NSRange that corresponds to the y indexes of the voxels to be used for the returned NIVolumeData.
  @param z An NSRange that corresponds to the z indexes of the voxels to be used for the returned NIVolumeData.
  @return An NIVolumeData object build with the given subranges.
 */
 - (NIVolumeData *)volumeDataWithIndexRangesX:(NSRange)x y:(NSRange)y z:(NSRange)z;
+/**
+ Returns an NIVolumeData object whose voxels are the receiver's voxels in reverse order along the given axes, with a modelToVoxelTransform that keeps every voxel at
+ the same place in model space. Reversing y or z of a flat float volume returns a view with negative strides, reversing x copies the voxels so that rows stay contiguous.
+ This method does not work on curved NIVolumeData objects.
+ @param reverseX YES to reverse the x axis.
+ @param reverseY YES to reverse the y axis.
+ @param reverseZ YES to reverse the z axis.
+ @return An NIVolumeData object with the given axes reversed.
+*/
+- (NIVolumeData *)volumeDataWithReversedAxesX:(BOOL)reverseX y:(BOOL)reverseY z:(BOOL)reverseZ;
 /**
  Returns an NIVolumeData object with the same underlying float data, but with the given in modelToVoxelTransform.
  @param modelToVoxelTransform The modelToVoxelTransform of the returned NIVolumeTransform.
@@ -320,6 +706,9 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
  orientation, a minimum volume that will fit the reciever is calculated. As such, the modelToVoxelTransform of the returned NIVolumeData may not be equal to the given modelToVoxelTransform.
  However, the orientation will be conserved, and any shift is guaranteed to be a multiple of the basis vectors of the given modelToVoxelTransform.
  
+ If both the receiver and the given modelToVoxelTransform only scale and translate, the receiver is resampled separably with three 1D passes along x, y and z
+ instead of interpolating every voxel in 3D, which is much faster for common cases such as making thin-slice CT isotropic.
+
  This method does not work on curved NIVolumeTransform objects.
  @param modelToVoxelTransform An NIAffineTransform that describes the orientation and pixel spacing of the desired NIVolumetransform.
  @param interpolationsMode The interpolation mode that is used when resampling the vector.
@@ -374,17 +763,54 @@ typedef struct { // build one of these on the stack and then use -[NIVolumeData
  @see acquireInlineBuffer:
  */
 - (CGFloat)cubicInterpolatedFloatAtModelVector:(NIVector)vector; // these are slower, use the inline buffer if you care about speed
+/**
+ Returns the float value of the point at the given coordinate in model space (DICOM space) by cubic B-spline interpolation.
+ Consider using an inline buffer of the cubicBSplineCoefficients if performance is important.
+ @param vector The coordinates of the desired point in model space (DICOM space).
+ @return The cubic B-spline interpolated value at the given point.
+ @see cubicBSplineCoefficients
+ */
+- (CGFloat)cubicBSplineInterpolatedFloatAtModelVector:(NIVector)vector; // these are slower, use the inline buffer if you care about speed
+
+/**
+ Fills outputValues with the linearly interpolated float intensities at the given points in voxel space. Points that are outside of the volume, or close to its edges,
+ are handled the same way as in NIVolumeDataLinearInterpolatedFloatAtVolumeVector(), so any point can be passed. Compressed volumes only decompress the bricks around the points.
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ @see NIVolumeDataLinearInterpolateVolumeVectors
+ */
+- (void)linearInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors;
+/**
+ Fills outputValues with the nearest neighbor interpolated float intensities at the given points in voxel space. Any point can be passed.
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ @see NIVolumeDataNearestNeighborInterpolateVolumeVectors
+ */
+- (void)nearestNeighborInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors;
+/**
+ Fills outputValues with the cubic interpolated float intensities at the given points in voxel space. Any point can be passed.
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ @see NIVolumeDataCubicInterpolateVolumeVectors
+ */
+- (void)cubicInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors;
 
 /**
  Used to initialize an NIVolumeDataInlineBuffer that was built on the stack. The inline buffer can then be used with a number of inline functions.
+ Raises an NSInvalidArgumentException if the volume is compressed, acquire the inline buffer of volumeDataForSamplingFromVolumeVector:toVolumeVector: instead.
  @param inlineBuffer A pointer to the NIVolumeDataInlineBuffer to be intialized.
+ @see compressedBrickSize
 */
 - (void)acquireInlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer;
 
 @end
 
 /**
- Returns a pointer to the array of float intensities in the previously initialized NIVolumeDataInlineBuffer.
+ Returns a pointer to the array of float intensities in the previously initialized NIVolumeDataInlineBuffer. If the volume is bricked the floats
+ are in brick order, and the rows of views are strided, use NIVolumeDataUncheckedIndexAtCoordinate() to find the index of a given voxel. Returns NULL if the volume does not store floats.
  @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @see [NIVolumeData acquireInlineBuffer:]
 */
@@ -394,51 +820,112 @@ CF_INLINE const float* NIVolumeDataFloatBytes(NIVolumeDataInlineBuffer *inlineBu
 }
 
 /**
- Returns the value of the voxel at the given coordinate.
+ Returns the value of the sample at the given index into the sample array, converted to a float with the rescale slope and intercept.
+ @warning This function does not do any bounds checking.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param index The index of the sample, see NIVolumeDataUncheckedIndexAtCoordinate().
+ */
+CF_INLINE float NIVolumeDataUncheckedSampleAtIndex(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger index)
+{
+    switch (inlineBuffer->sampleType) {
+        case NIVolumeDataSampleTypeInt16:
+            return (float)((const int16_t *)inlineBuffer->sampleBytes)[index] * inlineBuffer->rescaleSlope + inlineBuffer->rescaleIntercept;
+        case NIVolumeDataSampleTypeUInt16:
+            return (float)((const uint16_t *)inlineBuffer->sampleBytes)[index] * inlineBuffer->rescaleSlope + inlineBuffer->rescaleIntercept;
+        case NIVolumeDataSampleTypeUInt8:
+            return (float)((const uint8_t *)inlineBuffer->sampleBytes)[index] * inlineBuffer->rescaleSlope + inlineBuffer->rescaleIntercept;
+        default:
+            return inlineBuffer->floatBytes[index];
+    }
+}
+
+/**
+ Returns an index that NIVolumeDataSampleAtIndex() reads as the outOfBoundsValue.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ */
+CF_INLINE NSInteger NIVolumeDataOutOfBoundsIndex(const NIVolumeDataInlineBuffer *inlineBuffer)
+{
+    if (inlineBuffer->sampleType == NIVolumeDataSampleTypeFloat32) {
+        // this is a horible hack, but it works
+        // what I'm doing is looking at memory addresses to find an index into inlineBuffer->floatBytes that would jump out of
+        // the array and instead point to inlineBuffer->outOfBoundsValue which is on the stack
+        // This relies on both inlineBuffer->floatBytes and inlineBuffer->outOfBoundsValue being on a sizeof(float) boundry
+        return (((NSInteger)&(inlineBuffer->outOfBoundsValue)) - ((NSInteger)inlineBuffer->floatBytes)) / sizeof(float);
+    }
+    return NSIntegerMin; // samples of other types can't reach the outOfBoundsValue, so this index is compared against instead
+}
+
+/**
+ Returns the value of the sample at the given index into the sample array, or the outOfBoundsValue if the index is outOfBoundsIndex.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param index The index of the sample.
+ @param outOfBoundsIndex The index returned by NIVolumeDataOutOfBoundsIndex().
+ */
+CF_INLINE float NIVolumeDataSampleAtIndex(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger index, NSInteger outOfBoundsIndex)
+{
+    if (inlineBuffer->sampleType == NIVolumeDataSampleTypeFloat32) {
+        return inlineBuffer->floatBytes[index];
+    } else if (index == outOfBoundsIndex) {
+        return inlineBuffer->outOfBoundsValue;
+    }
+    return NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, index);
+}
+
+/**
+ Returns the part of the index into the float intensity array that depends on the x coordinate. The index of a voxel is the sum of the
+ x, y and z offsets, which lets the interpolation functions compute the indexes of neighboring voxels for both the flat and the bricked layouts.
  @warning This function does not do any bounds checking.
  @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @param x The x coordinate of the voxel.
+ @see NIVolumeDataUncheckedIndexAtCoordinate
+ */
+CF_INLINE NSInteger NIVolumeDataIndexOffsetForX(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x)
+{
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return ((x >> shift) << (3*shift)) + (x & (((NSInteger)1 << shift) - 1));
+}
+
+/**
+ Returns the part of the index into the float intensity array that depends on the y coordinate.
+ @warning This function does not do any bounds checking.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @param y The y coordinate of the voxel.
+ @see NIVolumeDataUncheckedIndexAtCoordinate
+ */
+CF_INLINE NSInteger NIVolumeDataIndexOffsetForY(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger y)
+{
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return (y >> shift) * inlineBuffer->rowStride + ((y & (((NSInteger)1 << shift) - 1)) << shift);
+}
+
+/**
+ Returns the part of the index into the float intensity array that depends on the z coordinate.
+ @warning This function does not do any bounds checking.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @param z The z coordinate of the voxel.
- @return The value of the voxel at the given coordinate.
- @see [NIVolumeData acquireInlineBuffer:]
+ @see NIVolumeDataUncheckedIndexAtCoordinate
  */
-CF_INLINE float NIVolumeDataUncheckedGetFloatAtPixelCoordinate(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
+CF_INLINE NSInteger NIVolumeDataIndexOffsetForZ(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger z)
 {
-    return (inlineBuffer->floatBytes)[x + inlineBuffer->pixelsWide*(y + inlineBuffer->pixelsHigh*z)];
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return (z >> shift) * inlineBuffer->sliceStride + ((z & (((NSInteger)1 << shift) - 1)) << (2*shift));
 }
 
 /**
- Returns the value of the voxel at the given coordinate.
+ Returns the index into the float intensity array for a given voxel coordinate.
+ @warning This function does not do any bounds checking.
  @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @param x The x coordinate of the voxel.
  @param y The y coordinate of the voxel.
  @param z The z coordinate of the voxel.
- @return The value of the voxel at the given coordinate.
- @see [NIVolumeData acquireInlineBuffer:]
- */
-CF_INLINE float NIVolumeDataGetFloatAtPixelCoordinate(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
+ @return The index into the float intensity array for a given voxel coordinate.
+*/
+CF_INLINE NSInteger NIVolumeDataUncheckedIndexAtCoordinate(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
 {
-    bool outside;
-
-    if (inlineBuffer->floatBytes) {
-        outside = false;
-
-        outside |= x < 0;
-        outside |= y < 0;
-        outside |= z < 0;
-        outside |= x >= inlineBuffer->pixelsWide;
-        outside |= y >= inlineBuffer->pixelsHigh;
-        outside |= z >= inlineBuffer->pixelsDeep;
-
-        if (!outside) {
-            return (inlineBuffer->floatBytes)[x + inlineBuffer->pixelsWide*(y + inlineBuffer->pixelsHigh*z)];
-        } else {
-            return inlineBuffer->outOfBoundsValue;
-        }
-    } else {
-        return 0;
+    if (inlineBuffer->brickShift == 0) {
+        return x + inlineBuffer->rowStride*y + inlineBuffer->sliceStride*z;
     }
+    return NIVolumeDataIndexOffsetForX(inlineBuffer, x) + NIVolumeDataIndexOffsetForY(inlineBuffer, y) + NIVolumeDataIndexOffsetForZ(inlineBuffer, z);
 }
 
 /**
@@ -457,21 +944,55 @@ CF_INLINE NSInteger NIVolumeDataIndexAtCoordinate(const NIVolumeDataInlineBuffer
         z < 0 || z >= inlineBuffer->pixelsDeep) {
         return outOfBoundsIndex;
     }
-    return x + inlineBuffer->pixelsWide*(y + inlineBuffer->pixelsHigh*z);
+    return NIVolumeDataUncheckedIndexAtCoordinate(inlineBuffer, x, y, z);
 }
 
 /**
- Returns the index into the float intensity array for a given voxel coordinate.
+ Returns the value of the voxel at the given coordinate.
  @warning This function does not do any bounds checking.
  @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
  @param x The x coordinate of the voxel.
  @param y The y coordinate of the voxel.
  @param z The z coordinate of the voxel.
- @return The index into the float intensity array for a given voxel coordinate.
-*/
-CF_INLINE NSInteger NIVolumeDataUncheckedIndexAtCoordinate(const NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
+ @return The value of the voxel at the given coordinate.
+ @see [NIVolumeData acquireInlineBuffer:]
+ */
+CF_INLINE float NIVolumeDataUncheckedGetFloatAtPixelCoordinate(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
 {
-    return x + inlineBuffer->pixelsWide*(y + inlineBuffer->pixelsHigh*z);
+    return NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, NIVolumeDataUncheckedIndexAtCoordinate(inlineBuffer, x, y, z));
+}
+
+/**
+ Returns the value of the voxel at the given coordinate.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param x The x coordinate of the voxel.
+ @param y The y coordinate of the voxel.
+ @param z The z coordinate of the voxel.
+ @return The value of the voxel at the given coordinate.
+ @see [NIVolumeData acquireInlineBuffer:]
+ */
+CF_INLINE float NIVolumeDataGetFloatAtPixelCoordinate(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger x, NSInteger y, NSInteger z)
+{
+    bool outside;
+
+    if (inlineBuffer->sampleBytes) {
+        outside = false;
+
+        outside |= x < 0;
+        outside |= y < 0;
+        outside |= z < 0;
+        outside |= x >= inlineBuffer->pixelsWide;
+        outside |= y >= inlineBuffer->pixelsHigh;
+        outside |= z >= inlineBuffer->pixelsDeep;
+
+        if (!outside) {
+            return NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, NIVolumeDataUncheckedIndexAtCoordinate(inlineBuffer, x, y, z));
+        } else {
+            return inlineBuffer->outOfBoundsValue;
+        }
+    } else {
+        return 0;
+    }
 }
 
 /**
@@ -485,7 +1006,10 @@ CF_INLINE NSInteger NIVolumeDataUncheckedIndexAtCoordinate(const NIVolumeDataInl
 */
 CF_INLINE void NIVolumeDataGetLinearIndexes(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger linearIndexes[_Nonnull 8], NSInteger x, NSInteger y, NSInteger z, NSInteger outOfBoundsIndex)
 {
-    if (x < 0 || y < 0 || z < 0 || x >= inlineBuffer->pixelsWide-1 || y >= inlineBuffer->pixelsHigh-1 || z >= inlineBuffer->pixelsDeep-1) {
+    const NSInteger border = inlineBuffer->borderWidth; // voxels in the padding are read like any other
+
+    if (x < -border || y < -border || z < -border ||
+        x >= (NSInteger)inlineBuffer->pixelsWide-1+border || y >= (NSInteger)inlineBuffer->pixelsHigh-1+border || z >= (NSInteger)inlineBuffer->pixelsDeep-1+border) {
         for (int i = 0; i < 2; ++i) {
             for (int j = 0; j < 2; ++j) {
                 for (int k = 0; k < 2; ++k) {
@@ -494,10 +1018,19 @@ CF_INLINE void NIVolumeDataGetLinearIndexes(NIVolumeDataInlineBuffer *inlineBuff
             }
         }
     } else {
+        // the index is separable in x, y and z, so only 6 offsets need to be computed, even for bricked volumes
+        NSInteger xOffsets[2];
+        NSInteger yOffsets[2];
+        NSInteger zOffsets[2];
+        for (int i = 0; i < 2; ++i) {
+            xOffsets[i] = NIVolumeDataIndexOffsetForX(inlineBuffer, x+i);
+            yOffsets[i] = NIVolumeDataIndexOffsetForY(inlineBuffer, y+i);
+            zOffsets[i] = NIVolumeDataIndexOffsetForZ(inlineBuffer, z+i);
+        }
         for (int i = 0; i < 2; ++i) {
             for (int j = 0; j < 2; ++j) {
                 for (int k = 0; k < 2; ++k) {
-                    linearIndexes[i+2*(j+2*k)] = NIVolumeDataUncheckedIndexAtCoordinate(inlineBuffer, x+i, y+j, z+k);
+                    linearIndexes[i+2*(j+2*k)] = xOffsets[i] + yOffsets[j] + zOffsets[k];
                 }
             }
         }
@@ -524,16 +1057,15 @@ CF_INLINE float NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(NIVolumeDa
     const CGFloat z_floor = floorf(z);
 #endif
 
-    // this is a horible hack, but it works
-    // what I'm doing is looking at memory addresses to find an index into inlineBuffer->floatBytes that would jump out of
-    // the array and instead point to inlineBuffer->outOfBoundsValue which is on the stack
-    // This relies on both inlineBuffer->floatBytes and inlineBuffer->outOfBoundsValue being on a sizeof(float) boundry
-    NSInteger outOfBoundsIndex = (((NSInteger)&(inlineBuffer->outOfBoundsValue)) - ((NSInteger)inlineBuffer->floatBytes)) / sizeof(float);
+    NSInteger outOfBoundsIndex = NIVolumeDataOutOfBoundsIndex(inlineBuffer);
 
     NSInteger linearIndexes[8];
     NIVolumeDataGetLinearIndexes(inlineBuffer, linearIndexes, x_floor, y_floor, z_floor, outOfBoundsIndex);
 
-    const float *floatBytes = inlineBuffer->floatBytes;
+    float values[8];
+    for (int i = 0; i < 8; ++i) {
+        values[i] = NIVolumeDataSampleAtIndex(inlineBuffer, linearIndexes[i], outOfBoundsIndex);
+    }
 
     const CGFloat dx1 = x-x_floor;
     const CGFloat dy1 = y-y_floor;
@@ -543,10 +1075,10 @@ CF_INLINE float NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(NIVolumeDa
     const CGFloat dy0 = 1.0 - dy1;
     const CGFloat dz0 = 1.0 - dz1;
 
-    return (dz0*(dy0*(dx0*floatBytes[linearIndexes[0+2*(0+2*0)]] + dx1*floatBytes[linearIndexes[1+2*(0+2*0)]]) +
-                 dy1*(dx0*floatBytes[linearIndexes[0+2*(1+2*0)]] + dx1*floatBytes[linearIndexes[1+2*(1+2*0)]]))) +
-           (dz1*(dy0*(dx0*floatBytes[linearIndexes[0+2*(0+2*1)]] + dx1*floatBytes[linearIndexes[1+2*(0+2*1)]]) +
-                 dy1*(dx0*floatBytes[linearIndexes[0+2*(1+2*1)]] + dx1*floatBytes[linearIndexes[1+2*(1+2*1)]])));
+    return (dz0*(dy0*(dx0*values[0+2*(0+2*0)] + dx1*values[1+2*(0+2*0)]) +
+                 dy1*(dx0*values[0+2*(1+2*0)] + dx1*values[1+2*(1+2*0)]))) +
+           (dz1*(dy0*(dx0*values[0+2*(0+2*1)] + dx1*values[1+2*(0+2*1)]) +
+                 dy1*(dx0*values[0+2*(1+2*1)] + dx1*values[1+2*(1+2*1)])));
 }
 
 /**
@@ -582,7 +1114,10 @@ CF_INLINE float NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeCoordinate(N
 */
 CF_INLINE void NIVolumeDataGetCubicIndexes(NIVolumeDataInlineBuffer *inlineBuffer, NSInteger cubicIndexes[_Nonnull 64], NSInteger x, NSInteger y, NSInteger z, NSInteger outOfBoundsIndex)
 {
-    if (x <= 0 || y <= 0 || z <= 0 || x >= inlineBuffer->pixelsWide-2 || y >= inlineBuffer->pixelsHigh-2 || z >= inlineBuffer->pixelsDeep-2) {
+    const NSInteger border = inlineBuffer->borderWidth; // voxels in the padding are read like any other
+
+    if (x <= -border || y <= -border || z <= -border ||
+        x >= (NSInteger)inlineBuffer->pixelsWide-2+border || y >= (NSInteger)inlineBuffer->pixelsHigh-2+border || z >= (NSInteger)inlineBuffer->pixelsDeep-2+border) {
         for (int i = 0; i < 4; ++i) {
             for (int j = 0; j < 4; ++j) {
                 for (int k = 0; k < 4; ++k) {
@@ -591,16 +1126,40 @@ CF_INLINE void NIVolumeDataGetCubicIndexes(NIVolumeDataInlineBuffer *inlineBuffe
             }
         }
     } else {
+        NSInteger xOffsets[4];
+        NSInteger yOffsets[4];
+        NSInteger zOffsets[4];
+        for (int i = 0; i < 4; ++i) {
+            xOffsets[i] = NIVolumeDataIndexOffsetForX(inlineBuffer, x+i-1);
+            yOffsets[i] = NIVolumeDataIndexOffsetForY(inlineBuffer, y+i-1);
+            zOffsets[i] = NIVolumeDataIndexOffsetForZ(inlineBuffer, z+i-1);
+        }
         for (int i = 0; i < 4; ++i) {
             for (int j = 0; j < 4; ++j) {
                 for (int k = 0; k < 4; ++k) {
-                    cubicIndexes[i+4*(j+4*k)] = NIVolumeDataUncheckedIndexAtCoordinate(inlineBuffer, x+i-1, y+j-1, z+k-1);
+                    cubicIndexes[i+4*(j+4*k)] = xOffsets[i] + yOffsets[j] + zOffsets[k];
                 }
             }
         }
     }
 }
 
+/**
+ Fills weights with the 4 cubic interpolation weights for a sample that is the given fraction of a voxel past the second of the 4 taps.
+ @param fraction The distance, between 0 and 1, from the floor of the sampled coordinate.
+ @param weights An array that will be filled out with the weights of the voxels at floor-1, floor, floor+1 and floor+2.
+ */
+CF_INLINE void NIVolumeDataGetCubicWeights(CGFloat fraction, CGFloat weights[_Nonnull 4])
+{
+    const CGFloat fraction2 = fraction*fraction;
+    const CGFloat fraction3 = fraction2*fraction;
+
+    weights[0] = 0.5 * (          - fraction + 2.0*fraction2 -       fraction3);
+    weights[1] = 0.5 * (2.0                  - 5.0*fraction2 + 3.0 * fraction3);
+    weights[2] = 0.5 * (            fraction + 4.0*fraction2 - 3.0 * fraction3);
+    weights[3] = 0.5 * (                     -     fraction2 +       fraction3);
+}
+
 /**
  Returns the cubic interpolated float intensity at the given point in voxel space.
  @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
@@ -620,69 +1179,142 @@ CF_INLINE float NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate(NIVolumeDat
     const CGFloat z_floor = floorf(z);
 #endif
 
-    const CGFloat dx = x-x_floor;
-    const CGFloat dy = y-y_floor;
-    const CGFloat dz = z-z_floor;
-
-    const CGFloat dxx = dx*dx;
-    const CGFloat dxxx = dxx*dx;
-
-    const CGFloat dyy = dy*dy;
-    const CGFloat dyyy = dyy*dy;
-
-    const CGFloat dzz = dz*dz;
-    const CGFloat dzzz = dzz*dz;
-
-    const CGFloat wx0 = 0.5 * (    - dx + 2.0*dxx -       dxxx);
-    const CGFloat wx1 = 0.5 * (2.0      - 5.0*dxx + 3.0 * dxxx);
-    const CGFloat wx2 = 0.5 * (      dx + 4.0*dxx - 3.0 * dxxx);
-    const CGFloat wx3 = 0.5 * (         -     dxx +       dxxx);
-
-    const CGFloat wy0 = 0.5 * (    - dy + 2.0*dyy -       dyyy);
-    const CGFloat wy1 = 0.5 * (2.0      - 5.0*dyy + 3.0 * dyyy);
-    const CGFloat wy2 = 0.5 * (      dy + 4.0*dyy - 3.0 * dyyy);
-    const CGFloat wy3 = 0.5 * (         -     dyy +       dyyy);
+    CGFloat wx[4];
+    CGFloat wy[4];
+    CGFloat wz[4];
+    NIVolumeDataGetCubicWeights(x-x_floor, wx);
+    NIVolumeDataGetCubicWeights(y-y_floor, wy);
+    NIVolumeDataGetCubicWeights(z-z_floor, wz);
 
-    const CGFloat wz0 = 0.5 * (    - dz + 2.0*dzz -       dzzz);
-    const CGFloat wz1 = 0.5 * (2.0      - 5.0*dzz + 3.0 * dzzz);
-    const CGFloat wz2 = 0.5 * (      dz + 4.0*dzz - 3.0 * dzzz);
-    const CGFloat wz3 = 0.5 * (         -     dzz +       dzzz);
+    const float *floatBytes = inlineBuffer->floatBytes;
+    const NSInteger xIndex = x_floor;
+    const NSInteger yIndex = y_floor;
+    const NSInteger zIndex = z_floor;
+    const NSInteger border = inlineBuffer->borderWidth;
+    CGFloat value = 0;
+    int j;
+    int k;
+
+    if (xIndex > -border && yIndex > -border && zIndex > -border &&
+        xIndex < (NSInteger)inlineBuffer->pixelsWide-2+border && yIndex < (NSInteger)inlineBuffer->pixelsHigh-2+border && zIndex < (NSInteger)inlineBuffer->pixelsDeep-2+border) {
+        // all 64 voxels are in the volume or its padding, so they are read directly without building an index array
+        if (inlineBuffer->brickShift == 0 && floatBytes) {
+            const NSInteger rowStride = inlineBuffer->rowStride;
+            const NSInteger sliceStride = inlineBuffer->sliceStride;
+            const float *corner = floatBytes + (xIndex-1) + rowStride*(yIndex-1) + sliceStride*(zIndex-1);
+            for (k = 0; k < 4; ++k) {
+                const float *slice = corner + sliceStride*k;
+                CGFloat planeValue = 0;
+                for (j = 0; j < 4; ++j) {
+                    const float *row = slice + rowStride*j;
+                    planeValue += wy[j]*(wx[0]*row[0] + wx[1]*row[1] + wx[2]*row[2] + wx[3]*row[3]);
+                }
+                value += wz[k]*planeValue;
+            }
+        } else {
+            NSInteger xOffsets[4];
+            NSInteger yOffsets[4];
+            NSInteger zOffsets[4];
+            for (j = 0; j < 4; ++j) {
+                xOffsets[j] = NIVolumeDataIndexOffsetForX(inlineBuffer, xIndex+j-1);
+                yOffsets[j] = NIVolumeDataIndexOffsetForY(inlineBuffer, yIndex+j-1);
+                zOffsets[j] = NIVolumeDataIndexOffsetForZ(inlineBuffer, zIndex+j-1);
+            }
+            for (k = 0; k < 4; ++k) {
+                CGFloat planeValue = 0;
+                for (j = 0; j < 4; ++j) {
+                    const NSInteger rowOffset = yOffsets[j] + zOffsets[k];
+                    planeValue += wy[j]*(wx[0]*NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, rowOffset + xOffsets[0]) + wx[1]*NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, rowOffset + xOffsets[1]) +
+                                         wx[2]*NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, rowOffset + xOffsets[2]) + wx[3]*NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, rowOffset + xOffsets[3]));
+                }
+                value += wz[k]*planeValue;
+            }
+        }
+        return value;
+    }
 
-    // this is a horible hack, but it works
-    // what I'm doing is looking at memory addresses to find an index into inlineBuffer->floatBytes that would jump out of
-    // the array and instead point to inlineBuffer->outOfBoundsValue which is on the stack
-    // This relies on both inlineBuffer->floatBytes and inlineBuffer->outOfBoundsValue being on a sizeof(float) boundry
-    NSInteger outOfBoundsIndex = (((NSInteger)&(inlineBuffer->outOfBoundsValue)) - ((NSInteger)inlineBuffer->floatBytes)) / sizeof(float);
+    NSInteger outOfBoundsIndex = NIVolumeDataOutOfBoundsIndex(inlineBuffer);
 
     NSInteger cubicIndexes[64];
     NIVolumeDataGetCubicIndexes(inlineBuffer, cubicIndexes, x_floor, y_floor, z_floor, outOfBoundsIndex);
 
-    const float *floatBytes = inlineBuffer->floatBytes;
+    for (k = 0; k < 4; ++k) {
+        CGFloat planeValue = 0;
+        for (j = 0; j < 4; ++j) {
+            const NSInteger *rowIndexes = cubicIndexes + 4*(j+4*k);
+            planeValue += wy[j]*(wx[0]*NIVolumeDataSampleAtIndex(inlineBuffer, rowIndexes[0], outOfBoundsIndex) + wx[1]*NIVolumeDataSampleAtIndex(inlineBuffer, rowIndexes[1], outOfBoundsIndex) +
+                                 wx[2]*NIVolumeDataSampleAtIndex(inlineBuffer, rowIndexes[2], outOfBoundsIndex) + wx[3]*NIVolumeDataSampleAtIndex(inlineBuffer, rowIndexes[3], outOfBoundsIndex));
+        }
+        value += wz[k]*planeValue;
+    }
+    return value;
+}
 
-    return wz0*(
-                wy0*(wx0 * floatBytes[cubicIndexes[0+4*(0+4*0)]] + wx1 * floatBytes[cubicIndexes[1+4*(0+4*0)]] +  wx2 * floatBytes[cubicIndexes[2+4*(0+4*0)]] + wx3 * floatBytes[cubicIndexes[3+4*(0+4*0)]]) +
-                wy1*(wx0 * floatBytes[cubicIndexes[0+4*(1+4*0)]] + wx1 * floatBytes[cubicIndexes[1+4*(1+4*0)]] +  wx2 * floatBytes[cubicIndexes[2+4*(1+4*0)]] + wx3 * floatBytes[cubicIndexes[3+4*(1+4*0)]]) +
-                wy2*(wx0 * floatBytes[cubicIndexes[0+4*(2+4*0)]] + wx1 * floatBytes[cubicIndexes[1+4*(2+4*0)]] +  wx2 * floatBytes[cubicIndexes[2+4*(2+4*0)]] + wx3 * floatBytes[cubicIndexes[3+4*(2+4*0)]]) +
-                wy3*(wx0 * floatBytes[cubicIndexes[0+4*(3+4*0)]] + wx1 * floatBytes[cubicIndexes[1+4*(3+4*0)]] +  wx2 * floatBytes[cubicIndexes[2+4*(3+4*0)]] + wx3 * floatBytes[cubicIndexes[3+4*(3+4*0)]])
-                ) +
-    wz1*(
-         wy0*(wx0 * floatBytes[cubicIndexes[0+4*(0+4*1)]] + wx1 * floatBytes[cubicIndexes[1+4*(0+4*1)]] +  wx2 * floatBytes[cubicIndexes[2+4*(0+4*1)]] + wx3 * floatBytes[cubicIndexes[3+4*(0+4*1)]]) +
-         wy1*(wx0 * floatBytes[cubicIndexes[0+4*(1+4*1)]] + wx1 * floatBytes[cubicIndexes[1+4*(1+4*1)]] +  wx2 * floatBytes[cubicIndexes[2+4*(1+4*1)]] + wx3 * floatBytes[cubicIndexes[3+4*(1+4*1)]]) +
-         wy2*(wx0 * floatBytes[cubicIndexes[0+4*(2+4*1)]] + wx1 * floatBytes[cubicIndexes[1+4*(2+4*1)]] +  wx2 * floatBytes[cubicIndexes[2+4*(2+4*1)]] + wx3 * floatBytes[cubicIndexes[3+4*(2+4*1)]]) +
-         wy3*(wx0 * floatBytes[cubicIndexes[0+4*(3+4*1)]] + wx1 * floatBytes[cubicIndexes[1+4*(3+4*1)]] +  wx2 * floatBytes[cubicIndexes[2+4*(3+4*1)]] + wx3 * floatBytes[cubicIndexes[3+4*(3+4*1)]])
-         ) +
-    wz2*(
-         wy0*(wx0 * floatBytes[cubicIndexes[0+4*(0+4*2)]] + wx1 * floatBytes[cubicIndexes[1+4*(0+4*2)]] +  wx2 * floatBytes[cubicIndexes[2+4*(0+4*2)]] + wx3 * floatBytes[cubicIndexes[3+4*(0+4*2)]]) +
-         wy1*(wx0 * floatBytes[cubicIndexes[0+4*(1+4*2)]] + wx1 * floatBytes[cubicIndexes[1+4*(1+4*2)]] +  wx2 * floatBytes[cubicIndexes[2+4*(1+4*2)]] + wx3 * floatBytes[cubicIndexes[3+4*(1+4*2)]]) +
-         wy2*(wx0 * floatBytes[cubicIndexes[0+4*(2+4*2)]] + wx1 * floatBytes[cubicIndexes[1+4*(2+4*2)]] +  wx2 * floatBytes[cubicIndexes[2+4*(2+4*2)]] + wx3 * floatBytes[cubicIndexes[3+4*(2+4*2)]]) +
-         wy3*(wx0 * floatBytes[cubicIndexes[0+4*(3+4*2)]] + wx1 * floatBytes[cubicIndexes[1+4*(3+4*2)]] +  wx2 * floatBytes[cubicIndexes[2+4*(3+4*2)]] + wx3 * floatBytes[cubicIndexes[3+4*(3+4*2)]])
-         ) +
-    wz3*(
-         wy0*(wx0 * floatBytes[cubicIndexes[0+4*(0+4*3)]] + wx1 * floatBytes[cubicIndexes[1+4*(0+4*3)]] +  wx2 * floatBytes[cubicIndexes[2+4*(0+4*3)]] + wx3 * floatBytes[cubicIndexes[3+4*(0+4*3)]]) +
-         wy1*(wx0 * floatBytes[cubicIndexes[0+4*(1+4*3)]] + wx1 * floatBytes[cubicIndexes[1+4*(1+4*3)]] +  wx2 * floatBytes[cubicIndexes[2+4*(1+4*3)]] + wx3 * floatBytes[cubicIndexes[3+4*(1+4*3)]]) +
-         wy2*(wx0 * floatBytes[cubicIndexes[0+4*(2+4*3)]] + wx1 * floatBytes[cubicIndexes[1+4*(2+4*3)]] +  wx2 * floatBytes[cubicIndexes[2+4*(2+4*3)]] + wx3 * floatBytes[cubicIndexes[3+4*(2+4*3)]]) +
-         wy3*(wx0 * floatBytes[cubicIndexes[0+4*(3+4*3)]] + wx1 * floatBytes[cubicIndexes[1+4*(3+4*3)]] +  wx2 * floatBytes[cubicIndexes[2+4*(3+4*3)]] + wx3 * floatBytes[cubicIndexes[3+4*(3+4*3)]])
-         );
+/**
+ Computes the 2 linear interpolation taps that together give the same result as the 4 taps of a cubic B-spline along one axis. Linear interpolation
+ at positions[0] and positions[1] weighted by weights[0] and weights[1] is equal to the cubic B-spline at the given coordinate.
+ @param coordinate The coordinate along the axis, in voxel space.
+ @param positions An array that will be filled out with the 2 coordinates at which to linearly interpolate.
+ @param weights An array that will be filled out with the weights of the 2 linear interpolations.
+ */
+CF_INLINE void NIVolumeDataGetCubicBSplineLinearTaps(CGFloat coordinate, CGFloat positions[_Nonnull 2], CGFloat weights[_Nonnull 2])
+{
+#if CGFLOAT_IS_DOUBLE
+    const CGFloat coordinate_floor = floor(coordinate);
+#else
+    const CGFloat coordinate_floor = floorf(coordinate);
+#endif
+    const CGFloat t = coordinate - coordinate_floor;
+    const CGFloat t2 = t*t;
+    const CGFloat t3 = t2*t;
+    const CGFloat oneMinusT = 1.0 - t;
+
+    const CGFloat w0 = (1.0/6.0) * oneMinusT*oneMinusT*oneMinusT;
+    const CGFloat w1 = (1.0/6.0) * (4.0             - 6.0*t2 + 3.0*t3);
+    const CGFloat w2 = (1.0/6.0) * (1.0 + 3.0*t + 3.0*t2 - 3.0*t3);
+    const CGFloat w3 = (1.0/6.0) * t3;
+
+    weights[0] = w0 + w1; // both sums are at least 1/6
+    weights[1] = w2 + w3;
+    positions[0] = coordinate_floor - 1.0 + w1/weights[0];
+    positions[1] = coordinate_floor + 1.0 + w3/weights[1];
+}
+
+/**
+ Returns the cubic B-spline interpolated float intensity at the given point in voxel space. The B-spline is evaluated as 8 linear interpolations of the coefficients,
+ which reads 8 neighborhoods of 8 voxels that mostly overlap, rather than the 64 independent voxels needed by NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate().
+ @param coefficientsInlineBuffer An inline buffer that was previously initialized using [[NIVolumeData cubicBSplineCoefficients] acquireInlineBuffer:]
+ @param x The x coordinate of the voxel.
+ @param y The y coordinate of the voxel.
+ @param z The z coordinate of the voxel.
+ @see [NIVolumeData cubicBSplineCoefficients]
+ */
+CF_INLINE float NIVolumeDataCubicBSplineInterpolatedFloatAtVolumeCoordinate(NIVolumeDataInlineBuffer *coefficientsInlineBuffer, CGFloat x, CGFloat y, CGFloat z) // coordinate in the pixel space
+{
+    CGFloat xPositions[2];
+    CGFloat yPositions[2];
+    CGFloat zPositions[2];
+    CGFloat xWeights[2];
+    CGFloat yWeights[2];
+    CGFloat zWeights[2];
+    CGFloat value = 0;
+    int i;
+    int j;
+    int k;
+
+    NIVolumeDataGetCubicBSplineLinearTaps(x, xPositions, xWeights);
+    NIVolumeDataGetCubicBSplineLinearTaps(y, yPositions, yWeights);
+    NIVolumeDataGetCubicBSplineLinearTaps(z, zPositions, zWeights);
+
+    for (k = 0; k < 2; ++k) {
+        for (j = 0; j < 2; ++j) {
+            for (i = 0; i < 2; ++i) {
+                value += zWeights[k]*yWeights[j]*xWeights[i] *
+                         NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(coefficientsInlineBuffer, xPositions[i], yPositions[j], zPositions[k]);
+            }
+        }
+    }
+    return value;
 }
 
 __attribute__((deprecated("convert the vector using [-[NIVolumeData convertVolumeVectorFromModelVector:] first")))
@@ -736,6 +1368,167 @@ CF_INLINE float NIVolumeDataCubicInterpolatedFloatAtVolumeVector(NIVolumeDataInl
     return NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate(inlineBuffer, vector.x, vector.y, vector.z);
 }
 
+/**
+ Fills outputValues with the linearly interpolated float intensities at the given points in voxel space. This returns the same values as calling
+ NIVolumeDataLinearInterpolatedFloatAtVolumeVector() for each point, but processes several points at a time using SIMD instructions when they are available.
+ Points outside of the volume get the outOfBoundsValue, so any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ */
+void NIVolumeDataLinearInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors);
+
+/**
+ Fills outputValues with the nearest neighbor interpolated float intensities at the given points in voxel space. This returns the same values as calling
+ NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector() for each point. Any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ */
+void NIVolumeDataNearestNeighborInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors);
+
+/**
+ Fills outputValues with the cubic interpolated float intensities at the given points in voxel space. This returns the same values as calling
+ NIVolumeDataCubicInterpolatedFloatAtVolumeVector() for each point. Any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param volumeVectors An array of numVectors points in voxel space.
+ @param outputValues An array of numVectors floats that will be filled with the interpolated values.
+ @param numVectors The number of points to sample.
+ */
+void NIVolumeDataCubicInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors);
+
+/**
+ Fills outputValues with the linearly interpolated float intensities at the given points in voxel space. The points are passed as separate single precision
+ x, y and z arrays, which lets twice as many points be processed per SIMD instruction as NIVolumeDataLinearInterpolateVolumeVectors() and halves the memory
+ traffic for the coordinates. The results match NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate() to within float rounding. Any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param xCoordinates An array of numCoordinates x coordinates in voxel space.
+ @param yCoordinates An array of numCoordinates y coordinates in voxel space.
+ @param zCoordinates An array of numCoordinates z coordinates in voxel space.
+ @param outputValues An array of numCoordinates floats that will be filled with the interpolated values.
+ @param numCoordinates The number of points to sample.
+ */
+void NIVolumeDataLinearInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                    float *outputValues, NSUInteger numCoordinates);
+
+/**
+ Fills outputValues with the nearest neighbor interpolated float intensities at the given points in voxel space, passed as separate single precision x, y and z arrays.
+ See NIVolumeDataLinearInterpolateVolumeCoordinates(). Any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param xCoordinates An array of numCoordinates x coordinates in voxel space.
+ @param yCoordinates An array of numCoordinates y coordinates in voxel space.
+ @param zCoordinates An array of numCoordinates z coordinates in voxel space.
+ @param outputValues An array of numCoordinates floats that will be filled with the interpolated values.
+ @param numCoordinates The number of points to sample.
+ */
+void NIVolumeDataNearestNeighborInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                             float *outputValues, NSUInteger numCoordinates);
+
+/**
+ Fills outputValues with the cubic interpolated float intensities at the given points in voxel space, passed as separate single precision x, y and z arrays.
+ See NIVolumeDataLinearInterpolateVolumeCoordinates(). Any point can be passed.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]
+ @param xCoordinates An array of numCoordinates x coordinates in voxel space.
+ @param yCoordinates An array of numCoordinates y coordinates in voxel space.
+ @param zCoordinates An array of numCoordinates z coordinates in voxel space.
+ @param outputValues An array of numCoordinates floats that will be filled with the interpolated values.
+ @param numCoordinates The number of points to sample.
+ */
+void NIVolumeDataCubicInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                   float *outputValues, NSUInteger numCoordinates);
+
+/**
+ Fills outputValues with the cubic B-spline interpolated float intensities at the given points in voxel space, passed as separate single precision x, y and z arrays.
+ The 8 linear interpolations of each point are done with NIVolumeDataLinearInterpolateVolumeCoordinates(). Any point can be passed.
+ @param coefficientsInlineBuffer An inline buffer that was previously initialized using [[NIVolumeData cubicBSplineCoefficients] acquireInlineBuffer:]
+ @param xCoordinates An array of numCoordinates x coordinates in voxel space.
+ @param yCoordinates An array of numCoordinates y coordinates in voxel space.
+ @param zCoordinates An array of numCoordinates z coordinates in voxel space.
+ @param outputValues An array of numCoordinates floats that will be filled with the interpolated values.
+ @param numCoordinates The number of points to sample.
+ @see [NIVolumeData cubicBSplineCoefficients]
+ */
+void NIVolumeDataCubicBSplineInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *coefficientsInlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                          float *outputValues, NSUInteger numCoordinates);
+
+/**
+ Fills outputValues with the interpolated float intensities along a straight line in voxel space, the ith value being sampled at startVolumeVector + i*volumeStep.
+ The points are generated in chunks on the stack, so no memory is allocated and no transform needs to be applied to the points. The start of each chunk is
+ computed in double precision, so the positions don't drift along long scanlines. Cubic scanlines that only move in x compute the y and z weights
+ once per scanline instead of once per value.
+ @param inlineBuffer The inline buffer that was previously initialized using [NIVolumeData acquireInlineBuffer:]. For NIInterpolationModeCubicBSpline, this must be
+ an inline buffer of the volume's cubicBSplineCoefficients.
+ @param interpolationMode The interpolation mode to use. outputValues is filled with 0 if the interpolation mode is unknown.
+ @param startVolumeVector The point in voxel space of the first value.
+ @param volumeStep The step in voxel space between successive values.
+ @param outputValues An array of numValues floats that will be filled with the interpolated values.
+ @param numValues The number of values to sample.
+ */
+void NIVolumeDataInterpolateVolumeScanline(NIVolumeDataInlineBuffer *inlineBuffer, NIInterpolationMode interpolationMode, NIVector startVolumeVector, NIVector volumeStep,
+                                           float *outputValues, NSUInteger numValues);
+
+/**
+ Gets the smallest and largest values that nearest neighbor or linear interpolation can return at points inside the given box in voxel space. The bounds come
+ from the cells of the grid that hold the voxels the interpolation reads, and include the outOfBoundsValue if the interpolation reads outside the volume.
+ The bounds do not hold for cubic interpolation, which overshoots the voxels it reads.
+ @param minMaxGrid The grid that was previously initialized using [NIVolumeData acquireMinMaxGrid:]
+ @param minVolumeVector The corner of the box with the smallest coordinates, in voxel space.
+ @param maxVolumeVector The corner of the box with the largest coordinates, in voxel space.
+ @param min Returns the smallest value that can be sampled in the box.
+ @param max Returns the largest value that can be sampled in the box.
+ @see [NIVolumeData acquireMinMaxGrid:]
+ */
+CF_INLINE void NIVolumeDataMinMaxGridGetBounds(const NIVolumeDataMinMaxGrid *minMaxGrid, NIVector minVolumeVector, NIVector maxVolumeVector, float *min, float *max)
+{
+    const CGFloat mins[3] = {minVolumeVector.x, minVolumeVector.y, minVolumeVector.z};
+    const CGFloat maxs[3] = {maxVolumeVector.x, maxVolumeVector.y, maxVolumeVector.z};
+    const NSUInteger sizes[3] = {minMaxGrid->pixelsWide, minMaxGrid->pixelsHigh, minMaxGrid->pixelsDeep};
+    NSInteger firstCells[3];
+    NSInteger lastCells[3];
+    BOOL readsOutOfBounds = NO;
+    float boundsMin = INFINITY;
+    float boundsMax = -INFINITY;
+    NSInteger i, j, k;
+    NSInteger axis;
+
+    for (axis = 0; axis < 3; axis++) {
+        // nearest neighbor and linear interpolation read the voxels from floor(coordinate) to floor(coordinate) + 1
+        CGFloat first = floor(MAX(mins[axis], -1.0));
+        CGFloat last = floor(MIN(maxs[axis], (CGFloat)sizes[axis])) + 1.0;
+        if (!(first >= 0.0 && last <= (CGFloat)(sizes[axis] - 1))) { // also catches NaN coordinates
+            readsOutOfBounds = YES;
+        }
+        first = MAX(first, 0.0);
+        last = MIN(last, (CGFloat)(sizes[axis] - 1));
+        if (!(first <= last)) {
+            *min = minMaxGrid->outOfBoundsValue;
+            *max = minMaxGrid->outOfBoundsValue;
+            return;
+        }
+        firstCells[axis] = (NSInteger)first >> minMaxGrid->cellShift;
+        lastCells[axis] = (NSInteger)last >> minMaxGrid->cellShift;
+    }
+
+    for (k = firstCells[2]; k <= lastCells[2]; k++) {
+        for (j = firstCells[1]; j <= lastCells[1]; j++) {
+            NSInteger rowIndex = (k * minMaxGrid->cellsHigh + j) * minMaxGrid->cellsWide;
+            for (i = firstCells[0]; i <= lastCells[0]; i++) {
+                boundsMin = MIN(boundsMin, minMaxGrid->cellMins[rowIndex + i]);
+                boundsMax = MAX(boundsMax, minMaxGrid->cellMaxs[rowIndex + i]);
+            }
+        }
+    }
+
+    if (readsOutOfBounds) {
+        boundsMin = MIN(boundsMin, minMaxGrid->outOfBoundsValue);
+        boundsMax = MAX(boundsMax, minMaxGrid->outOfBoundsValue);
+    }
+    *min = boundsMin;
+    *max = boundsMax;
+}
+
 CF_EXTERN_C_END
 
 NS_ASSUME_NONNULL_END
@@ -23,401 +23,2393 @@
 #import "NIGenerator.h"
 #import "NIGeneratorRequest.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 NS_ASSUME_NONNULL_BEGIN
 
 @interface NIVolumeData ()
 
 @property (nonatomic, readonly, assign) float* floatBytes;
 
-@end
-
-
-@implementation NIVolumeData
+- (instancetype)initWithBrickedData:(NSData *)brickedData brickSize:(NSUInteger)brickSize pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+              modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithPaddedData:(NSData *)paddedData borderWidth:(NSUInteger)borderWidth pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithCompressedBrickData:(NSData *)compressedBrickData brickOffsets:(NSData *)brickOffsets brickSize:(NSUInteger)brickSize
+                                  pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                       modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithViewedData:(NSData *)viewedData offset:(NSInteger)offset rowStride:(NSInteger)rowStride sliceStride:(NSInteger)sliceStride
+                        pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue NS_DESIGNATED_INITIALIZER;
+- (BOOL)_canBeViewed;
+- (NIVolumeData *)_viewWithOriginX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                          reversedY:(BOOL)reversedY reversedZ:(BOOL)reversedZ modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform;
+- (NIVolumeData *)_downsampledVolumeData;
+- (void)_enumerateRowsOfSliceAtIndex:(NSUInteger)z sliceBuffer:(float *)sliceBuffer usingBlock:(void (^)(const float *row))block;
+- (void)_computeIntensityStatistics;
+- (void)_copyIntensityStatisticsFromVolumeData:(NIVolumeData *)volumeData;
+- (nullable NIVolumeData *)_volumeDataSeparablyResampledWithModelToVoxelTransform:(NIAffineTransform)transform pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh
+                                                                       pixelsDeep:(NSUInteger)pixelsDeep interpolationMode:(NIInterpolationMode)interpolationMode;
+- (NSData *)_decompressedBrickAtIndex:(NSUInteger)brickIndex;
+- (void)_getCompressedFloats:(float *)floats inIndexRangesX:(NSRange)xr y:(NSRange)yr z:(NSRange)zr;
+- (NIVolumeData *)_volumeDataForSamplingModelVector:(NIVector)vector;
+- (void)_interpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors
+                          sampler:(void (*)(NIVolumeDataInlineBuffer *, const NIVector *, float *, NSUInteger))sampler;
+- (BOOL)_hasEqualSlicesToVolumeData:(NIVolumeData *)otherVolumeData;
 
-@synthesize outOfBoundsValue = _outOfBoundsValue;
-@synthesize pixelsWide = _pixelsWide;
-@synthesize pixelsHigh = _pixelsHigh;
-@synthesize pixelsDeep = _pixelsDeep;
-@synthesize modelToVoxelTransform = _modelToVoxelTransform;
-@synthesize floatData = _floatData;
-@synthesize curved = _curved;
+@end
 
-+ (NIAffineTransform)modelToVoxelTransformForOrigin:(NIVector)origin directionX:(NIVector)directionX pixelSpacingX:(CGFloat)pixelSpacingX directionY:(NIVector)directionY pixelSpacingY:(CGFloat)pixelSpacingY
-                                     directionZ:(NIVector)directionZ pixelSpacingZ:(CGFloat)pixelSpacingZ
+static NSUInteger NIVolumeDataBrickShift(NSUInteger brickSize) // returns NSNotFound if brickSize is not a power of 2
 {
-    directionX = NIVectorNormalize(directionX);
-    directionY = NIVectorNormalize(directionY);
-    directionZ = NIVectorNormalize(directionZ);
-
-    NIAffineTransform transform = NIAffineTransformIdentity;
-    transform.m11 = directionX.x * pixelSpacingX;
-    transform.m12 = directionX.y * pixelSpacingX;
-    transform.m13 = directionX.z * pixelSpacingX;
-    transform.m21 = directionY.x * pixelSpacingY;
-    transform.m22 = directionY.y * pixelSpacingY;
-    transform.m23 = directionY.z * pixelSpacingY;
-    transform.m31 = directionZ.x * pixelSpacingZ;
-    transform.m32 = directionZ.y * pixelSpacingZ;
-    transform.m33 = directionZ.z * pixelSpacingZ;
-    transform.m41 = origin.x;
-    transform.m42 = origin.y;
-    transform.m43 = origin.z;
+    NSUInteger shift = 0;
+    while (((NSUInteger)1 << shift) < brickSize) {
+        shift++;
+    }
+    return ((NSUInteger)1 << shift) == brickSize ? shift : NSNotFound;
+}
 
-    return NIAffineTransformInvert(transform);
+static NSUInteger NIVolumeDataBrickedFloatCount(NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger brickSize)
+{
+    NSUInteger bricksWide = (pixelsWide + brickSize - 1) / brickSize;
+    NSUInteger bricksHigh = (pixelsHigh + brickSize - 1) / brickSize;
+    NSUInteger bricksDeep = (pixelsDeep + brickSize - 1) / brickSize;
+    return bricksWide * bricksHigh * bricksDeep * brickSize * brickSize * brickSize;
 }
 
-- (instancetype)initWithBytesNoCopy:(const float *)floatBytes pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
-                    modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue freeWhenDone:(BOOL)freeWhenDone // modelToVoxelTransform is the transform from Model (patient) space to pixel data
+// copies the floats between the flat and the bricked layouts, each z slice is copied in parallel
+static void NIVolumeDataCopyBrickedFloats(float *flatFloats, float *brickedFloats, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger brickSize, BOOL toBricks)
 {
-    return [self initWithData:[NSData dataWithBytesNoCopy:(void *)floatBytes length:sizeof(float) * pixelsWide * pixelsHigh * pixelsDeep freeWhenDone:freeWhenDone]
-                   pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue];
+    NIVolumeDataInlineBuffer inlineBuffer;
+    memset(&inlineBuffer, 0, sizeof(NIVolumeDataInlineBuffer));
+    inlineBuffer.pixelsWide = pixelsWide;
+    inlineBuffer.pixelsHigh = pixelsHigh;
+    inlineBuffer.pixelsDeep = pixelsDeep;
+    inlineBuffer.brickShift = NIVolumeDataBrickShift(brickSize);
+    inlineBuffer.rowStride = ((pixelsWide + brickSize - 1) / brickSize) * brickSize * brickSize * brickSize;
+    inlineBuffer.sliceStride = inlineBuffer.rowStride * ((pixelsHigh + brickSize - 1) / brickSize);
+
+    dispatch_apply(pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+        NSUInteger x;
+        NSUInteger y;
+        for (y = 0; y < pixelsHigh; y++) {
+            for (x = 0; x < pixelsWide; x += brickSize) {
+                float *flatRun = flatFloats + (x + pixelsWide*(y + pixelsHigh*z));
+                float *brickedRun = brickedFloats + NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, x, y, z);
+                NSUInteger runLength = MIN(brickSize, pixelsWide - x);
+                if (toBricks) {
+                    memcpy(brickedRun, flatRun, runLength * sizeof(float));
+                } else {
+                    memcpy(flatRun, brickedRun, runLength * sizeof(float));
+                }
+            }
+        }
+    });
 }
 
-- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
-             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue // modelToVoxelTransform is the transform from Model (patient) space to pixel data
+// returns nil if the memory could not be allocated
+static NSData * _Nullable NIVolumeDataBrickedData(NSData *flatData, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger brickSize, float outOfBoundsValue)
 {
-    if ([data length] < sizeof(float)*pixelsWide*pixelsHigh*pixelsDeep) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld", __PRETTY_FUNCTION__, (long long)[data length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep] userInfo:nil];
+    NSUInteger brickedFloatCount = NIVolumeDataBrickedFloatCount(pixelsWide, pixelsHigh, pixelsDeep, brickSize);
+    float *brickedFloats = malloc(brickedFloatCount * sizeof(float));
+    if (brickedFloats == NULL) {
+        return nil;
     }
 
-    if ( (self = [super init]) ) {
-        _floatData = [data retain];
-        _outOfBoundsValue = outOfBoundsValue;
-        _pixelsWide = pixelsWide;
-        _pixelsHigh = pixelsHigh;
-        _pixelsDeep = pixelsDeep;
-        _modelToVoxelTransform = modelToVoxelTransform;
+    if (pixelsWide % brickSize || pixelsHigh % brickSize || pixelsDeep % brickSize) { // the voxels that pad the last bricks are never sampled, but keep them well defined
+        vDSP_vfill(&outOfBoundsValue, brickedFloats, 1, brickedFloatCount);
     }
-    return self;
+    NIVolumeDataCopyBrickedFloats((float *)[flatData bytes], brickedFloats, pixelsWide, pixelsHigh, pixelsDeep, brickSize, YES);
+
+    return [NSData dataWithBytesNoCopy:brickedFloats length:brickedFloatCount * sizeof(float) freeWhenDone:YES];
+}
+static NSUInteger NIVolumeDataPaddedFloatCount(NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger borderWidth)
+{
+    return (pixelsWide + 2*borderWidth) * (pixelsHigh + 2*borderWidth) * (pixelsDeep + 2*borderWidth);
 }
 
-- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
-      volumeToModelConverter:(NIVector (^)(NIVector volumeVector))volumeToModelConverter modelToVolumeConverter:(NIVector (^)(NIVector modelVector))modelToVolumeConverter
-            outOfBoundsValue:(float)outOfBoundsValue
+// copies the floats between the flat and the padded layouts, each z slice is copied in parallel
+static void NIVolumeDataCopyPaddedFloats(float *flatFloats, float *paddedFloats, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger borderWidth, BOOL toPadded)
 {
-    if ( (self = [super init]) ) {
-        _floatData = [data retain];
-        _outOfBoundsValue = outOfBoundsValue;
-        _pixelsWide = pixelsWide;
-        _pixelsHigh = pixelsHigh;
-        _pixelsDeep = pixelsDeep;
-        _modelToVoxelTransform = NIAffineTransformIdentity;
-        _curved = YES;
-        _convertVolumeVectorToModelVectorBlock = [volumeToModelConverter copy];
-        _convertVolumeVectorFromModelVectorBlock = [modelToVolumeConverter copy];
-    }
-    return self;
+    const NSUInteger paddedWide = pixelsWide + 2*borderWidth;
+    const NSUInteger paddedHigh = pixelsHigh + 2*borderWidth;
+
+    dispatch_apply(pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+        NSUInteger y;
+        for (y = 0; y < pixelsHigh; y++) {
+            float *flatRow = flatFloats + (pixelsWide*(y + pixelsHigh*z));
+            float *paddedRow = paddedFloats + (borderWidth + paddedWide*(y + borderWidth + paddedHigh*(z + borderWidth)));
+            if (toPadded) {
+                memcpy(paddedRow, flatRow, pixelsWide * sizeof(float));
+            } else {
+                memcpy(flatRow, paddedRow, pixelsWide * sizeof(float));
+            }
+        }
+    });
 }
 
-- (instancetype)initWithVolumeData:(NIVolumeData *)volumeData
+// returns nil if the memory could not be allocated
+static NSData * _Nullable NIVolumeDataPaddedData(NSData *flatData, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger borderWidth, float outOfBoundsValue)
 {
-    if (volumeData.curved) {
-        return [self initWithData:volumeData.floatData pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue];
-    } else {
-        return [self initWithData:volumeData.floatData pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep
-           volumeToModelConverter:volumeData.convertVolumeVectorToModelVectorBlock modelToVolumeConverter:volumeData.convertVolumeVectorFromModelVectorBlock outOfBoundsValue:volumeData.outOfBoundsValue];
+    NSUInteger paddedFloatCount = NIVolumeDataPaddedFloatCount(pixelsWide, pixelsHigh, pixelsDeep, borderWidth);
+    float *paddedFloats = malloc(paddedFloatCount * sizeof(float));
+    if (paddedFloats == NULL) {
+        return nil;
     }
+
+    vDSP_vfill(&outOfBoundsValue, paddedFloats, 1, paddedFloatCount);
+    NIVolumeDataCopyPaddedFloats((float *)[flatData bytes], paddedFloats, pixelsWide, pixelsHigh, pixelsDeep, borderWidth, YES);
+
+    return [NSData dataWithBytesNoCopy:paddedFloats length:paddedFloatCount * sizeof(float) freeWhenDone:YES];
 }
 
-+ (BOOL)supportsSecureCoding
+static const NSUInteger NIVolumeDataDefaultBrickCacheLimit = 64 << 20;
+static const NSUInteger NIVolumeDataMinMaxCellShift = 3; // the min/max grid cells are 8x8x8 voxels
+
+// Compressed bricks start with a format byte. Packed bricks XOR every float with the previous one, and store a tag nibble per float, two to a byte,
+// that holds the number of zero bytes at the top and at the bottom of the XOR, followed by the bytes in between. A nibble of 0xF means the XOR is 0.
+// Bricks that would not get smaller are stored raw.
+enum {
+    NIVolumeDataBrickFormatRaw = 0,
+    NIVolumeDataBrickFormatPacked = 1,
+};
+
+static const uint8_t NIVolumeDataPackedZeroNibble = 0xF;
+
+static size_t NIVolumeDataMaxCompressedBrickLength(NSUInteger floatCount)
 {
-    return YES;
+    return 1 + floatCount * sizeof(float) + (floatCount + 1) / 2;
 }
 
-- (nullable id)replacementObjectForPortCoder:(NSPortCoder *)encoder
+// returns the length of the compressed brick, compressed must be at least NIVolumeDataMaxCompressedBrickLength() long
+static size_t NIVolumeDataCompressBrick(const float *brickFloats, NSUInteger floatCount, uint8_t *compressed)
 {
-    if ([encoder isBycopy]) return self;
-    return [super replacementObjectForPortCoder:encoder];
+    const uint32_t *bits = (const uint32_t *)brickFloats;
+    uint8_t *output = compressed + 1;
+    uint8_t *tag = NULL;
+    uint32_t previous = 0;
+    NSUInteger i;
+    NSUInteger j;
+
+    for (i = 0; i < floatCount; i++) {
+        uint32_t delta = bits[i] ^ previous;
+        uint8_t nibble = NIVolumeDataPackedZeroNibble;
+        previous = bits[i];
+
+        if ((i & 1) == 0) {
+            tag = output++;
+            *tag = 0;
+        }
+
+        if (delta) {
+            NSUInteger leadingBytes = __builtin_clz(delta) / 8;
+            NSUInteger trailingBytes = __builtin_ctz(delta) / 8;
+            NSUInteger length = 4 - leadingBytes - trailingBytes;
+            nibble = (uint8_t)((leadingBytes << 2) | trailingBytes);
+            delta >>= 8 * trailingBytes;
+            for (j = 0; j < length; j++) {
+                *output++ = (uint8_t)delta;
+                delta >>= 8;
+            }
+        }
+        *tag |= nibble << (4 * (i & 1));
+    }
+
+    if ((size_t)(output - compressed) >= 1 + floatCount * sizeof(float)) {
+        compressed[0] = NIVolumeDataBrickFormatRaw;
+        memcpy(compressed + 1, brickFloats, floatCount * sizeof(float));
+        return 1 + floatCount * sizeof(float);
+    }
+    compressed[0] = NIVolumeDataBrickFormatPacked;
+    return output - compressed;
 }
 
-- (nullable instancetype)initWithCoder:(NSCoder *)decoder;
+// returns NO if the compressed brick is corrupt
+static BOOL NIVolumeDataDecompressBrick(const uint8_t *compressed, size_t length, float *brickFloats, NSUInteger floatCount)
 {
-    if ([decoder allowsKeyedCoding]) {
-        if ( (self = [super init]) ) {
-            _floatData = [[decoder decodeObjectOfClass:[NSData class] forKey:@"floatData"] retain];
-            _outOfBoundsValue = [decoder decodeFloatForKey:@"outOfBoundsValue"];
+    const uint8_t *input = compressed + 1;
+    const uint8_t *end = compressed + length;
+    uint32_t *bits = (uint32_t *)brickFloats;
+    uint32_t previous = 0;
+    uint8_t tag = 0;
+    NSUInteger i;
+    NSInteger j;
+
+    if (length < 1) {
+        return NO;
+    } else if (compressed[0] == NIVolumeDataBrickFormatRaw) {
+        if (length != 1 + floatCount * sizeof(float)) {
+            return NO;
+        }
+        memcpy(brickFloats, input, floatCount * sizeof(float));
+        return YES;
+    } else if (compressed[0] != NIVolumeDataBrickFormatPacked) {
+        return NO;
+    }
 
-            _pixelsWide = [decoder decodeIntegerForKey:@"pixelsWide"];
-            _pixelsHigh = [decoder decodeIntegerForKey:@"pixelsHigh"];
-            _pixelsDeep = [decoder decodeIntegerForKey:@"pixelsDeep"];
+    for (i = 0; i < floatCount; i++) {
+        uint8_t nibble;
+        uint32_t delta = 0;
 
-            if ([_floatData length] < (_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float))) {
-                [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: floatData (%lld bytes) is not large enough for the size parameters. (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld)",
-                 __PRETTY_FUNCTION__, (long long)[_floatData length], (long long)_pixelsWide, (long long)_pixelsHigh, (long long)_pixelsDeep];
+        if ((i & 1) == 0) {
+            if (input >= end) {
+                return NO;
             }
+            tag = *input++;
+        }
 
-            _modelToVoxelTransform = [decoder decodeNIAffineTransformForKey:@"modelToVoxelTransform"];
+        nibble = (tag >> (4 * (i & 1))) & 0xF;
+        if (nibble != NIVolumeDataPackedZeroNibble) {
+            NSInteger trailingBytes = nibble & 3;
+            NSInteger length = 4 - (nibble >> 2) - trailingBytes;
+            if (length < 1 || end - input < length) {
+                return NO;
+            }
+            for (j = 0; j < length; j++) {
+                delta |= (uint32_t)input[j] << (8 * j);
+            }
+            input += length;
+            delta <<= 8 * trailingBytes;
         }
-    } else {
-        [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: only supports keyed coders", __PRETTY_FUNCTION__];
+        previous ^= delta;
+        bits[i] = previous;
     }
-    return self;
-}
 
-
-- (instancetype)copyWithZone:(nullable NSZone *)zone
-{
-    return [[[self class] allocWithZone:zone] initWithVolumeData:self];
+    return input == end;
 }
 
-- (void)dealloc
+// compresses every brick in parallel, gatherBrick fills the brickSize^3 floats of a brick, returns NO if the memory could not be allocated
+static BOOL NIVolumeDataCompressBricks(NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger brickSize,
+                                       void (^gatherBrick)(NSUInteger brickX, NSUInteger brickY, NSUInteger brickZ, float *brickFloats),
+                                       NSData * _Nullable * _Nonnull compressedBrickData, NSData * _Nullable * _Nonnull brickOffsets)
 {
-    [_floatData release];
-    _floatData = nil;
-    [_convertVolumeVectorToModelVectorBlock release];
-    _convertVolumeVectorToModelVectorBlock = nil;
-    [_convertVolumeVectorFromModelVectorBlock release];
-    _convertVolumeVectorFromModelVectorBlock = nil;
+    const NSUInteger bricksWide = (pixelsWide + brickSize - 1) / brickSize;
+    const NSUInteger bricksHigh = (pixelsHigh + brickSize - 1) / brickSize;
+    const NSUInteger brickCount = bricksWide * bricksHigh * ((pixelsDeep + brickSize - 1) / brickSize);
+    const NSUInteger brickFloatCount = brickSize * brickSize * brickSize;
+    uint8_t **compressedBricks = calloc(brickCount, sizeof(uint8_t *));
+    size_t *compressedLengths = calloc(brickCount, sizeof(size_t));
+    __block BOOL failed = NO;
+    NSUInteger i;
+
+    if (compressedBricks == NULL || compressedLengths == NULL) {
+        free(compressedBricks);
+        free(compressedLengths);
+        return NO;
+    }
 
-    [super dealloc];
-}
+    dispatch_apply(brickCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t brickIndex) {
+        float *brickFloats = malloc(brickFloatCount * sizeof(float));
+        uint8_t *compressed = malloc(NIVolumeDataMaxCompressedBrickLength(brickFloatCount));
+        if (brickFloats == NULL || compressed == NULL) {
+            free(brickFloats);
+            free(compressed);
+            failed = YES;
+            return;
+        }
 
-- (void)encodeWithCoder:(NSCoder *)aCoder
-{
-    if ([aCoder allowsKeyedCoding]) {
-        if (_curved) {
-            [NSException raise:NSInvalidArchiveOperationException format:@"*** %s: can't archive curved volumes", __PRETTY_FUNCTION__];
+        gatherBrick(brickIndex % bricksWide, (brickIndex / bricksWide) % bricksHigh, brickIndex / (bricksWide * bricksHigh), brickFloats);
+        compressedLengths[brickIndex] = NIVolumeDataCompressBrick(brickFloats, brickFloatCount, compressed);
+        compressedBricks[brickIndex] = realloc(compressed, compressedLengths[brickIndex]) ?: compressed;
+        free(brickFloats);
+    });
+
+    NSMutableData *data = nil;
+    NSMutableData *offsets = nil;
+    if (failed == NO) {
+        size_t totalLength = 0;
+        for (i = 0; i < brickCount; i++) {
+            totalLength += compressedLengths[i];
+        }
+        data = [NSMutableData dataWithLength:totalLength];
+        offsets = [NSMutableData dataWithLength:(brickCount + 1) * sizeof(uint64_t)];
+        if (data && offsets) {
+            uint64_t *offsetValues = (uint64_t *)[offsets mutableBytes];
+            uint8_t *bytes = (uint8_t *)[data mutableBytes];
+            offsetValues[0] = 0;
+            for (i = 0; i < brickCount; i++) {
+                memcpy(bytes + offsetValues[i], compressedBricks[i], compressedLengths[i]);
+                offsetValues[i + 1] = offsetValues[i] + compressedLengths[i];
+            }
+        } else {
+            failed = YES;
         }
+    }
 
-        [aCoder encodeObject:_floatData forKey:@"floatData"];
-        [aCoder encodeFloat:_outOfBoundsValue forKey:@"outOfBoundsValue"];
+    for (i = 0; i < brickCount; i++) {
+        free(compressedBricks[i]);
+    }
+    free(compressedBricks);
+    free(compressedLengths);
 
-        [aCoder encodeInteger:_pixelsWide forKey:@"pixelsWide"];
-        [aCoder encodeInteger:_pixelsHigh forKey:@"pixelsHigh"];
-        [aCoder encodeInteger:_pixelsDeep forKey:@"pixelsDeep"];
+    *compressedBrickData = failed ? nil : data;
+    *brickOffsets = failed ? nil : offsets;
+    return failed == NO;
+}
 
+static BOOL NIVolumeDataCompressedBrickOffsetsAreValid(NSData *brickOffsets, NSData *compressedBrickData, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep, NSUInteger brickSize)
+{
+    const NSUInteger brickCount = ((pixelsWide + brickSize - 1) / brickSize) * ((pixelsHigh + brickSize - 1) / brickSize) * ((pixelsDeep + brickSize - 1) / brickSize);
+    const uint64_t *offsets = (const uint64_t *)[brickOffsets bytes];
+    NSUInteger i;
 
-        [aCoder encodeNIAffineTransform:_modelToVoxelTransform forKey:@"modelToVoxelTransform"];
-    } else {
-        [NSException raise:NSInvalidArchiveOperationException format:@"*** %s: only supports keyed coders", __PRETTY_FUNCTION__];
+    if ([brickOffsets length] != (brickCount + 1) * sizeof(uint64_t) || offsets[0] != 0 || offsets[brickCount] != [compressedBrickData length]) {
+        return NO;
     }
+    for (i = 0; i < brickCount; i++) {
+        if (offsets[i + 1] <= offsets[i]) {
+            return NO;
+        }
+    }
+    return YES;
 }
 
-- (BOOL)isRectilinear
+static size_t NIVolumeDataSampleSize(NIVolumeDataSampleType sampleType)
 {
-    return self.curved == NO && NIAffineTransformIsRectilinear(_modelToVoxelTransform);
+    switch (sampleType) {
+        case NIVolumeDataSampleTypeInt16:
+        case NIVolumeDataSampleTypeUInt16:
+            return 2;
+        case NIVolumeDataSampleTypeUInt8:
+            return 1;
+        default:
+            return sizeof(float);
+    }
 }
 
-- (CGFloat)minPixelSpacing
+// converts count samples to floats and applies the rescale
+static void NIVolumeDataConvertSamples(const void *samples, NIVolumeDataSampleType sampleType, float rescaleSlope, float rescaleIntercept, float *floats, NSUInteger count)
 {
-    return MIN(MIN(self.pixelSpacingX, self.pixelSpacingY), self.pixelSpacingZ);
+    switch (sampleType) {
+        case NIVolumeDataSampleTypeInt16:
+            vDSP_vflt16((const short *)samples, 1, floats, 1, count);
+            break;
+        case NIVolumeDataSampleTypeUInt16:
+            vDSP_vfltu16((const unsigned short *)samples, 1, floats, 1, count);
+            break;
+        case NIVolumeDataSampleTypeUInt8:
+            vDSP_vfltu8((const unsigned char *)samples, 1, floats, 1, count);
+            break;
+        default:
+            memcpy(floats, samples, count * sizeof(float));
+            break;
+    }
+    if (rescaleSlope != 1 || rescaleIntercept != 0) {
+        vDSP_vsmsa(floats, 1, &rescaleSlope, &rescaleIntercept, floats, 1, count);
+    }
 }
 
-- (CGFloat)pixelSpacingX
+static const char NIVolumeDataFileMagic[8] = {'N', 'I', 'V', 'O', 'L', 'U', 'M', 'E'};
+
+static NSError *NIVolumeDataPOSIXError(NSString *path)
 {
-    NIVector zero;
-    NIAffineTransform inverseTransform;
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{NSFilePathErrorKey: path}];
+}
 
-    if (self.rectilinear) {
-        return 1.0/_modelToVoxelTransform.m11;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
-        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(1.0, 0.0, 0.0), inverseTransform));
-    }
+static NSError *NIVolumeDataCorruptFileError(NSString *path, NSString *reason)
+{
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSFilePathErrorKey: path, NSLocalizedFailureReasonErrorKey: reason}];
 }
 
-- (CGFloat)pixelSpacingY
+// maps the whole file read only, the returned NSData covers the voxels and unmaps the file when it is deallocated
+static NSData * _Nullable NIVolumeDataMappedFloatData(NSString *path, NIVolumeDataFileHeader *header, NSError **error)
 {
-    NIVector zero;
-    NIAffineTransform inverseTransform;
+    struct stat fileStat;
+    void *mapping;
+    uint64_t floatLength;
+
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    if (fd == -1) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        return nil;
+    }
 
-    if (self.rectilinear) {
-        return 1.0/_modelToVoxelTransform.m22;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
-        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(0.0, 1.0, 0.0), inverseTransform));
+    if (fstat(fd, &fileStat) == -1) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        close(fd);
+        return nil;
+    }
+    if (fileStat.st_size < (off_t)sizeof(NIVolumeDataFileHeader)) {
+        if (error) *error = NIVolumeDataCorruptFileError(path, @"The file is too short to hold a volume header.");
+        close(fd);
+        return nil;
+    }
+    if (pread(fd, header, sizeof(NIVolumeDataFileHeader), 0) != sizeof(NIVolumeDataFileHeader)) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        close(fd);
+        return nil;
     }
-}
 
-- (CGFloat)pixelSpacingZ
-{
-    NIVector zero;
-    NIAffineTransform inverseTransform;
+    header->version = CFSwapInt32LittleToHost(header->version);
+    header->voxelOffset = CFSwapInt64LittleToHost(header->voxelOffset);
+    header->pixelsWide = CFSwapInt64LittleToHost(header->pixelsWide);
+    header->pixelsHigh = CFSwapInt64LittleToHost(header->pixelsHigh);
+    header->pixelsDeep = CFSwapInt64LittleToHost(header->pixelsDeep);
 
-    if (self.rectilinear) {
-        return 1.0/_modelToVoxelTransform.m33;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
-        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(0.0, 0.0, 1.0), inverseTransform));
+    if (memcmp(header->magic, NIVolumeDataFileMagic, sizeof(NIVolumeDataFileMagic)) != 0 || header->version != NIVolumeDataFileVersion) {
+        if (error) *error = NIVolumeDataCorruptFileError(path, @"The file is not a volume file, or was written by a newer version.");
+        close(fd);
+        return nil;
+    }
+    if (header->voxelOffset < sizeof(NIVolumeDataFileHeader) || header->voxelOffset % NIVolumeDataFileAlignment != 0) {
+        if (error) *error = NIVolumeDataCorruptFileError(path, @"The voxel offset in the file header is not aligned.");
+        close(fd);
+        return nil;
+    }
+    if (header->pixelsWide == 0 || header->pixelsHigh == 0 || header->pixelsDeep == 0 ||
+        header->pixelsDeep > (uint64_t)fileStat.st_size || __builtin_mul_overflow(header->pixelsWide, header->pixelsHigh, &floatLength) || __builtin_mul_overflow(floatLength, header->pixelsDeep * sizeof(float), &floatLength) ||
+        header->voxelOffset > (uint64_t)fileStat.st_size || floatLength > (uint64_t)fileStat.st_size - header->voxelOffset) {
+        if (error) *error = NIVolumeDataCorruptFileError(path, @"The file is too short for the volume size in its header.");
+        close(fd);
+        return nil;
     }
-}
 
-- (CGFloat)mmWide
-{
-    return self.pixelsWide * self.pixelSpacingX;
+    const size_t mappedLength = fileStat.st_size;
+    mapping = mmap(NULL, mappedLength, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (mapping == MAP_FAILED) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        return nil;
+    }
+
+    return [[[NSData alloc] initWithBytesNoCopy:(char *)mapping + header->voxelOffset length:floatLength deallocator:^(void *bytes, NSUInteger length) {
+        munmap(mapping, mappedLength);
+    }] autorelease];
 }
 
-- (CGFloat)mmHigh
+static BOOL NIVolumeDataWriteAll(int fd, const void *bytes, size_t length)
 {
-    return self.pixelsHigh * self.pixelSpacingY;
+    while (length) {
+        ssize_t written = write(fd, bytes, MIN(length, (size_t)1 << 30));
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const char *)bytes + written;
+        length -= written;
+    }
+    return YES;
 }
 
-- (CGFloat)mmDeep
+static const double NIVolumeDataCubicBSplinePole = -0.267949192431122706472553658494127633; // sqrt(3) - 2
+static const NSUInteger NIVolumeDataCubicBSplineHorizon = 30; // pole^30 is below double precision
+
+// in place causal then anticausal recursive filtering of a line of samples, with mirror boundaries
+// see M. Unser, "Splines: A Perfect Fit for Signal and Image Processing", IEEE Signal Processing Magazine, 1999
+static void NIVolumeDataCubicBSplinePrefilterLine(double *line, NSUInteger length)
 {
-    return self.pixelsDeep * self.pixelSpacingZ;
+    const double pole = NIVolumeDataCubicBSplinePole;
+    double poleToTheN;
+    double sum;
+    NSInteger n;
+
+    if (length < 2) {
+        return;
+    }
+
+    for (n = 0; n < length; n++) {
+        line[n] *= (1.0 - pole) * (1.0 - 1.0/pole);
+    }
+
+    poleToTheN = pole;
+    sum = line[0];
+    for (n = 1; n < MIN(length, NIVolumeDataCubicBSplineHorizon); n++) {
+        sum += poleToTheN * line[n];
+        poleToTheN *= pole;
+    }
+    line[0] = sum;
+    for (n = 1; n < length; n++) {
+        line[n] += pole * line[n - 1];
+    }
+
+    line[length - 1] = (pole / (pole * pole - 1.0)) * (pole * line[length - 2] + line[length - 1]);
+    for (n = length - 2; n >= 0; n--) {
+        line[n] = pole * (line[n + 1] - line[n]);
+    }
 }
 
-- (NIVector)origin
+// filters the flat floats along x, then y, then z. The lines along an axis are independent, so each plane of lines is filtered in parallel
+static BOOL NIVolumeDataCubicBSplinePrefilter(float *floats, NSUInteger pixelsWide, NSUInteger pixelsHigh, NSUInteger pixelsDeep)
 {
-    NIAffineTransform inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-    return NIVectorMake(inverseTransform.m41, inverseTransform.m42, inverseTransform.m43);
+    const NSUInteger lengths[3] = {pixelsWide, pixelsHigh, pixelsDeep};
+    const NSUInteger strides[3] = {1, pixelsWide, pixelsWide * pixelsHigh};
+    __block BOOL failed = NO;
+    NSUInteger axis;
+
+    for (axis = 0; axis < 3; axis++) {
+        const NSUInteger length = lengths[axis];
+        const NSUInteger stride = strides[axis];
+        // the planes are z slices for the x and y axes, and y rows for the z axis, each plane has pixelsWide lines, or pixelsHigh lines along x
+        const NSUInteger planeCount = axis == 2 ? pixelsHigh : pixelsDeep;
+        const NSUInteger linesPerPlane = axis == 0 ? pixelsHigh : pixelsWide;
+
+        if (length < 2) {
+            continue;
+        }
+
+        dispatch_apply(planeCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t plane) {
+            double *line = malloc(length * sizeof(double));
+            NSUInteger lineIndex;
+            float *lineStart;
+
+            if (line == NULL) {
+                failed = YES;
+                return;
+            }
+
+            for (lineIndex = 0; lineIndex < linesPerPlane; lineIndex++) {
+                switch (axis) {
+                    case 0:
+                        lineStart = floats + (pixelsWide * (lineIndex + pixelsHigh * plane));
+                        break;
+                    case 1:
+                        lineStart = floats + (lineIndex + pixelsWide * pixelsHigh * plane);
+                        break;
+                    default:
+                        lineStart = floats + (lineIndex + pixelsWide * plane);
+                        break;
+                }
+                vDSP_vspdp(lineStart, stride, line, 1, length);
+                NIVolumeDataCubicBSplinePrefilterLine(line, length);
+                vDSP_vdpsp(line, 1, lineStart, stride, length);
+            }
+            free(line);
+        });
+    }
+
+    return failed == NO;
 }
 
-- (NIVector)center
+
+// separable resampling of rectilinear volumes, each output voxel along an axis reads tapCount consecutive input voxels starting at its first index
+
+static NSUInteger NIVolumeDataResamplingTapCount(NIInterpolationMode interpolationMode) // returns 0 if the mode can't be resampled separably
 {
-    NIAffineTransform inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-    return NIVectorApplyTransform(NIVectorMake((CGFloat)_pixelsWide/2.0, (CGFloat)_pixelsHigh/2.0, (CGFloat)_pixelsDeep/2.0), inverseTransform);
+    switch (interpolationMode) {
+        case NIInterpolationModeNearestNeighbor:
+            return 1;
+        case NIInterpolationModeLinear:
+            return 2;
+        case NIInterpolationModeCubic:
+        case NIInterpolationModeCubicBSpline:
+            return 4;
+        default:
+            return 0;
+    }
 }
 
-- (NIVector)directionX
+// fills the first indexes and weights of the input voxels read by output voxels 0 to count-1, output voxel i is at the input coordinate scale*i + offset
+static void NIVolumeDataGetResamplingTaps(NIInterpolationMode interpolationMode, CGFloat scale, CGFloat offset, NSUInteger count, NSInteger *firstIndexes, float *weights)
 {
-    NIAffineTransform inverseTransform;
-
-    if (self.rectilinear) {
-        return NIVectorXBasis;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        return NIVectorNormalize(NIVectorMake(inverseTransform.m11, inverseTransform.m12, inverseTransform.m13));
+    const NSUInteger tapCount = NIVolumeDataResamplingTapCount(interpolationMode);
+    CGFloat cubicWeights[4];
+    NSUInteger i;
+    NSUInteger t;
+
+    for (i = 0; i < count; i++) {
+        const CGFloat coordinate = scale*(CGFloat)i + offset;
+        const CGFloat coordinateFloor = floor(coordinate);
+        const CGFloat fraction = coordinate - coordinateFloor;
+        float *tapWeights = weights + i*tapCount;
+
+        switch (interpolationMode) {
+            case NIInterpolationModeNearestNeighbor:
+                firstIndexes[i] = (NSInteger)round(coordinate);
+                tapWeights[0] = 1;
+                break;
+            case NIInterpolationModeLinear:
+                firstIndexes[i] = (NSInteger)coordinateFloor;
+                tapWeights[0] = 1.0 - fraction;
+                tapWeights[1] = fraction;
+                break;
+            case NIInterpolationModeCubic:
+                firstIndexes[i] = (NSInteger)coordinateFloor - 1;
+                NIVolumeDataGetCubicWeights(fraction, cubicWeights);
+                for (t = 0; t < 4; t++) {
+                    tapWeights[t] = cubicWeights[t];
+                }
+                break;
+            default: // NIInterpolationModeCubicBSpline, the taps read the B-spline coefficients
+                firstIndexes[i] = (NSInteger)coordinateFloor - 1;
+                tapWeights[0] = (1.0/6.0) * (1.0 - fraction)*(1.0 - fraction)*(1.0 - fraction);
+                tapWeights[1] = (1.0/6.0) * (4.0 - 6.0*fraction*fraction + 3.0*fraction*fraction*fraction);
+                tapWeights[2] = (1.0/6.0) * (1.0 + 3.0*fraction + 3.0*fraction*fraction - 3.0*fraction*fraction*fraction);
+                tapWeights[3] = (1.0/6.0) * fraction*fraction*fraction;
+                break;
+        }
     }
 }
 
-- (NIVector)directionY
+// finds the range of input voxels, out of inputCount, that the taps read, returns NO if they only read outside of the input
+static BOOL NIVolumeDataGetResamplingWindow(const NSInteger *firstIndexes, NSUInteger count, NSUInteger tapCount, NSUInteger inputCount, NSRange *window)
 {
-    NIAffineTransform inverseTransform;
+    NSInteger windowMin = NSIntegerMax;
+    NSInteger windowMax = NSIntegerMin;
+    NSUInteger i;
+
+    for (i = 0; i < count; i++) {
+        NSInteger first = MAX(firstIndexes[i], 0);
+        NSInteger last = MIN(firstIndexes[i] + (NSInteger)tapCount - 1, (NSInteger)inputCount - 1);
+        if (first <= last) {
+            windowMin = MIN(windowMin, first);
+            windowMax = MAX(windowMax, last);
+        }
+    }
 
-    if (self.rectilinear) {
-        return NIVectorYBasis;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        return NIVectorNormalize(NIVectorMake(inverseTransform.m21, inverseTransform.m22, inverseTransform.m23));
+    if (windowMin > windowMax) {
+        return NO;
     }
+    *window = NSMakeRange(windowMin, windowMax - windowMin + 1);
+    return YES;
 }
 
-- (NIVector)directionZ
+// resamples a run of inputCount floats into count floats, taps outside of the input read the outOfBoundsValue
+static void NIVolumeDataResampleRun(const float *input, NSUInteger inputCount, float *output, NSUInteger count, const NSInteger *firstIndexes, const float *weights, NSUInteger tapCount, float outOfBoundsValue)
 {
-    NIAffineTransform inverseTransform;
+    NSUInteger i;
+    NSUInteger t;
+
+    for (i = 0; i < count; i++) {
+        float value = 0;
+        for (t = 0; t < tapCount; t++) {
+            const NSInteger index = firstIndexes[i] + (NSInteger)t;
+            value += weights[i*tapCount + t] * (index >= 0 && index < (NSInteger)inputCount ? input[index] : outOfBoundsValue);
+        }
+        output[i] = value;
+    }
+}
 
-    if (self.rectilinear) {
-        return NIVectorZBasis;
-    } else {
-        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
-        return NIVectorNormalize(NIVectorMake(inverseTransform.m31, inverseTransform.m32, inverseTransform.m33));
+// computes output plane i out of inputCount contiguous input planes of planeLength floats, taps outside of the input read the outOfBoundsValue
+static void NIVolumeDataResamplePlane(const float *input, NSUInteger inputCount, NSUInteger planeLength, float *output, NSUInteger i, const NSInteger *firstIndexes, const float *weights, NSUInteger tapCount, float outOfBoundsValue)
+{
+    float outOfBoundsWeight = 0;
+    NSUInteger t;
+
+    vDSP_vclr(output, 1, planeLength);
+    for (t = 0; t < tapCount; t++) {
+        const NSInteger index = firstIndexes[i] + (NSInteger)t;
+        float weight = weights[i*tapCount + t];
+        if (index >= 0 && index < (NSInteger)inputCount) {
+            vDSP_vsma(input + index*planeLength, 1, &weight, output, 1, output, 1, planeLength);
+        } else {
+            outOfBoundsWeight += weight;
+        }
+    }
+    if (outOfBoundsWeight != 0) {
+        float outOfBoundsSum = outOfBoundsWeight * outOfBoundsValue;
+        vDSP_vsadd(output, 1, &outOfBoundsSum, output, 1, planeLength);
     }
 }
 
-- (float *)floatBytes
+
+@implementation NIVolumeData
+
+@synthesize outOfBoundsValue = _outOfBoundsValue;
+@synthesize pixelsWide = _pixelsWide;
+@synthesize pixelsHigh = _pixelsHigh;
+@synthesize pixelsDeep = _pixelsDeep;
+@synthesize modelToVoxelTransform = _modelToVoxelTransform;
+@synthesize brickSize = _brickSize;
+@synthesize borderWidth = _borderWidth;
+@synthesize mappedFilePath = _mappedFilePath;
+@synthesize sampleType = _sampleType;
+@synthesize compressedBrickSize = _compressedBrickSize;
+@synthesize curved = _curved;
+
++ (NIAffineTransform)modelToVoxelTransformForOrigin:(NIVector)origin directionX:(NIVector)directionX pixelSpacingX:(CGFloat)pixelSpacingX directionY:(NIVector)directionY pixelSpacingY:(CGFloat)pixelSpacingY
+                                     directionZ:(NIVector)directionZ pixelSpacingZ:(CGFloat)pixelSpacingZ
+{
+    directionX = NIVectorNormalize(directionX);
+    directionY = NIVectorNormalize(directionY);
+    directionZ = NIVectorNormalize(directionZ);
+
+    NIAffineTransform transform = NIAffineTransformIdentity;
+    transform.m11 = directionX.x * pixelSpacingX;
+    transform.m12 = directionX.y * pixelSpacingX;
+    transform.m13 = directionX.z * pixelSpacingX;
+    transform.m21 = directionY.x * pixelSpacingY;
+    transform.m22 = directionY.y * pixelSpacingY;
+    transform.m23 = directionY.z * pixelSpacingY;
+    transform.m31 = directionZ.x * pixelSpacingZ;
+    transform.m32 = directionZ.y * pixelSpacingZ;
+    transform.m33 = directionZ.z * pixelSpacingZ;
+    transform.m41 = origin.x;
+    transform.m42 = origin.y;
+    transform.m43 = origin.z;
+
+    return NIAffineTransformInvert(transform);
+}
+
+- (instancetype)initWithBytesNoCopy:(const float *)floatBytes pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                    modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue freeWhenDone:(BOOL)freeWhenDone // modelToVoxelTransform is the transform from Model (patient) space to pixel data
 {
-    return (float *)[_floatData bytes];
+    return [self initWithData:[NSData dataWithBytesNoCopy:(void *)floatBytes length:sizeof(float) * pixelsWide * pixelsHigh * pixelsDeep freeWhenDone:freeWhenDone]
+                   pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue];
 }
 
-// will copy fill length*sizeof(float) bytes
-- (NSUInteger)getFloatRun:(float *)buffer atPixelCoordinateX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z length:(NSUInteger)length
+- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue // modelToVoxelTransform is the transform from Model (patient) space to pixel data
 {
-    NSUInteger copyLength = length;
-    if (x >= _pixelsWide || y >= _pixelsHigh || z >= _pixelsDeep) {
-        return 0;
+    if ([data length] < sizeof(float)*pixelsWide*pixelsHigh*pixelsDeep) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld", __PRETTY_FUNCTION__, (long long)[data length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep] userInfo:nil];
     }
-    copyLength = MIN(length, _pixelsWide - x);
-    memcpy(buffer, &(self.floatBytes[x + _pixelsWide*(y + z*_pixelsHigh)]), copyLength * sizeof(float));
-    return copyLength;
+
+    if ( (self = [super init]) ) {
+        _floatData = [data retain];
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
+    }
+    return self;
 }
 
-- (nullable NIVector (^)(NIVector))convertVolumeVectorToModelVectorBlock
+- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+       modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue brickSize:(NSUInteger)brickSize
 {
-    if (_curved == NO) {
-        NIAffineTransform voxelToModelTransform = NIAffineTransformInvert([self modelToVoxelTransform]);
+    if (brickSize <= 1) {
+        return [self initWithData:data pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue];
+    }
 
-        return [[^NIVector(NIVector vector) {
-            return NIVectorApplyTransform(vector, voxelToModelTransform);
-        } copy] autorelease];
-    } else {
-        return _convertVolumeVectorToModelVectorBlock;
+    if (NIVolumeDataBrickShift(brickSize) == NSNotFound) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: brickSize (%lld) is not a power of 2", __PRETTY_FUNCTION__, (long long)brickSize] userInfo:nil];
+    }
+    if ([data length] < sizeof(float)*pixelsWide*pixelsHigh*pixelsDeep) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld", __PRETTY_FUNCTION__, (long long)[data length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep] userInfo:nil];
+    }
+
+    NSData *brickedData = NIVolumeDataBrickedData(data, pixelsWide, pixelsHigh, pixelsDeep, brickSize, outOfBoundsValue);
+    if (brickedData == nil) {
+        [self release];
+        return nil;
     }
+
+    return [self initWithBrickedData:brickedData brickSize:brickSize
+                          pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue];
 }
 
-- (nullable NIVector (^)(NIVector))convertVolumeVectorFromModelVectorBlock
+- (instancetype)initWithBrickedData:(NSData *)brickedData brickSize:(NSUInteger)brickSize pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+              modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue
 {
-    if (_curved == NO) {
-        NIAffineTransform modelToVoxelTransform = [self modelToVoxelTransform];
+    if ([brickedData length] < sizeof(float)*NIVolumeDataBrickedFloatCount(pixelsWide, pixelsHigh, pixelsDeep, brickSize)) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld in bricks of %lld", __PRETTY_FUNCTION__, (long long)[brickedData length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep, (long long)brickSize] userInfo:nil];
+    }
 
-        return [[^NIVector(NIVector vector) {
-            return NIVectorApplyTransform(vector, modelToVoxelTransform);
-        } copy] autorelease];
-    } else {
-        return _convertVolumeVectorFromModelVectorBlock;
+    if ( (self = [super init]) ) {
+        _brickedFloatData = [brickedData retain];
+        _brickSize = brickSize;
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
     }
+    return self;
 }
 
-- (NIVector)convertVolumeVectorToModelVector:(NIVector)vector
+- (instancetype)initWithPaddedData:(NSData *)paddedData borderWidth:(NSUInteger)borderWidth pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue
 {
-    if (_curved) {
-        return _convertVolumeVectorToModelVectorBlock(vector);
+    if ([paddedData length] < sizeof(float)*NIVolumeDataPaddedFloatCount(pixelsWide, pixelsHigh, pixelsDeep, borderWidth)) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld with a border of %lld", __PRETTY_FUNCTION__, (long long)[paddedData length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep, (long long)borderWidth] userInfo:nil];
     }
-    else {
-        return NIVectorApplyTransform(vector, NIAffineTransformInvert([self modelToVoxelTransform]));
+
+    if ( (self = [super init]) ) {
+        _paddedFloatData = [paddedData retain];
+        _borderWidth = borderWidth;
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
     }
+    return self;
 }
 
-- (NIVector)convertVolumeVectorFromModelVector:(NIVector)vector
+- (instancetype)initWithCompressedBrickData:(NSData *)compressedBrickData brickOffsets:(NSData *)brickOffsets brickSize:(NSUInteger)brickSize
+                                  pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                       modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue
 {
-    if (_curved) {
-        return _convertVolumeVectorFromModelVectorBlock(vector);
+    if (NIVolumeDataCompressedBrickOffsetsAreValid(brickOffsets, compressedBrickData, pixelsWide, pixelsHigh, pixelsDeep, brickSize) == NO) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: the brick offsets don't match the compressed data (length:%lld) for a volume of size %lldx%lldx%lld in bricks of %lld", __PRETTY_FUNCTION__, (long long)[compressedBrickData length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep, (long long)brickSize] userInfo:nil];
     }
-    else {
-        return NIVectorApplyTransform(vector, [self modelToVoxelTransform]);
+
+    if ( (self = [super init]) ) {
+        _compressedBrickData = [compressedBrickData retain];
+        _compressedBrickOffsets = [brickOffsets retain];
+        _compressedBrickSize = brickSize;
+        _brickCacheLimit = NIVolumeDataDefaultBrickCacheLimit;
+        _brickCache = [[NSMutableDictionary alloc] init];
+        _brickCacheOrder = [[NSMutableOrderedSet alloc] init];
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
     }
+    return self;
 }
 
-- (vImage_Buffer)floatBufferForSliceAtIndex:(NSUInteger)z {
-    vImage_Buffer floatBuffer;
-    floatBuffer.data = (void *)self.floatBytes + (_pixelsWide * _pixelsHigh * sizeof(float) * z);
-    floatBuffer.height = _pixelsHigh;
-    floatBuffer.width = _pixelsWide;
-    floatBuffer.rowBytes = sizeof(float) * _pixelsWide;
-    return floatBuffer;
+- (instancetype)initWithViewedData:(NSData *)viewedData offset:(NSInteger)offset rowStride:(NSInteger)rowStride sliceStride:(NSInteger)sliceStride
+                        pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue
+{
+    // the farthest voxels of the view in either direction are at its corners
+    NSInteger lastX = (NSInteger)pixelsWide - 1;
+    NSInteger lastYOffset = rowStride * ((NSInteger)pixelsHigh - 1);
+    NSInteger lastZOffset = sliceStride * ((NSInteger)pixelsDeep - 1);
+    NSInteger minIndex = offset + MIN(lastYOffset, 0) + MIN(lastZOffset, 0);
+    NSInteger maxIndex = offset + lastX + MAX(lastYOffset, 0) + MAX(lastZOffset, 0);
+    if (pixelsWide == 0 || pixelsHigh == 0 || pixelsDeep == 0 || minIndex < 0 || maxIndex >= (NSInteger)([viewedData length] / sizeof(float))) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: a view of size %lldx%lldx%lld at offset %lld with strides %lld and %lld does not fit in the data (length:%lld)", __PRETTY_FUNCTION__, (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep, (long long)offset, (long long)rowStride, (long long)sliceStride, (long long)[viewedData length]] userInfo:nil];
+    }
+
+    if ( (self = [super init]) ) {
+        _viewedFloatData = [viewedData retain];
+        _viewOffset = offset;
+        _viewRowStride = rowStride;
+        _viewSliceStride = sliceStride;
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
+    }
+    return self;
 }
 
-- (NIVolumeData *)volumeDataForSliceAtIndex:(NSUInteger)z
+- (instancetype)initWithSampleData:(NSData *)sampleData sampleType:(NIVolumeDataSampleType)sampleType rescaleSlope:(float)rescaleSlope rescaleIntercept:(float)rescaleIntercept
+                        pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+             modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform outOfBoundsValue:(float)outOfBoundsValue
 {
-    if (z >= _pixelsDeep) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: z index outside of the volume", __PRETTY_FUNCTION__] userInfo:nil];
+    if (sampleType < NIVolumeDataSampleTypeFloat32 || sampleType > NIVolumeDataSampleTypeUInt8) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: unknown sampleType (%lld)", __PRETTY_FUNCTION__, (long long)sampleType] userInfo:nil];
+    }
+    if ([sampleData length] < NIVolumeDataSampleSize(sampleType)*pixelsWide*pixelsHigh*pixelsDeep) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: data is not big enough (length:%lld) to hold a volume of size %lldx%lldx%lld", __PRETTY_FUNCTION__, (long long)[sampleData length], (long long)pixelsWide, (long long)pixelsHigh, (long long)pixelsDeep] userInfo:nil];
     }
 
-    NIVolumeData *sliceVolume;
+    if (sampleType == NIVolumeDataSampleTypeFloat32) { // floats are stored as floatData, rescaled if they need to be
+        NSData *floatData = sampleData;
+        if (rescaleSlope != 1 || rescaleIntercept != 0) {
+            NSMutableData *rescaledData = [NSMutableData dataWithLength:sizeof(float)*pixelsWide*pixelsHigh*pixelsDeep];
+            NIVolumeDataConvertSamples([sampleData bytes], sampleType, rescaleSlope, rescaleIntercept, (float *)[rescaledData mutableBytes], pixelsWide*pixelsHigh*pixelsDeep);
+            floatData = rescaledData;
+        }
+        return [self initWithData:floatData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue];
+    }
 
-    NSData *sliceData = [NSData dataWithBytes:self.floatBytes + (_pixelsWide*_pixelsHigh*z) length:_pixelsWide * _pixelsHigh * sizeof(float)];
+    if ( (self = [super init]) ) {
+        _sampleData = [sampleData retain];
+        _sampleType = sampleType;
+        _rescaleSlope = rescaleSlope;
+        _rescaleIntercept = rescaleIntercept;
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = modelToVoxelTransform;
+    }
+    return self;
+}
 
-    if (self.curved) {
-        NIVector (^volumeVectorToModelVectorBlock)(NIVector) = ^(NIVector volumeVector){
-            NIVector translatedVolumeVector = NIVectorSubtract(volumeVector, NIVectorMake(0, 0, z));
-            return _convertVolumeVectorToModelVectorBlock(translatedVolumeVector);
-        };
-        NIVector (^volumeVectorFromModelVectorBlock)(NIVector) = ^(NIVector modelVector){
-            NIVector volumeVector = _convertVolumeVectorFromModelVectorBlock(modelVector);
-            return NIVectorAdd(volumeVector, NIVectorMake(0, 0, z));
-        };
+- (instancetype)initWithData:(NSData *)data pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+      volumeToModelConverter:(NIVector (^)(NIVector volumeVector))volumeToModelConverter modelToVolumeConverter:(NIVector (^)(NIVector modelVector))modelToVolumeConverter
+            outOfBoundsValue:(float)outOfBoundsValue
+{
+    if ( (self = [super init]) ) {
+        _floatData = [data retain];
+        _outOfBoundsValue = outOfBoundsValue;
+        _pixelsWide = pixelsWide;
+        _pixelsHigh = pixelsHigh;
+        _pixelsDeep = pixelsDeep;
+        _modelToVoxelTransform = NIAffineTransformIdentity;
+        _curved = YES;
+        _convertVolumeVectorToModelVectorBlock = [volumeToModelConverter copy];
+        _convertVolumeVectorFromModelVectorBlock = [modelToVolumeConverter copy];
+    }
+    return self;
+}
 
-        sliceVolume = [[[self class] alloc] initWithData:sliceData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:1
-                                  volumeToModelConverter:volumeVectorToModelVectorBlock modelToVolumeConverter:volumeVectorFromModelVectorBlock outOfBoundsValue:_outOfBoundsValue];
+- (instancetype)initWithVolumeData:(NIVolumeData *)volumeData
+{
+    if (volumeData.curved) {
+        return [self initWithData:volumeData.floatData pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep
+           volumeToModelConverter:volumeData.convertVolumeVectorToModelVectorBlock modelToVolumeConverter:volumeData.convertVolumeVectorFromModelVectorBlock outOfBoundsValue:volumeData.outOfBoundsValue];
+    } else if (volumeData.brickSize) {
+        return [self initWithBrickedData:volumeData->_brickedFloatData brickSize:volumeData.brickSize pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep
+                   modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue];
+    } else if (volumeData.borderWidth) {
+        return [self initWithPaddedData:volumeData->_paddedFloatData borderWidth:volumeData.borderWidth pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep
+                  modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue];
+    } else if (volumeData.compressedBrickSize) { // the copy shares the compressed bricks, but starts with an empty brick cache
+        if ( (self = [self initWithCompressedBrickData:volumeData->_compressedBrickData brickOffsets:volumeData->_compressedBrickOffsets brickSize:volumeData.compressedBrickSize
+                                            pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue]) ) {
+            _brickCacheLimit = volumeData.brickCacheLimit;
+        }
+        return self;
+    } else if (volumeData->_viewedFloatData) { // the copy is a view of the same floats
+        return [self initWithViewedData:volumeData->_viewedFloatData offset:volumeData->_viewOffset rowStride:volumeData->_viewRowStride sliceStride:volumeData->_viewSliceStride
+                             pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue];
+    } else if (volumeData.sampleType != NIVolumeDataSampleTypeFloat32) {
+        return [self initWithSampleData:volumeData->_sampleData sampleType:volumeData.sampleType rescaleSlope:volumeData.rescaleSlope rescaleIntercept:volumeData.rescaleIntercept
+                             pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue];
     } else {
-        NIAffineTransform sliceTransform = NIAffineTransformConcat(_modelToVoxelTransform, NIAffineTransformMakeTranslation(0, 0, -z));
-        sliceVolume = [[[self class] alloc] initWithData:sliceData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:1 modelToVoxelTransform:sliceTransform outOfBoundsValue:_outOfBoundsValue];
+        if ( (self = [self initWithData:volumeData.floatData pixelsWide:volumeData.pixelsWide pixelsHigh:volumeData.pixelsHigh pixelsDeep:volumeData.pixelsDeep modelToVoxelTransform:volumeData.modelToVoxelTransform outOfBoundsValue:volumeData.outOfBoundsValue]) ) {
+            _mappedFilePath = [volumeData.mappedFilePath copy];
+            _floatDataIsMapped = volumeData->_floatDataIsMapped;
+        }
+        return self;
     }
+}
 
-    return [sliceVolume autorelease];
+- (nullable instancetype)initWithContentsOfMappedFile:(NSString *)path error:(NSError **)error
+{
+    NIVolumeDataFileHeader header;
+    NIAffineTransform modelToVoxelTransform;
+    CGFloat *transformValues = (CGFloat *)&modelToVoxelTransform; // NIAffineTransform is a CATransform3D, 16 CGFloats in row order
+    NSInteger i;
+
+    NSData *floatData = NIVolumeDataMappedFloatData(path, &header, error);
+    if (floatData == nil) {
+        [self release];
+        return nil;
+    }
+
+    // the doubles and the float are stored as little endian bit patterns, like the integer fields
+    for (i = 0; i < 16; i++) {
+        uint64_t transformBits;
+        double transformValue;
+        memcpy(&transformBits, &header.modelToVoxelTransform[i], sizeof(transformBits));
+        transformBits = CFSwapInt64LittleToHost(transformBits);
+        memcpy(&transformValue, &transformBits, sizeof(transformValue));
+        transformValues[i] = transformValue;
+    }
+    uint32_t outOfBoundsBits;
+    float outOfBoundsValue;
+    memcpy(&outOfBoundsBits, &header.outOfBoundsValue, sizeof(outOfBoundsBits));
+    outOfBoundsBits = CFSwapInt32LittleToHost(outOfBoundsBits);
+    memcpy(&outOfBoundsValue, &outOfBoundsBits, sizeof(outOfBoundsValue));
+
+    if ( (self = [self initWithData:floatData pixelsWide:(NSUInteger)header.pixelsWide pixelsHigh:(NSUInteger)header.pixelsHigh pixelsDeep:(NSUInteger)header.pixelsDeep
+              modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:outOfBoundsValue]) ) {
+        _mappedFilePath = [path copy];
+        _floatDataIsMapped = YES;
+    }
+    return self;
 }
 
-- (NIVolumeData *)volumeDataWithIndexRangesX:(NSRange)xr y:(NSRange)yr z:(NSRange)zr {
-    if (NSMaxRange(xr) > _pixelsWide ||  NSMaxRange(yr) > _pixelsHigh ||  NSMaxRange(zr) > _pixelsDeep) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: index range outside of the volume", __PRETTY_FUNCTION__] userInfo:nil];
++ (BOOL)supportsSecureCoding
+{
+    return YES;
+}
+
+- (nullable id)replacementObjectForPortCoder:(NSPortCoder *)encoder
+{
+    if ([encoder isBycopy]) return self;
+    return [super replacementObjectForPortCoder:encoder];
+}
+
+- (nullable instancetype)initWithCoder:(NSCoder *)decoder;
+{
+    NIVolumeDataFileHeader mappedFileHeader;
+
+    if ([decoder allowsKeyedCoding]) {
+        if ( (self = [super init]) ) {
+            NSString *mappedFilePath = [decoder decodeObjectOfClass:[NSString class] forKey:@"mappedFilePath"];
+            if (mappedFilePath) {
+                NSError *error = nil;
+                _floatData = [NIVolumeDataMappedFloatData(mappedFilePath, &mappedFileHeader, &error) retain];
+                if (_floatData == nil) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: could not map the volume file: %@", __PRETTY_FUNCTION__, error];
+                }
+                _mappedFilePath = [mappedFilePath copy];
+                _floatDataIsMapped = YES;
+            } else if ([decoder containsValueForKey:@"compressedBrickData"]) {
+                _compressedBrickData = [[decoder decodeObjectOfClass:[NSData class] forKey:@"compressedBrickData"] retain];
+                _compressedBrickOffsets = [[decoder decodeObjectOfClass:[NSData class] forKey:@"compressedBrickOffsets"] retain];
+                _compressedBrickSize = [decoder decodeIntegerForKey:@"compressedBrickSize"];
+                if (_compressedBrickSize <= 1 || NIVolumeDataBrickShift(_compressedBrickSize) == NSNotFound) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: compressedBrickSize (%lld) is not a power of 2", __PRETTY_FUNCTION__, (long long)_compressedBrickSize];
+                }
+                _brickCacheLimit = NIVolumeDataDefaultBrickCacheLimit;
+                _brickCache = [[NSMutableDictionary alloc] init];
+                _brickCacheOrder = [[NSMutableOrderedSet alloc] init];
+            } else if ([decoder containsValueForKey:@"sampleData"]) {
+                _sampleData = [[decoder decodeObjectOfClass:[NSData class] forKey:@"sampleData"] retain];
+                _sampleType = [decoder decodeIntegerForKey:@"sampleType"];
+                _rescaleSlope = [decoder decodeFloatForKey:@"rescaleSlope"];
+                _rescaleIntercept = [decoder decodeFloatForKey:@"rescaleIntercept"];
+                if (_sampleType <= NIVolumeDataSampleTypeFloat32 || _sampleType > NIVolumeDataSampleTypeUInt8) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: unknown sampleType (%lld)", __PRETTY_FUNCTION__, (long long)_sampleType];
+                }
+            } else {
+                _floatData = [[decoder decodeObjectOfClass:[NSData class] forKey:@"floatData"] retain];
+            }
+            _outOfBoundsValue = [decoder decodeFloatForKey:@"outOfBoundsValue"];
+
+            _pixelsWide = [decoder decodeIntegerForKey:@"pixelsWide"];
+            _pixelsHigh = [decoder decodeIntegerForKey:@"pixelsHigh"];
+            _pixelsDeep = [decoder decodeIntegerForKey:@"pixelsDeep"];
+
+            if (_compressedBrickSize) {
+                if (NIVolumeDataCompressedBrickOffsetsAreValid(_compressedBrickOffsets, _compressedBrickData, _pixelsWide, _pixelsHigh, _pixelsDeep, _compressedBrickSize) == NO) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: the brick offsets don't match the compressed data (%lld bytes). (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld)",
+                     __PRETTY_FUNCTION__, (long long)[_compressedBrickData length], (long long)_pixelsWide, (long long)_pixelsHigh, (long long)_pixelsDeep];
+                }
+            } else if (_sampleData) {
+                if ([_sampleData length] < (_pixelsWide * _pixelsHigh * _pixelsDeep * NIVolumeDataSampleSize(_sampleType))) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: sampleData (%lld bytes) is not large enough for the size parameters. (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld)",
+                     __PRETTY_FUNCTION__, (long long)[_sampleData length], (long long)_pixelsWide, (long long)_pixelsHigh, (long long)_pixelsDeep];
+                }
+            } else if (_floatDataIsMapped) {
+                // the file may have been replaced since the volume was encoded
+                if (mappedFileHeader.pixelsWide != _pixelsWide || mappedFileHeader.pixelsHigh != _pixelsHigh || mappedFileHeader.pixelsDeep != _pixelsDeep) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: the volume file %@ (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld) doesn't match the size parameters. (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld)",
+                     __PRETTY_FUNCTION__, _mappedFilePath, (long long)mappedFileHeader.pixelsWide, (long long)mappedFileHeader.pixelsHigh, (long long)mappedFileHeader.pixelsDeep,
+                     (long long)_pixelsWide, (long long)_pixelsHigh, (long long)_pixelsDeep];
+                }
+            } else if ([_floatData length] < (_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float))) {
+                [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: floatData (%lld bytes) is not large enough for the size parameters. (pixelsWide: %lld, pixelsHigh: %lld, pixelsDeep: %lld)",
+                 __PRETTY_FUNCTION__, (long long)[_floatData length], (long long)_pixelsWide, (long long)_pixelsHigh, (long long)_pixelsDeep];
+            }
+
+            _modelToVoxelTransform = [decoder decodeNIAffineTransformForKey:@"modelToVoxelTransform"];
+
+            NSUInteger brickSize = [decoder decodeIntegerForKey:@"brickSize"];
+            if (brickSize > 1) {
+                if (NIVolumeDataBrickShift(brickSize) == NSNotFound) {
+                    [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: brickSize (%lld) is not a power of 2", __PRETTY_FUNCTION__, (long long)brickSize];
+                }
+                _brickedFloatData = [NIVolumeDataBrickedData(_floatData, _pixelsWide, _pixelsHigh, _pixelsDeep, brickSize, _outOfBoundsValue) retain];
+                if (_brickedFloatData == nil) {
+                    [NSException raise:NSMallocException format:@"*** %s: could not allocate the bricked floats", __PRETTY_FUNCTION__];
+                }
+                _brickSize = brickSize;
+                [_floatData release];
+                _floatData = nil;
+            }
+
+            NSUInteger borderWidth = [decoder decodeIntegerForKey:@"borderWidth"];
+            if (borderWidth && _brickSize == 0) {
+                _paddedFloatData = [NIVolumeDataPaddedData(_floatData, _pixelsWide, _pixelsHigh, _pixelsDeep, borderWidth, _outOfBoundsValue) retain];
+                if (_paddedFloatData == nil) {
+                    [NSException raise:NSMallocException format:@"*** %s: could not allocate the padded floats", __PRETTY_FUNCTION__];
+                }
+                _borderWidth = borderWidth;
+                [_floatData release];
+                _floatData = nil;
+            }
+        }
+    } else {
+        [NSException raise:NSInvalidUnarchiveOperationException format:@"*** %s: only supports keyed coders", __PRETTY_FUNCTION__];
     }
+    return self;
+}
 
-    NIVolumeData *data = nil;
-    NIVector origin = NIVectorMake(xr.location, yr.location, zr.location);
-    if (self.curved) {
+
+- (instancetype)copyWithZone:(nullable NSZone *)zone
+{
+    NIVolumeData *copy = [[[self class] allocWithZone:zone] initWithVolumeData:self];
+    [copy _copyIntensityStatisticsFromVolumeData:self];
+    return copy;
+}
+
+- (void)dealloc
+{
+    [_floatData release];
+    _floatData = nil;
+    [_brickedFloatData release];
+    _brickedFloatData = nil;
+    [_paddedFloatData release];
+    _paddedFloatData = nil;
+    [_viewedFloatData release];
+    _viewedFloatData = nil;
+    [_cubicBSplineCoefficients release];
+    _cubicBSplineCoefficients = nil;
+    [_mipLevels release];
+    _mipLevels = nil;
+    [_intensityHistograms release];
+    _intensityHistograms = nil;
+    [_minMaxGridData release];
+    _minMaxGridData = nil;
+    [_mappedFilePath release];
+    _mappedFilePath = nil;
+    [_sampleData release];
+    _sampleData = nil;
+    [_compressedBrickData release];
+    _compressedBrickData = nil;
+    [_compressedBrickOffsets release];
+    _compressedBrickOffsets = nil;
+    [_brickCache release];
+    _brickCache = nil;
+    [_brickCacheOrder release];
+    _brickCacheOrder = nil;
+    [_convertVolumeVectorToModelVectorBlock release];
+    _convertVolumeVectorToModelVectorBlock = nil;
+    [_convertVolumeVectorFromModelVectorBlock release];
+    _convertVolumeVectorFromModelVectorBlock = nil;
+
+    [super dealloc];
+}
+
+- (void)encodeWithCoder:(NSCoder *)aCoder
+{
+    if ([aCoder allowsKeyedCoding]) {
+        if (_curved) {
+            [NSException raise:NSInvalidArchiveOperationException format:@"*** %s: can't archive curved volumes", __PRETTY_FUNCTION__];
+        }
+
+        if (_mappedFilePath) { // the file is shared instead of copying its floats into the archive
+            [aCoder encodeObject:_mappedFilePath forKey:@"mappedFilePath"];
+        } else if (_compressedBrickSize) {
+            [aCoder encodeObject:_compressedBrickData forKey:@"compressedBrickData"];
+            [aCoder encodeObject:_compressedBrickOffsets forKey:@"compressedBrickOffsets"];
+            [aCoder encodeInteger:_compressedBrickSize forKey:@"compressedBrickSize"];
+        } else if (_sampleData) {
+            [aCoder encodeObject:_sampleData forKey:@"sampleData"];
+            [aCoder encodeInteger:_sampleType forKey:@"sampleType"];
+            [aCoder encodeFloat:_rescaleSlope forKey:@"rescaleSlope"];
+            [aCoder encodeFloat:_rescaleIntercept forKey:@"rescaleIntercept"];
+        } else {
+            [aCoder encodeObject:self.floatData forKey:@"floatData"];
+        }
+        [aCoder encodeFloat:_outOfBoundsValue forKey:@"outOfBoundsValue"];
+        if (_brickSize) {
+            [aCoder encodeInteger:_brickSize forKey:@"brickSize"];
+        }
+        if (_borderWidth) {
+            [aCoder encodeInteger:_borderWidth forKey:@"borderWidth"];
+        }
+
+        [aCoder encodeInteger:_pixelsWide forKey:@"pixelsWide"];
+        [aCoder encodeInteger:_pixelsHigh forKey:@"pixelsHigh"];
+        [aCoder encodeInteger:_pixelsDeep forKey:@"pixelsDeep"];
+
+
+        [aCoder encodeNIAffineTransform:_modelToVoxelTransform forKey:@"modelToVoxelTransform"];
+    } else {
+        [NSException raise:NSInvalidArchiveOperationException format:@"*** %s: only supports keyed coders", __PRETTY_FUNCTION__];
+    }
+}
+
+- (BOOL)isRectilinear
+{
+    return self.curved == NO && NIAffineTransformIsRectilinear(_modelToVoxelTransform);
+}
+
+- (CGFloat)minPixelSpacing
+{
+    return MIN(MIN(self.pixelSpacingX, self.pixelSpacingY), self.pixelSpacingZ);
+}
+
+- (CGFloat)pixelSpacingX
+{
+    NIVector zero;
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return 1.0/_modelToVoxelTransform.m11;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
+        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(1.0, 0.0, 0.0), inverseTransform));
+    }
+}
+
+- (CGFloat)pixelSpacingY
+{
+    NIVector zero;
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return 1.0/_modelToVoxelTransform.m22;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
+        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(0.0, 1.0, 0.0), inverseTransform));
+    }
+}
+
+- (CGFloat)pixelSpacingZ
+{
+    NIVector zero;
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return 1.0/_modelToVoxelTransform.m33;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        zero = NIVectorApplyTransform(NIVectorZero, inverseTransform);
+        return NIVectorDistance(zero, NIVectorApplyTransform(NIVectorMake(0.0, 0.0, 1.0), inverseTransform));
+    }
+}
+
+- (CGFloat)mmWide
+{
+    return self.pixelsWide * self.pixelSpacingX;
+}
+
+- (CGFloat)mmHigh
+{
+    return self.pixelsHigh * self.pixelSpacingY;
+}
+
+- (CGFloat)mmDeep
+{
+    return self.pixelsDeep * self.pixelSpacingZ;
+}
+
+- (NIVector)origin
+{
+    NIAffineTransform inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+    return NIVectorMake(inverseTransform.m41, inverseTransform.m42, inverseTransform.m43);
+}
+
+- (NIVector)center
+{
+    NIAffineTransform inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+    return NIVectorApplyTransform(NIVectorMake((CGFloat)_pixelsWide/2.0, (CGFloat)_pixelsHigh/2.0, (CGFloat)_pixelsDeep/2.0), inverseTransform);
+}
+
+- (NIVector)directionX
+{
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return NIVectorXBasis;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        return NIVectorNormalize(NIVectorMake(inverseTransform.m11, inverseTransform.m12, inverseTransform.m13));
+    }
+}
+
+- (NIVector)directionY
+{
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return NIVectorYBasis;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        return NIVectorNormalize(NIVectorMake(inverseTransform.m21, inverseTransform.m22, inverseTransform.m23));
+    }
+}
+
+- (NIVector)directionZ
+{
+    NIAffineTransform inverseTransform;
+
+    if (self.rectilinear) {
+        return NIVectorZBasis;
+    } else {
+        inverseTransform = NIAffineTransformInvert(_modelToVoxelTransform);
+        return NIVectorNormalize(NIVectorMake(inverseTransform.m31, inverseTransform.m32, inverseTransform.m33));
+    }
+}
+
+- (float *)floatBytes
+{
+    return (float *)[self.floatData bytes];
+}
+
+- (float)rescaleSlope
+{
+    return _sampleData ? _rescaleSlope : 1;
+}
+
+- (float)rescaleIntercept
+{
+    return _sampleData ? _rescaleIntercept : 0;
+}
+
+- (NSData *)floatData
+{
+    if (_brickSize == 0 && _borderWidth == 0 && _sampleData == nil && _compressedBrickSize == 0 && _viewedFloatData == nil) {
+        return _floatData;
+    }
+
+    @synchronized (self) {
+        if (_floatData == nil) {
+            float *flatFloats = malloc(_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float));
+            if (flatFloats == NULL) {
+                [NSException raise:NSMallocException format:@"*** %s: could not allocate the flat floats", __PRETTY_FUNCTION__];
+            }
+            if (_compressedBrickSize) {
+                [self _getCompressedFloats:flatFloats inIndexRangesX:NSMakeRange(0, _pixelsWide) y:NSMakeRange(0, _pixelsHigh) z:NSMakeRange(0, _pixelsDeep)];
+            } else if (_sampleData) { // convert one slice per iteration
+                const NSUInteger sliceCount = _pixelsWide * _pixelsHigh;
+                const size_t sampleSize = NIVolumeDataSampleSize(_sampleType);
+                const uint8_t *samples = [_sampleData bytes];
+                NIVolumeDataSampleType sampleType = _sampleType;
+                float rescaleSlope = _rescaleSlope;
+                float rescaleIntercept = _rescaleIntercept;
+                dispatch_apply(_pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+                    NIVolumeDataConvertSamples(samples + (z * sliceCount * sampleSize), sampleType, rescaleSlope, rescaleIntercept, flatFloats + (z * sliceCount), sliceCount);
+                });
+            } else if (_viewedFloatData) { // compact the view, one slice per iteration
+                NIVolumeDataInlineBuffer inlineBuffer;
+                [self acquireInlineBuffer:&inlineBuffer];
+                const NSUInteger pixelsWide = _pixelsWide;
+                const NSUInteger pixelsHigh = _pixelsHigh;
+                dispatch_apply(_pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+                    for (NSUInteger y = 0; y < pixelsHigh; y++) {
+                        memcpy(flatFloats + pixelsWide*(y + pixelsHigh*z), inlineBuffer.floatBytes + NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, 0, y, z), pixelsWide * sizeof(float));
+                    }
+                });
+            } else if (_brickSize) {
+                NIVolumeDataCopyBrickedFloats(flatFloats, (float *)[_brickedFloatData bytes], _pixelsWide, _pixelsHigh, _pixelsDeep, _brickSize, NO);
+            } else {
+                NIVolumeDataCopyPaddedFloats(flatFloats, (float *)[_paddedFloatData bytes], _pixelsWide, _pixelsHigh, _pixelsDeep, _borderWidth, NO);
+            }
+            _floatData = [[NSData alloc] initWithBytesNoCopy:flatFloats length:_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float) freeWhenDone:YES];
+        }
+        return _floatData;
+    }
+}
+
+- (instancetype)volumeDataWithBrickSize:(NSUInteger)brickSize
+{
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (brickSize <= 1) {
+        brickSize = 0;
+    }
+    if (brickSize == _brickSize) {
+        return self;
+    }
+
+    return [[[[self class] alloc] initWithData:self.floatData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                         modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue brickSize:brickSize] autorelease];
+}
+
+- (NSUInteger)brickCacheLimit
+{
+    @synchronized (_brickCache) {
+        return _brickCacheLimit;
+    }
+}
+
+- (void)setBrickCacheLimit:(NSUInteger)brickCacheLimit
+{
+    @synchronized (_brickCache) {
+        _brickCacheLimit = brickCacheLimit;
+        while (_brickCacheSize > _brickCacheLimit && [_brickCacheOrder count]) {
+            NSNumber *oldestKey = [_brickCacheOrder firstObject];
+            _brickCacheSize -= [[_brickCache objectForKey:oldestKey] length];
+            [_brickCache removeObjectForKey:oldestKey];
+            [_brickCacheOrder removeObjectAtIndex:0];
+        }
+    }
+}
+
+- (instancetype)volumeDataWithCompressedBrickSize:(NSUInteger)brickSize
+{
+    NSData *compressedBrickData;
+    NSData *brickOffsets;
+
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (brickSize <= 1) {
+        brickSize = 0;
+    }
+    if (brickSize == _compressedBrickSize) {
+        return self;
+    }
+    if (brickSize == 0) {
+        return [[[[self class] alloc] initWithData:self.floatData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                             modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    }
+    if (NIVolumeDataBrickShift(brickSize) == NSNotFound) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: brickSize (%lld) is not a power of 2", __PRETTY_FUNCTION__, (long long)brickSize] userInfo:nil];
+    }
+
+    // the bricks are gathered from runs of the receiver, so volumes that aren't stored as flat floats don't build their floatData
+    const NSUInteger pixelsWide = _pixelsWide;
+    const NSUInteger pixelsHigh = _pixelsHigh;
+    const NSUInteger pixelsDeep = _pixelsDeep;
+    const float outOfBoundsValue = _outOfBoundsValue;
+    void (^gatherBrick)(NSUInteger, NSUInteger, NSUInteger, float *) = ^(NSUInteger brickX, NSUInteger brickY, NSUInteger brickZ, float *brickFloats) { // the part of the brick outside of the volume is set to the outOfBoundsValue
+        const NSUInteger x0 = brickX * brickSize;
+        const NSUInteger y0 = brickY * brickSize;
+        const NSUInteger z0 = brickZ * brickSize;
+        NSUInteger y;
+        NSUInteger z;
+
+        if (x0 + brickSize > pixelsWide || y0 + brickSize > pixelsHigh || z0 + brickSize > pixelsDeep) {
+            vDSP_vfill(&outOfBoundsValue, brickFloats, 1, brickSize * brickSize * brickSize);
+        }
+        for (z = 0; z < brickSize && z0 + z < pixelsDeep; z++) {
+            for (y = 0; y < brickSize && y0 + y < pixelsHigh; y++) {
+                [self getFloatRun:brickFloats + brickSize * (y + brickSize * z) atPixelCoordinateX:x0 y:y0 + y z:z0 + z length:brickSize];
+            }
+        }
+    };
+
+    if (NIVolumeDataCompressBricks(_pixelsWide, _pixelsHigh, _pixelsDeep, brickSize, gatherBrick, &compressedBrickData, &brickOffsets) == NO) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the compressed bricks", __PRETTY_FUNCTION__];
+    }
+
+    return [[[[self class] alloc] initWithCompressedBrickData:compressedBrickData brickOffsets:brickOffsets brickSize:brickSize pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                        modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+}
+
+- (NSData *)_decompressedBrickAtIndex:(NSUInteger)brickIndex
+{
+    const NSUInteger brickFloatCount = _compressedBrickSize * _compressedBrickSize * _compressedBrickSize;
+    const uint64_t *offsets = (const uint64_t *)[_compressedBrickOffsets bytes];
+    NSNumber *key = [NSNumber numberWithUnsignedInteger:brickIndex];
+    NSData *brick;
+
+    @synchronized (_brickCache) {
+        brick = [[[_brickCache objectForKey:key] retain] autorelease];
+        if (brick) {
+            [_brickCacheOrder removeObject:key];
+            [_brickCacheOrder addObject:key];
+            return brick;
+        }
+    }
+
+    // decompress outside of the lock so that other threads can decompress other bricks at the same time
+    float *brickFloats = malloc(brickFloatCount * sizeof(float));
+    if (brickFloats == NULL) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the decompressed brick", __PRETTY_FUNCTION__];
+    }
+    if (NIVolumeDataDecompressBrick((const uint8_t *)[_compressedBrickData bytes] + offsets[brickIndex], (size_t)(offsets[brickIndex + 1] - offsets[brickIndex]), brickFloats, brickFloatCount) == NO) {
+        free(brickFloats);
+        [NSException raise:NSInternalInconsistencyException format:@"*** %s: brick %lld is corrupt", __PRETTY_FUNCTION__, (long long)brickIndex];
+    }
+    brick = [NSData dataWithBytesNoCopy:brickFloats length:brickFloatCount * sizeof(float) freeWhenDone:YES];
+
+    @synchronized (_brickCache) {
+        if ([_brickCache objectForKey:key] == nil) { // another thread might have decompressed the same brick in the meantime
+            [_brickCache setObject:brick forKey:key];
+            [_brickCacheOrder addObject:key];
+            _brickCacheSize += [brick length];
+            while (_brickCacheSize > _brickCacheLimit && [_brickCacheOrder count] > 1) {
+                NSNumber *oldestKey = [_brickCacheOrder firstObject];
+                _brickCacheSize -= [[_brickCache objectForKey:oldestKey] length];
+                [_brickCache removeObjectForKey:oldestKey];
+                [_brickCacheOrder removeObjectAtIndex:0];
+            }
+        }
+    }
+    return brick;
+}
+
+// fills floats, which is flat with the size of the ranges, the bricks the ranges go through are read in parallel
+- (void)_getCompressedFloats:(float *)floats inIndexRangesX:(NSRange)xr y:(NSRange)yr z:(NSRange)zr
+{
+    if (xr.length == 0 || yr.length == 0 || zr.length == 0) {
+        return;
+    }
+
+    const NSUInteger brickSize = _compressedBrickSize;
+    const NSUInteger brickShift = NIVolumeDataBrickShift(brickSize);
+    const NSUInteger bricksWide = (_pixelsWide + brickSize - 1) / brickSize;
+    const NSUInteger bricksHigh = (_pixelsHigh + brickSize - 1) / brickSize;
+    const NSUInteger firstBrickX = xr.location >> brickShift;
+    const NSUInteger firstBrickY = yr.location >> brickShift;
+    const NSUInteger firstBrickZ = zr.location >> brickShift;
+    const NSUInteger rangeBricksWide = ((NSMaxRange(xr) - 1) >> brickShift) - firstBrickX + 1;
+    const NSUInteger rangeBricksHigh = ((NSMaxRange(yr) - 1) >> brickShift) - firstBrickY + 1;
+    const NSUInteger rangeBricksDeep = ((NSMaxRange(zr) - 1) >> brickShift) - firstBrickZ + 1;
+
+    dispatch_apply(rangeBricksWide * rangeBricksHigh * rangeBricksDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        const NSUInteger brickX = firstBrickX + (i % rangeBricksWide);
+        const NSUInteger brickY = firstBrickY + ((i / rangeBricksWide) % rangeBricksHigh);
+        const NSUInteger brickZ = firstBrickZ + (i / (rangeBricksWide * rangeBricksHigh));
+        const NSUInteger x0 = MAX(brickX << brickShift, xr.location);
+        const NSUInteger x1 = MIN((brickX + 1) << brickShift, NSMaxRange(xr));
+        const NSUInteger y1 = MIN((brickY + 1) << brickShift, NSMaxRange(yr));
+        const NSUInteger z1 = MIN((brickZ + 1) << brickShift, NSMaxRange(zr));
+        const float *brickFloats = (const float *)[[self _decompressedBrickAtIndex:brickX + bricksWide*(brickY + bricksHigh*brickZ)] bytes];
+        NSUInteger y;
+        NSUInteger z;
+
+        for (z = MAX(brickZ << brickShift, zr.location); z < z1; z++) {
+            for (y = MAX(brickY << brickShift, yr.location); y < y1; y++) {
+                memcpy(floats + ((x0 - xr.location) + xr.length*((y - yr.location) + yr.length*(z - zr.location))),
+                       brickFloats + ((x0 & (brickSize - 1)) + brickSize*((y & (brickSize - 1)) + brickSize*(z & (brickSize - 1)))), (x1 - x0) * sizeof(float));
+            }
+        }
+    });
+}
+
+- (NIVolumeData *)volumeDataForSamplingFromVolumeVector:(NIVector)minVolumeVector toVolumeVector:(NIVector)maxVolumeVector
+{
+    if (_compressedBrickSize == 0) {
+        return self;
+    }
+
+    // the interpolation kernels read up to 2 voxels past the sample points
+    const CGFloat mins[3] = {minVolumeVector.x, minVolumeVector.y, minVolumeVector.z};
+    const CGFloat maxs[3] = {maxVolumeVector.x, maxVolumeVector.y, maxVolumeVector.z};
+    const NSUInteger sizes[3] = {_pixelsWide, _pixelsHigh, _pixelsDeep};
+    NSRange ranges[3];
+    NSInteger axis;
+
+    for (axis = 0; axis < 3; axis++) {
+        CGFloat first = MIN(MAX(floor(mins[axis]) - 2.0, 0.0), (CGFloat)(sizes[axis] - 1));
+        CGFloat last = MIN(MAX(ceil(maxs[axis]) + 2.0, first), (CGFloat)(sizes[axis] - 1));
+        ranges[axis] = NSMakeRange((NSUInteger)first, (NSUInteger)(last - first) + 1);
+    }
+
+    return [self volumeDataWithIndexRangesX:ranges[0] y:ranges[1] z:ranges[2]];
+}
+
+- (NIVolumeData *)_volumeDataForSamplingModelVector:(NIVector)vector
+{
+    if (_compressedBrickSize == 0) {
+        return self;
+    }
+    NIVector volumeVector = [self convertVolumeVectorFromModelVector:vector];
+    return [self volumeDataForSamplingFromVolumeVector:volumeVector toVolumeVector:volumeVector];
+}
+
+- (nullable NIVolumeData *)cubicBSplineCoefficients
+{
+    if (_curved) {
+        return nil;
+    }
+
+    @synchronized (self) {
+        if (_cubicBSplineCoefficients == nil) {
+            NSUInteger y;
+            NSUInteger z;
+            float *coefficients = malloc(_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float));
+            if (coefficients == NULL) {
+                [NSException raise:NSMallocException format:@"*** %s: could not allocate the coefficients", __PRETTY_FUNCTION__];
+            }
+
+            for (z = 0; z < _pixelsDeep; z++) {
+                for (y = 0; y < _pixelsHigh; y++) {
+                    [self getFloatRun:coefficients + (_pixelsWide * (y + _pixelsHigh * z)) atPixelCoordinateX:0 y:y z:z length:_pixelsWide];
+                }
+            }
+            if (NIVolumeDataCubicBSplinePrefilter(coefficients, _pixelsWide, _pixelsHigh, _pixelsDeep) == NO) {
+                free(coefficients);
+                [NSException raise:NSMallocException format:@"*** %s: could not allocate the prefilter lines", __PRETTY_FUNCTION__];
+            }
+
+            NSData *coefficientData = [NSData dataWithBytesNoCopy:coefficients length:_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float) freeWhenDone:YES];
+            _cubicBSplineCoefficients = [[[self class] alloc] initWithData:coefficientData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                                     modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue brickSize:_brickSize];
+            if (_borderWidth) {
+                NIVolumeData *paddedCoefficients = [[_cubicBSplineCoefficients volumeDataWithBorderWidth:_borderWidth] retain];
+                [_cubicBSplineCoefficients release];
+                _cubicBSplineCoefficients = paddedCoefficients;
+            }
+        }
+        return _cubicBSplineCoefficients;
+    }
+}
+
+- (uint64_t)uniqueIdentifier
+{
+    static volatile int64_t lastUniqueIdentifier __attribute__ ((aligned (8))) = 0;
+
+    if (_uniqueIdentifier == 0) {
+        // if two threads race only the first identifier is kept, the other one is simply never used
+        OSAtomicCompareAndSwap64Barrier(0, OSAtomicIncrement64Barrier(&lastUniqueIdentifier), &_uniqueIdentifier);
+    }
+    return (uint64_t)_uniqueIdentifier;
+}
+
+- (float)intensityMin
+{
+    [self _computeIntensityStatistics];
+    @synchronized (self) {
+        return _intensityMin;
+    }
+}
+
+- (float)intensityMax
+{
+    [self _computeIntensityStatistics];
+    @synchronized (self) {
+        return _intensityMax;
+    }
+}
+
+- (float)intensityMean
+{
+    [self _computeIntensityStatistics];
+    @synchronized (self) {
+        return _intensityMean;
+    }
+}
+
+- (NSData *)intensityHistogramWithBinCount:(NSUInteger)binCount
+{
+    if (binCount == 0) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: binCount must be greater than 0", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    NSData *histogram;
+    float intensityMin;
+    float intensityMax;
+
+    @synchronized (self) {
+        histogram = [[[_intensityHistograms objectForKey:[NSNumber numberWithUnsignedInteger:binCount]] retain] autorelease];
+    }
+    if (histogram) {
+        return histogram;
+    }
+
+    [self _computeIntensityStatistics];
+    @synchronized (self) {
+        intensityMin = _intensityMin;
+        intensityMax = _intensityMax;
+    }
+
+    // the histogram is built outside of the lock so that the statistics and the histograms that are already built never wait for it. The slices are split in chunks
+    // that each fill their own histogram, the chunk histograms are then summed
+    const NSUInteger chunkCount = MIN(_pixelsDeep, [[NSProcessInfo processInfo] activeProcessorCount] * 2);
+    const NSUInteger pixelsWide = _pixelsWide;
+    const NSUInteger pixelsHigh = _pixelsHigh;
+    const NSUInteger pixelsDeep = _pixelsDeep;
+    const float binScale = intensityMax > intensityMin ? (float)binCount / (intensityMax - intensityMin) : 0;
+    const float binOffset = -intensityMin * binScale;
+    const float lowestBin = 0;
+    const float highestBin = binCount - 1;
+    NSUInteger *chunkHistograms = calloc(chunkCount * binCount, sizeof(NSUInteger));
+    if (chunkHistograms == NULL) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the histograms", __PRETTY_FUNCTION__];
+    }
+    __block volatile BOOL failed = NO; // exceptions can't be raised out of the dispatch_apply block
+
+    dispatch_apply(chunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) {
+        NSUInteger *chunkHistogram = chunkHistograms + chunk * binCount;
+        float *sliceBuffer = malloc(pixelsWide * pixelsHigh * sizeof(float));
+        float *binValues = malloc(pixelsWide * sizeof(float));
+        unsigned int *bins = malloc(pixelsWide * sizeof(unsigned int));
+        NSUInteger z;
+        if (sliceBuffer == NULL || binValues == NULL || bins == NULL) {
+            free(bins);
+            free(binValues);
+            free(sliceBuffer);
+            failed = YES;
+            return;
+        }
+        for (z = (chunk * pixelsDeep) / chunkCount; z < ((chunk + 1) * pixelsDeep) / chunkCount; z++) {
+            [self _enumerateRowsOfSliceAtIndex:z sliceBuffer:sliceBuffer usingBlock:^(const float *row) {
+                NSUInteger x;
+                vDSP_vsmsa(row, 1, &binScale, &binOffset, binValues, 1, pixelsWide);
+                vDSP_vclip(binValues, 1, &lowestBin, &highestBin, binValues, 1, pixelsWide);
+                vDSP_vfixu32(binValues, 1, bins, 1, pixelsWide);
+                for (x = 0; x < pixelsWide; x++) {
+                    chunkHistogram[bins[x]]++;
+                }
+            }];
+        }
+        free(bins);
+        free(binValues);
+        free(sliceBuffer);
+    });
+    if (failed) {
+        free(chunkHistograms);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the row buffers", __PRETTY_FUNCTION__];
+    }
+
+    NSMutableData *histogramData = [NSMutableData dataWithLength:binCount * sizeof(NSUInteger)];
+    NSUInteger *histogramCounts = (NSUInteger *)[histogramData mutableBytes];
+    NSUInteger chunk;
+    NSUInteger bin;
+    for (chunk = 0; chunk < chunkCount; chunk++) {
+        for (bin = 0; bin < binCount; bin++) {
+            histogramCounts[bin] += chunkHistograms[chunk * binCount + bin];
+        }
+    }
+    free(chunkHistograms);
+
+    @synchronized (self) {
+        histogram = [_intensityHistograms objectForKey:[NSNumber numberWithUnsignedInteger:binCount]];
+        if (histogram) { // another thread might have built the same histogram in the meantime
+            return [[histogram retain] autorelease];
+        }
+        if (_intensityHistograms == nil) {
+            _intensityHistograms = [[NSMutableDictionary alloc] init];
+        }
+        [_intensityHistograms setObject:histogramData forKey:[NSNumber numberWithUnsignedInteger:binCount]];
+    }
+    return histogramData;
+}
+
+// the statistics are computed outside of the lock and then published, like the mip levels, so that the callers that only read them never wait for them
+- (void)_computeIntensityStatistics
+{
+    @synchronized (self) {
+        if (_hasIntensityStatistics) {
+            return;
+        }
+    }
+
+    const NSUInteger pixelsWide = _pixelsWide;
+    const NSUInteger pixelsHigh = _pixelsHigh;
+    float *sliceMins = malloc(_pixelsDeep * sizeof(float));
+    float *sliceMaxs = malloc(_pixelsDeep * sizeof(float));
+    double *sliceSums = malloc(_pixelsDeep * sizeof(double));
+    if (sliceMins == NULL || sliceMaxs == NULL || sliceSums == NULL) {
+        free(sliceMins);
+        free(sliceMaxs);
+        free(sliceSums);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the slice statistics", __PRETTY_FUNCTION__];
+    }
+    __block volatile BOOL failed = NO; // exceptions can't be raised out of the dispatch_apply block
+
+    dispatch_apply(_pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+        float *sliceBuffer = malloc(pixelsWide * pixelsHigh * sizeof(float));
+        __block float sliceMin = INFINITY;
+        __block float sliceMax = -INFINITY;
+        __block double sliceSum = 0;
+        if (sliceBuffer == NULL) {
+            failed = YES;
+            return;
+        }
+        [self _enumerateRowsOfSliceAtIndex:z sliceBuffer:sliceBuffer usingBlock:^(const float *row) {
+            float rowValue;
+            vDSP_minv(row, 1, &rowValue, pixelsWide);
+            sliceMin = MIN(sliceMin, rowValue);
+            vDSP_maxv(row, 1, &rowValue, pixelsWide);
+            sliceMax = MAX(sliceMax, rowValue);
+            vDSP_sve(row, 1, &rowValue, pixelsWide);
+            sliceSum += rowValue;
+        }];
+        sliceMins[z] = sliceMin;
+        sliceMaxs[z] = sliceMax;
+        sliceSums[z] = sliceSum;
+        free(sliceBuffer);
+    });
+    if (failed) {
+        free(sliceMins);
+        free(sliceMaxs);
+        free(sliceSums);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the slice buffers", __PRETTY_FUNCTION__];
+    }
+
+    double sum = 0;
+    float intensityMin;
+    float intensityMax;
+    NSUInteger z;
+    vDSP_minv(sliceMins, 1, &intensityMin, _pixelsDeep);
+    vDSP_maxv(sliceMaxs, 1, &intensityMax, _pixelsDeep);
+    for (z = 0; z < _pixelsDeep; z++) {
+        sum += sliceSums[z];
+    }
+
+    free(sliceMins);
+    free(sliceMaxs);
+    free(sliceSums);
+
+    @synchronized (self) {
+        if (_hasIntensityStatistics == NO) { // another thread might have computed them in the meantime
+            _intensityMin = intensityMin;
+            _intensityMax = intensityMax;
+            _intensityMean = sum / (double)(_pixelsWide * _pixelsHigh * _pixelsDeep);
+            _hasIntensityStatistics = YES;
+        }
+    }
+}
+
+// volumes that share the same voxels share the same statistics and min/max grid
+- (void)_copyIntensityStatisticsFromVolumeData:(NIVolumeData *)volumeData
+{
+    if (volumeData == self) {
+        return;
+    }
+
+    BOOL hasIntensityStatistics = NO;
+    float intensityMin = 0;
+    float intensityMax = 0;
+    float intensityMean = 0;
+    NSDictionary *intensityHistograms = nil;
+    NSData *minMaxGridData = nil;
+    @synchronized (volumeData) {
+        hasIntensityStatistics = volumeData->_hasIntensityStatistics;
+        intensityMin = volumeData->_intensityMin;
+        intensityMax = volumeData->_intensityMax;
+        intensityMean = volumeData->_intensityMean;
+        intensityHistograms = [[volumeData->_intensityHistograms copy] autorelease];
+        minMaxGridData = [[volumeData->_minMaxGridData retain] autorelease];
+    }
+
+    @synchronized (self) {
+        if (hasIntensityStatistics) {
+            _intensityMin = intensityMin;
+            _intensityMax = intensityMax;
+            _intensityMean = intensityMean;
+            _hasIntensityStatistics = YES;
+            if (intensityHistograms) {
+                [_intensityHistograms release];
+                _intensityHistograms = [intensityHistograms mutableCopy];
+            }
+        }
+        if (minMaxGridData && _minMaxGridData == nil) {
+            _minMaxGridData = [minMaxGridData retain];
+        }
+    }
+}
+
+- (void)acquireMinMaxGrid:(NIVolumeDataMinMaxGrid *)minMaxGrid
+{
+    const NSUInteger cellSize = (NSUInteger)1 << NIVolumeDataMinMaxCellShift;
+    const NSUInteger cellsWide = (_pixelsWide + cellSize - 1) >> NIVolumeDataMinMaxCellShift;
+    const NSUInteger cellsHigh = (_pixelsHigh + cellSize - 1) >> NIVolumeDataMinMaxCellShift;
+    const NSUInteger cellsDeep = (_pixelsDeep + cellSize - 1) >> NIVolumeDataMinMaxCellShift;
+    const NSUInteger cellCount = cellsWide * cellsHigh * cellsDeep;
+    const float *cellMins;
+    NSData *minMaxGridData;
+
+    @synchronized (self) {
+        minMaxGridData = [[_minMaxGridData retain] autorelease];
+    }
+
+    // the grid is built outside of the lock, like the mip levels, so that the statistics and the other lazily built data of the volume never wait for it
+    if (minMaxGridData == nil) {
+        const NSUInteger pixelsWide = _pixelsWide;
+        const NSUInteger pixelsHigh = _pixelsHigh;
+        const NSUInteger pixelsDeep = _pixelsDeep;
+        float *gridFloats = malloc(cellCount * 2 * sizeof(float));
+        if (gridFloats == NULL) {
+            [NSException raise:NSMallocException format:@"*** %s: could not allocate the min/max grid", __PRETTY_FUNCTION__];
+        }
+        __block volatile BOOL failed = NO; // exceptions can't be raised out of the dispatch_apply block
+
+        // each layer of cells is reduced on its own thread, the rows of a layer are cut at the cell boundaries
+        dispatch_apply(cellsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t k) {
+            float *layerMins = gridFloats + k * cellsWide * cellsHigh;
+            float *layerMaxs = gridFloats + cellCount + k * cellsWide * cellsHigh;
+            float *sliceBuffer = malloc(pixelsWide * pixelsHigh * sizeof(float));
+            NSUInteger z;
+            NSUInteger i;
+
+            if (sliceBuffer == NULL) {
+                failed = YES;
+                return;
+            }
+            for (i = 0; i < cellsWide * cellsHigh; i++) {
+                layerMins[i] = INFINITY;
+                layerMaxs[i] = -INFINITY;
+            }
+            for (z = k << NIVolumeDataMinMaxCellShift; z < MIN((k + 1) << NIVolumeDataMinMaxCellShift, pixelsDeep); z++) {
+                __block NSUInteger y = 0;
+                [self _enumerateRowsOfSliceAtIndex:z sliceBuffer:sliceBuffer usingBlock:^(const float *row) {
+                    float *rowMins = layerMins + (y >> NIVolumeDataMinMaxCellShift) * cellsWide;
+                    float *rowMaxs = layerMaxs + (y >> NIVolumeDataMinMaxCellShift) * cellsWide;
+                    NSUInteger cell;
+                    float value;
+                    for (cell = 0; cell < cellsWide; cell++) {
+                        NSUInteger x = cell << NIVolumeDataMinMaxCellShift;
+                        NSUInteger length = MIN(cellSize, pixelsWide - x);
+                        vDSP_minv(row + x, 1, &value, length);
+                        rowMins[cell] = MIN(rowMins[cell], value);
+                        vDSP_maxv(row + x, 1, &value, length);
+                        rowMaxs[cell] = MAX(rowMaxs[cell], value);
+                    }
+                    y++;
+                }];
+            }
+            free(sliceBuffer);
+        });
+        if (failed) {
+            free(gridFloats);
+            [NSException raise:NSMallocException format:@"*** %s: could not allocate the slice buffers", __PRETTY_FUNCTION__];
+        }
+
+        minMaxGridData = [[[NSData alloc] initWithBytesNoCopy:gridFloats length:cellCount * 2 * sizeof(float) freeWhenDone:YES] autorelease];
+
+        @synchronized (self) {
+            if (_minMaxGridData == nil) {
+                _minMaxGridData = [minMaxGridData retain];
+            } else { // another thread might have built the grid in the meantime
+                minMaxGridData = [[_minMaxGridData retain] autorelease];
+            }
+        }
+    }
+    cellMins = (const float *)[minMaxGridData bytes];
+
+    memset(minMaxGrid, 0, sizeof(NIVolumeDataMinMaxGrid));
+    minMaxGrid->cellMins = cellMins;
+    minMaxGrid->cellMaxs = cellMins + cellCount;
+    minMaxGrid->cellShift = NIVolumeDataMinMaxCellShift;
+    minMaxGrid->cellsWide = cellsWide;
+    minMaxGrid->cellsHigh = cellsHigh;
+    minMaxGrid->cellsDeep = cellsDeep;
+    minMaxGrid->pixelsWide = _pixelsWide;
+    minMaxGrid->pixelsHigh = _pixelsHigh;
+    minMaxGrid->pixelsDeep = _pixelsDeep;
+    minMaxGrid->outOfBoundsValue = _outOfBoundsValue;
+}
+
+// calls the block with each row of slice z, rows that can't be read in place are copied into sliceBuffer, which must hold a slice of floats
+- (void)_enumerateRowsOfSliceAtIndex:(NSUInteger)z sliceBuffer:(float *)sliceBuffer usingBlock:(void (^)(const float *row))block
+{
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NSUInteger y;
+
+    if (_compressedBrickSize) { // decompress the bricks of the slice once, rather than once per row
+        [self _getCompressedFloats:sliceBuffer inIndexRangesX:NSMakeRange(0, _pixelsWide) y:NSMakeRange(0, _pixelsHigh) z:NSMakeRange(z, 1)];
+        for (y = 0; y < _pixelsHigh; y++) {
+            block(sliceBuffer + y*_pixelsWide);
+        }
+        return;
+    }
+
+    [self acquireInlineBuffer:&inlineBuffer];
+    for (y = 0; y < _pixelsHigh; y++) {
+        if (inlineBuffer.floatBytes && inlineBuffer.brickShift == 0) {
+            block(inlineBuffer.floatBytes + NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, 0, y, z));
+        } else {
+            [self getFloatRun:sliceBuffer + y*_pixelsWide atPixelCoordinateX:0 y:y z:z length:_pixelsWide];
+            block(sliceBuffer + y*_pixelsWide);
+        }
+    }
+}
+
+- (NSUInteger)mipLevelCount
+{
+    NSUInteger largestDimension = MAX(MAX(_pixelsWide, _pixelsHigh), _pixelsDeep);
+    NSUInteger mipLevelCount = 1;
+
+    if (_curved) {
+        return 1;
+    }
+
+    while (largestDimension > 1) {
+        largestDimension = (largestDimension + 1) / 2;
+        mipLevelCount++;
+    }
+    return mipLevelCount;
+}
+
+- (NIVolumeData *)volumeDataForMipLevel:(NSUInteger)level
+{
+    NIVolumeData *previousLevel;
+    NIVolumeData *mipLevel;
+    NSUInteger builtLevelCount;
+
+    level = MIN(level, self.mipLevelCount - 1);
+    if (level == 0) {
+        return self;
+    }
+
+    // the levels are built outside of the lock so that availableVolumeDataForMipLevel: never waits for them
+    while (1) {
+        @synchronized (self) {
+            if (_mipLevels == nil) {
+                _mipLevels = [[NSMutableArray alloc] init];
+            }
+            builtLevelCount = [_mipLevels count];
+            if (builtLevelCount >= level) {
+                return [[[_mipLevels objectAtIndex:level - 1] retain] autorelease];
+            }
+            previousLevel = builtLevelCount ? [[[_mipLevels lastObject] retain] autorelease] : self;
+        }
+
+        mipLevel = [previousLevel _downsampledVolumeData];
+
+        @synchronized (self) {
+            if ([_mipLevels count] == builtLevelCount) { // another thread might have built the same level in the meantime
+                [_mipLevels addObject:mipLevel];
+            }
+        }
+    }
+}
+
+- (NIVolumeData *)availableVolumeDataForMipLevel:(NSUInteger)level
+{
+    NSUInteger builtLevel;
+
+    level = MIN(level, self.mipLevelCount - 1);
+
+    @synchronized (self) {
+        builtLevel = MIN(level, [_mipLevels count]);
+        if (builtLevel < level && _buildingMipLevels == NO && _mipLevelsFailed == NO) {
+            _buildingMipLevels = YES;
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                BOOL failed = NO;
+                @try {
+                    [self volumeDataForMipLevel:level];
+                }
+                @catch (NSException *exception) { // the exception can't leave the block, volumeDataForMipLevel: raises it again for callers that wait for the level
+                    failed = YES;
+                }
+                @synchronized (self) {
+                    _buildingMipLevels = NO;
+                    _mipLevelsFailed = failed;
+                }
+            });
+        }
+
+        if (builtLevel == 0) {
+            return self;
+        }
+        return [[[_mipLevels objectAtIndex:builtLevel - 1] retain] autorelease];
+    }
+}
+
+- (NSUInteger)mipLevelForSampleSpacing:(CGFloat)sampleSpacing
+{
+    const NSUInteger mipLevelCount = self.mipLevelCount;
+    CGFloat levelSpacing;
+    NSUInteger level = 0;
+
+    if (mipLevelCount == 1) {
+        return 0;
+    }
+
+    // every level halves all of the axes, so the level is chosen from the coarsest axis, otherwise the coarse axis of an anisotropic volume would be blurred well past
+    // the sample spacing. The small tolerance lets spacings that were derived from a level's spacing select that level
+    levelSpacing = 0;
+    if (_pixelsWide > 1) {
+        levelSpacing = MAX(levelSpacing, self.pixelSpacingX);
+    }
+    if (_pixelsHigh > 1) {
+        levelSpacing = MAX(levelSpacing, self.pixelSpacingY);
+    }
+    if (_pixelsDeep > 1) {
+        levelSpacing = MAX(levelSpacing, self.pixelSpacingZ);
+    }
+    while (level + 1 < mipLevelCount && levelSpacing * 2.0 <= sampleSpacing * 1.001) {
+        levelSpacing *= 2.0;
+        level++;
+    }
+    return level;
+}
+
+// the slices are read one at a time through _enumerateRowsOfSliceAtIndex:, so that volumes that aren't stored as flat floats are downsampled without building their floatData
+- (NIVolumeData *)_downsampledVolumeData
+{
+    const NSUInteger pixelsWide = _pixelsWide;
+    const NSUInteger pixelsHigh = _pixelsHigh;
+    const NSUInteger pixelsDeep = _pixelsDeep;
+    const NSUInteger xFactor = _pixelsWide > 1 ? 2 : 1;
+    const NSUInteger yFactor = _pixelsHigh > 1 ? 2 : 1;
+    const NSUInteger zFactor = _pixelsDeep > 1 ? 2 : 1;
+    const NSUInteger downsampledWide = (_pixelsWide + xFactor - 1) / xFactor;
+    const NSUInteger downsampledHigh = (_pixelsHigh + yFactor - 1) / yFactor;
+    const NSUInteger downsampledDeep = (_pixelsDeep + zFactor - 1) / zFactor;
+    const NSUInteger pairedWide = _pixelsWide / xFactor; // the downsampled voxels of a row that cover xFactor voxels, the last one of an odd row covers a single voxel
+    NIAffineTransform modelToVoxelTransform;
+
+    float *downsampledFloats = calloc(downsampledWide * downsampledHigh * downsampledDeep, sizeof(float));
+    if (downsampledFloats == NULL) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the downsampled floats", __PRETTY_FUNCTION__];
+    }
+    __block volatile BOOL failed = NO; // exceptions can't be raised out of the dispatch_apply block
+
+    // each downsampled voxel is the mean of the voxels it covers, along an odd axis the last downsampled voxel only covers the last voxel
+    dispatch_apply(downsampledDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+        float *downsampledSlice = downsampledFloats + downsampledWide * downsampledHigh * z;
+        float *sliceBuffer = malloc(pixelsWide * pixelsHigh * sizeof(float));
+        const NSUInteger sliceCount = MIN((z + 1) * zFactor, pixelsDeep) - z * zFactor;
+        NSUInteger k;
+        NSUInteger y;
+
+        if (sliceBuffer == NULL) {
+            failed = YES;
+            return;
+        }
+        for (k = z * zFactor; k < z * zFactor + sliceCount; k++) {
+            __block NSUInteger rowIndex = 0;
+            [self _enumerateRowsOfSliceAtIndex:k sliceBuffer:sliceBuffer usingBlock:^(const float *row) {
+                float *downsampledRow = downsampledSlice + downsampledWide * (rowIndex / yFactor);
+                NSUInteger i;
+                for (i = 0; i < xFactor; i++) {
+                    vDSP_vadd(row + i, xFactor, downsampledRow, 1, downsampledRow, 1, pairedWide);
+                }
+                if (pairedWide < downsampledWide) {
+                    downsampledRow[downsampledWide - 1] += row[pixelsWide - 1];
+                }
+                rowIndex++;
+            }];
+        }
+        for (y = 0; y < downsampledHigh; y++) {
+            float *downsampledRow = downsampledSlice + downsampledWide * y;
+            const NSUInteger rowCount = MIN((y + 1) * yFactor, pixelsHigh) - y * yFactor;
+            float scale = 1.0f / (float)(xFactor * rowCount * sliceCount);
+            vDSP_vsmul(downsampledRow, 1, &scale, downsampledRow, 1, pairedWide);
+            if (pairedWide < downsampledWide) {
+                downsampledRow[downsampledWide - 1] /= (float)(rowCount * sliceCount);
+            }
+        }
+        free(sliceBuffer);
+    });
+    if (failed) {
+        free(downsampledFloats);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the slice buffers", __PRETTY_FUNCTION__];
+    }
+
+    // a downsampled voxel sits at the center of the voxels it covers
+    modelToVoxelTransform = NIAffineTransformConcat(_modelToVoxelTransform, NIAffineTransformMakeTranslation(-0.5*(CGFloat)(xFactor - 1), -0.5*(CGFloat)(yFactor - 1), -0.5*(CGFloat)(zFactor - 1)));
+    modelToVoxelTransform = NIAffineTransformConcat(modelToVoxelTransform, NIAffineTransformMakeScale(1.0/(CGFloat)xFactor, 1.0/(CGFloat)yFactor, 1.0/(CGFloat)zFactor));
+
+    NSData *downsampledData = [NSData dataWithBytesNoCopy:downsampledFloats length:downsampledWide * downsampledHigh * downsampledDeep * sizeof(float) freeWhenDone:YES];
+    NIVolumeData *downsampledVolumeData = [[[[self class] alloc] initWithData:downsampledData pixelsWide:downsampledWide pixelsHigh:downsampledHigh pixelsDeep:downsampledDeep
+                                                       modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue brickSize:_brickSize] autorelease];
+    if (_borderWidth) {
+        downsampledVolumeData = [downsampledVolumeData volumeDataWithBorderWidth:_borderWidth];
+    } else if (_compressedBrickSize) {
+        downsampledVolumeData = [downsampledVolumeData volumeDataWithCompressedBrickSize:_compressedBrickSize];
+    }
+    return downsampledVolumeData;
+}
+
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error
+{
+    NIVolumeDataFileHeader header;
+    const CGFloat *transformValues = (const CGFloat *)&_modelToVoxelTransform;
+    NSInteger i;
+
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NIVolumeDataFileMagic, sizeof(NIVolumeDataFileMagic));
+    header.version = CFSwapInt32HostToLittle(NIVolumeDataFileVersion);
+    header.voxelOffset = CFSwapInt64HostToLittle(NIVolumeDataFileAlignment);
+    header.pixelsWide = CFSwapInt64HostToLittle(_pixelsWide);
+    header.pixelsHigh = CFSwapInt64HostToLittle(_pixelsHigh);
+    header.pixelsDeep = CFSwapInt64HostToLittle(_pixelsDeep);
+    // CFConvertFloat64HostToSwapped would store the doubles big endian, so the bit patterns are swapped like the integer fields
+    for (i = 0; i < 16; i++) {
+        double transformValue = transformValues[i];
+        uint64_t transformBits;
+        memcpy(&transformBits, &transformValue, sizeof(transformBits));
+        transformBits = CFSwapInt64HostToLittle(transformBits);
+        memcpy(&header.modelToVoxelTransform[i], &transformBits, sizeof(transformBits));
+    }
+    uint32_t outOfBoundsBits;
+    memcpy(&outOfBoundsBits, &_outOfBoundsValue, sizeof(outOfBoundsBits));
+    outOfBoundsBits = CFSwapInt32HostToLittle(outOfBoundsBits);
+    memcpy(&header.outOfBoundsValue, &outOfBoundsBits, sizeof(outOfBoundsBits));
+
+    NSMutableData *headerData = [NSMutableData dataWithLength:NIVolumeDataFileAlignment];
+    memcpy([headerData mutableBytes], &header, sizeof(header));
+    NSData *floatData = self.floatData;
+
+    int fd = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        return NO;
+    }
+    if (NIVolumeDataWriteAll(fd, [headerData bytes], [headerData length]) == NO ||
+        NIVolumeDataWriteAll(fd, [floatData bytes], _pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float)) == NO) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        close(fd);
+        return NO;
+    }
+    if (close(fd) == -1) {
+        if (error) *error = NIVolumeDataPOSIXError(path);
+        return NO;
+    }
+    return YES;
+}
+
+- (void)prefetchSlicesInRange:(NSRange)range
+{
+    if (_floatDataIsMapped == NO || range.location >= _pixelsDeep) { // only the flat floats of a volume file are paged in
+        return;
+    }
+    range.length = MIN(range.length, _pixelsDeep - range.location);
+
+    // madvise needs a page aligned start
+    const size_t sliceLength = _pixelsWide * _pixelsHigh * sizeof(float);
+    const uintptr_t pageSize = (uintptr_t)getpagesize();
+    const uintptr_t start = (uintptr_t)[_floatData bytes] + range.location * sliceLength;
+    const uintptr_t alignedStart = start & ~(pageSize - 1);
+    madvise((void *)alignedStart, (start - alignedStart) + range.length * sliceLength, MADV_WILLNEED);
+}
+
+- (instancetype)volumeDataWithBorderWidth:(NSUInteger)borderWidth
+{
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (borderWidth == _borderWidth && _brickSize == 0) {
+        return self;
+    }
+    if (borderWidth == 0) {
+        return [[[[self class] alloc] initWithData:self.floatData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                             modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    }
+
+    NSData *paddedData = NIVolumeDataPaddedData(self.floatData, _pixelsWide, _pixelsHigh, _pixelsDeep, borderWidth, _outOfBoundsValue);
+    if (paddedData == nil) {
+        return nil;
+    }
+    return [[[[self class] alloc] initWithPaddedData:paddedData borderWidth:borderWidth pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                               modelToVoxelTransform:_modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+}
+
+// will copy fill length*sizeof(float) bytes
+- (NSUInteger)getFloatRun:(float *)buffer atPixelCoordinateX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z length:(NSUInteger)length
+{
+    NSUInteger copyLength = length;
+    if (x >= _pixelsWide || y >= _pixelsHigh || z >= _pixelsDeep) {
+        return 0;
+    }
+    copyLength = MIN(length, _pixelsWide - x);
+
+    if (_brickSize) { // copy the run one brick at a time
+        NIVolumeDataInlineBuffer inlineBuffer;
+        NSUInteger i = 0;
+        [self acquireInlineBuffer:&inlineBuffer];
+        while (i < copyLength) {
+            NSUInteger runLength = MIN(copyLength - i, _brickSize - ((x + i) & (_brickSize - 1)));
+            memcpy(buffer + i, inlineBuffer.floatBytes + NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, x + i, y, z), runLength * sizeof(float));
+            i += runLength;
+        }
+    } else if (_borderWidth || _viewedFloatData) {
+        NIVolumeDataInlineBuffer inlineBuffer;
+        [self acquireInlineBuffer:&inlineBuffer];
+        memcpy(buffer, inlineBuffer.floatBytes + NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, x, y, z), copyLength * sizeof(float));
+    } else if (_compressedBrickSize) {
+        [self _getCompressedFloats:buffer inIndexRangesX:NSMakeRange(x, copyLength) y:NSMakeRange(y, 1) z:NSMakeRange(z, 1)];
+    } else if (_sampleData) {
+        NIVolumeDataConvertSamples((const uint8_t *)[_sampleData bytes] + (x + _pixelsWide*(y + z*_pixelsHigh)) * NIVolumeDataSampleSize(_sampleType),
+                                   _sampleType, _rescaleSlope, _rescaleIntercept, buffer, copyLength);
+    } else {
+        memcpy(buffer, &(self.floatBytes[x + _pixelsWide*(y + z*_pixelsHigh)]), copyLength * sizeof(float));
+    }
+    return copyLength;
+}
+
+- (nullable NIVector (^)(NIVector))convertVolumeVectorToModelVectorBlock
+{
+    if (_curved == NO) {
+        NIAffineTransform voxelToModelTransform = NIAffineTransformInvert([self modelToVoxelTransform]);
+
+        return [[^NIVector(NIVector vector) {
+            return NIVectorApplyTransform(vector, voxelToModelTransform);
+        } copy] autorelease];
+    } else {
+        return _convertVolumeVectorToModelVectorBlock;
+    }
+}
+
+- (nullable NIVector (^)(NIVector))convertVolumeVectorFromModelVectorBlock
+{
+    if (_curved == NO) {
+        NIAffineTransform modelToVoxelTransform = [self modelToVoxelTransform];
+
+        return [[^NIVector(NIVector vector) {
+            return NIVectorApplyTransform(vector, modelToVoxelTransform);
+        } copy] autorelease];
+    } else {
+        return _convertVolumeVectorFromModelVectorBlock;
+    }
+}
+
+- (NIVector)convertVolumeVectorToModelVector:(NIVector)vector
+{
+    if (_curved) {
+        return _convertVolumeVectorToModelVectorBlock(vector);
+    }
+    else {
+        return NIVectorApplyTransform(vector, NIAffineTransformInvert([self modelToVoxelTransform]));
+    }
+}
+
+- (NIVector)convertVolumeVectorFromModelVector:(NIVector)vector
+{
+    if (_curved) {
+        return _convertVolumeVectorFromModelVectorBlock(vector);
+    }
+    else {
+        return NIVectorApplyTransform(vector, [self modelToVoxelTransform]);
+    }
+}
+
+- (vImage_Buffer)floatBufferForSliceAtIndex:(NSUInteger)z {
+    vImage_Buffer floatBuffer;
+    if (_viewedFloatData && _viewRowStride > 0) { // vImage can walk the rows of the view in place
+        floatBuffer.data = (void *)((const float *)[_viewedFloatData bytes] + _viewOffset + _viewSliceStride*(NSInteger)z);
+        floatBuffer.height = _pixelsHigh;
+        floatBuffer.width = _pixelsWide;
+        floatBuffer.rowBytes = sizeof(float) * _viewRowStride;
+        return floatBuffer;
+    }
+    floatBuffer.data = (void *)self.floatBytes + (_pixelsWide * _pixelsHigh * sizeof(float) * z);
+    floatBuffer.height = _pixelsHigh;
+    floatBuffer.width = _pixelsWide;
+    floatBuffer.rowBytes = sizeof(float) * _pixelsWide;
+    return floatBuffer;
+}
+
+- (NIVolumeData *)volumeDataForSliceAtIndex:(NSUInteger)z
+{
+    if (z >= _pixelsDeep) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: z index outside of the volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    NIVolumeData *sliceVolume;
+
+    NSData *sliceData;
+
+    if ([self _canBeViewed]) {
+        return [self _viewWithOriginX:0 y:0 z:z pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:1 reversedY:NO reversedZ:NO
+                modelToVoxelTransform:NIAffineTransformConcat(_modelToVoxelTransform, NIAffineTransformMakeTranslation(0, 0, -1.*z))];
+    }
+
+    if (_compressedBrickSize) {
+        NSMutableData *mutableSliceData = [NSMutableData dataWithLength:_pixelsWide * _pixelsHigh * sizeof(float)];
+        [self _getCompressedFloats:(float *)[mutableSliceData mutableBytes] inIndexRangesX:NSMakeRange(0, _pixelsWide) y:NSMakeRange(0, _pixelsHigh) z:NSMakeRange(z, 1)];
+        sliceData = mutableSliceData;
+    } else if (_brickSize || _borderWidth || _sampleData) {
+        NSMutableData *mutableSliceData = [NSMutableData dataWithLength:_pixelsWide * _pixelsHigh * sizeof(float)];
+        float *sliceFloats = (float *)[mutableSliceData mutableBytes];
+        for (NSUInteger y = 0; y < _pixelsHigh; y++) {
+            [self getFloatRun:sliceFloats + (y * _pixelsWide) atPixelCoordinateX:0 y:y z:z length:_pixelsWide];
+        }
+        sliceData = mutableSliceData;
+    } else {
+        sliceData = [NSData dataWithBytes:self.floatBytes + (_pixelsWide*_pixelsHigh*z) length:_pixelsWide * _pixelsHigh * sizeof(float)];
+    }
+
+    if (self.curved) {
+        NIVector (^volumeVectorToModelVectorBlock)(NIVector) = ^(NIVector volumeVector){
+            NIVector translatedVolumeVector = NIVectorSubtract(volumeVector, NIVectorMake(0, 0, z));
+            return _convertVolumeVectorToModelVectorBlock(translatedVolumeVector);
+        };
+        NIVector (^volumeVectorFromModelVectorBlock)(NIVector) = ^(NIVector modelVector){
+            NIVector volumeVector = _convertVolumeVectorFromModelVectorBlock(modelVector);
+            return NIVectorAdd(volumeVector, NIVectorMake(0, 0, z));
+        };
+
+        sliceVolume = [[[self class] alloc] initWithData:sliceData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:1
+                                  volumeToModelConverter:volumeVectorToModelVectorBlock modelToVolumeConverter:volumeVectorFromModelVectorBlock outOfBoundsValue:_outOfBoundsValue];
+    } else {
+        NIAffineTransform sliceTransform = NIAffineTransformConcat(_modelToVoxelTransform, NIAffineTransformMakeTranslation(0, 0, -z));
+        sliceVolume = [[[self class] alloc] initWithData:sliceData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:1 modelToVoxelTransform:sliceTransform outOfBoundsValue:_outOfBoundsValue];
+    }
+
+    return [sliceVolume autorelease];
+}
+
+- (NIVolumeData *)volumeDataWithIndexRangesX:(NSRange)xr y:(NSRange)yr z:(NSRange)zr {
+    if (NSMaxRange(xr) > _pixelsWide ||  NSMaxRange(yr) > _pixelsHigh ||  NSMaxRange(zr) > _pixelsDeep) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: index range outside of the volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    NIVolumeData *data = nil;
+    NIVector origin = NIVectorMake(xr.location, yr.location, zr.location);
+    if ([self _canBeViewed] && xr.length && yr.length && zr.length) {
+        return [self _viewWithOriginX:xr.location y:yr.location z:zr.location pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length reversedY:NO reversedZ:NO
+                modelToVoxelTransform:NIAffineTransformConcat(self.modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.*xr.location, -1.*yr.location, -1.*zr.location))];
+    } else if (self.curved) {
         NIVector (^volumeVectorToModelVectorBlock)(NIVector) = ^(NIVector volumeVector){
             NIVector translatedVolumeVector = NIVectorSubtract(volumeVector, origin);
             return _convertVolumeVectorToModelVectorBlock(translatedVolumeVector);
@@ -427,337 +2419,1375 @@ NS_ASSUME_NONNULL_BEGIN
             return NIVectorAdd(volumeVector, origin);
         };
 
-        data = [[[self class] alloc] initWithData:[NSMutableData dataWithLength:xr.length*yr.length*zr.length*sizeof(float)] pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length
-                           volumeToModelConverter:volumeVectorToModelVectorBlock modelToVolumeConverter:volumeVectorFromModelVectorBlock outOfBoundsValue:self.outOfBoundsValue];
-    } else {
-        data = [[[self class] alloc] initWithData:[NSMutableData dataWithLength:xr.length*yr.length*zr.length*sizeof(float)] pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length
-                            modelToVoxelTransform:NIAffineTransformConcat(self.modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.*xr.location, -1.*yr.location, -1.*zr.location)) outOfBoundsValue:self.outOfBoundsValue];
+        data = [[[self class] alloc] initWithData:[NSMutableData dataWithLength:xr.length*yr.length*zr.length*sizeof(float)] pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length
+                           volumeToModelConverter:volumeVectorToModelVectorBlock modelToVolumeConverter:volumeVectorFromModelVectorBlock outOfBoundsValue:self.outOfBoundsValue];
+    } else if (_compressedBrickSize) { // the subvolume is returned uncompressed, only the bricks it covers are decompressed
+        NSMutableData *floatData = [NSMutableData dataWithLength:xr.length*yr.length*zr.length*sizeof(float)];
+        [self _getCompressedFloats:(float *)[floatData mutableBytes] inIndexRangesX:xr y:yr z:zr];
+        return [[[[self class] alloc] initWithData:floatData pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length
+                             modelToVoxelTransform:NIAffineTransformConcat(self.modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.*xr.location, -1.*yr.location, -1.*zr.location)) outOfBoundsValue:self.outOfBoundsValue] autorelease];
+    } else {
+        data = [[[self class] alloc] initWithData:[NSMutableData dataWithLength:xr.length*yr.length*zr.length*sizeof(float)] pixelsWide:xr.length pixelsHigh:yr.length pixelsDeep:zr.length
+                            modelToVoxelTransform:NIAffineTransformConcat(self.modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.*xr.location, -1.*yr.location, -1.*zr.location)) outOfBoundsValue:self.outOfBoundsValue];
+    }
+    NIVolumeDataInlineBuffer dib; [data acquireInlineBuffer:&dib];
+    for (NSUInteger z = 0; z < zr.length; ++z)
+        for (NSUInteger y = 0; y < yr.length; ++y)
+            [self getFloatRun:(float *)&dib.floatBytes[NIVolumeDataUncheckedIndexAtCoordinate(&dib, 0,y,z)] atPixelCoordinateX:xr.location y:yr.location+y z:zr.location+z length:xr.length];
+
+    if (_brickSize) {
+        return [[data autorelease] volumeDataWithBrickSize:_brickSize];
+    } else if (_borderWidth) {
+        return [[data autorelease] volumeDataWithBorderWidth:_borderWidth];
+    }
+    return [data autorelease];
+}
+
+- (NIVolumeData *)volumeDataWithReversedAxesX:(BOOL)reverseX y:(BOOL)reverseY z:(BOOL)reverseZ
+{
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (reverseX == NO && reverseY == NO && reverseZ == NO) {
+        return self;
+    }
+
+    // voxel x of the reversed volume is voxel pixelsWide-1-x of the receiver
+    NIAffineTransform reversingTransform = NIAffineTransformMakeScale(reverseX ? -1 : 1, reverseY ? -1 : 1, reverseZ ? -1 : 1);
+    reversingTransform = NIAffineTransformConcat(reversingTransform, NIAffineTransformMakeTranslation(reverseX ? _pixelsWide - 1.0 : 0, reverseY ? _pixelsHigh - 1.0 : 0, reverseZ ? _pixelsDeep - 1.0 : 0));
+    NIAffineTransform modelToVoxelTransform = NIAffineTransformConcat(_modelToVoxelTransform, reversingTransform);
+
+    if (reverseX == NO && [self _canBeViewed]) {
+        return [self _viewWithOriginX:0 y:0 z:0 pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep reversedY:reverseY reversedZ:reverseZ modelToVoxelTransform:modelToVoxelTransform];
+    }
+
+    NSMutableData *reversedData = [NSMutableData dataWithLength:_pixelsWide * _pixelsHigh * _pixelsDeep * sizeof(float)];
+    float *reversedFloats = (float *)[reversedData mutableBytes];
+    const NSUInteger pixelsWide = _pixelsWide;
+    const NSUInteger pixelsHigh = _pixelsHigh;
+    const NSUInteger pixelsDeep = _pixelsDeep;
+    dispatch_apply(_pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+        for (NSUInteger y = 0; y < pixelsHigh; y++) {
+            float *row = reversedFloats + pixelsWide*(y + pixelsHigh*z);
+            [self getFloatRun:row atPixelCoordinateX:0 y:reverseY ? pixelsHigh - 1 - y : y z:reverseZ ? pixelsDeep - 1 - z : z length:pixelsWide];
+            if (reverseX) {
+                vDSP_vrvrs(row, 1, pixelsWide);
+            }
+        }
+    });
+
+    NIVolumeData *reversedVolumeData = [[[[self class] alloc] initWithData:reversedData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                                     modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    if (_brickSize) {
+        return [reversedVolumeData volumeDataWithBrickSize:_brickSize];
+    } else if (_borderWidth) {
+        return [reversedVolumeData volumeDataWithBorderWidth:_borderWidth];
+    } else if (_compressedBrickSize) {
+        return [reversedVolumeData volumeDataWithCompressedBrickSize:_compressedBrickSize];
+    }
+    return reversedVolumeData;
+}
+
+- (BOOL)_canBeViewed
+{
+    return _curved == NO && _brickSize == 0 && _borderWidth == 0 && _sampleData == nil && _compressedBrickSize == 0;
+}
+
+- (NIVolumeData *)_viewWithOriginX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                          reversedY:(BOOL)reversedY reversedZ:(BOOL)reversedZ modelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform
+{
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NSData *viewedData = _viewedFloatData ? _viewedFloatData : _floatData;
+
+    [self acquireInlineBuffer:&inlineBuffer];
+    // the offset of the view's voxel (0, 0, 0), which is the last row or slice of the range if that axis is reversed
+    NSInteger offset = (inlineBuffer.floatBytes - (const float *)[viewedData bytes]) +
+        NIVolumeDataUncheckedIndexAtCoordinate(&inlineBuffer, x, reversedY ? y + pixelsHigh - 1 : y, reversedZ ? z + pixelsDeep - 1 : z);
+
+    return [[[[self class] alloc] initWithViewedData:viewedData offset:offset rowStride:reversedY ? -inlineBuffer.rowStride : inlineBuffer.rowStride
+                                         sliceStride:reversedZ ? -inlineBuffer.sliceStride : inlineBuffer.sliceStride pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                               modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+}
+
+- (CGFloat)floatAtPixelCoordinateX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z
+{
+    NIVolumeDataInlineBuffer inlineBuffer;
+    float value;
+
+    if (_compressedBrickSize) {
+        return [self getFloatRun:&value atPixelCoordinateX:x y:y z:z length:1] ? value : _outOfBoundsValue;
+    }
+
+    [self acquireInlineBuffer:&inlineBuffer];
+    return NIVolumeDataGetFloatAtPixelCoordinate(&inlineBuffer, x, y, z);
+}
+
+- (CGFloat)linearInterpolatedFloatAtModelVector:(NIVector)vector
+{
+    NIVolumeData *samplingVolumeData = [self _volumeDataForSamplingModelVector:vector];
+    NIVector volumeVector = [samplingVolumeData convertVolumeVectorFromModelVector:vector];
+    NIVolumeDataInlineBuffer inlineBuffer;
+
+    [samplingVolumeData acquireInlineBuffer:&inlineBuffer];
+    return NIVolumeDataLinearInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+}
+
+- (CGFloat)nearestNeighborInterpolatedFloatAtModelVector:(NIVector)vector
+{
+    NIVolumeData *samplingVolumeData = [self _volumeDataForSamplingModelVector:vector];
+    NIVector volumeVector = [samplingVolumeData convertVolumeVectorFromModelVector:vector];
+    NIVolumeDataInlineBuffer inlineBuffer;
+
+    [samplingVolumeData acquireInlineBuffer:&inlineBuffer];
+    return NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+}
+
+- (CGFloat)cubicInterpolatedFloatAtModelVector:(NIVector)vector
+{
+    NIVolumeData *samplingVolumeData = [self _volumeDataForSamplingModelVector:vector];
+    NIVector volumeVector = [samplingVolumeData convertVolumeVectorFromModelVector:vector];
+    NIVolumeDataInlineBuffer inlineBuffer;
+
+    [samplingVolumeData acquireInlineBuffer:&inlineBuffer];
+    return NIVolumeDataCubicInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+}
+
+- (CGFloat)cubicBSplineInterpolatedFloatAtModelVector:(NIVector)vector
+{
+    NIVector volumeVector = [self convertVolumeVectorFromModelVector:vector];
+    NIVolumeDataInlineBuffer inlineBuffer;
+
+    [self.cubicBSplineCoefficients acquireInlineBuffer:&inlineBuffer];
+    return NIVolumeDataCubicBSplineInterpolatedFloatAtVolumeCoordinate(&inlineBuffer, volumeVector.x, volumeVector.y, volumeVector.z);
+}
+
+- (instancetype)volumeDataWithModelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform
+{
+    NIVolumeData *volumeData;
+
+    if (_brickSize) {
+        volumeData = [[[[self class] alloc] initWithBrickedData:_brickedFloatData brickSize:_brickSize pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                          modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    } else if (_borderWidth) {
+        volumeData = [[[[self class] alloc] initWithPaddedData:_paddedFloatData borderWidth:_borderWidth pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                         modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    } else if (_compressedBrickSize) {
+        volumeData = [[[[self class] alloc] initWithCompressedBrickData:_compressedBrickData brickOffsets:_compressedBrickOffsets brickSize:_compressedBrickSize
+                                                              pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+        volumeData.brickCacheLimit = self.brickCacheLimit;
+    } else if (_sampleData) {
+        volumeData = [[[[self class] alloc] initWithSampleData:_sampleData sampleType:_sampleType rescaleSlope:_rescaleSlope rescaleIntercept:_rescaleIntercept
+                                                    pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    } else if (_viewedFloatData) {
+        volumeData = [[[[self class] alloc] initWithViewedData:_viewedFloatData offset:_viewOffset rowStride:_viewRowStride sliceStride:_viewSliceStride
+                                                    pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    } else {
+        volumeData = [[[[self class] alloc] initWithData:_floatData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
+                                   modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+        volumeData->_mappedFilePath = [_mappedFilePath copy];
+        volumeData->_floatDataIsMapped = _floatDataIsMapped;
+    }
+    [volumeData _copyIntensityStatisticsFromVolumeData:self];
+    return volumeData;
+}
+
+- (instancetype)volumeDataResampledWithModelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform interpolationMode:(NIInterpolationMode)interpolationsMode
+{
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (NIAffineTransformEqualToTransform(self.modelToVoxelTransform, modelToVoxelTransform)) {
+        return self;
+    }
+
+    NIAffineTransform oringinalVoxelToModelTransform = NIAffineTransformInvert(self.modelToVoxelTransform);
+    NIAffineTransform originalVoxelToNewVoxelTransform = NIAffineTransformConcat(oringinalVoxelToModelTransform, modelToVoxelTransform);
+
+    NIVector minCorner = NIVectorZero;
+    NIVector maxCorner = NIVectorZero;
+
+    NIVector corner1 = NIVectorApplyTransform(NIVectorMake(0,                   0,                   0), originalVoxelToNewVoxelTransform);
+    NIVector corner2 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, 0,                   0), originalVoxelToNewVoxelTransform);
+    NIVector corner3 = NIVectorApplyTransform(NIVectorMake(0,                   self.pixelsHigh - 1, 0), originalVoxelToNewVoxelTransform);
+    NIVector corner4 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, self.pixelsHigh - 1, 0), originalVoxelToNewVoxelTransform);
+    NIVector corner5 = NIVectorApplyTransform(NIVectorMake(0,                   0,                   self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
+    NIVector corner6 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, 0,                   self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
+    NIVector corner7 = NIVectorApplyTransform(NIVectorMake(0,                   self.pixelsHigh - 1, self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
+    NIVector corner8 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, self.pixelsHigh - 1, self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
+
+    minCorner.x = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.x, corner2.x), corner3.x), corner4.x), corner5.x), corner6.x), corner7.x), corner8.x);
+    minCorner.y = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.y, corner2.y), corner3.y), corner4.y), corner5.y), corner6.y), corner7.y), corner8.y);
+    minCorner.z = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.z, corner2.z), corner3.z), corner4.z), corner5.z), corner6.z), corner7.z), corner8.z);
+    maxCorner.x = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.x, corner2.x), corner3.x), corner4.x), corner5.x), corner6.x), corner7.x), corner8.x);
+    maxCorner.y = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.y, corner2.y), corner3.y), corner4.y), corner5.y), corner6.y), corner7.y), corner8.y);
+    maxCorner.z = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.z, corner2.z), corner3.z), corner4.z), corner5.z), corner6.z), corner7.z), corner8.z);
+
+#if CGFLOAT_IS_DOUBLE
+    minCorner.x = floor(minCorner.x + 0.05);
+    minCorner.y = floor(minCorner.y + 0.05);
+    minCorner.z = floor(minCorner.z + 0.05);
+    maxCorner.x = ceil(maxCorner.x - 0.05);
+    maxCorner.y = ceil(maxCorner.y - 0.05);
+    maxCorner.z = ceil(maxCorner.z - 0.05);
+#else
+    minCorner.x = floorf(minCorner.x + 0.05);
+    minCorner.y = floorf(minCorner.y + 0.05);
+    minCorner.z = floorf(minCorner.z + 0.05);
+    maxCorner.x = ceilf(maxCorner.x - 0.05);
+    maxCorner.y = ceilf(maxCorner.y - 0.05);
+    maxCorner.z = ceilf(maxCorner.z - 0.05);
+#endif
+
+    NSUInteger width = (NSUInteger)(maxCorner.x - minCorner.x) + 1;
+    NSUInteger height = (NSUInteger)(maxCorner.y - minCorner.y) + 1;
+    NSUInteger depth = (NSUInteger)(maxCorner.z - minCorner.z) + 1;
+
+    NIAffineTransform shiftedTransform = NIAffineTransformConcat(modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.0*(CGFloat)minCorner.x, -1.0*(CGFloat)minCorner.y, -1.0*(CGFloat)minCorner.z));
+
+    return [self volumeDataResampledWithModelToVoxelTransform:shiftedTransform pixelsWide:width pixelsHigh:height pixelsDeep:depth interpolationMode:interpolationsMode];
+}
+
+- (instancetype)volumeDataResampledWithModelToVoxelTransform:(NIAffineTransform)transform pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
+                                     interpolationMode:(NIInterpolationMode)interpolationsMode
+{
+    if (self.curved) {
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    if (self.rectilinear && NIAffineTransformIsRectilinear(transform) && NIVolumeDataResamplingTapCount(interpolationsMode)) {
+        return [self _volumeDataSeparablyResampledWithModelToVoxelTransform:transform pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep interpolationMode:interpolationsMode];
+    }
+
+    NIAffineTransform newVoxelToModelTransform = NIAffineTransformInvert(transform);
+
+    NIObliqueSliceGeneratorRequest *request = [[[NIObliqueSliceGeneratorRequest alloc] init] autorelease];
+
+    NIVector xBasis = NIVectorApplyTransformToDirectionalVector(NIVectorXBasis, newVoxelToModelTransform);
+    NIVector yBasis = NIVectorApplyTransformToDirectionalVector(NIVectorYBasis, newVoxelToModelTransform);
+    NIVector zBasis = NIVectorApplyTransformToDirectionalVector(NIVectorZBasis, newVoxelToModelTransform);
+
+    request.origin = NIVectorApplyTransform(NIVectorMake(0, 0, floor(((CGFloat)pixelsDeep) / 2.0)), newVoxelToModelTransform);
+    request.directionX = NIVectorNormalize(xBasis);
+    request.directionY = NIVectorNormalize(yBasis);
+    request.directionZ = NIVectorNormalize(zBasis);
+
+    request.pixelSpacingX = NIVectorLength(xBasis);
+    request.pixelSpacingY = NIVectorLength(yBasis);
+    request.pixelSpacingZ = NIVectorLength(zBasis);
+
+    request.pixelsWide = pixelsWide;
+    request.pixelsHigh = pixelsHigh;
+
+    if (pixelsDeep % 2) {
+        request.slabWidth = NIVectorLength(zBasis) * ((CGFloat)pixelsDeep - 1);
+    } else {
+        request.slabWidth = NIVectorLength(zBasis) * (CGFloat)pixelsDeep;
+    }
+
+    request.interpolationMode = interpolationsMode;
+
+    NIVolumeData *newVolumeData = [NIGenerator synchronousRequestVolume:request volumeData:self];
+
+    return [[[[self class] alloc] initWithData:[newVolumeData floatData] pixelsWide:newVolumeData.pixelsWide pixelsHigh:newVolumeData.pixelsHigh pixelsDeep:pixelsDeep
+                               modelToVoxelTransform:newVolumeData.modelToVoxelTransform outOfBoundsValue:newVolumeData.outOfBoundsValue] autorelease];
+}
+
+// axis aligned resampling is separable, so instead of interpolating every voxel in 3D the volume is resampled along x, then y, then z
+- (nullable NIVolumeData *)_volumeDataSeparablyResampledWithModelToVoxelTransform:(NIAffineTransform)transform pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh
+                                                                       pixelsDeep:(NSUInteger)pixelsDeep interpolationMode:(NIInterpolationMode)interpolationMode
+{
+    // the receiver itself is resampled, like the NIGenerator path for transforms that aren't rectilinear, so the result doesn't depend on which mip levels happen to be
+    // built and no levels are built for it
+    NIAffineTransform newVoxelToModelTransform = NIAffineTransformInvert(transform);
+    NIVolumeData *sourceVolumeData = self;
+    if (interpolationMode == NIInterpolationModeCubicBSpline) {
+        sourceVolumeData = sourceVolumeData.cubicBSplineCoefficients;
+    }
+
+    // both transforms only scale and translate, so each output axis maps to the same input axis
+    NIAffineTransform outputToInputTransform = NIAffineTransformConcat(newVoxelToModelTransform, sourceVolumeData.modelToVoxelTransform);
+    const NSUInteger inputWide = sourceVolumeData.pixelsWide;
+    const NSUInteger inputHigh = sourceVolumeData.pixelsHigh;
+    const NSUInteger inputDeep = sourceVolumeData.pixelsDeep;
+    const NSUInteger tapCount = NIVolumeDataResamplingTapCount(interpolationMode);
+    const float outOfBoundsValue = sourceVolumeData.outOfBoundsValue;
+
+    NSMutableData *tableData = [NSMutableData dataWithLength:(pixelsWide + pixelsHigh + pixelsDeep) * (sizeof(NSInteger) + tapCount*sizeof(float))];
+    NSInteger *xFirstIndexes = (NSInteger *)[tableData mutableBytes];
+    NSInteger *yFirstIndexes = xFirstIndexes + pixelsWide;
+    NSInteger *zFirstIndexes = yFirstIndexes + pixelsHigh;
+    float *xWeights = (float *)(zFirstIndexes + pixelsDeep);
+    float *yWeights = xWeights + pixelsWide*tapCount;
+    float *zWeights = yWeights + pixelsHigh*tapCount;
+    NIVolumeDataGetResamplingTaps(interpolationMode, outputToInputTransform.m11, outputToInputTransform.m41, pixelsWide, xFirstIndexes, xWeights);
+    NIVolumeDataGetResamplingTaps(interpolationMode, outputToInputTransform.m22, outputToInputTransform.m42, pixelsHigh, yFirstIndexes, yWeights);
+    NIVolumeDataGetResamplingTaps(interpolationMode, outputToInputTransform.m33, outputToInputTransform.m43, pixelsDeep, zFirstIndexes, zWeights);
+
+    NSMutableData *outputData = [NSMutableData dataWithLength:pixelsWide * pixelsHigh * pixelsDeep * sizeof(float)];
+    if (outputData == nil) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the resampled floats", __PRETTY_FUNCTION__];
+    }
+    float *outputFloats = (float *)[outputData mutableBytes];
+
+    // only the input voxels that some tap reads are resampled, the taps are shifted so that they index into these windows
+    NSRange xWindow;
+    NSRange yWindow;
+    NSRange zWindow;
+    if (NIVolumeDataGetResamplingWindow(xFirstIndexes, pixelsWide, tapCount, inputWide, &xWindow) == NO ||
+        NIVolumeDataGetResamplingWindow(yFirstIndexes, pixelsHigh, tapCount, inputHigh, &yWindow) == NO ||
+        NIVolumeDataGetResamplingWindow(zFirstIndexes, pixelsDeep, tapCount, inputDeep, &zWindow) == NO) {
+        vDSP_vfill(&outOfBoundsValue, outputFloats, 1, pixelsWide * pixelsHigh * pixelsDeep);
+    } else {
+        NSUInteger i;
+        for (i = 0; i < pixelsWide; i++) {
+            xFirstIndexes[i] -= xWindow.location;
+        }
+        for (i = 0; i < pixelsHigh; i++) {
+            yFirstIndexes[i] -= yWindow.location;
+        }
+        for (i = 0; i < pixelsDeep; i++) {
+            zFirstIndexes[i] -= zWindow.location;
+        }
+
+        // resample x and then y one input slice at a time, the slices resampled in x and y are kept for the z pass
+        const NSUInteger outputSliceLength = pixelsWide * pixelsHigh;
+        float *resampledSlices = malloc(outputSliceLength * zWindow.length * sizeof(float));
+        if (resampledSlices == NULL) {
+            [NSException raise:NSMallocException format:@"*** %s: could not allocate the resampled slices", __PRETTY_FUNCTION__];
+        }
+        __block volatile BOOL failed = NO; // exceptions can't be raised out of the dispatch_apply block
+
+        dispatch_apply(zWindow.length, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+            float *inputRow = malloc(xWindow.length * sizeof(float));
+            float *xResampledSlice = malloc(pixelsWide * yWindow.length * sizeof(float));
+            NSUInteger y;
+            if (inputRow == NULL || xResampledSlice == NULL) {
+                free(xResampledSlice);
+                free(inputRow);
+                failed = YES;
+                return;
+            }
+            for (y = 0; y < yWindow.length; y++) {
+                [sourceVolumeData getFloatRun:inputRow atPixelCoordinateX:xWindow.location y:yWindow.location + y z:zWindow.location + z length:xWindow.length];
+                NIVolumeDataResampleRun(inputRow, xWindow.length, xResampledSlice + y*pixelsWide, pixelsWide, xFirstIndexes, xWeights, tapCount, outOfBoundsValue);
+            }
+            for (y = 0; y < pixelsHigh; y++) {
+                NIVolumeDataResamplePlane(xResampledSlice, yWindow.length, pixelsWide, resampledSlices + z*outputSliceLength + y*pixelsWide, y, yFirstIndexes, yWeights, tapCount, outOfBoundsValue);
+            }
+            free(xResampledSlice);
+            free(inputRow);
+        });
+        if (failed) {
+            free(resampledSlices);
+            [NSException raise:NSMallocException format:@"*** %s: could not allocate the scratch rows", __PRETTY_FUNCTION__];
+        }
+
+        dispatch_apply(pixelsDeep, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t z) {
+            NIVolumeDataResamplePlane(resampledSlices, zWindow.length, outputSliceLength, outputFloats + z*outputSliceLength, z, zFirstIndexes, zWeights, tapCount, outOfBoundsValue);
+        });
+
+        free(resampledSlices);
+    }
+
+    return [[[[self class] alloc] initWithData:outputData pixelsWide:pixelsWide pixelsHigh:pixelsHigh pixelsDeep:pixelsDeep
+                         modelToVoxelTransform:transform outOfBoundsValue:_outOfBoundsValue] autorelease];
+}
+
+// compares the voxels one slice at a time, so that compressed volumes are compared without building their floatData
+- (BOOL)_hasEqualSlicesToVolumeData:(NIVolumeData *)otherVolumeData
+{
+    const NSUInteger pixelsWide = _pixelsWide;
+    float *sliceBuffer = malloc(_pixelsWide * _pixelsHigh * sizeof(float));
+    float *otherSliceBuffer = malloc(_pixelsWide * _pixelsHigh * sizeof(float));
+    __block BOOL isEqual = YES;
+    __block NSUInteger y;
+    NSUInteger z;
+
+    if (sliceBuffer == NULL || otherSliceBuffer == NULL) {
+        free(sliceBuffer);
+        free(otherSliceBuffer);
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the slice buffers", __PRETTY_FUNCTION__];
+    }
+
+    for (z = 0; z < _pixelsDeep && isEqual; z++) {
+        y = 0;
+        [otherVolumeData _enumerateRowsOfSliceAtIndex:z sliceBuffer:otherSliceBuffer usingBlock:^(const float *row) {
+            if (row != otherSliceBuffer + y*pixelsWide) { // flat rows are passed in place
+                memcpy(otherSliceBuffer + y*pixelsWide, row, pixelsWide * sizeof(float));
+            }
+            y++;
+        }];
+        y = 0;
+        [self _enumerateRowsOfSliceAtIndex:z sliceBuffer:sliceBuffer usingBlock:^(const float *row) {
+            isEqual = isEqual && memcmp(row, otherSliceBuffer + y*pixelsWide, pixelsWide * sizeof(float)) == 0;
+            y++;
+        }];
+    }
+
+    free(sliceBuffer);
+    free(otherSliceBuffer);
+    return isEqual;
+}
+
+- (BOOL)isEqual:(id)object
+{
+    BOOL isEqual = NO;
+    if ([object isKindOfClass:[NIVolumeData class]]) {
+        NIVolumeDataInlineBuffer inlineBuffer1;
+        NIVolumeDataInlineBuffer inlineBuffer2;
+        NIVolumeData *otherVolumeData = (NIVolumeData *)object;
+
+        if (_compressedBrickSize && _compressedBrickSize == otherVolumeData.compressedBrickSize) { // compression is deterministic, so the compressed bricks can be compared directly
+            return _outOfBoundsValue == otherVolumeData.outOfBoundsValue && _pixelsWide == otherVolumeData.pixelsWide && _pixelsHigh == otherVolumeData.pixelsHigh &&
+                   _pixelsDeep == otherVolumeData.pixelsDeep && NIAffineTransformEqualToTransform(_modelToVoxelTransform, otherVolumeData.modelToVoxelTransform) &&
+                   [_compressedBrickData isEqualToData:otherVolumeData->_compressedBrickData];
+        }
+        if (_compressedBrickSize || otherVolumeData.compressedBrickSize) { // compressed volumes don't have an inline buffer
+            return _outOfBoundsValue == otherVolumeData.outOfBoundsValue && _pixelsWide == otherVolumeData.pixelsWide && _pixelsHigh == otherVolumeData.pixelsHigh &&
+                   _pixelsDeep == otherVolumeData.pixelsDeep && NIAffineTransformEqualToTransform(_modelToVoxelTransform, otherVolumeData.modelToVoxelTransform) &&
+                   [self _hasEqualSlicesToVolumeData:otherVolumeData];
+        }
+
+        [self acquireInlineBuffer:&inlineBuffer1];
+        [otherVolumeData acquireInlineBuffer:&inlineBuffer2];
+
+        if (inlineBuffer1.outOfBoundsValue == inlineBuffer2.outOfBoundsValue &&
+            inlineBuffer1.pixelsWide == inlineBuffer2.pixelsWide &&
+            inlineBuffer1.pixelsHigh == inlineBuffer2.pixelsHigh &&
+            inlineBuffer1.pixelsDeep == inlineBuffer2.pixelsDeep &&
+            NIAffineTransformEqualToTransform(inlineBuffer1.modelToVoxelTransform, inlineBuffer2.modelToVoxelTransform)) {
+
+            if (inlineBuffer1.sampleBytes == inlineBuffer2.sampleBytes && inlineBuffer1.rowStride == inlineBuffer2.rowStride && inlineBuffer1.sliceStride == inlineBuffer2.sliceStride &&
+                inlineBuffer1.sampleType == inlineBuffer2.sampleType && inlineBuffer1.rescaleSlope == inlineBuffer2.rescaleSlope && inlineBuffer1.rescaleIntercept == inlineBuffer2.rescaleIntercept) {
+                return YES;
+            } else if (_sampleData && otherVolumeData->_sampleData && _sampleType == otherVolumeData.sampleType &&
+                       _rescaleSlope == otherVolumeData.rescaleSlope && _rescaleIntercept == otherVolumeData.rescaleIntercept) {
+                return memcmp(inlineBuffer1.sampleBytes, inlineBuffer2.sampleBytes, NIVolumeDataSampleSize(_sampleType) * _pixelsWide * _pixelsHigh * _pixelsDeep) == 0;
+            } else if (_brickSize != otherVolumeData.brickSize || _borderWidth != otherVolumeData.borderWidth || _sampleData || otherVolumeData->_sampleData ||
+                       _viewedFloatData || otherVolumeData->_viewedFloatData) {
+                return [self.floatData isEqualToData:otherVolumeData.floatData];
+            } else if (_borderWidth) { // the padding is filled with the outOfBoundsValue, so it can be compared too
+                return [_paddedFloatData isEqualToData:otherVolumeData->_paddedFloatData];
+            } else if (_brickSize) { // the padding of the last bricks is filled with the outOfBoundsValue, so it can be compared too
+                return memcmp(inlineBuffer1.floatBytes, inlineBuffer2.floatBytes, sizeof(float) * NIVolumeDataBrickedFloatCount(_pixelsWide, _pixelsHigh, _pixelsDeep, _brickSize)) == 0;
+            } else {
+                return memcmp(inlineBuffer1.floatBytes, inlineBuffer2.floatBytes, sizeof(float) * inlineBuffer1.pixelsWide * inlineBuffer1.pixelsHigh * inlineBuffer1.pixelsDeep) == 0;
+            }
+        }
+    }
+
+    return isEqual;
+}
+
+- (void)linearInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors
+{
+    [self _interpolateVolumeVectors:volumeVectors outputValues:outputValues numVectors:numVectors sampler:NIVolumeDataLinearInterpolateVolumeVectors];
+}
+
+- (void)nearestNeighborInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors
+{
+    [self _interpolateVolumeVectors:volumeVectors outputValues:outputValues numVectors:numVectors sampler:NIVolumeDataNearestNeighborInterpolateVolumeVectors];
+}
+
+- (void)cubicInterpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors
+{
+    [self _interpolateVolumeVectors:volumeVectors outputValues:outputValues numVectors:numVectors sampler:NIVolumeDataCubicInterpolateVolumeVectors];
+}
+
+// compressed volumes are sampled through the uncompressed volume that covers the vectors, with the vectors moved to its voxel space
+- (void)_interpolateVolumeVectors:(const NIVector *)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors
+                          sampler:(void (*)(NIVolumeDataInlineBuffer *, const NIVector *, float *, NSUInteger))sampler
+{
+    NIVolumeDataInlineBuffer inlineBuffer;
+    NIVector volumeMin = NIVectorMake(CGFLOAT_MAX, CGFLOAT_MAX, CGFLOAT_MAX);
+    NIVector volumeMax = NIVectorMake(-CGFLOAT_MAX, -CGFLOAT_MAX, -CGFLOAT_MAX);
+    NSUInteger i;
+
+    if (_compressedBrickSize == 0 || numVectors == 0) {
+        [self acquireInlineBuffer:&inlineBuffer];
+        sampler(&inlineBuffer, volumeVectors, outputValues, numVectors);
+        return;
+    }
+
+    for (i = 0; i < numVectors; i++) {
+        volumeMin = NIVectorMake(MIN(volumeMin.x, volumeVectors[i].x), MIN(volumeMin.y, volumeVectors[i].y), MIN(volumeMin.z, volumeVectors[i].z));
+        volumeMax = NIVectorMake(MAX(volumeMax.x, volumeVectors[i].x), MAX(volumeMax.y, volumeVectors[i].y), MAX(volumeMax.z, volumeVectors[i].z));
+    }
+    NIVolumeData *samplingVolumeData = [self volumeDataForSamplingFromVolumeVector:volumeMin toVolumeVector:volumeMax];
+    NIVector offset = NIVectorApplyTransform(NIVectorZero, NIAffineTransformConcat(NIAffineTransformInvert(_modelToVoxelTransform), samplingVolumeData.modelToVoxelTransform));
+
+    NIVector *samplingVolumeVectors = malloc(numVectors * sizeof(NIVector));
+    if (samplingVolumeVectors == NULL) {
+        [NSException raise:NSMallocException format:@"*** %s: could not allocate the sampling vectors", __PRETTY_FUNCTION__];
+    }
+    for (i = 0; i < numVectors; i++) {
+        samplingVolumeVectors[i] = NIVectorAdd(volumeVectors[i], offset);
+    }
+    [samplingVolumeData acquireInlineBuffer:&inlineBuffer];
+    sampler(&inlineBuffer, samplingVolumeVectors, outputValues, numVectors);
+    free(samplingVolumeVectors);
+}
+
+- (void)acquireInlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+{
+    if (_compressedBrickSize) { // the samplers need random access to every voxel, which would take a full decompressed copy
+        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a compressed volume, acquire the inline buffer of volumeDataForSamplingFromVolumeVector:toVolumeVector: instead", __PRETTY_FUNCTION__] userInfo:nil];
+    }
+
+    memset(inlineBuffer, 0, sizeof(NIVolumeDataInlineBuffer));
+    inlineBuffer->outOfBoundsValue = _outOfBoundsValue;
+    inlineBuffer->pixelsWide = _pixelsWide;
+    inlineBuffer->pixelsHigh = _pixelsHigh;
+    inlineBuffer->pixelsDeep = _pixelsDeep;
+    inlineBuffer->modelToVoxelTransform = _modelToVoxelTransform;
+    if (_brickSize) {
+        inlineBuffer->floatBytes = (const float *)[_brickedFloatData bytes];
+        inlineBuffer->brickShift = NIVolumeDataBrickShift(_brickSize);
+        inlineBuffer->rowStride = ((_pixelsWide + _brickSize - 1) / _brickSize) * _brickSize * _brickSize * _brickSize;
+        inlineBuffer->sliceStride = inlineBuffer->rowStride * ((_pixelsHigh + _brickSize - 1) / _brickSize);
+    } else if (_borderWidth) {
+        inlineBuffer->borderWidth = _borderWidth;
+        inlineBuffer->rowStride = _pixelsWide + 2*_borderWidth;
+        inlineBuffer->sliceStride = inlineBuffer->rowStride * (_pixelsHigh + 2*_borderWidth);
+        inlineBuffer->floatBytes = (const float *)[_paddedFloatData bytes] + (_borderWidth + inlineBuffer->rowStride*_borderWidth + inlineBuffer->sliceStride*_borderWidth);
+    } else if (_viewedFloatData) { // the view reads its parent's floats in place
+        inlineBuffer->floatBytes = (const float *)[_viewedFloatData bytes] + _viewOffset;
+        inlineBuffer->rowStride = _viewRowStride;
+        inlineBuffer->sliceStride = _viewSliceStride;
+    } else if (_sampleData) { // floatBytes stays NULL, the samples are read through sampleBytes
+        inlineBuffer->sampleBytes = [_sampleData bytes];
+        inlineBuffer->sampleType = _sampleType;
+        inlineBuffer->rescaleSlope = _rescaleSlope;
+        inlineBuffer->rescaleIntercept = _rescaleIntercept;
+        inlineBuffer->rowStride = _pixelsWide;
+        inlineBuffer->sliceStride = _pixelsWide * _pixelsHigh;
+        return;
+    } else {
+        inlineBuffer->floatBytes = (const float *)[_floatData bytes];
+        inlineBuffer->rowStride = _pixelsWide;
+        inlineBuffer->sliceStride = _pixelsWide * _pixelsHigh;
+    }
+    inlineBuffer->sampleBytes = inlineBuffer->floatBytes;
+    inlineBuffer->sampleType = NIVolumeDataSampleTypeFloat32;
+    inlineBuffer->rescaleSlope = 1;
+}
+
+- (NSString *)description
+{
+    NSMutableString *description = [NSMutableString string];
+    [description appendString:NSStringFromClass([self class])];
+    [description appendString:[NSString stringWithFormat: @"\nPixels Wide: %lld\n", (long long)_pixelsWide]];
+    [description appendString:[NSString stringWithFormat: @"Pixels High: %lld\n", (long long)_pixelsHigh]];
+    [description appendString:[NSString stringWithFormat: @"Pixels Deep: %lld\n", (long long)_pixelsDeep]];
+    [description appendString:[NSString stringWithFormat: @"Out of Bounds Value: %f\n", _outOfBoundsValue]];
+    if (_brickSize) {
+        [description appendString:[NSString stringWithFormat: @"Brick Size: %lld\n", (long long)_brickSize]];
+    }
+    if (_borderWidth) {
+        [description appendString:[NSString stringWithFormat: @"Border Width: %lld\n", (long long)_borderWidth]];
+    }
+    if (_mappedFilePath) {
+        [description appendString:[NSString stringWithFormat: @"Mapped File: %@\n", _mappedFilePath]];
+    }
+    if (_compressedBrickSize) {
+        [description appendString:[NSString stringWithFormat: @"Compressed Brick Size: %lld (%lld bytes)\n", (long long)_compressedBrickSize, (long long)[_compressedBrickData length]]];
+    }
+    if (_viewedFloatData) {
+        [description appendString:[NSString stringWithFormat: @"View Offset: %lld (Row Stride: %lld, Slice Stride: %lld)\n", (long long)_viewOffset, (long long)_viewRowStride, (long long)_viewSliceStride]];
+    }
+    if (_sampleData) {
+        static NSString * const sampleTypeNames[] = {@"Float32", @"Int16", @"UInt16", @"UInt8"};
+        [description appendString:[NSString stringWithFormat: @"Sample Type: %@ (Slope: %f, Intercept: %f)\n", sampleTypeNames[_sampleType], _rescaleSlope, _rescaleIntercept]];
+    }
+    [description appendString:[NSString stringWithFormat: @"Volume Transform:\n%@\n", NSStringFromNIAffineTransform(_modelToVoxelTransform)]];
+
+    return description;
+}
+
+@end
+
+// The batch samplers work on 4 vectors at a time using the GCC/Clang vector extensions. The voxel loads are still done one at a time,
+// but the floors, bounds checks, indexes and weights are computed for all 4 lanes at once. A group where any lane needs bounds checking,
+// and any vectors left over at the end, go through the scalar inline functions, which is also what is used if the vector extensions are not available.
+#if defined(__GNUC__)
+#define NI_VOLUME_DATA_VECTOR_SAMPLING 1
+typedef double NIVolumeDataDouble4 __attribute__((vector_size(4 * sizeof(double))));
+typedef long long NIVolumeDataInteger4 __attribute__((vector_size(4 * sizeof(long long))));
+
+CF_INLINE NIVolumeDataDouble4 NIVolumeDataGather4(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInteger4 indexes)
+{
+    if (inlineBuffer->sampleType != NIVolumeDataSampleTypeFloat32) {
+        NIVolumeDataDouble4 values = {NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[0]), NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[1]),
+                                      NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[2]), NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[3])};
+        return values;
     }
-    NIVolumeDataInlineBuffer sib, dib; [self acquireInlineBuffer:&sib]; [data acquireInlineBuffer:&dib];
-    for (NSUInteger z = 0; z < zr.length; ++z)
-        for (NSUInteger y = 0; y < yr.length; ++y)
-            memcpy((void *)&dib.floatBytes[NIVolumeDataUncheckedIndexAtCoordinate(&dib, 0,y,z)], &sib.floatBytes[NIVolumeDataUncheckedIndexAtCoordinate(&sib, xr.location,yr.location+y,zr.location+z)], xr.length*sizeof(float));
-    
-    return [data autorelease];
+    const float *floatBytes = inlineBuffer->floatBytes;
+    NIVolumeDataDouble4 values = {floatBytes[indexes[0]], floatBytes[indexes[1]], floatBytes[indexes[2]], floatBytes[indexes[3]]};
+    return values;
 }
 
-- (CGFloat)floatAtPixelCoordinateX:(NSUInteger)x y:(NSUInteger)y z:(NSUInteger)z
+CF_INLINE NIVolumeDataDouble4 NIVolumeDataFloor4(NIVolumeDataDouble4 values)
 {
-    NIVolumeDataInlineBuffer inlineBuffer;
-
-    [self acquireInlineBuffer:&inlineBuffer];
-    return NIVolumeDataGetFloatAtPixelCoordinate(&inlineBuffer, x, y, z);
+    NIVolumeDataDouble4 truncated = __builtin_convertvector(__builtin_convertvector(values, NIVolumeDataInteger4), NIVolumeDataDouble4);
+    return truncated + __builtin_convertvector(truncated > values, NIVolumeDataDouble4); // comparisons are -1 when true
 }
 
-- (CGFloat)linearInterpolatedFloatAtModelVector:(NIVector)vector
+CF_INLINE NIVolumeDataInteger4 NIVolumeDataIndexOffsetsForX4(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInteger4 x)
 {
-    NIVector volumeVector = [self convertVolumeVectorFromModelVector:vector];
-    NIVolumeDataInlineBuffer inlineBuffer;
-
-    [self acquireInlineBuffer:&inlineBuffer];
-    return NIVolumeDataLinearInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return ((x >> shift) << (3*shift)) + (x & (((long long)1 << shift) - 1));
 }
 
-- (CGFloat)nearestNeighborInterpolatedFloatAtModelVector:(NIVector)vector
+CF_INLINE NIVolumeDataInteger4 NIVolumeDataIndexOffsetsForY4(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInteger4 y)
 {
-    NIVector volumeVector = [self convertVolumeVectorFromModelVector:vector];
-    NIVolumeDataInlineBuffer inlineBuffer;
-
-    [self acquireInlineBuffer:&inlineBuffer];
-    return NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return (y >> shift) * (long long)inlineBuffer->rowStride + ((y & (((long long)1 << shift) - 1)) << shift);
 }
 
-- (CGFloat)cubicInterpolatedFloatAtModelVector:(NIVector)vector
+CF_INLINE NIVolumeDataInteger4 NIVolumeDataIndexOffsetsForZ4(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInteger4 z)
 {
-    NIVector volumeVector = [self convertVolumeVectorFromModelVector:vector];
-    NIVolumeDataInlineBuffer inlineBuffer;
+    const NSUInteger shift = inlineBuffer->brickShift;
+    return (z >> shift) * (long long)inlineBuffer->sliceStride + ((z & (((long long)1 << shift) - 1)) << (2*shift));
+}
 
-    [self acquireInlineBuffer:&inlineBuffer];
-    return NIVolumeDataCubicInterpolatedFloatAtVolumeVector(&inlineBuffer, volumeVector);
+// returns true if all 4 lanes can be converted to integers, the conversion is undefined for NaNs and for values that don't fit
+CF_INLINE bool NIVolumeDataAllConvertible4(NIVolumeDataDouble4 x, NIVolumeDataDouble4 y, NIVolumeDataDouble4 z)
+{
+    const double limit = (double)(1 << 30); // far larger than any volume, so that adding a few voxels to an index can't overflow
+    NIVolumeDataInteger4 convertible = (x > -limit) & (x < limit) & (y > -limit) & (y < limit) & (z > -limit) & (z < limit); // comparisons with NaN are false
+    return (convertible[0] & convertible[1] & convertible[2] & convertible[3]) != 0;
 }
 
-- (instancetype)volumeDataWithModelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform
+// returns true if all 4 lanes are at least lowMargin voxels from the low edges and highMargin voxels from the high edges of the volume, the padding border counts as inside
+CF_INLINE bool NIVolumeDataAllInside4(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInteger4 x, NIVolumeDataInteger4 y, NIVolumeDataInteger4 z, long long lowMargin, long long highMargin)
 {
-    return [[[[self class] alloc] initWithData:_floatData pixelsWide:_pixelsWide pixelsHigh:_pixelsHigh pixelsDeep:_pixelsDeep
-                         modelToVoxelTransform:modelToVoxelTransform outOfBoundsValue:_outOfBoundsValue] autorelease];
+    lowMargin -= (long long)inlineBuffer->borderWidth;
+    highMargin -= (long long)inlineBuffer->borderWidth;
+    NIVolumeDataInteger4 inside = (x >= lowMargin) & (y >= lowMargin) & (z >= lowMargin) &
+                                  (x < (long long)inlineBuffer->pixelsWide - highMargin) &
+                                  (y < (long long)inlineBuffer->pixelsHigh - highMargin) &
+                                  (z < (long long)inlineBuffer->pixelsDeep - highMargin);
+    return (inside[0] & inside[1] & inside[2] & inside[3]) != 0;
 }
+#endif
 
-- (instancetype)volumeDataResampledWithModelToVoxelTransform:(NIAffineTransform)modelToVoxelTransform interpolationMode:(NIInterpolationMode)interpolationsMode
+void NIVolumeDataLinearInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors)
 {
-    if (self.curved) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
-    }
+    NSUInteger i = 0;
+    NSUInteger j;
 
-    if (NIAffineTransformEqualToTransform(self.modelToVoxelTransform, modelToVoxelTransform)) {
-        return self;
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numVectors);
+        return;
     }
 
-    NIAffineTransform oringinalVoxelToModelTransform = NIAffineTransformInvert(self.modelToVoxelTransform);
-    NIAffineTransform originalVoxelToNewVoxelTransform = NIAffineTransformConcat(oringinalVoxelToModelTransform, modelToVoxelTransform);
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    for (; i + 4 <= numVectors; i += 4) {
+        const NIVector *vectors = volumeVectors + i;
+        NIVolumeDataDouble4 x = {vectors[0].x, vectors[1].x, vectors[2].x, vectors[3].x};
+        NIVolumeDataDouble4 y = {vectors[0].y, vectors[1].y, vectors[2].y, vectors[3].y};
+        NIVolumeDataDouble4 z = {vectors[0].z, vectors[1].z, vectors[2].z, vectors[3].z};
 
-    NIVector minCorner = NIVectorZero;
-    NIVector maxCorner = NIVectorZero;
+        if (NIVolumeDataAllConvertible4(x, y, z) == false) {
+            for (j = 0; j < 4; j++) {
+                outputValues[i + j] = NIVolumeDataLinearInterpolatedFloatAtVolumeVector(inlineBuffer, vectors[j]);
+            }
+            continue;
+        }
 
-    NIVector corner1 = NIVectorApplyTransform(NIVectorMake(0,                   0,                   0), originalVoxelToNewVoxelTransform);
-    NIVector corner2 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, 0,                   0), originalVoxelToNewVoxelTransform);
-    NIVector corner3 = NIVectorApplyTransform(NIVectorMake(0,                   self.pixelsHigh - 1, 0), originalVoxelToNewVoxelTransform);
-    NIVector corner4 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, self.pixelsHigh - 1, 0), originalVoxelToNewVoxelTransform);
-    NIVector corner5 = NIVectorApplyTransform(NIVectorMake(0,                   0,                   self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
-    NIVector corner6 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, 0,                   self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
-    NIVector corner7 = NIVectorApplyTransform(NIVectorMake(0,                   self.pixelsHigh - 1, self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
-    NIVector corner8 = NIVectorApplyTransform(NIVectorMake(self.pixelsWide - 1, self.pixelsHigh - 1, self.pixelsDeep - 1), originalVoxelToNewVoxelTransform);
+        NIVolumeDataDouble4 xFloor = NIVolumeDataFloor4(x);
+        NIVolumeDataDouble4 yFloor = NIVolumeDataFloor4(y);
+        NIVolumeDataDouble4 zFloor = NIVolumeDataFloor4(z);
+        NIVolumeDataInteger4 xIndex = __builtin_convertvector(xFloor, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 yIndex = __builtin_convertvector(yFloor, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 zIndex = __builtin_convertvector(zFloor, NIVolumeDataInteger4);
 
-    minCorner.x = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.x, corner2.x), corner3.x), corner4.x), corner5.x), corner6.x), corner7.x), corner8.x);
-    minCorner.y = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.y, corner2.y), corner3.y), corner4.y), corner5.y), corner6.y), corner7.y), corner8.y);
-    minCorner.z = MIN(MIN(MIN(MIN(MIN(MIN(MIN(corner1.z, corner2.z), corner3.z), corner4.z), corner5.z), corner6.z), corner7.z), corner8.z);
-    maxCorner.x = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.x, corner2.x), corner3.x), corner4.x), corner5.x), corner6.x), corner7.x), corner8.x);
-    maxCorner.y = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.y, corner2.y), corner3.y), corner4.y), corner5.y), corner6.y), corner7.y), corner8.y);
-    maxCorner.z = MAX(MAX(MAX(MAX(MAX(MAX(MAX(corner1.z, corner2.z), corner3.z), corner4.z), corner5.z), corner6.z), corner7.z), corner8.z);
+        if (NIVolumeDataAllInside4(inlineBuffer, xIndex, yIndex, zIndex, 0, 1) == false) {
+            for (j = 0; j < 4; j++) {
+                outputValues[i + j] = NIVolumeDataLinearInterpolatedFloatAtVolumeVector(inlineBuffer, vectors[j]);
+            }
+            continue;
+        }
 
-#if CGFLOAT_IS_DOUBLE
-    minCorner.x = floor(minCorner.x + 0.05);
-    minCorner.y = floor(minCorner.y + 0.05);
-    minCorner.z = floor(minCorner.z + 0.05);
-    maxCorner.x = ceil(maxCorner.x - 0.05);
-    maxCorner.y = ceil(maxCorner.y - 0.05);
-    maxCorner.z = ceil(maxCorner.z - 0.05);
-#else
-    minCorner.x = floorf(minCorner.x + 0.05);
-    minCorner.y = floorf(minCorner.y + 0.05);
-    minCorner.z = floorf(minCorner.z + 0.05);
-    maxCorner.x = ceilf(maxCorner.x - 0.05);
-    maxCorner.y = ceilf(maxCorner.y - 0.05);
-    maxCorner.z = ceilf(maxCorner.z - 0.05);
+        NIVolumeDataInteger4 x0 = NIVolumeDataIndexOffsetsForX4(inlineBuffer, xIndex);
+        NIVolumeDataInteger4 x1 = NIVolumeDataIndexOffsetsForX4(inlineBuffer, xIndex + 1);
+        NIVolumeDataInteger4 y0 = NIVolumeDataIndexOffsetsForY4(inlineBuffer, yIndex);
+        NIVolumeDataInteger4 y1 = NIVolumeDataIndexOffsetsForY4(inlineBuffer, yIndex + 1);
+        NIVolumeDataInteger4 z0 = NIVolumeDataIndexOffsetsForZ4(inlineBuffer, zIndex);
+        NIVolumeDataInteger4 z1 = NIVolumeDataIndexOffsetsForZ4(inlineBuffer, zIndex + 1);
+
+        const NIVolumeDataDouble4 dx1 = x - xFloor;
+        const NIVolumeDataDouble4 dy1 = y - yFloor;
+        const NIVolumeDataDouble4 dz1 = z - zFloor;
+        const NIVolumeDataDouble4 dx0 = 1.0 - dx1;
+        const NIVolumeDataDouble4 dy0 = 1.0 - dy1;
+        const NIVolumeDataDouble4 dz0 = 1.0 - dz1;
+
+        NIVolumeDataDouble4 values = (dz0*(dy0*(dx0*NIVolumeDataGather4(inlineBuffer, x0+y0+z0) + dx1*NIVolumeDataGather4(inlineBuffer, x1+y0+z0)) +
+                                           dy1*(dx0*NIVolumeDataGather4(inlineBuffer, x0+y1+z0) + dx1*NIVolumeDataGather4(inlineBuffer, x1+y1+z0)))) +
+                                     (dz1*(dy0*(dx0*NIVolumeDataGather4(inlineBuffer, x0+y0+z1) + dx1*NIVolumeDataGather4(inlineBuffer, x1+y0+z1)) +
+                                           dy1*(dx0*NIVolumeDataGather4(inlineBuffer, x0+y1+z1) + dx1*NIVolumeDataGather4(inlineBuffer, x1+y1+z1))));
+
+        for (j = 0; j < 4; j++) {
+            outputValues[i + j] = values[j];
+        }
+    }
 #endif
 
-    NSUInteger width = (NSUInteger)(maxCorner.x - minCorner.x) + 1;
-    NSUInteger height = (NSUInteger)(maxCorner.y - minCorner.y) + 1;
-    NSUInteger depth = (NSUInteger)(maxCorner.z - minCorner.z) + 1;
-
-    NIAffineTransform shiftedTransform = NIAffineTransformConcat(modelToVoxelTransform, NIAffineTransformMakeTranslation(-1.0*(CGFloat)minCorner.x, -1.0*(CGFloat)minCorner.y, -1.0*(CGFloat)minCorner.z));
-
-    return [self volumeDataResampledWithModelToVoxelTransform:shiftedTransform pixelsWide:width pixelsHigh:height pixelsDeep:depth interpolationMode:interpolationsMode];
+    for (; i < numVectors; i++) {
+        outputValues[i] = NIVolumeDataLinearInterpolatedFloatAtVolumeVector(inlineBuffer, volumeVectors[i]);
+    }
 }
 
-- (instancetype)volumeDataResampledWithModelToVoxelTransform:(NIAffineTransform)transform pixelsWide:(NSUInteger)pixelsWide pixelsHigh:(NSUInteger)pixelsHigh pixelsDeep:(NSUInteger)pixelsDeep
-                                     interpolationMode:(NIInterpolationMode)interpolationsMode
+void NIVolumeDataNearestNeighborInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors)
 {
-    if (self.curved) {
-        @throw [NSException exceptionWithName:NSInvalidArgumentException reason:[NSString stringWithFormat:@"*** %s: can not be called on a curved volume", __PRETTY_FUNCTION__] userInfo:nil];
+    NSUInteger i = 0;
+    NSUInteger j;
+
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numVectors);
+        return;
     }
 
-    NIAffineTransform newVoxelToModelTransform = NIAffineTransformInvert(transform);
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    const float outOfBoundsValue = inlineBuffer->outOfBoundsValue;
 
-    NIObliqueSliceGeneratorRequest *request = [[[NIObliqueSliceGeneratorRequest alloc] init] autorelease];
+    for (; i + 4 <= numVectors; i += 4) {
+        const NIVector *vectors = volumeVectors + i;
+        NIVolumeDataDouble4 x = {vectors[0].x, vectors[1].x, vectors[2].x, vectors[3].x};
+        NIVolumeDataDouble4 y = {vectors[0].y, vectors[1].y, vectors[2].y, vectors[3].y};
+        NIVolumeDataDouble4 z = {vectors[0].z, vectors[1].z, vectors[2].z, vectors[3].z};
 
-    NIVector xBasis = NIVectorApplyTransformToDirectionalVector(NIVectorXBasis, newVoxelToModelTransform);
-    NIVector yBasis = NIVectorApplyTransformToDirectionalVector(NIVectorYBasis, newVoxelToModelTransform);
-    NIVector zBasis = NIVectorApplyTransformToDirectionalVector(NIVectorZBasis, newVoxelToModelTransform);
+        if (NIVolumeDataAllConvertible4(x, y, z) == false) {
+            for (j = 0; j < 4; j++) {
+                outputValues[i + j] = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(inlineBuffer, vectors[j]);
+            }
+            continue;
+        }
 
-    request.origin = NIVectorApplyTransform(NIVectorMake(0, 0, floor(((CGFloat)pixelsDeep) / 2.0)), newVoxelToModelTransform);
-    request.directionX = NIVectorNormalize(xBasis);
-    request.directionY = NIVectorNormalize(yBasis);
-    request.directionZ = NIVectorNormalize(zBasis);
+        // round halfway cases away from zero, like round()
+        NIVolumeDataInteger4 xIndex = __builtin_convertvector(x, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 yIndex = __builtin_convertvector(y, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 zIndex = __builtin_convertvector(z, NIVolumeDataInteger4);
+        NIVolumeDataDouble4 xFraction = x - __builtin_convertvector(xIndex, NIVolumeDataDouble4);
+        NIVolumeDataDouble4 yFraction = y - __builtin_convertvector(yIndex, NIVolumeDataDouble4);
+        NIVolumeDataDouble4 zFraction = z - __builtin_convertvector(zIndex, NIVolumeDataDouble4);
+        xIndex = xIndex - (NIVolumeDataInteger4)(xFraction >= 0.5) + (NIVolumeDataInteger4)(xFraction <= -0.5);
+        yIndex = yIndex - (NIVolumeDataInteger4)(yFraction >= 0.5) + (NIVolumeDataInteger4)(yFraction <= -0.5);
+        zIndex = zIndex - (NIVolumeDataInteger4)(zFraction >= 0.5) + (NIVolumeDataInteger4)(zFraction <= -0.5);
+
+        NIVolumeDataInteger4 inside = (xIndex >= 0) & (yIndex >= 0) & (zIndex >= 0) &
+                                      (xIndex < (long long)inlineBuffer->pixelsWide) &
+                                      (yIndex < (long long)inlineBuffer->pixelsHigh) &
+                                      (zIndex < (long long)inlineBuffer->pixelsDeep);
+        NIVolumeDataInteger4 indexes = (NIVolumeDataIndexOffsetsForX4(inlineBuffer, xIndex) +
+                                        NIVolumeDataIndexOffsetsForY4(inlineBuffer, yIndex) +
+                                        NIVolumeDataIndexOffsetsForZ4(inlineBuffer, zIndex)) & inside;
+
+        for (j = 0; j < 4; j++) {
+            outputValues[i + j] = inside[j] ? NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[j]) : outOfBoundsValue;
+        }
+    }
+#endif
 
-    request.pixelSpacingX = NIVectorLength(xBasis);
-    request.pixelSpacingY = NIVectorLength(yBasis);
-    request.pixelSpacingZ = NIVectorLength(zBasis);
+    for (; i < numVectors; i++) {
+        outputValues[i] = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeVector(inlineBuffer, volumeVectors[i]);
+    }
+}
 
-    request.pixelsWide = pixelsWide;
-    request.pixelsHigh = pixelsHigh;
+void NIVolumeDataCubicInterpolateVolumeVectors(NIVolumeDataInlineBuffer *inlineBuffer, const NIVector *volumeVectors, float *outputValues, NSUInteger numVectors)
+{
+    NSUInteger i = 0;
+    NSUInteger j;
 
-    if (pixelsDeep % 2) {
-        request.slabWidth = NIVectorLength(zBasis) * ((CGFloat)pixelsDeep - 1);
-    } else {
-        request.slabWidth = NIVectorLength(zBasis) * (CGFloat)pixelsDeep;
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numVectors);
+        return;
     }
 
-    request.interpolationMode = interpolationsMode;
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    for (; i + 4 <= numVectors; i += 4) {
+        const NIVector *vectors = volumeVectors + i;
+        NIVolumeDataDouble4 x = {vectors[0].x, vectors[1].x, vectors[2].x, vectors[3].x};
+        NIVolumeDataDouble4 y = {vectors[0].y, vectors[1].y, vectors[2].y, vectors[3].y};
+        NIVolumeDataDouble4 z = {vectors[0].z, vectors[1].z, vectors[2].z, vectors[3].z};
 
-    NIVolumeData *newVolumeData = [NIGenerator synchronousRequestVolume:request volumeData:self];
+        if (NIVolumeDataAllConvertible4(x, y, z) == false) {
+            for (j = 0; j < 4; j++) {
+                outputValues[i + j] = NIVolumeDataCubicInterpolatedFloatAtVolumeVector(inlineBuffer, vectors[j]);
+            }
+            continue;
+        }
 
-    return [[[[self class] alloc] initWithData:[newVolumeData floatData] pixelsWide:newVolumeData.pixelsWide pixelsHigh:newVolumeData.pixelsHigh pixelsDeep:pixelsDeep
-                               modelToVoxelTransform:newVolumeData.modelToVoxelTransform outOfBoundsValue:newVolumeData.outOfBoundsValue] autorelease];
+        NIVolumeDataDouble4 xFloor = NIVolumeDataFloor4(x);
+        NIVolumeDataDouble4 yFloor = NIVolumeDataFloor4(y);
+        NIVolumeDataDouble4 zFloor = NIVolumeDataFloor4(z);
+        NIVolumeDataInteger4 xIndex = __builtin_convertvector(xFloor, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 yIndex = __builtin_convertvector(yFloor, NIVolumeDataInteger4);
+        NIVolumeDataInteger4 zIndex = __builtin_convertvector(zFloor, NIVolumeDataInteger4);
+
+        if (NIVolumeDataAllInside4(inlineBuffer, xIndex, yIndex, zIndex, 1, 2) == false) {
+            for (j = 0; j < 4; j++) {
+                outputValues[i + j] = NIVolumeDataCubicInterpolatedFloatAtVolumeVector(inlineBuffer, vectors[j]);
+            }
+            continue;
+        }
+
+        const NIVolumeDataDouble4 dx = x - xFloor;
+        const NIVolumeDataDouble4 dy = y - yFloor;
+        const NIVolumeDataDouble4 dz = z - zFloor;
+        const NIVolumeDataDouble4 dxx = dx*dx;
+        const NIVolumeDataDouble4 dxxx = dxx*dx;
+        const NIVolumeDataDouble4 dyy = dy*dy;
+        const NIVolumeDataDouble4 dyyy = dyy*dy;
+        const NIVolumeDataDouble4 dzz = dz*dz;
+        const NIVolumeDataDouble4 dzzz = dzz*dz;
+
+        const NIVolumeDataDouble4 wx[4] = {0.5 * (    - dx + 2.0*dxx -       dxxx),
+                                           0.5 * (2.0      - 5.0*dxx + 3.0 * dxxx),
+                                           0.5 * (      dx + 4.0*dxx - 3.0 * dxxx),
+                                           0.5 * (         -     dxx +       dxxx)};
+        const NIVolumeDataDouble4 wy[4] = {0.5 * (    - dy + 2.0*dyy -       dyyy),
+                                           0.5 * (2.0      - 5.0*dyy + 3.0 * dyyy),
+                                           0.5 * (      dy + 4.0*dyy - 3.0 * dyyy),
+                                           0.5 * (         -     dyy +       dyyy)};
+        const NIVolumeDataDouble4 wz[4] = {0.5 * (    - dz + 2.0*dzz -       dzzz),
+                                           0.5 * (2.0      - 5.0*dzz + 3.0 * dzzz),
+                                           0.5 * (      dz + 4.0*dzz - 3.0 * dzzz),
+                                           0.5 * (         -     dzz +       dzzz)};
+
+        NIVolumeDataInteger4 xOffsets[4];
+        NIVolumeDataInteger4 yOffsets[4];
+        NIVolumeDataInteger4 zOffsets[4];
+        int k;
+        int l;
+        for (k = 0; k < 4; k++) {
+            xOffsets[k] = NIVolumeDataIndexOffsetsForX4(inlineBuffer, xIndex + (k - 1));
+            yOffsets[k] = NIVolumeDataIndexOffsetsForY4(inlineBuffer, yIndex + (k - 1));
+            zOffsets[k] = NIVolumeDataIndexOffsetsForZ4(inlineBuffer, zIndex + (k - 1));
+        }
+
+        NIVolumeDataDouble4 values = {0, 0, 0, 0};
+        for (k = 0; k < 4; k++) {
+            NIVolumeDataDouble4 planeValues = {0, 0, 0, 0};
+            for (l = 0; l < 4; l++) {
+                NIVolumeDataInteger4 rowOffsets = yOffsets[l] + zOffsets[k];
+                planeValues += wy[l]*(wx[0] * NIVolumeDataGather4(inlineBuffer, xOffsets[0] + rowOffsets) + wx[1] * NIVolumeDataGather4(inlineBuffer, xOffsets[1] + rowOffsets) +
+                                      wx[2] * NIVolumeDataGather4(inlineBuffer, xOffsets[2] + rowOffsets) + wx[3] * NIVolumeDataGather4(inlineBuffer, xOffsets[3] + rowOffsets));
+            }
+            values += wz[k]*planeValues;
+        }
+
+        for (j = 0; j < 4; j++) {
+            outputValues[i + j] = values[j];
+        }
+    }
+#endif
+
+    for (; i < numVectors; i++) {
+        outputValues[i] = NIVolumeDataCubicInterpolatedFloatAtVolumeVector(inlineBuffer, volumeVectors[i]);
+    }
 }
 
-- (NSUInteger)tempBufferSizeForNumVectors:(NSUInteger)numVectors
+// The coordinate samplers take the x, y and z coordinates as separate float arrays, so twice as many lanes fit in a SIMD register
+// as with the NIVector (double) based samplers, and the coordinate arrays use half the memory bandwidth.
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+typedef float NIVolumeDataFloat8 __attribute__((vector_size(8 * sizeof(float))));
+typedef int NIVolumeDataInt8 __attribute__((vector_size(8 * sizeof(int))));
+typedef long long NIVolumeDataLong8 __attribute__((vector_size(8 * sizeof(long long))));
+
+CF_INLINE NIVolumeDataFloat8 NIVolumeDataLoad8(const float *floats)
 {
-    return numVectors * sizeof(float) * 11;
+    NIVolumeDataFloat8 values;
+    memcpy(&values, floats, sizeof(NIVolumeDataFloat8));
+    return values;
 }
 
-- (BOOL)isEqual:(id)object
+CF_INLINE void NIVolumeDataStore8(float *floats, NIVolumeDataFloat8 values)
 {
-    BOOL isEqual = NO;
-    if ([object isKindOfClass:[NIVolumeData class]]) {
-        NIVolumeDataInlineBuffer inlineBuffer1;
-        NIVolumeDataInlineBuffer inlineBuffer2;
-        NIVolumeData *otherVolumeData = (NIVolumeData *)object;
-
-        [self acquireInlineBuffer:&inlineBuffer1];
-        [otherVolumeData acquireInlineBuffer:&inlineBuffer2];
+    memcpy(floats, &values, sizeof(NIVolumeDataFloat8));
+}
 
-        if (inlineBuffer1.outOfBoundsValue == inlineBuffer2.outOfBoundsValue &&
-            inlineBuffer1.pixelsWide == inlineBuffer2.pixelsWide &&
-            inlineBuffer1.pixelsHigh == inlineBuffer2.pixelsHigh &&
-            inlineBuffer1.pixelsDeep == inlineBuffer2.pixelsDeep &&
-            NIAffineTransformEqualToTransform(inlineBuffer1.modelToVoxelTransform, inlineBuffer2.modelToVoxelTransform)) {
+// integer samples are gathered into an integer vector and then converted and rescaled all 8 lanes at once
+#define NI_VOLUME_DATA_GATHER_SAMPLES8(type, samples, indexes) \
+    (NIVolumeDataInt8){((const type *)(samples))[(indexes)[0]], ((const type *)(samples))[(indexes)[1]], ((const type *)(samples))[(indexes)[2]], ((const type *)(samples))[(indexes)[3]], \
+                       ((const type *)(samples))[(indexes)[4]], ((const type *)(samples))[(indexes)[5]], ((const type *)(samples))[(indexes)[6]], ((const type *)(samples))[(indexes)[7]]}
 
-            if (inlineBuffer1.floatBytes == inlineBuffer2.floatBytes) {
-                return YES;
-            } else {
-                return memcmp(inlineBuffer1.floatBytes, inlineBuffer2.floatBytes, sizeof(float) * inlineBuffer1.pixelsWide * inlineBuffer1.pixelsHigh * inlineBuffer1.pixelsDeep) == 0;
-            }
+CF_INLINE NIVolumeDataFloat8 NIVolumeDataGather8(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataLong8 indexes)
+{
+    NIVolumeDataInt8 samples;
+
+    switch (inlineBuffer->sampleType) {
+        case NIVolumeDataSampleTypeInt16:
+            samples = NI_VOLUME_DATA_GATHER_SAMPLES8(int16_t, inlineBuffer->sampleBytes, indexes);
+            break;
+        case NIVolumeDataSampleTypeUInt16:
+            samples = NI_VOLUME_DATA_GATHER_SAMPLES8(uint16_t, inlineBuffer->sampleBytes, indexes);
+            break;
+        case NIVolumeDataSampleTypeUInt8:
+            samples = NI_VOLUME_DATA_GATHER_SAMPLES8(uint8_t, inlineBuffer->sampleBytes, indexes);
+            break;
+        default: {
+            const float *floatBytes = inlineBuffer->floatBytes;
+            NIVolumeDataFloat8 values = {floatBytes[indexes[0]], floatBytes[indexes[1]], floatBytes[indexes[2]], floatBytes[indexes[3]],
+                                         floatBytes[indexes[4]], floatBytes[indexes[5]], floatBytes[indexes[6]], floatBytes[indexes[7]]};
+            return values;
         }
     }
+    return __builtin_convertvector(samples, NIVolumeDataFloat8) * inlineBuffer->rescaleSlope + inlineBuffer->rescaleIntercept;
+}
 
-    return isEqual;
+CF_INLINE NIVolumeDataFloat8 NIVolumeDataFloor8(NIVolumeDataFloat8 values)
+{
+    NIVolumeDataFloat8 truncated = __builtin_convertvector(__builtin_convertvector(values, NIVolumeDataInt8), NIVolumeDataFloat8);
+    return truncated + __builtin_convertvector(truncated > values, NIVolumeDataFloat8); // comparisons are -1 when true
 }
 
-// not done yet, will crash if given vectors that are outside of the volume
-- (void)linearInterpolateVolumeVectors:(NIVectorArray)volumeVectors outputValues:(float *)outputValues numVectors:(NSUInteger)numVectors tempBuffer:(void *)tempBuffer
+CF_INLINE NIVolumeDataLong8 NIVolumeDataIndexOffsetsForX8(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInt8 x)
 {
-    float *interpolateBuffer = (float *)tempBuffer;
+    const NSUInteger shift = inlineBuffer->brickShift;
+    NIVolumeDataLong8 longX = __builtin_convertvector(x, NIVolumeDataLong8);
+    return ((longX >> shift) << (3*shift)) + (longX & (((long long)1 << shift) - 1));
+}
 
-    float *scrap;
+CF_INLINE NIVolumeDataLong8 NIVolumeDataIndexOffsetsForY8(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInt8 y)
+{
+    const NSUInteger shift = inlineBuffer->brickShift;
+    NIVolumeDataLong8 longY = __builtin_convertvector(y, NIVolumeDataLong8);
+    return (longY >> shift) * (long long)inlineBuffer->rowStride + ((longY & (((long long)1 << shift) - 1)) << shift);
+}
 
-    float *yFloors;
-    float *zFloors;
-    float *yFrac;
-    float *zFrac;
-    float *yNegFrac;
-    float *zNegFrac;
-    float negOne;
+CF_INLINE NIVolumeDataLong8 NIVolumeDataIndexOffsetsForZ8(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInt8 z)
+{
+    const NSUInteger shift = inlineBuffer->brickShift;
+    NIVolumeDataLong8 longZ = __builtin_convertvector(z, NIVolumeDataLong8);
+    return (longZ >> shift) * (long long)inlineBuffer->sliceStride + ((longZ & (((long long)1 << shift) - 1)) << (2*shift));
+}
 
-    float *i1Positions;
-    float *i2Positions;
-    float *j1Positions;
-    float *j2Positions;
+// returns true if all 8 lanes can be converted to ints, the conversion is undefined for NaNs and for values that don't fit
+CF_INLINE bool NIVolumeDataAllConvertible8(NIVolumeDataFloat8 x, NIVolumeDataFloat8 y, NIVolumeDataFloat8 z)
+{
+    const float limit = (float)(1 << 30); // far larger than any volume, so that adding a few voxels to an index can't overflow
+    NIVolumeDataInt8 convertible = (x > -limit) & (x < limit) & (y > -limit) & (y < limit) & (z > -limit) & (z < limit); // comparisons with NaN are false
+    return (convertible[0] & convertible[1] & convertible[2] & convertible[3] & convertible[4] & convertible[5] & convertible[6] & convertible[7]) != 0;
+}
 
-    float *yFloorPosition;
-    float *yCielPosition;
-    float *zFloorPosition;
-    float *zCielPosition;
+// returns true if all 8 lanes are at least lowMargin voxels from the low edges and highMargin voxels from the high edges of the volume, the padding border counts as inside
+CF_INLINE bool NIVolumeDataAllInside8(const NIVolumeDataInlineBuffer *inlineBuffer, NIVolumeDataInt8 x, NIVolumeDataInt8 y, NIVolumeDataInt8 z, int lowMargin, int highMargin)
+{
+    lowMargin -= (int)inlineBuffer->borderWidth;
+    highMargin -= (int)inlineBuffer->borderWidth;
+    NIVolumeDataInt8 inside = (x >= lowMargin) & (y >= lowMargin) & (z >= lowMargin) &
+                              (x < (int)inlineBuffer->pixelsWide - highMargin) &
+                              (y < (int)inlineBuffer->pixelsHigh - highMargin) &
+                              (z < (int)inlineBuffer->pixelsDeep - highMargin);
+    return (inside[0] & inside[1] & inside[2] & inside[3] & inside[4] & inside[5] & inside[6] & inside[7]) != 0;
+}
 
-    float width;
-    float widthTimesHeight;
-    float widthTimesHeightTimeDepth;
+CF_INLINE void NIVolumeDataGetCubicWeights8(NIVolumeDataFloat8 fraction, NIVolumeDataFloat8 weights[4])
+{
+    const NIVolumeDataFloat8 fraction2 = fraction*fraction;
+    const NIVolumeDataFloat8 fraction3 = fraction2*fraction;
 
-    float *i1;
-    float *i2;
-    float *j1;
-    float *j2;
+    weights[0] = 0.5f * (           - fraction + 2.0f*fraction2 -        fraction3);
+    weights[1] = 0.5f * (2.0f                  - 5.0f*fraction2 + 3.0f * fraction3);
+    weights[2] = 0.5f * (             fraction + 4.0f*fraction2 - 3.0f * fraction3);
+    weights[3] = 0.5f * (                      -      fraction2 +        fraction3);
+}
+#endif
 
-    float *w1;
-    float *w2;
+void NIVolumeDataLinearInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                    float *outputValues, NSUInteger numCoordinates)
+{
+    NSUInteger i = 0;
+    NSUInteger j;
 
-    negOne = -1.0;
-    width = _pixelsWide;
-    widthTimesHeight = _pixelsWide*_pixelsHigh;
-    widthTimesHeightTimeDepth = widthTimesHeight*_pixelsDeep;
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numCoordinates);
+        return;
+    }
 
-    yFrac = interpolateBuffer + (numVectors * 0);
-    zFrac = interpolateBuffer + (numVectors * 1);
-    yFloors = interpolateBuffer + (numVectors * 2);
-    zFloors = interpolateBuffer + (numVectors * 3);
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    for (; i + 8 <= numCoordinates; i += 8) {
+        NIVolumeDataFloat8 x = NIVolumeDataLoad8(xCoordinates + i);
+        NIVolumeDataFloat8 y = NIVolumeDataLoad8(yCoordinates + i);
+        NIVolumeDataFloat8 z = NIVolumeDataLoad8(zCoordinates + i);
 
-    vDSP_vfrac(((float *)volumeVectors) + 1, 3, yFrac, 1, numVectors);
-    vDSP_vsub(yFrac, 1, ((float *)volumeVectors) + 1, 3, yFloors, 1, numVectors);
+        if (NIVolumeDataAllConvertible8(x, y, z) == false) {
+            for (j = i; j < i + 8; j++) {
+                outputValues[j] = NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[j], yCoordinates[j], zCoordinates[j]);
+            }
+            continue;
+        }
 
-    vDSP_vfrac(((float *)volumeVectors) + 2, 3, zFrac, 1, numVectors);
-    vDSP_vsub(zFrac, 1, ((float *)volumeVectors) + 2, 3, zFloors, 1, numVectors);
+        NIVolumeDataFloat8 xFloor = NIVolumeDataFloor8(x);
+        NIVolumeDataFloat8 yFloor = NIVolumeDataFloor8(y);
+        NIVolumeDataFloat8 zFloor = NIVolumeDataFloor8(z);
+        NIVolumeDataInt8 xIndex = __builtin_convertvector(xFloor, NIVolumeDataInt8);
+        NIVolumeDataInt8 yIndex = __builtin_convertvector(yFloor, NIVolumeDataInt8);
+        NIVolumeDataInt8 zIndex = __builtin_convertvector(zFloor, NIVolumeDataInt8);
 
-    yFloorPosition = interpolateBuffer + (numVectors * 6);
-    yCielPosition = interpolateBuffer + (numVectors * 7);
-    zFloorPosition = interpolateBuffer + (numVectors * 8);
-    zCielPosition = interpolateBuffer + (numVectors * 9);
+        if (NIVolumeDataAllInside8(inlineBuffer, xIndex, yIndex, zIndex, 0, 1) == false) {
+            for (j = i; j < i + 8; j++) {
+                outputValues[j] = NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[j], yCoordinates[j], zCoordinates[j]);
+            }
+            continue;
+        }
 
-    vDSP_vsmul(yFloors, 1, &width, yFloorPosition, 1, numVectors);
-    vDSP_vsadd(yFloorPosition, 1, &width, yCielPosition, 1, numVectors);
-    vDSP_vsmul(zFloors, 1, &widthTimesHeight, zFloorPosition, 1, numVectors);
-    vDSP_vsadd(zFloorPosition, 1, &widthTimesHeight, zCielPosition, 1, numVectors);
+        NIVolumeDataLong8 x0 = NIVolumeDataIndexOffsetsForX8(inlineBuffer, xIndex);
+        NIVolumeDataLong8 x1 = NIVolumeDataIndexOffsetsForX8(inlineBuffer, xIndex + 1);
+        NIVolumeDataLong8 y0 = NIVolumeDataIndexOffsetsForY8(inlineBuffer, yIndex);
+        NIVolumeDataLong8 y1 = NIVolumeDataIndexOffsetsForY8(inlineBuffer, yIndex + 1);
+        NIVolumeDataLong8 z0 = NIVolumeDataIndexOffsetsForZ8(inlineBuffer, zIndex);
+        NIVolumeDataLong8 z1 = NIVolumeDataIndexOffsetsForZ8(inlineBuffer, zIndex + 1);
+
+        const NIVolumeDataFloat8 dx1 = x - xFloor;
+        const NIVolumeDataFloat8 dy1 = y - yFloor;
+        const NIVolumeDataFloat8 dz1 = z - zFloor;
+        const NIVolumeDataFloat8 dx0 = 1.0f - dx1;
+        const NIVolumeDataFloat8 dy0 = 1.0f - dy1;
+        const NIVolumeDataFloat8 dz0 = 1.0f - dz1;
+
+        NIVolumeDataStore8(outputValues + i, (dz0*(dy0*(dx0*NIVolumeDataGather8(inlineBuffer, x0+y0+z0) + dx1*NIVolumeDataGather8(inlineBuffer, x1+y0+z0)) +
+                                                   dy1*(dx0*NIVolumeDataGather8(inlineBuffer, x0+y1+z0) + dx1*NIVolumeDataGather8(inlineBuffer, x1+y1+z0)))) +
+                                             (dz1*(dy0*(dx0*NIVolumeDataGather8(inlineBuffer, x0+y0+z1) + dx1*NIVolumeDataGather8(inlineBuffer, x1+y0+z1)) +
+                                                   dy1*(dx0*NIVolumeDataGather8(inlineBuffer, x0+y1+z1) + dx1*NIVolumeDataGather8(inlineBuffer, x1+y1+z1)))));
+    }
+#endif
 
-    i1Positions = interpolateBuffer + (numVectors * 2);
-    i2Positions = interpolateBuffer + (numVectors * 3);
-    j1Positions = interpolateBuffer + (numVectors * 4);
-    j2Positions = interpolateBuffer + (numVectors * 5);
+    for (; i < numCoordinates; i++) {
+        outputValues[i] = NIVolumeDataLinearInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[i], yCoordinates[i], zCoordinates[i]);
+    }
+}
 
-    // i1 yFloor zFloor
-    // i2 yFloor zCiel
-    // j1 yCiel zFloor
-    // j2 yCiel zCiel
+void NIVolumeDataNearestNeighborInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                             float *outputValues, NSUInteger numCoordinates)
+{
+    NSUInteger i = 0;
+    NSUInteger j;
 
-    vDSP_vadd((float *)volumeVectors, 3, yFloorPosition, 1, i1Positions, 1, numVectors);
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numCoordinates);
+        return;
+    }
 
-    vDSP_vadd(i1Positions, 1, zCielPosition, 1, i2Positions, 1, numVectors);
-    vDSP_vadd(i1Positions, 1, zFloorPosition, 1, i1Positions, 1, numVectors);
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    const float outOfBoundsValue = inlineBuffer->outOfBoundsValue;
 
-    vDSP_vadd((float *)volumeVectors, 3, yCielPosition, 1, j1Positions, 1, numVectors);
+    for (; i + 8 <= numCoordinates; i += 8) {
+        NIVolumeDataFloat8 x = NIVolumeDataLoad8(xCoordinates + i);
+        NIVolumeDataFloat8 y = NIVolumeDataLoad8(yCoordinates + i);
+        NIVolumeDataFloat8 z = NIVolumeDataLoad8(zCoordinates + i);
 
-    vDSP_vadd(j1Positions, 1, zCielPosition, 1, j2Positions, 1, numVectors);
-    vDSP_vadd(j1Positions, 1, zFloorPosition, 1, j1Positions, 1, numVectors);
+        if (NIVolumeDataAllConvertible8(x, y, z) == false ||
+            NIVolumeDataAllInside8(inlineBuffer, __builtin_convertvector(x, NIVolumeDataInt8), __builtin_convertvector(y, NIVolumeDataInt8), __builtin_convertvector(z, NIVolumeDataInt8), -1, -1) == false) {
+            for (j = i; j < i + 8; j++) {
+                outputValues[j] = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[j], yCoordinates[j], zCoordinates[j]);
+            }
+            continue;
+        }
 
+        // round halfway cases away from zero, like round()
+        NIVolumeDataInt8 xIndex = __builtin_convertvector(x, NIVolumeDataInt8);
+        NIVolumeDataInt8 yIndex = __builtin_convertvector(y, NIVolumeDataInt8);
+        NIVolumeDataInt8 zIndex = __builtin_convertvector(z, NIVolumeDataInt8);
+        NIVolumeDataFloat8 xFraction = x - __builtin_convertvector(xIndex, NIVolumeDataFloat8);
+        NIVolumeDataFloat8 yFraction = y - __builtin_convertvector(yIndex, NIVolumeDataFloat8);
+        NIVolumeDataFloat8 zFraction = z - __builtin_convertvector(zIndex, NIVolumeDataFloat8);
+        xIndex = xIndex - (NIVolumeDataInt8)(xFraction >= 0.5f) + (NIVolumeDataInt8)(xFraction <= -0.5f);
+        yIndex = yIndex - (NIVolumeDataInt8)(yFraction >= 0.5f) + (NIVolumeDataInt8)(yFraction <= -0.5f);
+        zIndex = zIndex - (NIVolumeDataInt8)(zFraction >= 0.5f) + (NIVolumeDataInt8)(zFraction <= -0.5f);
+
+        NIVolumeDataInt8 inside = (xIndex >= 0) & (yIndex >= 0) & (zIndex >= 0) &
+                                  (xIndex < (int)inlineBuffer->pixelsWide) &
+                                  (yIndex < (int)inlineBuffer->pixelsHigh) &
+                                  (zIndex < (int)inlineBuffer->pixelsDeep);
+        NIVolumeDataLong8 indexes = (NIVolumeDataIndexOffsetsForX8(inlineBuffer, xIndex) +
+                                     NIVolumeDataIndexOffsetsForY8(inlineBuffer, yIndex) +
+                                     NIVolumeDataIndexOffsetsForZ8(inlineBuffer, zIndex)) & __builtin_convertvector(inside, NIVolumeDataLong8);
+
+        for (j = 0; j < 8; j++) {
+            outputValues[i + j] = inside[j] ? NIVolumeDataUncheckedSampleAtIndex(inlineBuffer, indexes[j]) : outOfBoundsValue;
+        }
+    }
+#endif
 
-    i1 = interpolateBuffer + (numVectors * 6);
-    i2 = interpolateBuffer + (numVectors * 7);
-    j1 = interpolateBuffer + (numVectors * 8);
-    j2 = interpolateBuffer + (numVectors * 9);
+    for (; i < numCoordinates; i++) {
+        outputValues[i] = NIVolumeDataNearestNeighborInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[i], yCoordinates[i], zCoordinates[i]);
+    }
+}
 
-    vDSP_vlint((float *)self.floatBytes, i1Positions, 1, i1, 1, numVectors * 4, widthTimesHeightTimeDepth);
+void NIVolumeDataCubicInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *inlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                   float *outputValues, NSUInteger numCoordinates)
+{
+    NSUInteger i = 0;
+    NSUInteger j;
 
-    yNegFrac = interpolateBuffer + (numVectors * 2);
-    zNegFrac = interpolateBuffer + (numVectors * 3);
+    if (inlineBuffer->sampleBytes == NULL) {
+        vDSP_vclr(outputValues, 1, numCoordinates);
+        return;
+    }
 
-    vDSP_vsadd(yFrac, 1, &negOne, yNegFrac, 1, numVectors);
-    vDSP_vneg(yNegFrac, 1, yNegFrac, 1, numVectors);
+#if NI_VOLUME_DATA_VECTOR_SAMPLING
+    for (; i + 8 <= numCoordinates; i += 8) {
+        NIVolumeDataFloat8 x = NIVolumeDataLoad8(xCoordinates + i);
+        NIVolumeDataFloat8 y = NIVolumeDataLoad8(yCoordinates + i);
+        NIVolumeDataFloat8 z = NIVolumeDataLoad8(zCoordinates + i);
 
-    vDSP_vsadd(zFrac, 1, &negOne, zNegFrac, 1, numVectors);
-    vDSP_vneg(zNegFrac, 1, zNegFrac, 1, numVectors);
+        if (NIVolumeDataAllConvertible8(x, y, z) == false) {
+            for (j = i; j < i + 8; j++) {
+                outputValues[j] = NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[j], yCoordinates[j], zCoordinates[j]);
+            }
+            continue;
+        }
 
-    w1 = interpolateBuffer + (numVectors * 4);
-    w2 = interpolateBuffer + (numVectors * 5);
+        NIVolumeDataFloat8 xFloor = NIVolumeDataFloor8(x);
+        NIVolumeDataFloat8 yFloor = NIVolumeDataFloor8(y);
+        NIVolumeDataFloat8 zFloor = NIVolumeDataFloor8(z);
+        NIVolumeDataInt8 xIndex = __builtin_convertvector(xFloor, NIVolumeDataInt8);
+        NIVolumeDataInt8 yIndex = __builtin_convertvector(yFloor, NIVolumeDataInt8);
+        NIVolumeDataInt8 zIndex = __builtin_convertvector(zFloor, NIVolumeDataInt8);
 
-    scrap = interpolateBuffer + (numVectors * 10);
+        if (NIVolumeDataAllInside8(inlineBuffer, xIndex, yIndex, zIndex, 1, 2) == false) {
+            for (j = i; j < i + 8; j++) {
+                outputValues[j] = NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[j], yCoordinates[j], zCoordinates[j]);
+            }
+            continue;
+        }
 
-    vDSP_vmul(i1, 1, zNegFrac, 1, w1, 1, numVectors);
-    vDSP_vmul(i2, 1, zFrac, 1, scrap, 1, numVectors);
-    vDSP_vadd(w1, 1, scrap, 1, w1, 1, numVectors);
+        NIVolumeDataFloat8 wx[4];
+        NIVolumeDataFloat8 wy[4];
+        NIVolumeDataFloat8 wz[4];
+        NIVolumeDataGetCubicWeights8(x - xFloor, wx);
+        NIVolumeDataGetCubicWeights8(y - yFloor, wy);
+        NIVolumeDataGetCubicWeights8(z - zFloor, wz);
+
+        NIVolumeDataLong8 xOffsets[4];
+        NIVolumeDataLong8 yOffsets[4];
+        NIVolumeDataLong8 zOffsets[4];
+        int k;
+        int l;
+        if (inlineBuffer->brickShift == 0) { // flat floats, the neighbors are at constant strides from the first voxel
+            const long long rowStride = inlineBuffer->rowStride;
+            const long long sliceStride = inlineBuffer->sliceStride;
+            NIVolumeDataLong8 corner = __builtin_convertvector(xIndex - 1, NIVolumeDataLong8) + __builtin_convertvector(yIndex - 1, NIVolumeDataLong8) * rowStride +
+                                       __builtin_convertvector(zIndex - 1, NIVolumeDataLong8) * sliceStride;
+            for (k = 0; k < 4; k++) {
+                xOffsets[k] = corner + k;
+                yOffsets[k] = (NIVolumeDataLong8){0, 0, 0, 0, 0, 0, 0, 0} + rowStride * k;
+                zOffsets[k] = (NIVolumeDataLong8){0, 0, 0, 0, 0, 0, 0, 0} + sliceStride * k;
+            }
+        } else {
+            for (k = 0; k < 4; k++) {
+                xOffsets[k] = NIVolumeDataIndexOffsetsForX8(inlineBuffer, xIndex + (k - 1));
+                yOffsets[k] = NIVolumeDataIndexOffsetsForY8(inlineBuffer, yIndex + (k - 1));
+                zOffsets[k] = NIVolumeDataIndexOffsetsForZ8(inlineBuffer, zIndex + (k - 1));
+            }
+        }
 
-    vDSP_vmul(j1, 1, zNegFrac, 1, w2, 1, numVectors);
-    vDSP_vmul(j2, 1, zFrac, 1, scrap, 1, numVectors);
-    vDSP_vadd(w2, 1, scrap, 1, w2, 1, numVectors);
+        NIVolumeDataFloat8 values = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (k = 0; k < 4; k++) {
+            NIVolumeDataFloat8 planeValues = {0, 0, 0, 0, 0, 0, 0, 0};
+            for (l = 0; l < 4; l++) {
+                NIVolumeDataLong8 rowOffsets = yOffsets[l] + zOffsets[k];
+                planeValues += wy[l]*(wx[0] * NIVolumeDataGather8(inlineBuffer, xOffsets[0] + rowOffsets) + wx[1] * NIVolumeDataGather8(inlineBuffer, xOffsets[1] + rowOffsets) +
+                                      wx[2] * NIVolumeDataGather8(inlineBuffer, xOffsets[2] + rowOffsets) + wx[3] * NIVolumeDataGather8(inlineBuffer, xOffsets[3] + rowOffsets));
+            }
+            values += wz[k]*planeValues;
+        }
 
+        NIVolumeDataStore8(outputValues + i, values);
+    }
+#endif
 
-    vDSP_vmul(w1, 1, yNegFrac, 1, outputValues, 1, numVectors);
-    vDSP_vmul(w2, 1, yFrac, 1, scrap, 1, numVectors);
-    vDSP_vadd(outputValues, 1, scrap, 1, outputValues, 1, numVectors);
+    for (; i < numCoordinates; i++) {
+        outputValues[i] = NIVolumeDataCubicInterpolatedFloatAtVolumeCoordinate(inlineBuffer, xCoordinates[i], yCoordinates[i], zCoordinates[i]);
+    }
 }
 
+#define NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK 64 // the linear taps are computed on the stack in chunks of this many points
 
-
-- (void)acquireInlineBuffer:(NIVolumeDataInlineBuffer *)inlineBuffer
+void NIVolumeDataCubicBSplineInterpolateVolumeCoordinates(NIVolumeDataInlineBuffer *coefficientsInlineBuffer, const float *xCoordinates, const float *yCoordinates, const float *zCoordinates,
+                                                          float *outputValues, NSUInteger numCoordinates)
 {
-    memset(inlineBuffer, 0, sizeof(NIVolumeDataInlineBuffer));
-    inlineBuffer->floatBytes = self.floatBytes;
-    inlineBuffer->outOfBoundsValue = _outOfBoundsValue;
-    inlineBuffer->pixelsWide = _pixelsWide;
-    inlineBuffer->pixelsHigh = _pixelsHigh;
-    inlineBuffer->pixelsDeep = _pixelsDeep;
-    inlineBuffer->modelToVoxelTransform = _modelToVoxelTransform;
+    float positions[3][2][NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK];
+    float weights[3][2][NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK];
+    float tapWeights[NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK];
+    float tapValues[NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK];
+    const float *coordinates[3] = {xCoordinates, yCoordinates, zCoordinates};
+    CGFloat tapPositions[2];
+    CGFloat tapPositionWeights[2];
+    NSUInteger chunkCount;
+    NSUInteger i;
+    NSUInteger j;
+    int axis;
+    int tap;
+
+    for (i = 0; i < numCoordinates; i += NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK) {
+        chunkCount = MIN((NSUInteger)NI_VOLUME_DATA_CUBIC_B_SPLINE_CHUNK, numCoordinates - i);
+
+        for (axis = 0; axis < 3; axis++) {
+            for (j = 0; j < chunkCount; j++) {
+                NIVolumeDataGetCubicBSplineLinearTaps(coordinates[axis][i + j], tapPositions, tapPositionWeights);
+                positions[axis][0][j] = tapPositions[0];
+                positions[axis][1][j] = tapPositions[1];
+                weights[axis][0][j] = tapPositionWeights[0];
+                weights[axis][1][j] = tapPositionWeights[1];
+            }
+        }
+
+        vDSP_vclr(outputValues + i, 1, chunkCount);
+        for (tap = 0; tap < 8; tap++) {
+            const int xTap = tap & 1;
+            const int yTap = (tap >> 1) & 1;
+            const int zTap = tap >> 2;
+            NIVolumeDataLinearInterpolateVolumeCoordinates(coefficientsInlineBuffer, positions[0][xTap], positions[1][yTap], positions[2][zTap], tapValues, chunkCount);
+            vDSP_vmul(weights[0][xTap], 1, weights[1][yTap], 1, tapWeights, 1, chunkCount);
+            vDSP_vmul(tapWeights, 1, weights[2][zTap], 1, tapWeights, 1, chunkCount);
+            vDSP_vma(tapValues, 1, tapWeights, 1, outputValues + i, 1, outputValues + i, 1, chunkCount);
+        }
+    }
 }
 
-- (NSString *)description
+#define NI_VOLUME_DATA_SCANLINE_CHUNK 256 // the points are generated on the stack in chunks of this many
+
+// Cubic interpolation along a scanline that only moves in x (for example when resampling, or for slices that are aligned with the volume).
+// The y and z weights are the same for the whole scanline, so the 16 rows that are needed are first collapsed into a single row of columns,
+// and each output value is then a 4 tap filter of that row. When the x step is a whole number of voxels, the x weights are also the same
+// for every output value and are only computed once. Returns false without writing anything if any of the values needs bounds checking.
+static bool NIVolumeDataCubicInterpolateVolumeRow(NIVolumeDataInlineBuffer *inlineBuffer, NIVector startVolumeVector, CGFloat xStep, float *outputValues, NSUInteger numValues)
 {
-    NSMutableString *description = [NSMutableString string];
-    [description appendString:NSStringFromClass([self class])];
-    [description appendString:[NSString stringWithFormat: @"\nPixels Wide: %lld\n", (long long)_pixelsWide]];
-    [description appendString:[NSString stringWithFormat: @"Pixels High: %lld\n", (long long)_pixelsHigh]];
-    [description appendString:[NSString stringWithFormat: @"Pixels Deep: %lld\n", (long long)_pixelsDeep]];
-    [description appendString:[NSString stringWithFormat: @"Out of Bounds Value: %f\n", _outOfBoundsValue]];
-    [description appendString:[NSString stringWithFormat: @"Volume Transform:\n%@\n", NSStringFromNIAffineTransform(_modelToVoxelTransform)]];
+    float columns[NI_VOLUME_DATA_SCANLINE_CHUNK + 4];
+    CGFloat wy[4];
+    CGFloat wz[4];
+    CGFloat wx[4];
+    NSInteger xOffsets[NI_VOLUME_DATA_SCANLINE_CHUNK + 4];
+    NSInteger rowOffset;
+    NSInteger xMin;
+    NSInteger xMax;
+    NSInteger xIndex;
+    NSInteger column;
+    CGFloat x;
+    float weight;
+    NSUInteger i;
+    int j;
+    int k;
+
+    const CGFloat xLast = startVolumeVector.x + xStep*(CGFloat)(numValues - 1);
+    const CGFloat yFloor = floor(startVolumeVector.y);
+    const CGFloat zFloor = floor(startVolumeVector.z);
+    const NSInteger yIndex = yFloor;
+    const NSInteger zIndex = zFloor;
+
+    if (inlineBuffer->floatBytes == NULL || numValues == 0 || fabs(xStep) > 1.0) { // integer samples go through the gathering samplers
+        return false;
+    }
 
-    return description;
+    const NSInteger border = inlineBuffer->borderWidth;
+    xMin = floor(MIN(startVolumeVector.x, xLast));
+    xMax = floor(MAX(startVolumeVector.x, xLast));
+    if (xMin < 1 - border || yIndex < 1 - border || zIndex < 1 - border ||
+        xMax >= (NSInteger)inlineBuffer->pixelsWide - 2 + border || yIndex >= (NSInteger)inlineBuffer->pixelsHigh - 2 + border || zIndex >= (NSInteger)inlineBuffer->pixelsDeep - 2 + border) {
+        return false;
+    }
+
+    // columns[c] holds the y and z interpolated value at x = xMin - 1 + c
+    const NSInteger columnCount = xMax - xMin + 4;
+    const float *floatBytes = inlineBuffer->floatBytes;
+    NIVolumeDataGetCubicWeights(startVolumeVector.y - yFloor, wy);
+    NIVolumeDataGetCubicWeights(startVolumeVector.z - zFloor, wz);
+    for (column = 0; column < columnCount; column++) {
+        xOffsets[column] = NIVolumeDataIndexOffsetForX(inlineBuffer, xMin - 1 + column);
+    }
+
+    vDSP_vclr(columns, 1, columnCount);
+    for (k = 0; k < 4; k++) {
+        for (j = 0; j < 4; j++) {
+            weight = wz[k]*wy[j];
+            rowOffset = NIVolumeDataIndexOffsetForY(inlineBuffer, yIndex + j - 1) + NIVolumeDataIndexOffsetForZ(inlineBuffer, zIndex + k - 1);
+            if (inlineBuffer->brickShift == 0) {
+                vDSP_vsma(floatBytes + rowOffset + xOffsets[0], 1, &weight, columns, 1, columns, 1, columnCount);
+            } else {
+                for (column = 0; column < columnCount; column++) {
+                    columns[column] += weight * floatBytes[rowOffset + xOffsets[column]];
+                }
+            }
+        }
+    }
+
+    if (xStep == floor(xStep)) {
+        NIVolumeDataGetCubicWeights(startVolumeVector.x - floor(startVolumeVector.x), wx);
+        column = (NSInteger)floor(startVolumeVector.x) - xMin;
+        for (i = 0; i < numValues; i++, column += (NSInteger)xStep) {
+            outputValues[i] = wx[0]*columns[column] + wx[1]*columns[column + 1] + wx[2]*columns[column + 2] + wx[3]*columns[column + 3];
+        }
+    } else {
+        for (i = 0; i < numValues; i++) {
+            x = startVolumeVector.x + xStep*(CGFloat)i;
+            xIndex = floor(x);
+            NIVolumeDataGetCubicWeights(x - (CGFloat)xIndex, wx);
+            column = xIndex - xMin;
+            outputValues[i] = wx[0]*columns[column] + wx[1]*columns[column + 1] + wx[2]*columns[column + 2] + wx[3]*columns[column + 3];
+        }
+    }
+
+    return true;
 }
 
-@end
+void NIVolumeDataInterpolateVolumeScanline(NIVolumeDataInlineBuffer *inlineBuffer, NIInterpolationMode interpolationMode, NIVector startVolumeVector, NIVector volumeStep,
+                                           float *outputValues, NSUInteger numValues)
+{
+    float xCoordinates[NI_VOLUME_DATA_SCANLINE_CHUNK];
+    float yCoordinates[NI_VOLUME_DATA_SCANLINE_CHUNK];
+    float zCoordinates[NI_VOLUME_DATA_SCANLINE_CHUNK];
+    float chunkStart;
+    float step;
+    NIVector chunkStartVector;
+    NSUInteger chunkCount;
+    NSUInteger i;
+
+    if (interpolationMode != NIInterpolationModeLinear && interpolationMode != NIInterpolationModeNearestNeighbor && interpolationMode != NIInterpolationModeCubic &&
+        interpolationMode != NIInterpolationModeCubicBSpline) {
+        vDSP_vclr(outputValues, 1, numValues);
+        return;
+    }
+
+    for (i = 0; i < numValues; i += NI_VOLUME_DATA_SCANLINE_CHUNK) {
+        chunkCount = MIN((NSUInteger)NI_VOLUME_DATA_SCANLINE_CHUNK, numValues - i);
+        chunkStartVector = NIVectorAdd(startVolumeVector, NIVectorScalarMultiply(volumeStep, (CGFloat)i));
+
+        if (interpolationMode == NIInterpolationModeCubic && volumeStep.y == 0 && volumeStep.z == 0 &&
+            NIVolumeDataCubicInterpolateVolumeRow(inlineBuffer, chunkStartVector, volumeStep.x, outputValues + i, chunkCount)) {
+            continue;
+        }
+
+        chunkStart = chunkStartVector.x;
+        step = volumeStep.x;
+        vDSP_vramp(&chunkStart, &step, xCoordinates, 1, chunkCount);
+        chunkStart = chunkStartVector.y;
+        step = volumeStep.y;
+        vDSP_vramp(&chunkStart, &step, yCoordinates, 1, chunkCount);
+        chunkStart = chunkStartVector.z;
+        step = volumeStep.z;
+        vDSP_vramp(&chunkStart, &step, zCoordinates, 1, chunkCount);
+
+        switch (interpolationMode) {
+            case NIInterpolationModeLinear:
+                NIVolumeDataLinearInterpolateVolumeCoordinates(inlineBuffer, xCoordinates, yCoordinates, zCoordinates, outputValues + i, chunkCount);
+                break;
+            case NIInterpolationModeNearestNeighbor:
+                NIVolumeDataNearestNeighborInterpolateVolumeCoordinates(inlineBuffer, xCoordinates, yCoordinates, zCoordinates, outputValues + i, chunkCount);
+                break;
+            case NIInterpolationModeCubicBSpline:
+                NIVolumeDataCubicBSplineInterpolateVolumeCoordinates(inlineBuffer, xCoordinates, yCoordinates, zCoordinates, outputValues + i, chunkCount);
+                break;
+            default:
+                NIVolumeDataCubicInterpolateVolumeCoordinates(inlineBuffer, xCoordinates, yCoordinates, zCoordinates, outputValues + i, chunkCount);
+                break;
+        }
+    }
+}
 
 NS_ASSUME_NONNULL_END
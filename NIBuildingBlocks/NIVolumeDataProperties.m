@@ -103,6 +103,9 @@
         case NIInterpolationModeCubic:
             [description appendString:[NSString stringWithFormat: @"Preferred Interpolation Mode: Cubic\n"]];
             break;
+        case NIInterpolationModeCubicBSpline:
+            [description appendString:[NSString stringWithFormat: @"Preferred Interpolation Mode: Cubic B-Spline\n"]];
+            break;
         case NIInterpolationModeNone:
             [description appendString:[NSString stringWithFormat: @"Preferred Interpolation Mode: None\n"]];
             break;